@@ -0,0 +1,134 @@
+#ifndef HOST_VDP_H
+#define HOST_VDP_H
+
+// Host equivalent of video.ino
+// Pulls in the whole VDP the same way the sketch does, and provides the globals and functions the sketch would,
+// so tests and benchmarks can drive a VDUStreamProcessor directly
+//
+
+#include <HardwareSerial.h>
+#include <fabgl.h>
+
+#define SERIALBAUDRATE	115200
+
+HardwareSerial	DBGSerial(0);
+
+#include "agon.h"
+
+TerminalState	terminalState = TerminalState::Disabled;
+bool			consoleMode = false;
+bool			printerOn = false;
+bool			controlKeys = true;
+bool			hostDebugLog = false;			// Echo debug_log output to stderr
+
+#include "version.h"
+#include "agon_ps2.h"
+#include "agon_audio.h"
+#include "agon_screen.h"
+#include "agon_ttxt.h"
+#include "vdp_protocol.h"
+#include "vdu_stream_processor.h"
+#include "hexload.h"
+#include "memory_stream.h"
+
+VDUStreamProcessor *	processor;
+
+void debug_log(const char * format, ...) {
+	if (hostDebugLog) {
+		va_list ap;
+		va_start(ap, format);
+		vfprintf(stderr, format, ap);
+		va_end(ap);
+	}
+}
+
+void force_debug_log(const char * format, ...) {
+	va_list ap;
+	va_start(ap, format);
+	vfprintf(stderr, format, ap);
+	va_end(ap);
+}
+
+void setConsoleMode(bool mode) {
+	consoleMode = mode;
+}
+
+// The host has no terminal or ZDI port
+//
+void startTerminal() {}
+
+bool zdi_mode() {
+	return false;
+}
+
+void zdi_enter() {}
+
+void zdi_process_cmd(uint8_t key) {}
+
+void print(char const * text) {
+	for (auto i = 0; i < strlen(text); i++) {
+		processor->vdu(text[i], false);
+	}
+}
+
+void printFmt(const char * format, ...) {
+	va_list ap;
+	va_start(ap, format);
+	int size = vsnprintf(nullptr, 0, format, ap) + 1;
+	if (size > 0) {
+		va_end(ap);
+		va_start(ap, format);
+		char buf[size + 1];
+		vsnprintf(buf, size, format, ap);
+		print(buf);
+	}
+	va_end(ap);
+}
+
+// Bring the VDP up as setup() does, minus the parts that wait for the eZ80 or a keyboard
+//
+void hostSetup() {
+	static bool started = false;
+	if (started) {
+		return;
+	}
+	started = true;
+	changeMode(0);
+	copy_font();
+	setupVDPProtocol();
+	processor = new VDUStreamProcessor(&VDPStream, &VDPStream);
+	initAudio();
+}
+
+// Run created tasks on threads of their own, and make waits really block, while in scope
+//
+struct HostThreadedTasks {
+	HostThreadedTasks() {
+		hostThreadedTasks() = true;
+	}
+	~HostThreadedTasks() {
+		hostThreadedTasks() = false;
+	}
+};
+
+// A VDU stream processor reading from, and writing to, its own memory stream
+// The processor owns the stream, as it does for buffered command streams
+//
+struct HostProcessor {
+	MemoryStream *							stream;
+	std::unique_ptr<VDUStreamProcessor>		vdu;
+
+	HostProcessor() : stream(new MemoryStream()), vdu(new VDUStreamProcessor(stream, stream)) {}
+
+	// Feed the given bytes in and process them all
+	void run(std::initializer_list<uint8_t> data) {
+		stream->feed(data);
+		vdu->processAllAvailable();
+	}
+	void run(const std::vector<uint8_t> &data) {
+		stream->feed(data);
+		vdu->processAllAvailable();
+	}
+};
+
+#endif // HOST_VDP_H
@@ -0,0 +1,83 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Host stand-in for the parts of the Arduino ESP32 core used by the VDP
+// Time comes from the host's steady clock, plus a skew that blocking waits add to
+// Unless a test turns on threaded tasks, waiting for data that can't arrive just moves the clock on
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "freertos_host.h"
+#include "esp32-hal-psram.h"
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+
+#define PI			3.1415926535897932384626433832795
+#define HALF_PI		1.5707963267948966192313216916398
+#define TWO_PI		6.283185307179586476925286766559
+#define DEG_TO_RAD	0.017453292519943295769236907684886
+#define RAD_TO_DEG	57.295779513082320876798154814105
+
+#define INPUT			0x01
+#define OUTPUT			0x03
+#define INPUT_PULLUP	0x05
+#define LOW				0x0
+#define HIGH			0x1
+
+using std::min;
+using std::max;
+
+inline uint64_t host_micros() {
+	static const auto start = std::chrono::steady_clock::now();
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() + hostClockSkew();
+}
+
+inline unsigned long micros() {
+	return (unsigned long)host_micros();
+}
+
+inline unsigned long millis() {
+	return (unsigned long)(host_micros() / 1000);
+}
+
+inline void delay(uint32_t ms) {
+	hostClockSkew() += (uint64_t)ms * 1000;
+}
+
+inline void delayMicroseconds(uint32_t us) {
+	hostClockSkew() += us;
+}
+
+inline void pinMode(uint8_t pin, uint8_t mode) {}
+inline void digitalWrite(uint8_t pin, uint8_t value) {}
+inline int digitalRead(uint8_t pin) {
+	return LOW;
+}
+
+inline void disableCore0WDT() {}
+inline void disableCore1WDT() {}
+
+inline long map(long x, long inMin, long inMax, long outMin, long outMax) {
+	return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+inline long random(long max) {
+	return max > 0 ? rand() % max : 0;
+}
+inline long random(long min, long max) {
+	return min < max ? min + random(max - min) : min;
+}
+
+#endif // HOST_ARDUINO_H
@@ -0,0 +1,51 @@
+#ifndef HOST_CRC16_H
+#define HOST_CRC16_H
+
+// Host stand-in for the robtillaart CRC16 class
+//
+
+#include <cstdint>
+
+class CRC16 {
+	public:
+		CRC16(uint16_t polynome = 0x8001, uint16_t initial = 0, uint16_t xorOut = 0, bool reverseIn = false, bool reverseOut = false)
+			: polynome(polynome), initial(initial), xorOut(xorOut), reverseIn(reverseIn), reverseOut(reverseOut), crc(initial) {}
+
+		void restart() {
+			crc = initial;
+		}
+		void add(uint8_t value) {
+			if (reverseIn) {
+				value = reverse8(value);
+			}
+			crc ^= (uint16_t)value << 8;
+			for (int i = 0; i < 8; i++) {
+				crc = (crc & 0x8000) ? (crc << 1) ^ polynome : crc << 1;
+			}
+		}
+		uint16_t calc() const {
+			uint16_t value = crc;
+			if (reverseOut) {
+				value = (reverse8(value & 0xFF) << 8) | reverse8(value >> 8);
+			}
+			return value ^ xorOut;
+		}
+
+	private:
+		static uint8_t reverse8(uint8_t value) {
+			uint8_t result = 0;
+			for (int i = 0; i < 8; i++) {
+				result = (result << 1) | ((value >> i) & 1);
+			}
+			return result;
+		}
+
+		uint16_t polynome;
+		uint16_t initial;
+		uint16_t xorOut;
+		bool reverseIn;
+		bool reverseOut;
+		uint16_t crc;
+};
+
+#endif // HOST_CRC16_H
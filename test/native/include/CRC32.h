@@ -0,0 +1,28 @@
+#ifndef HOST_CRC32_H
+#define HOST_CRC32_H
+
+// Host stand-in for the robtillaart CRC32 class, with its default reflected 0x04C11DB7 settings
+//
+
+#include <cstdint>
+
+class CRC32 {
+	public:
+		void restart() {
+			crc = 0xFFFFFFFF;
+		}
+		void add(uint8_t value) {
+			crc ^= value;
+			for (int i = 0; i < 8; i++) {
+				crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+			}
+		}
+		uint32_t calc() const {
+			return crc ^ 0xFFFFFFFF;
+		}
+
+	private:
+		uint32_t crc = 0xFFFFFFFF;
+};
+
+#endif // HOST_CRC32_H
@@ -0,0 +1,62 @@
+#ifndef HOST_ESP32TIME_H
+#define HOST_ESP32TIME_H
+
+// Host stand-in for the ESP32Time RTC library, which keeps time relative to the host clock
+//
+
+#include <ctime>
+
+class ESP32Time {
+	public:
+		ESP32Time(unsigned long offset = 0) : offset(offset) {}
+
+		void setTime(int second, int minute, int hour, int day, int month, int year) {
+			struct tm t = {};
+			t.tm_sec = second;
+			t.tm_min = minute;
+			t.tm_hour = hour;
+			t.tm_mday = day;
+			t.tm_mon = month - 1;
+			t.tm_year = year - 1900;
+			adjust = timegm(&t) - ::time(nullptr);
+		}
+
+		int getSecond() {
+			return now().tm_sec;
+		}
+		int getMinute() {
+			return now().tm_min;
+		}
+		int getHour(bool mode = false) {
+			auto hour = now().tm_hour;
+			return mode || hour <= 12 ? hour : hour - 12;
+		}
+		int getDay() {
+			return now().tm_mday;
+		}
+		int getDayofWeek() {
+			return now().tm_wday;
+		}
+		int getDayofYear() {
+			return now().tm_yday;
+		}
+		int getMonth() {
+			return now().tm_mon;
+		}
+		int getYear() {
+			return now().tm_year + 1900;
+		}
+
+	private:
+		struct tm now() {
+			time_t seconds = ::time(nullptr) + adjust + offset;
+			struct tm t;
+			gmtime_r(&seconds, &t);
+			return t;
+		}
+
+		unsigned long offset;
+		time_t adjust = 0;
+};
+
+#endif // HOST_ESP32TIME_H
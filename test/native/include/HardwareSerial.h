@@ -0,0 +1,122 @@
+#ifndef HOST_HARDWARE_SERIAL_H
+#define HOST_HARDWARE_SERIAL_H
+
+// Host stand-in for an ESP32 UART
+// Received data is whatever a test feeds in, and transmitted data is kept for the test to inspect
+// Data may be fed in from a thread other than the one reading it
+// The debug port can echo its output to stdout instead
+//
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "Arduino.h"
+#include "Stream.h"
+
+#define SERIAL_8N1				0x800001c
+#define HW_FLOWCTRL_DISABLE		0x0
+#define HW_FLOWCTRL_RTS			0x1
+#define HW_FLOWCTRL_CTS			0x2
+#define HW_FLOWCTRL_CTS_RTS		0x3
+#define UART_PIN_NO_CHANGE		(-1)
+
+class HardwareSerial : public Stream {
+	public:
+		HardwareSerial(int uartNumber) : uartNumber(uartNumber) {}
+
+		void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1) {
+			running = true;
+		}
+		void end() {
+			running = false;
+		}
+		size_t setRxBufferSize(size_t size) {
+			return size;
+		}
+		bool setHwFlowCtrlMode(uint8_t mode, uint8_t threshold) {
+			return true;
+		}
+		bool setPins(int8_t rxPin, int8_t txPin, int8_t ctsPin = -1, int8_t rtsPin = -1) {
+			return true;
+		}
+		void onReceive(std::function<void(void)> function) {
+			onReceiveFunction = function;
+		}
+
+		int available() override {
+			std::lock_guard<std::mutex> lock(rxLock);
+			return rx.size();
+		}
+		int read() override {
+			std::lock_guard<std::mutex> lock(rxLock);
+			if (rx.empty()) {
+				return -1;
+			}
+			auto value = rx.front();
+			rx.pop_front();
+			return value;
+		}
+		size_t read(uint8_t * buffer, size_t size) {
+			std::lock_guard<std::mutex> lock(rxLock);
+			size_t count = std::min(size, rx.size());
+			std::copy(rx.begin(), rx.begin() + count, buffer);
+			rx.erase(rx.begin(), rx.begin() + count);
+			return count;
+		}
+		int peek() override {
+			std::lock_guard<std::mutex> lock(rxLock);
+			return rx.empty() ? -1 : rx.front();
+		}
+		size_t readBytes(char * buffer, size_t length) override {
+			return read((uint8_t *)buffer, length);
+		}
+		size_t write(uint8_t b) override {
+			return write(&b, 1);
+		}
+		size_t write(const uint8_t * buffer, size_t size) override {
+			if (echo) {
+				fwrite(buffer, 1, size, stdout);
+			} else {
+				tx.insert(tx.end(), buffer, buffer + size);
+			}
+			return size;
+		}
+		operator bool() const {
+			return running;
+		}
+
+		// Host test interface
+		void receive(const uint8_t * data, size_t size) {
+			{
+				std::lock_guard<std::mutex> lock(rxLock);
+				rx.insert(rx.end(), data, data + size);
+			}
+			if (onReceiveFunction) {
+				onReceiveFunction();
+			}
+		}
+		std::vector<uint8_t> takeOutput() {
+			std::vector<uint8_t> output;
+			output.swap(tx);
+			return output;
+		}
+		void setEcho(bool enabled) {
+			echo = enabled;
+		}
+
+	private:
+		int uartNumber;
+		bool running = false;
+		bool echo = false;
+		std::mutex rxLock;
+		std::deque<uint8_t> rx;
+		std::vector<uint8_t> tx;
+		std::function<void(void)> onReceiveFunction;
+};
+
+HardwareSerial Serial(0);
+HardwareSerial Serial2(2);
+
+#endif // HOST_HARDWARE_SERIAL_H
@@ -0,0 +1,55 @@
+#ifndef HOST_PRINT_H
+#define HOST_PRINT_H
+
+// Host stand-in for the Arduino Print class
+//
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+class Print {
+	public:
+		virtual ~Print() {}
+
+		virtual size_t write(uint8_t b) = 0;
+		virtual size_t write(const uint8_t * buffer, size_t size) {
+			size_t written = 0;
+			while (size--) {
+				if (write(*buffer++) == 0) {
+					break;
+				}
+				written++;
+			}
+			return written;
+		}
+		size_t write(const char * buffer, size_t size) {
+			return write((const uint8_t *)buffer, size);
+		}
+		virtual void flush() {}
+
+		size_t print(const char * text) {
+			return write((const uint8_t *)text, strlen(text));
+		}
+		size_t print(char c) {
+			return write((uint8_t)c);
+		}
+		size_t println(const char * text = "") {
+			return print(text) + print("\r\n");
+		}
+		size_t printf(const char * format, ...) __attribute__ ((format (printf, 2, 3))) {
+			char buffer[256];
+			va_list ap;
+			va_start(ap, format);
+			auto length = vsnprintf(buffer, sizeof buffer, format, ap);
+			va_end(ap);
+			if (length < 0) {
+				return 0;
+			}
+			return write((const uint8_t *)buffer, std::min<size_t>(length, sizeof buffer - 1));
+		}
+};
+
+#endif // HOST_PRINT_H
@@ -0,0 +1,58 @@
+#ifndef HOST_STREAM_H
+#define HOST_STREAM_H
+
+// Host stand-in for the Arduino Stream class
+//
+
+#include <algorithm>
+
+#include "Arduino.h"
+#include "Print.h"
+
+class Stream : public Print {
+	protected:
+		unsigned long _timeout = 1000;
+		unsigned long _startMillis = 0;
+
+		int timedRead() {
+			_startMillis = millis();
+			do {
+				auto c = read();
+				if (c >= 0) {
+					return c;
+				}
+				delay(1);
+			} while (millis() - _startMillis < _timeout);
+			return -1;
+		}
+
+	public:
+		virtual int available() = 0;
+		virtual int read() = 0;
+		virtual int peek() = 0;
+
+		void setTimeout(unsigned long timeout) {
+			_timeout = timeout;
+		}
+		unsigned long getTimeout() {
+			return _timeout;
+		}
+
+		virtual size_t readBytes(char * buffer, size_t length) {
+			size_t count = 0;
+			while (count < length) {
+				auto c = timedRead();
+				if (c < 0) {
+					break;
+				}
+				*buffer++ = (char)c;
+				count++;
+			}
+			return count;
+		}
+		virtual size_t readBytes(uint8_t * buffer, size_t length) {
+			return readBytes((char *)buffer, length);
+		}
+};
+
+#endif // HOST_STREAM_H
@@ -0,0 +1,31 @@
+#ifndef HOST_DRIVER_UART_H
+#define HOST_DRIVER_UART_H
+
+// Host stand-in for the ESP-IDF UART driver calls used by the VDP
+// The RTS level last set on each port is kept for tests to inspect
+//
+
+#include "esp_err.h"
+
+typedef int uart_port_t;
+
+#define UART_NUM_0		0
+#define UART_NUM_1		1
+#define UART_NUM_2		2
+#define UART_NUM_MAX	3
+
+// RTS level of each port, where 1 lets the sender send and 0 holds it off
+inline int * hostUartRts() {
+	static int levels[UART_NUM_MAX] = { 1, 1, 1 };
+	return levels;
+}
+
+inline esp_err_t uart_set_rts(uart_port_t port, int level) {
+	if (port < 0 || port >= UART_NUM_MAX) {
+		return ESP_FAIL;
+	}
+	hostUartRts()[port] = level;
+	return ESP_OK;
+}
+
+#endif // HOST_DRIVER_UART_H
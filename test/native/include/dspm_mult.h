@@ -0,0 +1,22 @@
+#ifndef HOST_DSPM_MULT_H
+#define HOST_DSPM_MULT_H
+
+// Host stand-in for the esp-dsp matrix multiply
+//
+
+#include "esp_err.h"
+
+inline esp_err_t dspm_mult_f32(const float * A, const float * B, float * C, int m, int n, int k) {
+	for (int row = 0; row < m; row++) {
+		for (int col = 0; col < k; col++) {
+			float sum = 0;
+			for (int i = 0; i < n; i++) {
+				sum += A[row * n + i] * B[i * k + col];
+			}
+			C[row * k + col] = sum;
+		}
+	}
+	return 0;
+}
+
+#endif // HOST_DSPM_MULT_H
@@ -0,0 +1,45 @@
+#ifndef HOST_ESP32_HAL_PSRAM_H
+#define HOST_ESP32_HAL_PSRAM_H
+
+// Host stand-in for PSRAM allocation, which just uses the normal heap
+// Tests can make larger allocations fail, to check out of memory handling, and count allocations
+//
+
+#include <cstdint>
+#include <cstdlib>
+
+// Allocations larger than this many bytes fail
+inline size_t &hostPsramLimit() {
+	static size_t limit = SIZE_MAX;
+	return limit;
+}
+
+// Number of allocations made
+inline uint32_t &hostPsramAllocations() {
+	static uint32_t count = 0;
+	return count;
+}
+
+inline bool psramInit() {
+	return true;
+}
+
+inline bool psramFound() {
+	return true;
+}
+
+inline void * ps_malloc(size_t size) {
+	hostPsramAllocations()++;
+	return size > hostPsramLimit() ? nullptr : malloc(size);
+}
+
+inline void * ps_calloc(size_t count, size_t size) {
+	hostPsramAllocations()++;
+	return count * size > hostPsramLimit() ? nullptr : calloc(count, size);
+}
+
+inline void * ps_realloc(void * pointer, size_t size) {
+	return size > hostPsramLimit() ? nullptr : realloc(pointer, size);
+}
+
+#endif // HOST_ESP32_HAL_PSRAM_H
@@ -0,0 +1,41 @@
+#ifndef HOST_ESP_HEAP_CAPS_H
+#define HOST_ESP_HEAP_CAPS_H
+
+// Host stand-in for capability-based heap allocation, which just uses the normal heap
+//
+
+#include <cstdint>
+#include <cstdlib>
+
+#define MALLOC_CAP_32BIT		(1 << 1)
+#define MALLOC_CAP_8BIT			(1 << 2)
+#define MALLOC_CAP_DMA			(1 << 3)
+#define MALLOC_CAP_SPIRAM		(1 << 10)
+#define MALLOC_CAP_INTERNAL		(1 << 11)
+#define MALLOC_CAP_DEFAULT		(1 << 12)
+
+inline void * heap_caps_malloc(size_t size, uint32_t caps) {
+	return malloc(size);
+}
+
+inline void * heap_caps_calloc(size_t count, size_t size, uint32_t caps) {
+	return calloc(count, size);
+}
+
+inline void * heap_caps_realloc(void * pointer, size_t size, uint32_t caps) {
+	return realloc(pointer, size);
+}
+
+inline void heap_caps_free(void * pointer) {
+	free(pointer);
+}
+
+inline size_t heap_caps_get_free_size(uint32_t caps) {
+	return (caps & MALLOC_CAP_SPIRAM) ? 4 * 1024 * 1024 : 256 * 1024;
+}
+
+inline size_t heap_caps_get_largest_free_block(uint32_t caps) {
+	return heap_caps_get_free_size(caps);
+}
+
+#endif // HOST_ESP_HEAP_CAPS_H
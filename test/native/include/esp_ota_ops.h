@@ -0,0 +1,52 @@
+#ifndef HOST_ESP_OTA_OPS_H
+#define HOST_ESP_OTA_OPS_H
+
+// Host stand-in for ESP-IDF over-the-air updates
+// There are no partitions on the host, so every update fails
+//
+
+#include <cstddef>
+#include <cstdint>
+
+#include "esp_err.h"
+#include "esp_system.h"
+
+#define OTA_SIZE_UNKNOWN	0xffffffff
+
+typedef uint32_t esp_ota_handle_t;
+
+typedef struct {
+	uint32_t address;
+	uint32_t size;
+	char label[17];
+} esp_partition_t;
+
+inline const esp_partition_t * esp_ota_get_boot_partition() {
+	return nullptr;
+}
+
+inline const esp_partition_t * esp_ota_get_running_partition() {
+	return nullptr;
+}
+
+inline const esp_partition_t * esp_ota_get_next_update_partition(const esp_partition_t * start) {
+	return nullptr;
+}
+
+inline esp_err_t esp_ota_begin(const esp_partition_t * partition, size_t imageSize, esp_ota_handle_t * handle) {
+	return ESP_FAIL;
+}
+
+inline esp_err_t esp_ota_write(esp_ota_handle_t handle, const void * data, size_t size) {
+	return ESP_FAIL;
+}
+
+inline esp_err_t esp_ota_end(esp_ota_handle_t handle) {
+	return ESP_FAIL;
+}
+
+inline esp_err_t esp_ota_set_boot_partition(const esp_partition_t * partition) {
+	return ESP_FAIL;
+}
+
+#endif // HOST_ESP_OTA_OPS_H
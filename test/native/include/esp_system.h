@@ -0,0 +1,28 @@
+#ifndef HOST_ESP_SYSTEM_H
+#define HOST_ESP_SYSTEM_H
+
+// Host stand-in for ESP-IDF system calls
+// The host always appears to have just powered on, and can't restart
+//
+
+#include <cstdio>
+#include <cstdlib>
+
+typedef enum {
+	ESP_RST_UNKNOWN,
+	ESP_RST_POWERON,
+	ESP_RST_EXT,
+	ESP_RST_SW,
+	ESP_RST_PANIC,
+} esp_reset_reason_t;
+
+inline esp_reset_reason_t esp_reset_reason() {
+	return ESP_RST_POWERON;
+}
+
+inline void esp_restart() {
+	fprintf(stderr, "esp_restart called\n");
+	exit(1);
+}
+
+#endif // HOST_ESP_SYSTEM_H
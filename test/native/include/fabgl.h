@@ -0,0 +1,1075 @@
+#ifndef HOST_FABGL_H
+#define HOST_FABGL_H
+
+// Host stand-in for the parts of vdp-gl (fabgl) used by the VDP
+// The canvas is a software framebuffer. It implements the primitives the VDP depends on to read back
+// (pixels, lines, rectangles, bitmaps and scrolling). Other shapes are counted but not rasterised.
+// Keyboard, mouse and sound are inert, apart from the mouse delta queue which tests can feed
+//
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "Arduino.h"
+#include "dspm_mult.h"
+#include "mat.h"
+
+#define VGA_320x200_70Hz	"\"320x200@70Hz\" 12.5875 320 328 376 400 200 206 207 224 -HSync -VSync DoubleScan"
+#define VGA_320x200_75Hz	"\"320x200@75Hz\" 12.93 320 352 376 408 200 208 211 229 -HSync -VSync DoubleScan"
+#define QVGA_320x240_60Hz	"\"320x240@60Hz\" 12.6 320 328 376 400 240 245 246 262 -HSync -VSync DoubleScan"
+#define VGA_512x384_60Hz	"\"512x384@60Hz\" 32.5 512 524 592 672 384 385 388 403 -HSync -VSync DoubleScan"
+#define VGA_640x480_60Hz	"\"640x480@60Hz\" 25.175 640 656 752 800 480 490 492 525 -HSync -VSync"
+#define SVGA_800x600_60Hz	"\"800x600@60Hz\" 40 800 840 968 1056 600 601 605 628 -HSync -VSync"
+#define SVGA_1024x768_60Hz	"\"1024x768@60Hz\" 65 1024 1048 1184 1344 768 771 777 806 -HSync -VSync"
+
+namespace fabgl {
+
+struct RGB888 {
+	uint8_t R;
+	uint8_t G;
+	uint8_t B;
+
+	RGB888() : R(0), G(0), B(0) {}
+	RGB888(uint8_t red, uint8_t green, uint8_t blue) : R(red), G(green), B(blue) {}
+};
+
+inline bool operator==(RGB888 const &a, RGB888 const &b) {
+	return a.R == b.R && a.G == b.G && a.B == b.B;
+}
+
+inline bool operator!=(RGB888 const &a, RGB888 const &b) {
+	return !(a == b);
+}
+
+struct RGBA8888 {
+	uint8_t R;
+	uint8_t G;
+	uint8_t B;
+	uint8_t A;
+
+	RGBA8888() : R(0), G(0), B(0), A(0) {}
+	RGBA8888(int red, int green, int blue, int alpha) : R(red), G(green), B(blue), A(alpha) {}
+};
+
+struct RGB222 {
+	uint8_t R : 2;
+	uint8_t G : 2;
+	uint8_t B : 2;
+
+	RGB222() : R(0), G(0), B(0) {}
+	RGB222(uint8_t red, uint8_t green, uint8_t blue) : R(red), G(green), B(blue) {}
+	RGB222(RGB888 const &value) : R(value.R >> 6), G(value.G >> 6), B(value.B >> 6) {}
+};
+
+struct RGBA2222 {
+	uint8_t R : 2;
+	uint8_t G : 2;
+	uint8_t B : 2;
+	uint8_t A : 2;
+
+	RGBA2222(int red, int green, int blue, int alpha) : R(red), G(green), B(blue), A(alpha) {}
+};
+
+struct Point {
+	int16_t X;
+	int16_t Y;
+
+	Point() : X(0), Y(0) {}
+	Point(int x, int y) : X(x), Y(y) {}
+
+	Point add(Point const &p) const {
+		return Point(X + p.X, Y + p.Y);
+	}
+	Point sub(Point const &p) const {
+		return Point(X - p.X, Y - p.Y);
+	}
+	Point neg() const {
+		return Point(-X, -Y);
+	}
+	bool operator==(Point const &p) const {
+		return X == p.X && Y == p.Y;
+	}
+	bool operator!=(Point const &p) const {
+		return !(*this == p);
+	}
+};
+
+struct Size {
+	int16_t width;
+	int16_t height;
+
+	Size() : width(0), height(0) {}
+	Size(int w, int h) : width(w), height(h) {}
+};
+
+struct Rect {
+	int16_t X1;
+	int16_t Y1;
+	int16_t X2;
+	int16_t Y2;
+
+	Rect() : X1(0), Y1(0), X2(0), Y2(0) {}
+	Rect(int x1, int y1, int x2, int y2) : X1(x1), Y1(y1), X2(x2), Y2(y2) {}
+
+	bool operator==(Rect const &r) const {
+		return X1 == r.X1 && Y1 == r.Y1 && X2 == r.X2 && Y2 == r.Y2;
+	}
+	bool operator!=(Rect const &r) const {
+		return !(*this == r);
+	}
+	int width() const {
+		return X2 - X1 + 1;
+	}
+	int height() const {
+		return Y2 - Y1 + 1;
+	}
+	Size size() const {
+		return Size(width(), height());
+	}
+	Rect translate(int offsetX, int offsetY) const {
+		return Rect(X1 + offsetX, Y1 + offsetY, X2 + offsetX, Y2 + offsetY);
+	}
+	Rect translate(Point const &offset) const {
+		return translate(offset.X, offset.Y);
+	}
+	Rect intersection(Rect const &r) const {
+		return Rect(std::max(X1, r.X1), std::max(Y1, r.Y1), std::min(X2, r.X2), std::min(Y2, r.Y2));
+	}
+	bool intersects(Rect const &r) const {
+		return X1 <= r.X2 && X2 >= r.X1 && Y1 <= r.Y2 && Y2 >= r.Y1;
+	}
+	bool contains(int x, int y) const {
+		return x >= X1 && y >= Y1 && x <= X2 && y <= Y2;
+	}
+	bool contains(Point const &p) const {
+		return contains(p.X, p.Y);
+	}
+};
+
+enum class PaintMode : uint8_t {
+	Set,
+	OR,
+	AND,
+	XOR,
+	Invert,
+	NoOp,
+	ANDNOT,
+	ORNOT,
+};
+
+struct PaintOptions {
+	uint8_t swapFGBG : 1;
+	uint8_t NOT : 1;
+	PaintMode mode;
+
+	PaintOptions() : swapFGBG(false), NOT(false), mode(PaintMode::Set) {}
+};
+
+struct GlyphOptions {
+	uint8_t fillBackground : 1;
+	uint8_t bold : 1;
+	uint8_t italic : 1;
+	uint8_t underline : 1;
+	uint8_t invert : 1;
+
+	GlyphOptions() : fillBackground(0), bold(0), italic(0), underline(0), invert(0) {}
+	GlyphOptions &FillBackground(bool value) {
+		fillBackground = value;
+		return *this;
+	}
+	GlyphOptions &Bold(bool value) {
+		bold = value;
+		return *this;
+	}
+	GlyphOptions &Italic(bool value) {
+		italic = value;
+		return *this;
+	}
+	GlyphOptions &Underline(bool value) {
+		underline = value;
+		return *this;
+	}
+	GlyphOptions &Invert(bool value) {
+		invert = value;
+		return *this;
+	}
+};
+
+struct LineOptions {
+	uint8_t omitFirst : 1;
+	uint8_t omitLast : 1;
+	uint8_t usePattern : 1;
+
+	LineOptions() : omitFirst(0), omitLast(0), usePattern(0) {}
+};
+
+struct LinePattern {
+	uint8_t pattern[8];
+	uint8_t offset;
+
+	LinePattern() : offset(0) {
+		memset(pattern, 0xAA, sizeof pattern);
+	}
+	void setPattern(uint8_t const * value) {
+		memcpy(pattern, value, sizeof pattern);
+	}
+};
+
+#define FONTINFOFLAGS_ITALIC	0x01
+#define FONTINFOFLAGS_UNDERLINE	0x02
+#define FONTINFODLAFS_STRIKEOUT	0x04
+#define FONTINFOFLAGS_VARWIDTH	0x08
+
+struct FontInfo {
+	uint8_t pointSize;
+	uint8_t width;
+	uint8_t height;
+	uint8_t ascent;
+	uint8_t inleading;
+	uint8_t exleading;
+	uint8_t flags;
+	uint16_t weight;
+	uint16_t charset;
+	const uint8_t * data;
+	const uint32_t * chptr;
+	uint16_t codepage;
+};
+
+enum class PixelFormat : uint8_t {
+	Undefined,
+	Native,
+	Mask,
+	RGBA2222,
+	RGBA8888,
+};
+
+struct Bitmap {
+	int16_t width;
+	int16_t height;
+	PixelFormat format;
+	RGB888 foregroundColor;
+	uint8_t * data;
+	bool dataAllocated;
+
+	Bitmap() : width(0), height(0), format(PixelFormat::Undefined), data(nullptr), dataAllocated(false) {}
+	Bitmap(int width, int height, void const * data, PixelFormat format, bool copy = false)
+		: Bitmap(width, height, data, format, RGB888(255, 255, 255), copy) {}
+	Bitmap(int width, int height, void const * data, PixelFormat format, RGB888 foregroundColor, bool copy = false)
+		: width(width), height(height), format(format), foregroundColor(foregroundColor), data((uint8_t *)data), dataAllocated(false) {
+		if (copy) {
+			auto size = dataSize();
+			this->data = (uint8_t *)malloc(size);
+			memcpy(this->data, data, size);
+			dataAllocated = true;
+		}
+	}
+	Bitmap(Bitmap const &other)
+		: width(other.width), height(other.height), format(other.format), foregroundColor(other.foregroundColor), data(other.data), dataAllocated(false) {}
+	Bitmap &operator=(Bitmap const &other) {
+		if (this != &other) {
+			release();
+			width = other.width;
+			height = other.height;
+			format = other.format;
+			foregroundColor = other.foregroundColor;
+			data = other.data;
+		}
+		return *this;
+	}
+	~Bitmap() {
+		release();
+	}
+
+	size_t dataSize() const {
+		switch (format) {
+			case PixelFormat::Mask:
+				return ((width + 7) / 8) * height;
+			case PixelFormat::RGBA8888:
+				return width * height * 4;
+			default:
+				return width * height;
+		}
+	}
+
+	private:
+		void release() {
+			if (dataAllocated) {
+				free(data);
+			}
+			dataAllocated = false;
+		}
+};
+
+struct Sprite {
+	int16_t x;
+	int16_t y;
+	Bitmap * * frames;
+	int16_t framesCount;
+	int16_t currentFrame;
+	int16_t savedX;
+	int16_t savedY;
+	uint8_t visible : 1;
+	uint8_t isStatic : 1;
+	uint8_t allowDraw : 1;
+	PaintOptions paintOptions;
+
+	Sprite() : x(0), y(0), frames(nullptr), framesCount(0), currentFrame(0), savedX(0), savedY(0), visible(0), isStatic(0), allowDraw(1) {}
+	~Sprite() {
+		free(frames);
+	}
+
+	Bitmap * getFrame() {
+		return frames ? frames[currentFrame] : nullptr;
+	}
+	Sprite * setFrame(int frame) {
+		currentFrame = frame;
+		return this;
+	}
+	Sprite * nextFrame() {
+		currentFrame = framesCount ? (currentFrame + 1) % framesCount : 0;
+		return this;
+	}
+	Sprite * addBitmap(Bitmap * bitmap) {
+		frames = (Bitmap * *)realloc(frames, sizeof(Bitmap *) * (framesCount + 1));
+		frames[framesCount++] = bitmap;
+		return this;
+	}
+	void clearBitmaps() {
+		free(frames);
+		frames = nullptr;
+		framesCount = 0;
+	}
+	Sprite * moveTo(int newX, int newY) {
+		x = newX;
+		y = newY;
+		return this;
+	}
+	Sprite * moveBy(int offsetX, int offsetY) {
+		x += offsetX;
+		y += offsetY;
+		return this;
+	}
+};
+
+enum CursorName : uint8_t {
+	CursorPointerAmigaLike,
+	CursorPointerSimpleReversed,
+	CursorPointerSmall,
+	CursorPointerShadowed,
+	CursorPointer,
+	CursorPen,
+	CursorCross1,
+	CursorCross2,
+	CursorPoint,
+	CursorLeftArrow,
+	CursorRightArrow,
+	CursorDownArrow,
+	CursorUpArrow,
+	CursorMove,
+	CursorResize1,
+	CursorResize2,
+	CursorResize3,
+	CursorResize4,
+	CursorTextInput,
+};
+
+struct Cursor {
+	int16_t hotspotX;
+	int16_t hotspotY;
+	Bitmap bitmap;
+};
+
+// Display controllers
+// The host has no video output, so controllers just keep track of their resolution
+//
+class BitmappedDisplayController {
+	public:
+		virtual ~BitmappedDisplayController() {}
+
+		virtual void begin() {}
+		virtual void end() {}
+		void setResolution(char const * modeline, int viewPortWidth = -1, int viewPortHeight = -1, bool doubleBuffered = false) {
+			// modelines start with a quoted name of the form "WxH@R"
+			int width = 640;
+			int height = 480;
+			if (modeline && modeline[0] == '"') {
+				sscanf(modeline + 1, "%dx%d", &width, &height);
+			}
+			screenWidth = viewPortWidth > 0 ? viewPortWidth : width;
+			screenHeight = viewPortHeight > 0 ? viewPortHeight : height;
+			this->doubleBuffered = doubleBuffered;
+		}
+		int getScreenWidth() {
+			return screenWidth;
+		}
+		int getScreenHeight() {
+			return screenHeight;
+		}
+		int getViewPortWidth() {
+			return screenWidth;
+		}
+		int getViewPortHeight() {
+			return screenHeight;
+		}
+		bool isDoubleBuffered() {
+			return doubleBuffered;
+		}
+		void enableBackgroundPrimitiveExecution(bool value) {}
+		void enableBackgroundPrimitiveTimeout(bool value) {}
+
+		template <typename T>
+		void setSprites(T * sprites, int count) {}
+		void removeSprites() {}
+		void refreshSprites() {}
+		void setMouseCursor(Cursor * cursor) {}
+		void setMouseCursor(CursorName cursorName) {}
+		void setMouseCursorPos(int x, int y) {}
+
+	private:
+		int screenWidth = 640;
+		int screenHeight = 480;
+		bool doubleBuffered = false;
+};
+
+class VGABaseController : public BitmappedDisplayController {};
+
+template <int Colours>
+class VGAPalettedController : public VGABaseController {
+	public:
+		VGAPalettedController() {
+			s_instance = this;
+		}
+		~VGAPalettedController() {
+			if (s_instance == this) {
+				s_instance = nullptr;
+			}
+		}
+		static VGAPalettedController * instance() {
+			return s_instance;
+		}
+		void setPaletteItem(int index, RGB888 const &color) {
+			if (index >= 0 && index < Colours) {
+				palette[index] = color;
+			}
+		}
+		void updateRGB2PaletteLUT() {}
+
+	private:
+		static VGAPalettedController * s_instance;
+		RGB888 palette[Colours];
+};
+
+template <int Colours>
+VGAPalettedController<Colours> * VGAPalettedController<Colours>::s_instance = nullptr;
+
+typedef VGAPalettedController<2> VGA2Controller;
+typedef VGAPalettedController<4> VGA4Controller;
+typedef VGAPalettedController<8> VGA8Controller;
+typedef VGAPalettedController<16> VGA16Controller;
+class VGAController : public VGABaseController {};
+
+// Software canvas
+// Draws into an RGB888 framebuffer the size of the display controller's screen
+//
+class Canvas {
+	public:
+		Canvas(BitmappedDisplayController * controller)
+			: width(controller->getScreenWidth()), height(controller->getScreenHeight()),
+			  pixels(width * height), clippingRect(0, 0, width - 1, height - 1), scrollingRegion(clippingRect) {}
+
+		int getWidth() {
+			return width;
+		}
+		int getHeight() {
+			return height;
+		}
+
+		void setPenColor(RGB888 const &color) {
+			penColor = color;
+		}
+		void setPenColor(uint8_t red, uint8_t green, uint8_t blue) {
+			penColor = RGB888(red, green, blue);
+		}
+		void setBrushColor(RGB888 const &color) {
+			brushColor = color;
+		}
+		void setBrushColor(uint8_t red, uint8_t green, uint8_t blue) {
+			brushColor = RGB888(red, green, blue);
+		}
+		void setPaintOptions(PaintOptions options) {
+			paintOptions = options;
+		}
+		void setGlyphOptions(GlyphOptions options) {
+			glyphOptions = options;
+		}
+		void setLineOptions(LineOptions options) {
+			lineOptions = options;
+		}
+		void setLinePattern(LinePattern pattern) {
+			linePattern = pattern;
+		}
+		void setLinePatternLength(int length) {}
+		void setLinePatternOffset(int offset) {
+			linePattern.offset = offset;
+		}
+		void setPenWidth(int width) {}
+		void setClippingRect(Rect const &rect) {
+			clippingRect = rect;
+		}
+		void setScrollingRegion(int x1, int y1, int x2, int y2) {
+			scrollingRegion = Rect(x1, y1, x2, y2);
+		}
+		void selectFont(FontInfo const * font) {
+			this->font = font;
+		}
+		FontInfo const * getFontInfo() {
+			return font;
+		}
+
+		void clear() {
+			primitives++;
+			std::fill(pixels.begin(), pixels.end(), brushColor);
+		}
+		void moveTo(int x, int y) {
+			position = Point(x, y);
+		}
+		void setPixel(int x, int y) {
+			primitives++;
+			plot(x, y, penColor);
+		}
+		RGB888 getPixel(int x, int y) {
+			if (x < 0 || y < 0 || x >= width || y >= height) {
+				return RGB888();
+			}
+			return pixels[y * width + x];
+		}
+		void lineTo(int x, int y) {
+			primitives++;
+			// Bresenham, honouring omitFirst/omitLast
+			int x0 = position.X;
+			int y0 = position.Y;
+			int dx = std::abs(x - x0);
+			int dy = -std::abs(y - y0);
+			int sx = x0 < x ? 1 : -1;
+			int sy = y0 < y ? 1 : -1;
+			int error = dx + dy;
+			bool first = true;
+			while (true) {
+				bool last = x0 == x && y0 == y;
+				if (!(first && lineOptions.omitFirst) && !(last && lineOptions.omitLast)) {
+					plot(x0, y0, penColor);
+				}
+				if (last) {
+					break;
+				}
+				first = false;
+				int e2 = 2 * error;
+				if (e2 >= dy) {
+					error += dy;
+					x0 += sx;
+				}
+				if (e2 <= dx) {
+					error += dx;
+					y0 += sy;
+				}
+			}
+			position = Point(x, y);
+		}
+		void fillRectangle(int x1, int y1, int x2, int y2) {
+			primitives++;
+			if (x1 > x2) {
+				std::swap(x1, x2);
+			}
+			if (y1 > y2) {
+				std::swap(y1, y2);
+			}
+			for (int y = y1; y <= y2; y++) {
+				for (int x = x1; x <= x2; x++) {
+					plot(x, y, brushColor);
+				}
+			}
+		}
+		void fillRectangle(Rect const &rect) {
+			fillRectangle(rect.X1, rect.Y1, rect.X2, rect.Y2);
+		}
+		void drawChar(int x, int y, char c) {
+			primitives++;
+			if (!font || !font->data) {
+				return;
+			}
+			int rowBytes = (font->width + 7) / 8;
+			auto glyph = font->chptr ? font->data + font->chptr[(uint8_t)c] : font->data + (uint8_t)c * font->height * rowBytes;
+			for (int row = 0; row < font->height; row++) {
+				for (int col = 0; col < font->width; col++) {
+					bool set = glyph[row * rowBytes + col / 8] & (0x80 >> (col & 7));
+					if (set) {
+						plot(x + col, y + row, penColor);
+					} else if (glyphOptions.fillBackground) {
+						plot(x + col, y + row, brushColor);
+					}
+				}
+			}
+		}
+		void drawBitmap(int x, int y, Bitmap const * bitmap) {
+			primitives++;
+			if (!bitmap || !bitmap->data) {
+				return;
+			}
+			for (int row = 0; row < bitmap->height; row++) {
+				for (int col = 0; col < bitmap->width; col++) {
+					auto index = row * bitmap->width + col;
+					switch (bitmap->format) {
+						case PixelFormat::RGBA8888: {
+							auto p = bitmap->data + index * 4;
+							if (p[3]) {
+								plot(x + col, y + row, RGB888(p[0], p[1], p[2]));
+							}
+						}	break;
+						case PixelFormat::RGBA2222: {
+							auto p = bitmap->data[index];
+							if (p >> 6) {
+								plot(x + col, y + row, RGB888((p & 3) * 85, ((p >> 2) & 3) * 85, ((p >> 4) & 3) * 85));
+							}
+						}	break;
+						case PixelFormat::Mask: {
+							auto p = bitmap->data[row * ((bitmap->width + 7) / 8) + col / 8];
+							if (p & (0x80 >> (col & 7))) {
+								plot(x + col, y + row, bitmap->foregroundColor);
+							}
+						}	break;
+						default:
+							break;
+					}
+				}
+			}
+		}
+		void drawTransformedBitmap(int x, int y, Bitmap const * bitmap, float * transform, float * inverse) {
+			primitives++;
+		}
+		void copyToBitmap(int x, int y, Bitmap * bitmap) {
+			primitives++;
+		}
+		void copyRect(int sourceX, int sourceY, int destX, int destY, int width, int height) {
+			primitives++;
+			std::vector<RGB888> copy;
+			copy.reserve(width * height);
+			for (int row = 0; row < height; row++) {
+				for (int col = 0; col < width; col++) {
+					copy.push_back(getPixel(sourceX + col, sourceY + row));
+				}
+			}
+			for (int row = 0; row < height; row++) {
+				for (int col = 0; col < width; col++) {
+					plot(destX + col, destY + row, copy[row * width + col]);
+				}
+			}
+		}
+		void scroll(int offsetX, int offsetY) {
+			primitives++;
+			auto region = scrollingRegion;
+			std::vector<RGB888> copy;
+			for (int y = region.Y1; y <= region.Y2; y++) {
+				for (int x = region.X1; x <= region.X2; x++) {
+					copy.push_back(getPixel(x, y));
+				}
+			}
+			auto regionWidth = region.width();
+			for (int y = region.Y1; y <= region.Y2; y++) {
+				for (int x = region.X1; x <= region.X2; x++) {
+					int sourceX = x - offsetX;
+					int sourceY = y - offsetY;
+					auto colour = region.contains(sourceX, sourceY)
+						? copy[(sourceY - region.Y1) * regionWidth + (sourceX - region.X1)]
+						: brushColor;
+					if (x >= 0 && y >= 0 && x < width && y < height) {
+						pixels[y * width + x] = colour;
+					}
+				}
+			}
+		}
+		void drawEllipse(int x, int y, int width, int height) {
+			primitives++;
+		}
+		void fillEllipse(int x, int y, int width, int height) {
+			primitives++;
+		}
+		void drawArc(int x1, int y1, int x2, int y2, int x3, int y3) {
+			primitives++;
+		}
+		void fillSegment(int x1, int y1, int x2, int y2, int x3, int y3) {
+			primitives++;
+		}
+		void fillSector(int x1, int y1, int x2, int y2, int x3, int y3) {
+			primitives++;
+		}
+		void drawPath(Point const * points, int count) {
+			primitives++;
+		}
+		void fillPath(Point const * points, int count) {
+			primitives++;
+		}
+		void swapBuffers() {}
+		void waitCompletion(bool waitVSync = true) {}
+
+		// Host interface
+		// Number of drawing primitives executed
+		uint32_t primitiveCount() const {
+			return primitives;
+		}
+
+	private:
+		void plot(int x, int y, RGB888 colour) {
+			if (!clippingRect.contains(x, y) || x < 0 || y < 0 || x >= width || y >= height) {
+				return;
+			}
+			auto &pixel = pixels[y * width + x];
+			switch (paintOptions.mode) {
+				case PaintMode::Set:	pixel = colour; break;
+				case PaintMode::OR:		pixel = RGB888(pixel.R | colour.R, pixel.G | colour.G, pixel.B | colour.B); break;
+				case PaintMode::AND:	pixel = RGB888(pixel.R & colour.R, pixel.G & colour.G, pixel.B & colour.B); break;
+				case PaintMode::XOR:	pixel = RGB888(pixel.R ^ colour.R, pixel.G ^ colour.G, pixel.B ^ colour.B); break;
+				case PaintMode::Invert:	pixel = RGB888(~pixel.R, ~pixel.G, ~pixel.B); break;
+				default: break;
+			}
+		}
+
+		int width;
+		int height;
+		std::vector<RGB888> pixels;
+		Rect clippingRect;
+		Rect scrollingRegion;
+		Point position;
+		RGB888 penColor = RGB888(255, 255, 255);
+		RGB888 brushColor;
+		PaintOptions paintOptions;
+		GlyphOptions glyphOptions;
+		LineOptions lineOptions;
+		LinePattern linePattern;
+		FontInfo const * font = nullptr;
+		uint32_t primitives = 0;
+};
+
+// Keyboard
+// There is no keyboard on the host, so no keys are ever pressed
+//
+enum VirtualKey {
+	VK_NONE,
+	VK_SPACE,
+	VK_BACKSPACE,
+	VK_TAB,
+	VK_RETURN,
+	VK_ESCAPE,
+	VK_LEFT,
+	VK_RIGHT,
+	VK_UP,
+	VK_DOWN,
+	VK_F12,
+	VK_LAST,
+};
+
+struct VirtualKeyItem {
+	VirtualKey vk;
+	uint8_t down : 1;
+	uint8_t CTRL : 1;
+	uint8_t LALT : 1;
+	uint8_t RALT : 1;
+	uint8_t SHIFT : 1;
+	uint8_t GUI : 1;
+	uint8_t CAPSLOCK : 1;
+	uint8_t NUMLOCK : 1;
+	uint8_t SCROLLLOCK : 1;
+	uint8_t ASCII;
+	uint8_t scancode[8];
+
+	VirtualKeyItem() {
+		memset(this, 0, sizeof *this);
+	}
+};
+
+struct KeyboardLayout {
+	const char * name;
+	const char * desc;
+};
+
+const KeyboardLayout USLayout { "US", "US English" };
+const KeyboardLayout UKLayout { "UK", "UK British" };
+const KeyboardLayout GermanLayout { "DE", "German" };
+const KeyboardLayout ItalianLayout { "IT", "Italian" };
+const KeyboardLayout SpanishLayout { "ES", "Spanish" };
+const KeyboardLayout FrenchLayout { "FR", "French" };
+const KeyboardLayout BelgianLayout { "BE", "Belgian" };
+const KeyboardLayout NorwegianLayout { "NO", "Norwegian" };
+const KeyboardLayout JapaneseLayout { "JP", "Japanese" };
+const KeyboardLayout USInternationalLayout { "US-INT", "US International" };
+const KeyboardLayout USInternationalAltLayout { "US-INT-ALT", "US International Alternative" };
+const KeyboardLayout SwissGLayout { "CH-DE", "Swiss German" };
+const KeyboardLayout SwissFLayout { "CH-FR", "Swiss French" };
+const KeyboardLayout DanishLayout { "DK", "Danish" };
+const KeyboardLayout SwedishLayout { "SE", "Swedish" };
+const KeyboardLayout PortugueseLayout { "PT", "Portuguese" };
+const KeyboardLayout BrazilianPortugueseLayout { "BR", "Brazilian Portuguese" };
+const KeyboardLayout DvorakLayout { "DVORAK", "Dvorak" };
+
+struct CodePage {
+	uint16_t codepage;
+};
+
+struct CodePages {
+	static CodePage const * get(uint16_t codepage) {
+		static const CodePage page { 1252 };
+		return &page;
+	}
+};
+
+class Keyboard {
+	public:
+		void setLayout(KeyboardLayout const * layout) {}
+		void setCodePage(CodePage const * codepage) {}
+		void setTypematicRateAndDelay(int repeatRateMS, int repeatDelayMS) {}
+		bool getNextVirtualKey(VirtualKeyItem * item, int timeOutMS = -1) {
+			*item = VirtualKeyItem();
+			return false;
+		}
+		bool setLEDs(bool numLock, bool capsLock, bool scrollLock) {
+			this->numLock = numLock;
+			this->capsLock = capsLock;
+			this->scrollLock = scrollLock;
+			return true;
+		}
+		void getLEDs(bool * numLock, bool * capsLock, bool * scrollLock) {
+			*numLock = this->numLock;
+			*capsLock = this->capsLock;
+			*scrollLock = this->scrollLock;
+		}
+
+	private:
+		bool numLock = false;
+		bool capsLock = false;
+		bool scrollLock = false;
+};
+
+// Mouse
+// Tests can queue deltas, which are then reported as if they came from a PS/2 mouse
+//
+struct MouseButtons {
+	uint8_t left : 1;
+	uint8_t middle : 1;
+	uint8_t right : 1;
+};
+
+struct MouseDelta {
+	int16_t deltaX;
+	int16_t deltaY;
+	int8_t deltaZ;
+	MouseButtons buttons;
+	uint8_t overflowX;
+	uint8_t overflowY;
+};
+
+struct MouseStatus {
+	int16_t X;
+	int16_t Y;
+	int8_t wheelDelta;
+	MouseButtons buttons;
+};
+
+class Mouse {
+	public:
+		bool isMouseAvailable() {
+			return available;
+		}
+		void suspendPort() {}
+		void resumePort() {}
+		bool reset() {
+			return true;
+		}
+		bool setSampleRate(int rate) {
+			return true;
+		}
+		bool setResolution(int resolution) {
+			return true;
+		}
+		bool setScaling(int scaling) {
+			return true;
+		}
+		int &movementAcceleration() {
+			return acceleration;
+		}
+		int &wheelAcceleration() {
+			return wheelAcc;
+		}
+		void setupAbsolutePositioner(int width, int height, bool createAbsolutePositioner, BitmappedDisplayController * display = nullptr) {
+			areaWidth = width;
+			areaHeight = height;
+		}
+		void terminateAbsolutePositioner() {}
+		MouseStatus &status() {
+			return currentStatus;
+		}
+		bool deltaAvailable() {
+			return !deltas.empty();
+		}
+		bool getNextDelta(MouseDelta * delta, int timeOutMS = -1, bool requestResendOnTimeOut = false) {
+			if (deltas.empty()) {
+				return false;
+			}
+			*delta = deltas.front();
+			deltas.pop_front();
+			return true;
+		}
+		void updateAbsolutePosition(MouseDelta * delta) {
+			currentStatus.X = std::min(std::max(currentStatus.X + delta->deltaX, 0), std::max(areaWidth - 1, 0));
+			currentStatus.Y = std::min(std::max(currentStatus.Y - delta->deltaY, 0), std::max(areaHeight - 1, 0));
+			currentStatus.wheelDelta = delta->deltaZ;
+			currentStatus.buttons = delta->buttons;
+		}
+
+		// Host interface
+		void setAvailable(bool value) {
+			available = value;
+		}
+		void queueDelta(MouseDelta const &delta) {
+			deltas.push_back(delta);
+		}
+
+	private:
+		bool available = true;
+		int acceleration = 180;
+		int wheelAcc = 60000;
+		int areaWidth = 0;
+		int areaHeight = 0;
+		MouseStatus currentStatus = {};
+		std::deque<MouseDelta> deltas;
+};
+
+class PS2Controller {
+	public:
+		static void begin() {}
+		static Keyboard * keyboard() {
+			static Keyboard instance;
+			return &instance;
+		}
+		static Mouse * mouse() {
+			static Mouse instance;
+			return &instance;
+		}
+};
+
+// Sound
+// Waveforms are generated on demand, but nothing plays them
+//
+class WaveformGenerator {
+	public:
+		virtual ~WaveformGenerator() {}
+
+		virtual void setFrequency(int value) = 0;
+		virtual int getSample() = 0;
+		virtual void setSampleRate(int value) {
+			m_sampleRate = value;
+		}
+
+		int sampleRate() {
+			return m_sampleRate;
+		}
+		void enable(bool value) {
+			m_enabled = value;
+		}
+		bool enabled() {
+			return m_enabled;
+		}
+		void setVolume(int value) {
+			m_volume = value;
+		}
+		int volume() {
+			return m_volume;
+		}
+		void setDuration(uint32_t value) {
+			m_duration = value;
+		}
+		uint32_t duration() {
+			return m_duration;
+		}
+		void decDuration() {
+			if (m_duration != 0 && m_duration != (uint32_t)-1) {
+				m_duration--;
+			}
+		}
+
+	private:
+		int m_sampleRate = 16000;
+		int m_volume = 100;
+		bool m_enabled = false;
+		uint32_t m_duration = (uint32_t)-1;
+};
+
+class SimpleWaveformGenerator : public WaveformGenerator {
+	public:
+		void setFrequency(int value) override {
+			frequency = value;
+		}
+		int getSample() override {
+			return 0;
+		}
+
+	protected:
+		int frequency = 0;
+};
+
+class SineWaveformGenerator : public SimpleWaveformGenerator {};
+class TriangleWaveformGenerator : public SimpleWaveformGenerator {};
+class SawtoothWaveformGenerator : public SimpleWaveformGenerator {};
+class NoiseWaveformGenerator : public SimpleWaveformGenerator {};
+class VICNoiseGenerator : public SimpleWaveformGenerator {};
+class SquareWaveformGenerator : public SimpleWaveformGenerator {
+	public:
+		void setDutyCycle(int dutyCycle) {
+			this->dutyCycle = dutyCycle;
+		}
+
+	private:
+		int dutyCycle = 127;
+};
+
+class SoundGenerator {
+	public:
+		SoundGenerator(int sampleRate = 16000) : rate(sampleRate) {}
+
+		bool play(bool value) {
+			auto previous = playing;
+			playing = value;
+			return previous;
+		}
+		void clear() {
+			waveforms.clear();
+		}
+		void attach(WaveformGenerator * waveform) {
+			waveform->setSampleRate(rate);
+			waveforms.push_back(waveform);
+		}
+		void detach(WaveformGenerator * waveform) {
+			waveforms.erase(std::remove(waveforms.begin(), waveforms.end(), waveform), waveforms.end());
+		}
+		void setVolume(int value) {
+			level = value;
+		}
+		int volume() {
+			return level;
+		}
+
+	private:
+		int rate;
+		int level = 127;
+		bool playing = false;
+		std::vector<WaveformGenerator *> waveforms;
+};
+
+} // namespace fabgl
+
+using namespace fabgl;
+
+#endif // HOST_FABGL_H
@@ -0,0 +1,177 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+// Host stand-in for the FreeRTOS calls used by the VDP
+// By default there is only ever one task, so task creation fails, which makes callers use their single task fallbacks
+// Blocking calls then return straight away, advancing the clock by their timeout
+// Notifications are counted for the one task, so a wait after a notification returns without blocking
+//
+// Tests that need real concurrency can turn on hostThreadedTasks, after which created tasks run on threads
+// of their own, and waits really block until notified or timed out
+// Tasks never end, so anything a task uses must be kept alive for the rest of the run
+//
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void * TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+struct portMUX_TYPE {
+	uint32_t owner;
+	uint32_t count;
+};
+
+// All critical sections share one lock, which is plenty for the host
+inline std::recursive_mutex &hostCriticalLock() {
+	static std::recursive_mutex lock;
+	return lock;
+}
+
+#define configTICK_RATE_HZ				1000
+#define portTICK_PERIOD_MS				(1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY					((TickType_t)0xFFFFFFFF)
+#define portMUX_INITIALIZER_UNLOCKED	{ 0, 0 }
+#define portENTER_CRITICAL(mux)			((void)(mux), hostCriticalLock().lock())
+#define portEXIT_CRITICAL(mux)			((void)(mux), hostCriticalLock().unlock())
+#define portENTER_CRITICAL_ISR(mux)		portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux)		portEXIT_CRITICAL(mux)
+#define pdMS_TO_TICKS(ms)				((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define pdTRUE							1
+#define pdFALSE							0
+#define pdPASS							1
+#define pdFAIL							0
+
+struct HostTask {
+	std::mutex					lock;
+	std::condition_variable		wake;
+	uint32_t					notifications = 0;
+};
+
+inline HostTask &hostMainTask() {
+	static HostTask task;
+	return task;
+}
+
+inline HostTask *&hostCurrentTask() {
+	static thread_local HostTask * task = &hostMainTask();
+	return task;
+}
+
+// Whether created tasks get threads of their own
+inline bool &hostThreadedTasks() {
+	static bool threaded = false;
+	return threaded;
+}
+
+// Microseconds added to the host clock by waits
+inline std::atomic<uint64_t> &hostClockSkew() {
+	static std::atomic<uint64_t> skew { 0 };
+	return skew;
+}
+
+// Number of waits by the main task that blocked, for tests checking a task sleeps rather than spins
+inline uint32_t &hostWaitCount() {
+	static uint32_t count = 0;
+	return count;
+}
+
+inline uint32_t &hostNotifyCount() {
+	return hostMainTask().notifications;
+}
+
+uint64_t host_micros();
+
+inline TickType_t xTaskGetTickCount() {
+	return (TickType_t)(host_micros() / (1000000 / configTICK_RATE_HZ));
+}
+
+inline TickType_t xTaskGetTickCountFromISR() {
+	return xTaskGetTickCount();
+}
+
+inline void vTaskDelay(TickType_t ticks) {
+	if (hostThreadedTasks() || hostCurrentTask() != &hostMainTask()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+		return;
+	}
+	hostClockSkew() += (uint64_t)ticks * (1000000 / configTICK_RATE_HZ);
+}
+
+inline TaskHandle_t xTaskGetCurrentTaskHandle() {
+	return hostCurrentTask();
+}
+
+inline BaseType_t xPortGetCoreID() {
+	return 1;
+}
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char * name, uint32_t stackDepth,
+	void * parameter, UBaseType_t priority, TaskHandle_t * handle, BaseType_t core) {
+	if (!hostThreadedTasks()) {
+		if (handle) {
+			*handle = nullptr;
+		}
+		return pdFAIL;
+	}
+	auto task = new HostTask();
+	if (handle) {
+		*handle = task;
+	}
+	std::thread([=]() {
+		hostCurrentTask() = task;
+		function(parameter);
+	}).detach();
+	return pdPASS;
+}
+
+inline void vTaskDelete(TaskHandle_t task) {}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t timeout) {
+	auto &task = *hostCurrentTask();
+	std::unique_lock<std::mutex> lock(task.lock);
+	if (!task.notifications) {
+		if (&task == &hostMainTask()) {
+			hostWaitCount()++;
+		}
+		auto notified = [&]() { return task.notifications != 0; };
+		if (!hostThreadedTasks() && &task == &hostMainTask()) {
+			// nothing else can run, so just move the clock on
+			if (timeout != portMAX_DELAY) {
+				hostClockSkew() += (uint64_t)timeout * (1000000 / configTICK_RATE_HZ);
+			}
+		} else if (timeout == portMAX_DELAY) {
+			task.wake.wait(lock, notified);
+		} else {
+			task.wake.wait_for(lock, std::chrono::milliseconds(timeout * portTICK_PERIOD_MS), notified);
+		}
+	}
+	auto value = task.notifications;
+	if (value) {
+		task.notifications = clearOnExit ? 0 : value - 1;
+	}
+	return value;
+}
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t handle) {
+	if (handle) {
+		auto task = (HostTask *)handle;
+		std::lock_guard<std::mutex> lock(task->lock);
+		task->notifications++;
+		task->wake.notify_one();
+	}
+	return pdPASS;
+}
+
+inline void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t * higherPriorityTaskWoken) {
+	xTaskNotifyGive(task);
+}
+
+#endif // HOST_FREERTOS_H
@@ -0,0 +1,83 @@
+#ifndef HOST_MAT_H
+#define HOST_MAT_H
+
+// Host stand-in for the esp-dsp matrix class, implementing only what the VDP uses
+//
+
+#include <cmath>
+#include <cstring>
+
+namespace dspm {
+
+class Mat {
+	public:
+		int rows;
+		int cols;
+		float * data;
+
+		Mat(float * data, int rows, int cols) : rows(rows), cols(cols), data(data), owned(false) {}
+		Mat(int rows, int cols) : rows(rows), cols(cols), data(new float[rows * cols]()), owned(true) {}
+		Mat(const Mat &other) : rows(other.rows), cols(other.cols), data(new float[other.rows * other.cols]), owned(true) {
+			memcpy(data, other.data, sizeof(float) * rows * cols);
+		}
+		~Mat() {
+			if (owned) {
+				delete[] data;
+			}
+		}
+		Mat &operator=(const Mat &other) = delete;
+
+		float &operator()(int row, int col) {
+			return data[row * cols + col];
+		}
+		const float &operator()(int row, int col) const {
+			return data[row * cols + col];
+		}
+
+		// Gauss-Jordan inversion, giving an all-zero matrix if there is no inverse
+		Mat inverse() {
+			Mat result(rows, cols);
+			Mat work(*this);
+			for (int i = 0; i < rows; i++) {
+				result(i, i) = 1;
+			}
+			for (int col = 0; col < cols; col++) {
+				int pivot = col;
+				for (int row = col + 1; row < rows; row++) {
+					if (std::fabs(work(row, col)) > std::fabs(work(pivot, col))) {
+						pivot = row;
+					}
+				}
+				if (work(pivot, col) == 0) {
+					memset(result.data, 0, sizeof(float) * rows * cols);
+					return result;
+				}
+				for (int i = 0; i < cols; i++) {
+					std::swap(work(col, i), work(pivot, i));
+					std::swap(result(col, i), result(pivot, i));
+				}
+				float scale = work(col, col);
+				for (int i = 0; i < cols; i++) {
+					work(col, i) /= scale;
+					result(col, i) /= scale;
+				}
+				for (int row = 0; row < rows; row++) {
+					if (row != col) {
+						float factor = work(row, col);
+						for (int i = 0; i < cols; i++) {
+							work(row, i) -= factor * work(col, i);
+							result(row, i) -= factor * result(col, i);
+						}
+					}
+				}
+			}
+			return result;
+		}
+
+	private:
+		bool owned;
+};
+
+} // namespace dspm
+
+#endif // HOST_MAT_H
@@ -0,0 +1,8 @@
+#ifndef HOST_XTENSA_CORE_ISA_H
+#define HOST_XTENSA_CORE_ISA_H
+
+// Host stand-in for the Xtensa core configuration
+// Nothing is needed, as mem_helpers.h only uses these values when building for __XTENSA__
+//
+
+#endif // HOST_XTENSA_CORE_ISA_H
@@ -0,0 +1,74 @@
+#ifndef MEMORY_STREAM_H
+#define MEMORY_STREAM_H
+
+// A Stream over an in-memory VDU byte stream, for driving a VDUStreamProcessor on the host
+// Input is fed in ahead of time and can be rewound to replay it, and anything written is captured
+// It also offers the zero-copy span interface, as the serial ring stream does
+//
+
+#include <initializer_list>
+#include <vector>
+
+#include <Stream.h>
+
+#include "span_reader.h"
+
+class MemoryStream : public Stream, public SpanReader {
+	public:
+		std::vector<uint8_t> output;
+
+		void feed(const uint8_t * data, size_t length) {
+			input.insert(input.end(), data, data + length);
+		}
+		void feed(std::initializer_list<uint8_t> data) {
+			input.insert(input.end(), data.begin(), data.end());
+		}
+		void feed(const std::vector<uint8_t> &data) {
+			feed(data.data(), data.size());
+		}
+		// Read the input again from the start
+		void rewind() {
+			position = 0;
+		}
+		// Discard all input and output
+		void reset() {
+			input.clear();
+			output.clear();
+			position = 0;
+		}
+
+		using Stream::readBytes;
+
+		int available() override {
+			return input.size() - position;
+		}
+		int read() override {
+			return position < input.size() ? input[position++] : -1;
+		}
+		int peek() override {
+			return position < input.size() ? input[position] : -1;
+		}
+		size_t readBytes(char * buffer, size_t length) override {
+			auto count = std::min<size_t>(length, input.size() - position);
+			memcpy(buffer, input.data() + position, count);
+			position += count;
+			return count;
+		}
+		size_t write(uint8_t b) override {
+			output.push_back(b);
+			return 1;
+		}
+
+		tcb::span<const uint8_t> readableSpan() override {
+			return { input.data() + position, input.size() - position };
+		}
+		void commit(size_t count) override {
+			position += count;
+		}
+
+	private:
+		std::vector<uint8_t> input;
+		size_t position = 0;
+};
+
+#endif // MEMORY_STREAM_H
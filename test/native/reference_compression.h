@@ -0,0 +1,170 @@
+#ifndef REFERENCE_COMPRESSION_H
+#define REFERENCE_COMPRESSION_H
+
+// The original TurboVega compressor, which scans the whole window for every match,
+// and decompressor, which decodes a bit at a time
+// Kept as references, to check that faster versions give exactly the same output
+//
+
+#include <vector>
+
+#include "compression.h"
+
+namespace reference {
+
+struct Compressor {
+	std::vector<uint8_t>	output;
+	uint32_t				windowSize = 0;
+	uint32_t				windowWriteIndex = 0;
+	uint32_t				stringSize = 0;
+	uint32_t				stringReadIndex = 0;
+	uint32_t				stringWriteIndex = 0;
+	uint8_t					windowData[COMPRESSION_WINDOW_SIZE] = {};
+	uint8_t					stringData[COMPRESSION_STRING_SIZE] = {};
+	uint8_t					outByte = 0;
+	uint8_t					outBits = 0;
+
+	void writeBit(uint8_t bit) {
+		outByte = (outByte << 1) | bit;
+		if (++outBits >= 8) {
+			output.push_back(outByte);
+			outByte = 0;
+			outBits = 0;
+		}
+	}
+
+	void writeCode(uint8_t command, uint8_t value) {
+		writeBit(command >> 1);
+		writeBit(command & 1);
+		for (uint8_t bit = 0; bit < 8; bit++) {
+			writeBit((value & 0x80) ? 1 : 0);
+			value <<= 1;
+		}
+	}
+
+	// Find the first window position matching the next size bytes of the string
+	int32_t find(uint32_t size) {
+		if (windowSize < size) {
+			return -1;
+		}
+		for (uint32_t start = 0; start <= windowSize - size; start++) {
+			uint32_t wi = start;
+			uint32_t si = stringReadIndex;
+			bool match = true;
+			for (uint32_t i = 0; i < size; i++) {
+				if (windowData[wi++] != stringData[si++]) {
+					match = false;
+					break;
+				}
+				wi &= (COMPRESSION_WINDOW_SIZE - 1);
+				si &= (COMPRESSION_STRING_SIZE - 1);
+			}
+			if (match) {
+				return start;
+			}
+		}
+		return -1;
+	}
+
+	void compressByte(uint8_t origByte) {
+		stringData[stringWriteIndex++] = origByte;
+		stringWriteIndex &= (COMPRESSION_STRING_SIZE - 1);
+		if (stringSize < COMPRESSION_STRING_SIZE) {
+			stringSize++;
+		} else {
+			stringReadIndex = (stringReadIndex + 1) & (COMPRESSION_STRING_SIZE - 1);
+		}
+		if (stringSize < 16) {
+			return;
+		}
+		auto start = find(16);
+		if (start >= 0) {
+			writeCode(3, start);
+			stringSize = 0;
+			return;
+		}
+		start = find(8);
+		if (start >= 0) {
+			writeCode(2, start);
+			stringSize -= 8;
+			stringReadIndex = (stringReadIndex + 8) & (COMPRESSION_STRING_SIZE - 1);
+			return;
+		}
+		start = find(4);
+		if (start >= 0) {
+			writeCode(1, start);
+			stringSize -= 4;
+			stringReadIndex = (stringReadIndex + 4) & (COMPRESSION_STRING_SIZE - 1);
+			return;
+		}
+		uint8_t oldByte = stringData[stringReadIndex++];
+		writeCode(0, oldByte);
+		stringSize--;
+		stringReadIndex &= (COMPRESSION_STRING_SIZE - 1);
+		windowData[windowWriteIndex++] = oldByte;
+		windowWriteIndex &= (COMPRESSION_WINDOW_SIZE - 1);
+		if (windowSize < COMPRESSION_WINDOW_SIZE) {
+			windowSize++;
+		}
+	}
+
+	void finish() {
+		while (stringSize) {
+			writeCode(0, stringData[stringReadIndex++]);
+			stringSize--;
+			stringReadIndex &= (COMPRESSION_STRING_SIZE - 1);
+		}
+		if (outBits) {
+			output.push_back(outByte << (8 - outBits));
+		}
+	}
+};
+
+std::vector<uint8_t> compress(const std::vector<uint8_t> &data) {
+	std::unique_ptr<Compressor> compressor(new Compressor());
+	for (auto value : data) {
+		compressor->compressByte(value);
+	}
+	compressor->finish();
+	return compressor->output;
+}
+
+// Decompress to at most origSize bytes
+std::vector<uint8_t> decompress(const std::vector<uint8_t> &data, uint32_t origSize) {
+	std::vector<uint8_t> output;
+	uint8_t windowData[COMPRESSION_WINDOW_SIZE] = {};
+	uint32_t windowWriteIndex = 0;
+	uint16_t code = 0;
+	uint8_t codeBits = 0;
+	for (auto compByte : data) {
+		for (uint8_t bit = 0; bit < 8; bit++) {
+			code = (code << 1) | ((compByte & 0x80) ? 1 : 0);
+			compByte <<= 1;
+			if (++codeBits < 10) {
+				continue;
+			}
+			uint8_t command = code >> 8;
+			uint8_t value = code;
+			code = 0;
+			codeBits = 0;
+			if (command == 0) {
+				windowData[windowWriteIndex++] = value;
+				windowWriteIndex &= (COMPRESSION_WINDOW_SIZE - 1);
+				if (output.size() < origSize) {
+					output.push_back(value);
+				}
+				continue;
+			}
+			uint32_t wi = value;
+			for (uint32_t i = 0; i < (2u << command) && output.size() < origSize; i++) {
+				output.push_back(windowData[wi++]);
+				wi &= (COMPRESSION_WINDOW_SIZE - 1);
+			}
+		}
+	}
+	return output;
+}
+
+} // namespace reference
+
+#endif // REFERENCE_COMPRESSION_H
@@ -0,0 +1,47 @@
+#ifndef REFERENCE_EXPAND_BITMAP_H
+#define REFERENCE_EXPAND_BITMAP_H
+
+// The original bitmap expansion loop, which gathers each pixel a bit at a time
+// Kept as a reference, to check that the table driven version gives exactly the same output
+//
+// This returns every pixel the loop produces, however many that is
+// The original sized its output with (pixelSize * width + 8 - pixelSize) / 8 bytes per aligned row,
+// which is less than the loop consumes for 3, 5, 6 and 7 bit pixels, and it expanded any trailing partial row,
+// so only whole rows, of (pixelSize * width + 7) / 8 bytes, are expected to match
+//
+
+#include <vector>
+
+namespace reference {
+
+std::vector<uint8_t> expandBitmap(const std::vector<uint8_t> &source, uint8_t pixelSize, bool aligned, int16_t width,
+	const uint8_t * mapValues) {
+	std::vector<uint8_t> output;
+	output.reserve(source.size() * 8 / pixelSize);
+	uint8_t bit = 0;
+	uint8_t pixel = 0;
+	uint16_t pixelCount = 0;
+	for (auto value : source) {
+		for (uint8_t i = 0; i < 8; i++) {
+			pixel = (pixel << 1) | ((value >> (7 - i)) & 1);
+			bit++;
+			if (bit == pixelSize) {
+				bit = 0;
+				output.push_back(mapValues[pixel]);
+				pixel = 0;
+				if (aligned) {
+					if (++pixelCount == width) {
+						// byte align
+						pixelCount = 0;
+						break;
+					}
+				}
+			}
+		}
+	}
+	return output;
+}
+
+} // namespace reference
+
+#endif // REFERENCE_EXPAND_BITMAP_H
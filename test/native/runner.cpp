@@ -0,0 +1,56 @@
+// Host test and benchmark runner
+// Builds the VDP for the host, as a single translation unit as the sketch does,
+// and runs every registered test and benchmark whose name contains the filter
+//
+// Usage: runner [--tests | --benchmarks] [filter]
+//
+
+#include "host_vdp.h"
+#include "runner.h"
+
+#include "test_vdu.h"
+#include "test_trace.h"
+#include "test_serial.h"
+#include "test_render.h"
+#include "test_tx.h"
+#include "test_mouse.h"
+#include "test_buffers.h"
+#include "test_seek.h"
+#include "test_adjust.h"
+#include "test_blit.h"
+#include "test_slices.h"
+#include "test_compiled.h"
+#include "test_pool.h"
+#include "test_compression.h"
+#include "test_expand.h"
+
+int main(int argc, char ** argv) {
+	bool runTests = true;
+	bool runBenchmarks = true;
+	const char * filter = "";
+	for (auto i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--tests") == 0) {
+			runBenchmarks = false;
+		} else if (strcmp(argv[i], "--benchmarks") == 0) {
+			runTests = false;
+		} else {
+			filter = argv[i];
+		}
+	}
+
+	uint32_t run = 0;
+	for (auto &hostCase : hostCases()) {
+		if ((hostCase.isBenchmark ? !runBenchmarks : !runTests) || !strstr(hostCase.name, filter)) {
+			continue;
+		}
+		auto failures = hostFailures();
+		printf("%s\n", hostCase.name);
+		hostCase.fn();
+		if (hostFailures() == failures && !hostCase.isBenchmark) {
+			printf("  ok\n");
+		}
+		run++;
+	}
+	printf("%u run, %u failed\n", run, hostFailures());
+	return hostFailures() ? 1 : 0;
+}
@@ -0,0 +1,93 @@
+#ifndef RUNNER_H
+#define RUNNER_H
+
+// Minimal test and benchmark registry for the host build
+// TEST and BENCHMARK define functions that register themselves by name, and runner.cpp runs them
+// CHECK records a failure and returns from the current test
+// benchmark() times a piece of work and reports its throughput
+//
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+struct HostCase {
+	const char *	name;
+	void			(*fn)();
+	bool			isBenchmark;
+};
+
+inline std::vector<HostCase> &hostCases() {
+	static std::vector<HostCase> cases;
+	return cases;
+}
+
+inline uint32_t &hostFailures() {
+	static uint32_t failures = 0;
+	return failures;
+}
+
+struct HostCaseRegistration {
+	HostCaseRegistration(const char * name, void (*fn)(), bool isBenchmark) {
+		hostCases().push_back({ name, fn, isBenchmark });
+	}
+};
+
+#define HOST_CASE(name, isBenchmark) \
+	static void name(); \
+	static HostCaseRegistration name##_registration(#name, name, isBenchmark); \
+	static void name()
+
+#define TEST(name)		HOST_CASE(test_##name, false)
+#define BENCHMARK(name)	HOST_CASE(bench_##name, true)
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			printf("  FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition); \
+			hostFailures()++; \
+			return; \
+		} \
+	} while (0)
+
+#define CHECK_EQ(actual, expected) \
+	do { \
+		auto _actual = (actual); \
+		auto _expected = (expected); \
+		if (!(_actual == _expected)) { \
+			printf("  FAILED %s:%d: %s == %s (got %lld, expected %lld)\n", __FILE__, __LINE__, #actual, #expected, \
+				(long long)_actual, (long long)_expected); \
+			hostFailures()++; \
+			return; \
+		} \
+	} while (0)
+
+// Run fn repeatedly for at least minimumMs of wall time, and report throughput
+// bytes and commands are the amount of work done by one call of fn; either may be zero
+//
+template<typename F>
+void benchmark(const char * label, uint64_t bytes, uint64_t commands, F fn, uint32_t minimumMs = 200) {
+	using Clock = std::chrono::steady_clock;
+	fn();		// warm up, so allocations made on first use aren't counted
+	uint64_t iterations = 0;
+	auto start = Clock::now();
+	auto elapsed = Clock::duration::zero();
+	do {
+		fn();
+		iterations++;
+		elapsed = Clock::now() - start;
+	} while (elapsed < std::chrono::milliseconds(minimumMs));
+
+	double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+	printf("  %-40s %10.0f ns/iter", label, ns / iterations);
+	if (bytes) {
+		printf(" %12.0f bytes/sec", (bytes * iterations) / (ns / 1e9));
+	}
+	if (commands) {
+		printf(" %8.1f ns/command", ns / (commands * iterations));
+	}
+	printf("\n");
+}
+
+#endif // RUNNER_H
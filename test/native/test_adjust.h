@@ -0,0 +1,106 @@
+#ifndef TEST_ADJUST_H
+#define TEST_ADJUST_H
+
+// Strided and masked buffer adjustments
+//
+
+#include <vector>
+
+#include "host_vdp.h"
+#include "runner.h"
+#include "test_buffers.h"
+#include "test_vdu.h"
+
+// Build a strided adjust, which is masked when mask isn't empty
+std::vector<uint8_t> makeAdjustStrided(uint16_t bufferId, uint8_t operation, uint16_t offset, uint16_t count,
+	uint8_t width, uint16_t stride, const std::vector<uint8_t> &mask, const std::vector<uint8_t> &operand) {
+	std::vector<uint8_t> command = { 23, 0, 0xA0 };
+	pushWord(command, bufferId);
+	command.push_back(mask.empty() ? BUFFERED_ADJUST_STRIDED : BUFFERED_ADJUST_MASKED);
+	command.push_back(operation);
+	pushWord(command, offset);
+	pushWord(command, count);
+	command.push_back(width);
+	pushWord(command, stride);
+	command.insert(command.end(), mask.begin(), mask.end());
+	command.insert(command.end(), operand.begin(), operand.end());
+	return command;
+}
+
+std::vector<uint8_t> readBuffer(uint16_t bufferId) {
+	std::vector<uint8_t> data;
+	auto blocks = buffers.get(bufferId);
+	if (blocks) {
+		for (auto &block : *blocks) {
+			data.insert(data.end(), block->getBuffer(), block->getBuffer() + block->size());
+		}
+	}
+	return data;
+}
+
+TEST(adjust_strided_adds_to_each_element) {
+	hostSetup();
+	HostProcessor host;
+	host.run(makeBufferClear(0x400));
+	host.run(makeBufferWrite(0x400, std::vector<uint8_t>(16, 0x10)));
+	host.run(makeAdjustStrided(0x400, ADJUST_ADD, 3, 4, 1, 4, {}, { 0x05 }));
+	auto data = readBuffer(0x400);
+	for (auto i = 0; i < 16; i++) {
+		CHECK_EQ(data[i], (i % 4 == 3) ? 0x15 : 0x10);
+	}
+	host.run(makeBufferClear(0x400));
+}
+
+TEST(adjust_masked_changes_masked_bits) {
+	hostSetup();
+	HostProcessor host;
+	host.run(makeBufferClear(0x401));
+	// two blocks, so one element straddles the boundary
+	host.run(makeBufferWrite(0x401, std::vector<uint8_t>(7, 0x33)));
+	host.run(makeBufferWrite(0x401, std::vector<uint8_t>(9, 0x33)));
+	host.run(makeAdjustStrided(0x401, ADJUST_XOR, 0, 5, 2, 3, { 0x0F, 0xF0 }, { 0xFF, 0xFF }));
+	auto data = readBuffer(0x401);
+	CHECK_EQ(data.size(), 16);
+	for (auto i = 0; i < 15; i++) {
+		auto expected = i % 3 == 0 ? 0x3C : i % 3 == 1 ? 0xC3 : 0x33;
+		CHECK_EQ(data[i], expected);
+	}
+	CHECK_EQ(data[15], 0x33);
+	host.run(makeBufferClear(0x401));
+}
+
+// Rejected adjustments still consume their operands, and leave the buffer alone
+TEST(adjust_strided_rejects_overflow) {
+	hostSetup();
+	HostProcessor host;
+	host.run(makeBufferClear(0x402));
+	host.run(makeBufferWrite(0x402, std::vector<uint8_t>(8, 0)));
+	host.run(makeAdjustStrided(0x402, ADJUST_SET | ADJUST_MULTI_OPERAND, 0, 3, 2, 4, {}, std::vector<uint8_t>(6, 0xAA)));
+	CHECK(host.stream->available() == 0);
+	CHECK(readBuffer(0x402) == std::vector<uint8_t>(8, 0));
+
+	// nothing to adjust, but the single operand is still there
+	host.run(makeAdjustStrided(0x402, ADJUST_SET, 0, 0, 2, 4, {}, { 0xAA, 0xAA }));
+	CHECK(host.stream->available() == 0);
+	CHECK(readBuffer(0x402) == std::vector<uint8_t>(8, 0));
+
+	// and the stream is still in step
+	host.run(makeAdjustStrided(0x402, ADJUST_SET | ADJUST_MULTI_OPERAND, 0, 2, 2, 4, {}, { 1, 2, 3, 4 }));
+	CHECK(readBuffer(0x402) == std::vector<uint8_t>({ 1, 2, 0, 0, 3, 4, 0, 0 }));
+	host.run(makeBufferClear(0x402));
+}
+
+// Adjust the alpha channel of a 128x64 RGBA8888 bitmap
+BENCHMARK(adjust_strided_alpha) {
+	hostSetup();
+	HostProcessor host;
+	host.run(makeBufferClear(0x403));
+	host.run(makeBufferWrite(0x403, std::vector<uint8_t>(128 * 64 * 4, 0x80)));
+	benchmarkStream("strided add, 1 element", makeAdjustStrided(0x403, ADJUST_ADD, 3, 1, 1, 4, {}, { 1 }), 1);
+	benchmarkStream("strided add, 8192 elements", makeAdjustStrided(0x403, ADJUST_ADD, 3, 8192, 1, 4, {}, { 1 }), 8192);
+	benchmarkStream("strided xor, 8192 elements", makeAdjustStrided(0x403, ADJUST_XOR, 3, 8192, 1, 4, {}, { 0xFF }), 8192);
+	benchmarkStream("masked xor, 8192 elements", makeAdjustStrided(0x403, ADJUST_XOR, 3, 8192, 1, 4, { 0xF0 }, { 0xFF }), 8192);
+	host.run(makeBufferClear(0x403));
+}
+
+#endif // TEST_ADJUST_H
@@ -0,0 +1,93 @@
+#ifndef TEST_BLIT_H
+#define TEST_BLIT_H
+
+// Rectangular blits between buffers
+//
+
+#include <vector>
+
+#include "host_vdp.h"
+#include "runner.h"
+#include "test_adjust.h"
+#include "test_buffers.h"
+#include "test_vdu.h"
+
+// Build a blit into an existing target, which is keyed when key isn't empty
+std::vector<uint8_t> makeBlit(uint16_t bufferId, uint16_t sourceBufferId, uint16_t sourceOffset, uint16_t sourcePitch,
+	uint16_t offset, uint16_t pitch, uint16_t width, uint16_t height, uint8_t bytesPerPixel, const std::vector<uint8_t> &key) {
+	std::vector<uint8_t> command = { 23, 0, 0xA0 };
+	pushWord(command, bufferId);
+	command.push_back(BUFFERED_BLIT);
+	command.push_back(key.empty() ? 0 : BLIT_TRANSPARENT);
+	pushWord(command, sourceBufferId);
+	pushWord(command, sourceOffset);
+	pushWord(command, sourcePitch);
+	pushWord(command, offset);
+	pushWord(command, pitch);
+	pushWord(command, width);
+	pushWord(command, height);
+	command.push_back(bytesPerPixel);
+	command.insert(command.end(), key.begin(), key.end());
+	return command;
+}
+
+// A buffer holding 0, 1, 2... over blocks of the given sizes
+void writeCountingBlocks(HostProcessor &host, uint16_t bufferId, const std::vector<uint8_t> &sizes) {
+	host.run(makeBufferClear(bufferId));
+	uint8_t value = 0;
+	for (auto size : sizes) {
+		std::vector<uint8_t> data;
+		for (auto i = 0; i < size; i++) {
+			data.push_back(value++);
+		}
+		host.run(makeBufferWrite(bufferId, data));
+	}
+}
+
+TEST(blit_skips_keyed_pixels) {
+	hostSetup();
+	HostProcessor host;
+	host.run(makeBufferClear(0x500));
+	host.run(makeBufferWrite(0x500, { 1, 2, 3, 4, 0, 6, 7, 8, 9, 0, 0, 0, 0, 14 }));
+	host.run(makeBufferClear(0x501));
+	host.run(makeBufferWrite(0x501, std::vector<uint8_t>(14, 0xEE)));
+	host.run(makeBlit(0x501, 0x500, 0, 14, 0, 14, 14, 1, 1, { 0 }));
+	CHECK(readBuffer(0x501) == std::vector<uint8_t>({ 1, 2, 3, 4, 0xEE, 6, 7, 8, 9, 0xEE, 0xEE, 0xEE, 0xEE, 14 }));
+	host.run(makeBufferClear(0x500));
+	host.run(makeBufferClear(0x501));
+}
+
+// Rows that overlap themselves within a buffer are copied as they were before the blit,
+// even where the row crosses blocks
+TEST(blit_overlapping_row_across_blocks) {
+	hostSetup();
+	HostProcessor host;
+	writeCountingBlocks(host, 0x502, { 5, 5, 6 });
+	host.run(makeBlit(0x502, 0x502, 0, 16, 3, 16, 10, 1, 1, {}));
+	CHECK(readBuffer(0x502) == std::vector<uint8_t>({ 0, 1, 2, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 13, 14, 15 }));
+
+	writeCountingBlocks(host, 0x502, { 5, 5, 6 });
+	host.run(makeBlit(0x502, 0x502, 4, 16, 2, 16, 5, 1, 2, { 8, 9 }));
+	CHECK(readBuffer(0x502) == std::vector<uint8_t>({ 0, 1, 4, 5, 6, 7, 6, 7, 10, 11, 12, 13, 12, 13, 14, 15 }));
+	host.run(makeBufferClear(0x502));
+}
+
+// Take a 64x64 rectangle from a 128x128 sheet of 1 byte pixels
+BENCHMARK(blit_sheet) {
+	hostSetup();
+	HostProcessor host;
+	host.run(makeBufferClear(0x503));
+	std::vector<uint8_t> sheet(128 * 128);
+	for (uint32_t i = 0; i < sheet.size(); i++) {
+		sheet[i] = (i % 7) ? i : 0;
+	}
+	host.run(makeBufferWrite(0x503, sheet));
+	host.run(makeBufferClear(0x504));
+	host.run(makeBufferWrite(0x504, std::vector<uint8_t>(64 * 64, 0)));
+	benchmarkStream("blit 64x64", makeBlit(0x504, 0x503, 32, 128, 0, 64, 64, 64, 1, {}), 64 * 64);
+	benchmarkStream("keyed blit 64x64", makeBlit(0x504, 0x503, 32, 128, 0, 64, 64, 64, 1, { 0 }), 64 * 64);
+	host.run(makeBufferClear(0x503));
+	host.run(makeBufferClear(0x504));
+}
+
+#endif // TEST_BLIT_H
@@ -0,0 +1,100 @@
+#ifndef TEST_BUFFERS_H
+#define TEST_BUFFERS_H
+
+// Buffer table
+//
+
+#include <vector>
+
+#include "host_vdp.h"
+#include "runner.h"
+#include "test_vdu.h"
+
+std::vector<uint8_t> makeBufferWrite(uint16_t bufferId, const std::vector<uint8_t> &data) {
+	std::vector<uint8_t> command = { 23, 0, 0xA0 };
+	pushWord(command, bufferId);
+	command.push_back(0);
+	pushWord(command, data.size());
+	command.insert(command.end(), data.begin(), data.end());
+	return command;
+}
+
+std::vector<uint8_t> makeBufferClear(uint16_t bufferId) {
+	std::vector<uint8_t> command = { 23, 0, 0xA0 };
+	pushWord(command, bufferId);
+	command.push_back(2);
+	return command;
+}
+
+TEST(buffer_table_create_and_erase) {
+	BufferTable table;
+	auto blocks = table.create(0x1234);
+	CHECK(blocks != nullptr);
+	CHECK(table.create(0x1234) == blocks);
+	CHECK(table.get(0x1234) == blocks);
+	CHECK(table.get(0x1235) == nullptr);
+	CHECK_EQ(table.size(), 1);
+	table.erase(0x1234);
+	CHECK(table.get(0x1234) == nullptr);
+	CHECK_EQ(table.size(), 0);
+}
+
+// Creating a buffer in a new page fails cleanly if the page can't be allocated,
+// and the command's data is still consumed
+TEST(buffer_write_out_of_memory) {
+	hostSetup();
+	HostProcessor host;
+	host.run(makeBufferClear(0x7700));
+	hostPsramLimit() = 8192;
+	host.run(makeBufferWrite(0x7700, { 1, 2, 3, 4 }));
+	hostPsramLimit() = SIZE_MAX;
+	CHECK(buffers.get(0x7700) == nullptr);
+	CHECK(host.stream->available() == 0);
+
+	host.run(makeBufferWrite(0x7700, { 1, 2, 3, 4 }));
+	auto blocks = buffers.get(0x7700);
+	CHECK(blocks != nullptr);
+	CHECK_EQ(blocks->size(), 1);
+	host.run(makeBufferClear(0x7700));
+}
+
+BENCHMARK(buffer_table_lookup) {
+	BufferTable table;
+	for (uint32_t id = 0; id < 1024; id++) {
+		table.create(id * 61);
+	}
+	uint32_t found = 0;
+	benchmark("get, 1024 buffers over many pages", 0, 1024, [&]() {
+		for (uint32_t id = 0; id < 1024; id++) {
+			found += table.get(id * 61) != nullptr;
+		}
+	});
+	CHECK(found > 0);
+}
+
+BENCHMARK(buffer_table_create_erase) {
+	BufferTable table;
+	benchmark("create and erase, 256 buffers", 0, 512, [&]() {
+		for (uint32_t id = 0; id < 256; id++) {
+			table.create(0x4000 + id);
+		}
+		for (uint32_t id = 0; id < 256; id++) {
+			table.erase(0x4000 + id);
+		}
+	});
+}
+
+BENCHMARK(buffer_write_clear) {
+	std::vector<uint8_t> data;
+	for (uint16_t id = 0x5000; id < 0x5040; id++) {
+		auto write = makeBufferWrite(id, std::vector<uint8_t>(32, 0x55));
+		data.insert(data.end(), write.begin(), write.end());
+	}
+	for (uint16_t id = 0x5000; id < 0x5040; id++) {
+		auto clear = makeBufferClear(id);
+		data.insert(data.end(), clear.begin(), clear.end());
+	}
+	benchmarkStream("write and clear 64 buffers", data);
+}
+
+#endif // TEST_BUFFERS_H
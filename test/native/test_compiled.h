@@ -0,0 +1,143 @@
+#ifndef TEST_COMPILED_H
+#define TEST_COMPILED_H
+
+// Compiled buffers
+// A compiled buffer must draw exactly what interpreting it would, and must be recompiled whenever its data changes
+//
+
+#include <vector>
+
+#include "host_vdp.h"
+#include "runner.h"
+#include "test_adjust.h"
+#include "test_buffers.h"
+#include "test_render.h"
+#include "test_slices.h"
+#include "test_vdu.h"
+
+std::vector<uint8_t> makeBufferCall(uint16_t bufferId) {
+	std::vector<uint8_t> command = { 23, 0, 0xA0 };
+	pushWord(command, bufferId);
+	command.push_back(BUFFERED_CALL);
+	return command;
+}
+
+// Call a buffer, interpreted or compiled, and return what it drew
+std::vector<RGB888> callBuffer(HostProcessor &host, uint16_t bufferId, bool compiled) {
+	if (compiled) {
+		setTestFlag(TEST_FLAG_COMPILED_BUFFERS, 1);
+	}
+	host.run(makeBufferCall(bufferId));
+	host.vdu->flushRenderQueue();
+	clearTestFlag(TEST_FLAG_COMPILED_BUFFERS);
+	return snapshotCanvas();
+}
+
+// Commands that set the colours and clear the screen, so a buffer starting with them draws the same on every call
+// VDU 20 doesn't reset the text colour, so can't be used for this
+std::vector<uint8_t> withReset(std::initializer_list<uint8_t> commands) {
+	std::vector<uint8_t> data = { 17, 15, 17, 128, 18, 0, 15, 18, 0, 128, 12 };
+	data.insert(data.end(), commands);
+	return data;
+}
+
+// Check a buffer draws the same compiled as interpreted, on both its first call, which compiles it, and a later one
+void checkCompiledMatches(HostProcessor &host, uint16_t bufferId) {
+	auto expected = callBuffer(host, bufferId, false);
+	CHECK(buffers.getCompiled(bufferId) == nullptr);
+	CHECK(callBuffer(host, bufferId, true) == expected);
+	CHECK(buffers.getCompiled(bufferId) != nullptr);
+	CHECK(callBuffer(host, bufferId, true) == expected);
+}
+
+// Text, colours, plots, and fixed-length VDU 23 commands, all of which compile
+std::vector<uint8_t> makeMixedCommands() {
+	auto data = withReset({ 'H', 'e', 'l', 'l', 'o', 17, 2, 'W', 'o', 'r', 'l', 'd', 18, 0, 3 });
+	data.insert(data.end(), { 25, 4 });
+	pushWord(data, 100);
+	pushWord(data, 100);
+	data.insert(data.end(), { 25, 5 });
+	pushWord(data, 900);
+	pushWord(data, 700);
+	data.insert(data.end(), { 25, 0x55 });
+	pushWord(data, 300);
+	pushWord(data, 900);
+	data.insert(data.end(), { 23, 1, 0, 31, 5, 10, 'X', 23, 1, 1, 13, 10, 17, 1, 'E', 'n', 'd', 20 });
+	return data;
+}
+
+TEST(compiled_matches_interpreted) {
+	hostSetup();
+	HostProcessor host;
+	host.run(makeBufferClear(0x600));
+	auto data = makeMixedCommands();
+	host.run(makeBufferWrite(0x600, data));
+	checkCompiledMatches(host, 0x600);
+	CHECK_EQ(buffers.getCompiled(0x600)->length, data.size());
+	host.run(makeBufferClear(0x600));
+}
+
+// Compilation stops at a VDU 23, 27 command, and the rest of the buffer is interpreted
+TEST(compiled_stops_at_uncompilable_command) {
+	hostSetup();
+	HostProcessor host;
+	host.run(makeBufferClear(0x601));
+	auto data = withReset({ 'A', 'B', 23, 27, 0x20, 0x01, 0x06, 'C', 17, 3, 'D', 20 });
+	host.run(makeBufferWrite(0x601, data));
+	checkCompiledMatches(host, 0x601);
+	CHECK_EQ(buffers.getCompiled(0x601)->length, data.size() - 10);
+	host.run(makeBufferClear(0x601));
+}
+
+// VDU 27 prints the next byte, and then any text following it, so consumes more than its compiled length
+// The rest of the buffer is then interpreted from wherever it got to
+TEST(compiled_falls_back_when_command_length_differs) {
+	hostSetup();
+	HostProcessor host;
+	host.run(makeBufferClear(0x602));
+	auto data = withReset({ 27, 1, 'B', 'C', 'D', 17, 1, 'E', 27, 27, 'F', 20 });
+	host.run(makeBufferWrite(0x602, data));
+	checkCompiledMatches(host, 0x602);
+	CHECK_EQ(buffers.getCompiled(0x602)->length, data.size());
+	host.run(makeBufferClear(0x602));
+}
+
+// Writing, adjusting, splitting or clearing the called buffer discards its compiled copy,
+// and the next call draws the new commands
+TEST(compiled_invalidated_by_changes) {
+	hostSetup();
+	HostProcessor host;
+	host.run(makeBufferClear(0x603));
+	auto data = makeMixedCommands();
+	host.run(makeBufferWrite(0x603, data));
+	checkCompiledMatches(host, 0x603);
+
+	// write another block
+	host.run(makeBufferWrite(0x603, { 'M', 'o', 'r', 'e' }));
+	CHECK(buffers.getCompiled(0x603) == nullptr);
+	checkCompiledMatches(host, 0x603);
+
+	// move the end of the first line
+	auto before = callBuffer(host, 0x603, true);
+	host.run(makeBufferSetByte(0x603, 34, 0x10));
+	CHECK(buffers.getCompiled(0x603) == nullptr);
+	checkCompiledMatches(host, 0x603);
+	CHECK(callBuffer(host, 0x603, true) != before);
+
+	// split into blocks, leaving the commands as they were
+	host.run(makeBufferSplitFrom(0x603, 7, 0x603));
+	CHECK(buffers.getCompiled(0x603) == nullptr);
+	checkCompiledMatches(host, 0x603);
+
+	host.run(makeBufferClear(0x603));
+	CHECK(buffers.getCompiled(0x603) == nullptr);
+	CHECK(buffers.get(0x603) == nullptr);
+}
+
+BENCHMARK(vdu_buffered_call_compiled) {
+	setTestFlag(TEST_FLAG_COMPILED_BUFFERS, 1);
+	benchmarkBufferedCall("buffered call, compiled");
+	clearTestFlag(TEST_FLAG_COMPILED_BUFFERS);
+}
+
+#endif // TEST_COMPILED_H
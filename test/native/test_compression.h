@@ -0,0 +1,444 @@
+#ifndef TEST_COMPRESSION_H
+#define TEST_COMPRESSION_H
+
+// Compression and decompression, checked against reference implementations and round trips
+//
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "host_vdp.h"
+#include "reference_compression.h"
+#include "runner.h"
+#include "test_adjust.h"
+#include "test_buffers.h"
+#include "test_vdu.h"
+
+// A bitmap of width x height RGBA2222 pixels, with flat areas, gradients and repeated shapes, as sprites tend to have
+std::vector<uint8_t> makeSampleBitmap(uint32_t width, uint32_t height) {
+	std::vector<uint8_t> data(width * height);
+	for (uint32_t y = 0; y < height; y++) {
+		for (uint32_t x = 0; x < width; x++) {
+			uint8_t value = 0xC0;
+			auto dx = (int32_t)(x % 32) - 16;
+			auto dy = (int32_t)(y % 32) - 16;
+			if (dx * dx + dy * dy < 100) {
+				value |= ((x / 32 + y / 32) & 0x3F) | 0x01;
+			} else if (y > height * 3 / 4) {
+				value |= (x * 4 / width) << 4;
+			}
+			data[y * width + x] = value;
+		}
+	}
+	return data;
+}
+
+// Bytes that rarely repeat, the worst case for compression
+std::vector<uint8_t> makeNoise(uint32_t size) {
+	std::vector<uint8_t> data(size);
+	uint32_t state = 12345;
+	for (auto &value : data) {
+		state = state * 1103515245 + 12345;
+		value = state >> 16;
+	}
+	return data;
+}
+
+static void vector_write_compressed_byte(void* p_cd, uint8_t comp_byte) {
+	auto cd = (CompressionData*) p_cd;
+	((std::vector<uint8_t>*) cd->context)->push_back(comp_byte);
+}
+
+std::vector<uint8_t> turboCompress(const std::vector<uint8_t> &data) {
+	std::vector<uint8_t> output;
+	std::unique_ptr<CompressionData> cd(new CompressionData());
+	agon_init_compression(cd.get(), &output, &vector_write_compressed_byte);
+	for (auto value : data) {
+		agon_compress_byte(cd.get(), value);
+	}
+	agon_finish_compression(cd.get());
+	return output;
+}
+
+std::vector<std::vector<uint8_t>> sampleData() {
+	std::vector<std::vector<uint8_t>> samples;
+	samples.push_back(makeSampleBitmap(128, 96));
+	samples.push_back(makeNoise(5000));
+	samples.push_back(std::vector<uint8_t>(3000, 0x55));
+	std::vector<uint8_t> text;
+	while (text.size() < 4000) {
+		const char * line = "The quick brown fox jumps over the lazy dog. 0123456789\r\n";
+		text.insert(text.end(), line, line + strlen(line));
+	}
+	samples.push_back(text);
+	samples.push_back({ 1, 2, 3 });
+	samples.push_back({});
+	return samples;
+}
+
+// Decompress, passing the data in blocks of blockSize bytes
+std::vector<uint8_t> turboDecompress(const std::vector<uint8_t> &data, uint32_t origSize, uint32_t blockSize) {
+	std::vector<uint8_t> output(origSize);
+	std::unique_ptr<DecompressionData> dd(new DecompressionData());
+	agon_init_decompression(dd.get(), origSize);
+	for (uint32_t offset = 0; offset < data.size(); offset += blockSize) {
+		auto size = std::min<uint32_t>(blockSize, data.size() - offset);
+		if (!agon_decompress_block(dd.get(), data.data() + offset, size, output.data())) {
+			break;
+		}
+	}
+	output.resize(dd->output_count);
+	return output;
+}
+
+static void vector_write_compressed_block(void* p_output, const uint8_t* comp_data, uint32_t comp_size) {
+	((std::vector<uint8_t>*) p_output)->insert(((std::vector<uint8_t>*) p_output)->end(), comp_data, comp_data + comp_size);
+}
+
+std::vector<uint8_t> lzCompress(const std::vector<uint8_t> &data) {
+	std::vector<uint8_t> output;
+	std::vector<uint32_t> hashTable(1 << LZ_HASH_BITS);
+	LzCompressionData lc = { &output, &vector_write_compressed_block, hashTable.data(), 0, 0 };
+	agon_lz_compress(&lc, data.data(), data.size());
+	return output;
+}
+
+// Decompress, passing the data in blocks of blockSize bytes
+std::vector<uint8_t> lzDecompress(const std::vector<uint8_t> &data, uint32_t origSize, uint32_t blockSize) {
+	std::vector<uint8_t> output(origSize);
+	LzDecompressionData ld;
+	agon_init_lz_decompression(&ld, origSize);
+	for (uint32_t offset = 0; offset < data.size(); offset += blockSize) {
+		auto size = std::min<uint32_t>(blockSize, data.size() - offset);
+		if (!agon_lz_decompress_block(&ld, data.data() + offset, size, output.data())) {
+			break;
+		}
+	}
+	output.resize(ld.output_count);
+	return output;
+}
+
+TEST(compression_matches_reference) {
+	for (auto &sample : sampleData()) {
+		CHECK(turboCompress(sample) == reference::compress(sample));
+	}
+}
+
+TEST(decompression_matches_reference) {
+	for (auto &sample : sampleData()) {
+		auto compressed = turboCompress(sample);
+		auto expected = reference::decompress(compressed, sample.size());
+		CHECK(expected == sample);
+		for (uint32_t blockSize : { 1, 2, 3, 7, 4096 }) {
+			CHECK(turboDecompress(compressed, sample.size(), blockSize) == expected);
+		}
+	}
+}
+
+// Output stops at the original size, even if the last code is a string running past it
+TEST(decompression_stops_at_original_size) {
+	std::vector<uint8_t> data(64, 0x42);
+	auto compressed = turboCompress(data);
+	CHECK(turboDecompress(compressed, 40, 4096) == std::vector<uint8_t>(40, 0x42));
+}
+
+std::vector<uint8_t> makeBufferCompress(uint16_t bufferId, uint16_t sourceBufferId, uint8_t type) {
+	std::vector<uint8_t> command = { 23, 0, 0xA0 };
+	pushWord(command, bufferId);
+	command.push_back(BUFFERED_COMPRESS_TYPE);
+	pushWord(command, sourceBufferId);
+	command.push_back(type);
+	return command;
+}
+
+std::vector<uint8_t> makeBufferDecompress(uint16_t bufferId, uint16_t sourceBufferId) {
+	std::vector<uint8_t> command = { 23, 0, 0xA0 };
+	pushWord(command, bufferId);
+	command.push_back(BUFFERED_DECOMPRESS);
+	pushWord(command, sourceBufferId);
+	return command;
+}
+
+// Compress a buffer written in several blocks, then decompress it again
+void checkBufferRoundTrip(uint8_t type) {
+	hostSetup();
+	HostProcessor host;
+	auto bitmap = makeSampleBitmap(128, 96);
+	host.run(makeBufferClear(0x600));
+	for (uint32_t offset = 0; offset < bitmap.size(); offset += 5000) {
+		auto end = bitmap.begin() + std::min<size_t>(offset + 5000, bitmap.size());
+		host.run(makeBufferWrite(0x600, std::vector<uint8_t>(bitmap.begin() + offset, end)));
+	}
+	host.run(makeBufferCompress(0x601, 0x600, type));
+	auto compressed = readBuffer(0x601);
+	CHECK(compressed.size() > sizeof(CompressionFileHeader));
+	CHECK(compressed.size() < bitmap.size());
+	CHECK_EQ(compressed[3], type);
+	host.run(makeBufferDecompress(0x602, 0x601));
+	CHECK(readBuffer(0x602) == bitmap);
+	for (uint16_t bufferId = 0x600; bufferId <= 0x602; bufferId++) {
+		host.run(makeBufferClear(bufferId));
+	}
+}
+
+TEST(decompression_buffer_round_trip) {
+	checkBufferRoundTrip(COMPRESSION_TYPE_TURBO);
+}
+
+TEST(decompression_buffer_round_trip_lz) {
+	checkBufferRoundTrip(COMPRESSION_TYPE_LZ);
+}
+
+// Samples include literal runs and matches long enough to need extension bytes
+TEST(lz_round_trip) {
+	for (auto &sample : sampleData()) {
+		auto compressed = lzCompress(sample);
+		for (uint32_t blockSize : { 1, 2, 3, 7, 4096 }) {
+			CHECK(lzDecompress(compressed, sample.size(), blockSize) == sample);
+		}
+	}
+}
+
+// A match reaching back before the start of the output ends decompression, rather than reading outside it
+TEST(lz_rejects_invalid_offset) {
+	std::vector<uint8_t> compressed = { 0x20, 'a', 'b', 0x10, 0x00 };
+	CHECK(lzDecompress(compressed, 10, 4096) == std::vector<uint8_t>({ 'a', 'b' }));
+}
+
+// Compress data into a buffer, check it was split into whole output blocks with the header at the start,
+// then check it decompresses back to the original
+void checkCompressedBlocks(const std::vector<uint8_t> &data, uint8_t type) {
+	hostSetup();
+	HostProcessor host;
+	host.run(makeBufferClear(0x620));
+	host.run(makeBufferWrite(0x620, data));
+	host.run(makeBufferCompress(0x621, 0x620, type));
+
+	auto compressed = readBuffer(0x621);
+	auto payload = type == COMPRESSION_TYPE_LZ ? lzCompress(data) : turboCompress(data);
+	CHECK_EQ(compressed.size(), sizeof(CompressionFileHeader) + payload.size());
+	CHECK(std::equal(payload.begin(), payload.end(), compressed.begin() + sizeof(CompressionFileHeader)));
+	auto header = (const CompressionFileHeader *)compressed.data();
+	CHECK_EQ(header->type, type);
+	CHECK_EQ(header->orig_size, data.size());
+
+	auto &blocks = *buffers.get(0x621);
+	CHECK_EQ(blocks.size(), (compressed.size() + COMPRESSION_OUTPUT_CHUNK_SIZE - 1) / COMPRESSION_OUTPUT_CHUNK_SIZE);
+	for (size_t i = 0; i + 1 < blocks.size(); i++) {
+		CHECK_EQ(blocks[i]->size(), COMPRESSION_OUTPUT_CHUNK_SIZE);
+	}
+	CHECK(blocks.back()->size() > 0);
+
+	host.run(makeBufferDecompress(0x622, 0x621));
+	CHECK(readBuffer(0x622) == data);
+	for (uint16_t bufferId = 0x620; bufferId <= 0x622; bufferId++) {
+		host.run(makeBufferClear(bufferId));
+	}
+}
+
+// Find a length of noise whose compressed output, with its header, exactly fills whole output blocks
+std::vector<uint8_t> makeBlockFillingNoise(uint8_t type, uint32_t blocks) {
+	auto target = blocks * COMPRESSION_OUTPUT_CHUNK_SIZE - sizeof(CompressionFileHeader);
+	auto noise = makeNoise(target);
+	for (uint32_t size = target * 3 / 4; size <= target; size++) {
+		std::vector<uint8_t> data(noise.begin(), noise.begin() + size);
+		auto compressed = type == COMPRESSION_TYPE_LZ ? lzCompress(data) : turboCompress(data);
+		if (compressed.size() == target) {
+			return data;
+		}
+	}
+	return {};
+}
+
+// Noise barely compresses, so fills several output blocks
+TEST(compression_sink_multiple_blocks) {
+	auto noise = makeNoise(20000);
+	checkCompressedBlocks(noise, COMPRESSION_TYPE_TURBO);
+	checkCompressedBlocks(noise, COMPRESSION_TYPE_LZ);
+}
+
+// Output exactly filling its blocks leaves no empty block at the end
+TEST(compression_sink_exact_blocks) {
+	for (auto type : { COMPRESSION_TYPE_TURBO, COMPRESSION_TYPE_LZ }) {
+		for (uint32_t blocks : { 1, 2 }) {
+			auto data = makeBlockFillingNoise(type, blocks);
+			CHECK(!data.empty());
+			checkCompressedBlocks(data, type);
+		}
+	}
+}
+
+// Compress data with the buffer compress command, returning the compressed data with its header
+std::vector<uint8_t> compressWithHeader(HostProcessor &host, const std::vector<uint8_t> &data, uint8_t type) {
+	host.run(makeBufferClear(0x6F0));
+	host.run(makeBufferWrite(0x6F0, data));
+	host.run(makeBufferCompress(0x6F1, 0x6F0, type));
+	auto compressed = readBuffer(0x6F1);
+	host.run(makeBufferClear(0x6F0));
+	host.run(makeBufferClear(0x6F1));
+	return compressed;
+}
+
+// Decompress data sent with the command, where target holds the target and its arguments
+std::vector<uint8_t> makeDecompressStream(uint16_t bufferId, const std::vector<uint8_t> &target, const std::vector<uint8_t> &compressed) {
+	std::vector<uint8_t> command = { 23, 0, 0xA0 };
+	pushWord(command, bufferId);
+	command.push_back(BUFFERED_DECOMPRESS_STREAM);
+	command.insert(command.end(), target.begin(), target.end());
+	pushWord(command, compressed.size() & 0xFFFF);
+	command.push_back(compressed.size() >> 16);
+	command.insert(command.end(), compressed.begin(), compressed.end());
+	return command;
+}
+
+TEST(decompress_stream_to_buffer) {
+	hostSetup();
+	HostProcessor host;
+	auto bitmap = makeSampleBitmap(128, 96);
+	for (auto type : { COMPRESSION_TYPE_TURBO, COMPRESSION_TYPE_LZ }) {
+		auto compressed = compressWithHeader(host, bitmap, type);
+		host.run(makeDecompressStream(0x610, { DECOMPRESS_STREAM_BUFFER }, compressed));
+		CHECK(host.stream->available() == 0);
+		CHECK_EQ(buffers.get(0x610)->size(), 1);
+		CHECK(readBuffer(0x610) == bitmap);
+	}
+	host.run(makeBufferClear(0x610));
+}
+
+TEST(decompress_stream_to_bitmap) {
+	hostSetup();
+	HostProcessor host;
+	auto pixels = makeSampleBitmap(64, 48);
+	for (auto type : { COMPRESSION_TYPE_TURBO, COMPRESSION_TYPE_LZ }) {
+		bitmaps.erase(0x611);
+		auto compressed = compressWithHeader(host, pixels, type);
+		// RGBA2222, 64x48
+		host.run(makeDecompressStream(0x611, { DECOMPRESS_STREAM_BITMAP, 1, 64, 0, 48, 0 }, compressed));
+		CHECK(host.stream->available() == 0);
+		auto bitmap = bitmaps[0x611];
+		CHECK(bitmap != nullptr);
+		CHECK_EQ(bitmap->width, 64);
+		CHECK_EQ(bitmap->height, 48);
+		CHECK(bitmap->format == PixelFormat::RGBA2222);
+		CHECK(bitmap->data == buffers.get(0x611)->front()->getBuffer());
+		CHECK(memcmp(bitmap->data, pixels.data(), pixels.size()) == 0);
+	}
+	host.run(makeBufferClear(0x611));
+	bitmaps.erase(0x611);
+}
+
+TEST(decompress_stream_to_sample) {
+	hostSetup();
+	HostProcessor host;
+	auto sound = makeNoise(6000);
+	for (auto type : { COMPRESSION_TYPE_TURBO, COMPRESSION_TYPE_LZ }) {
+		samples.erase(0x612);
+		auto compressed = compressWithHeader(host, sound, type);
+		// unsigned 8-bit, at 8000Hz
+		host.run(makeDecompressStream(0x612, { DECOMPRESS_STREAM_SAMPLE, AUDIO_FORMAT_8BIT_UNSIGNED | AUDIO_FORMAT_WITH_RATE, 0x40, 0x1F }, compressed));
+		CHECK(host.stream->available() == 0);
+		auto sample = samples[0x612];
+		CHECK(sample != nullptr);
+		CHECK_EQ(sample->format, AUDIO_FORMAT_8BIT_UNSIGNED);
+		CHECK_EQ(sample->sampleRate, 8000);
+		CHECK_EQ(sample->getSize(), sound.size());
+		CHECK(readBuffer(0x612) == sound);
+	}
+	host.run(makeBufferClear(0x612));
+	samples.erase(0x612);
+}
+
+// Bad data never creates the target, but always consumes exactly length bytes, so the next command is read correctly
+TEST(decompress_stream_rejects_bad_data) {
+	hostSetup();
+	HostProcessor host;
+	auto data = makeSampleBitmap(64, 48);
+	auto turbo = compressWithHeader(host, data, COMPRESSION_TYPE_TURBO);
+	auto lz = compressWithHeader(host, data, COMPRESSION_TYPE_LZ);
+
+	std::vector<std::vector<uint8_t>> payloads;
+	// too small for a header
+	payloads.push_back({ 'C', 'm', 'p' });
+	// a header with the wrong marker
+	auto invalid = turbo;
+	invalid[0] = 'X';
+	payloads.push_back(invalid);
+	// truncated
+	payloads.push_back(std::vector<uint8_t>(turbo.begin(), turbo.begin() + turbo.size() / 2));
+	payloads.push_back(std::vector<uint8_t>(lz.begin(), lz.begin() + lz.size() / 2));
+	// an LZ match reaching back before the start of the output
+	auto badMatch = std::vector<uint8_t>(lz.begin(), lz.begin() + sizeof(CompressionFileHeader));
+	badMatch.insert(badMatch.end(), { 0x20, 'a', 'b', 0x10, 0x00 });
+	payloads.push_back(badMatch);
+
+	for (auto &payload : payloads) {
+		host.run(makeBufferClear(0x613));
+		host.run(makeBufferClear(0x614));
+		auto command = makeDecompressStream(0x613, { DECOMPRESS_STREAM_BUFFER }, payload);
+		auto marker = makeBufferWrite(0x614, { 0xAB });
+		command.insert(command.end(), marker.begin(), marker.end());
+		host.run(command);
+		CHECK(host.stream->available() == 0);
+		CHECK(buffers.get(0x613) == nullptr);
+		CHECK(readBuffer(0x614) == std::vector<uint8_t>({ 0xAB }));
+	}
+	host.run(makeBufferClear(0x614));
+}
+
+BENCHMARK(compression_turbo) {
+	auto bitmap = makeSampleBitmap(128, 128);
+	std::vector<uint8_t> output;
+	benchmark("reference compress, 16KB bitmap", bitmap.size(), 0, [&]() {
+		output = reference::compress(bitmap);
+	});
+	benchmark("hashed compress, 16KB bitmap", bitmap.size(), 0, [&]() {
+		output = turboCompress(bitmap);
+	});
+	CHECK(output == reference::compress(bitmap));
+}
+
+// Compression ratio and decode speed of both formats, on a bitmap and on data that barely compresses
+BENCHMARK(compression_lz_against_turbo) {
+	std::vector<std::pair<const char *, std::vector<uint8_t>>> samples = {
+		{ "16KB bitmap", makeSampleBitmap(128, 128) },
+		{ "16KB noise", makeNoise(16384) },
+	};
+	for (auto &sample : samples) {
+		auto &data = sample.second;
+		auto turbo = turboCompress(data);
+		auto lz = lzCompress(data);
+		printf("  %s: turbo %u bytes (%.1f%%), lz %u bytes (%.1f%%)\n", sample.first,
+			(uint32_t)turbo.size(), 100.0 * turbo.size() / data.size(), (uint32_t)lz.size(), 100.0 * lz.size() / data.size());
+		std::vector<uint8_t> output;
+		std::string label = std::string("turbo decompress, ") + sample.first;
+		benchmark(label.c_str(), data.size(), 0, [&]() {
+			output = turboDecompress(turbo, data.size(), COMPRESSION_OUTPUT_CHUNK_SIZE);
+		});
+		CHECK(output == data);
+		label = std::string("lz decompress, ") + sample.first;
+		benchmark(label.c_str(), data.size(), 0, [&]() {
+			output = lzDecompress(lz, data.size(), COMPRESSION_OUTPUT_CHUNK_SIZE);
+		});
+		CHECK(output == data);
+		label = std::string("lz compress, ") + sample.first;
+		benchmark(label.c_str(), data.size(), 0, [&]() {
+			lz = lzCompress(data);
+		});
+	}
+}
+
+BENCHMARK(decompression_turbo) {
+	auto bitmap = makeSampleBitmap(128, 128);
+	auto compressed = turboCompress(bitmap);
+	std::vector<uint8_t> output;
+	benchmark("reference decompress, 16KB bitmap", bitmap.size(), 0, [&]() {
+		output = reference::decompress(compressed, bitmap.size());
+	});
+	benchmark("block decompress, 16KB bitmap", bitmap.size(), 0, [&]() {
+		output = turboDecompress(compressed, bitmap.size(), COMPRESSION_OUTPUT_CHUNK_SIZE);
+	});
+	CHECK(output == bitmap);
+}
+
+#endif // TEST_COMPRESSION_H
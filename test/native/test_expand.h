@@ -0,0 +1,95 @@
+#ifndef TEST_EXPAND_H
+#define TEST_EXPAND_H
+
+// Bitmap expansion
+// The table driven expansion must match the original bit loop for every pixel size, aligned or not
+//
+
+#include <vector>
+
+#include "host_vdp.h"
+#include "reference_expand_bitmap.h"
+#include "runner.h"
+#include "test_adjust.h"
+#include "test_buffers.h"
+#include "test_compression.h"
+#include "test_vdu.h"
+
+// Expand a buffer, with the map values sent in the command
+std::vector<uint8_t> makeExpandBitmap(uint16_t bufferId, uint8_t pixelSize, bool aligned, uint16_t width,
+	uint16_t sourceId, const std::vector<uint8_t> &mapValues) {
+	std::vector<uint8_t> command = { 23, 0, 0xA0 };
+	pushWord(command, bufferId);
+	command.push_back(BUFFERED_EXPAND_BITMAP);
+	command.push_back((pixelSize & EXPAND_BITMAP_SIZE) | (aligned ? EXPAND_BITMAP_ALIGNED : 0));
+	pushWord(command, sourceId);
+	if (aligned) {
+		pushWord(command, width);
+	}
+	command.insert(command.end(), mapValues.begin(), mapValues.begin() + (1 << pixelSize));
+	return command;
+}
+
+std::vector<uint8_t> makeMapValues() {
+	std::vector<uint8_t> mapValues(256);
+	for (auto i = 0; i < 256; i++) {
+		mapValues[i] = i * 37 + 11;
+	}
+	return mapValues;
+}
+
+// What the original loop produced, cut down to the whole rows the new expansion produces
+std::vector<uint8_t> expectedExpansion(const std::vector<uint8_t> &source, uint8_t pixelSize, bool aligned, uint16_t width,
+	const std::vector<uint8_t> &mapValues) {
+	auto expected = reference::expandBitmap(source, pixelSize, aligned, width, mapValues.data());
+	if (aligned) {
+		auto byteWidth = (pixelSize * width + 7) / 8;
+		expected.resize(source.size() / byteWidth * width);
+	}
+	return expected;
+}
+
+TEST(expand_bitmap_matches_reference) {
+	hostSetup();
+	HostProcessor host;
+	auto mapValues = makeMapValues();
+	for (uint8_t pixelSize = 1; pixelSize <= 8; pixelSize++) {
+		for (uint16_t width = 1; width < 40; width++) {
+			// aligned, with three whole rows and part of another
+			auto byteWidth = (pixelSize * width + 7) / 8;
+			auto source = makeNoise(byteWidth * 3 + byteWidth / 2);
+			host.run(makeBufferClear(0x800));
+			host.run(makeBufferWrite(0x800, source));
+			host.run(makeExpandBitmap(0x801, pixelSize, true, width, 0x800, mapValues));
+			CHECK(readBuffer(0x801) == expectedExpansion(source, pixelSize, true, width, mapValues));
+
+			// unaligned, using width as the source length
+			source = makeNoise(width);
+			host.run(makeBufferClear(0x800));
+			host.run(makeBufferWrite(0x800, source));
+			host.run(makeExpandBitmap(0x801, pixelSize, false, 0, 0x800, mapValues));
+			CHECK(readBuffer(0x801) == expectedExpansion(source, pixelSize, false, 0, mapValues));
+		}
+	}
+	CHECK(host.stream->available() == 0);
+	host.run(makeBufferClear(0x800));
+	host.run(makeBufferClear(0x801));
+}
+
+// A 640x480 1bpp screen, expanded to a byte per pixel
+BENCHMARK(expand_bitmap_1bpp) {
+	hostSetup();
+	HostProcessor host;
+	auto mapValues = makeMapValues();
+	auto source = makeNoise(640 / 8 * 480);
+	host.run(makeBufferClear(0x800));
+	host.run(makeBufferWrite(0x800, source));
+	benchmarkStream("expand 1bpp 640x480", makeExpandBitmap(0x801, 1, true, 640, 0x800, mapValues), source.size());
+	benchmark("expand 1bpp 640x480, original loop", source.size(), 0, [&]() {
+		reference::expandBitmap(source, 1, true, 640, mapValues.data());
+	});
+	host.run(makeBufferClear(0x800));
+	host.run(makeBufferClear(0x801));
+}
+
+#endif // TEST_EXPAND_H
@@ -0,0 +1,131 @@
+#ifndef TEST_MOUSE_H
+#define TEST_MOUSE_H
+
+// Mouse movement coalescing, driven by synthetic mouse deltas
+//
+
+#include <vector>
+
+#include "host_vdp.h"
+#include "runner.h"
+
+MouseDelta makeMouseDelta(int16_t x, int16_t y, int8_t z, bool left = false) {
+	MouseDelta delta = {};
+	delta.deltaX = x;
+	delta.deltaY = y;
+	delta.deltaZ = z;
+	delta.buttons.left = left;
+	return delta;
+}
+
+// Gather queued deltas as the main loop does, returning the packets sent
+std::vector<MouseDelta> sendMouseDeltas() {
+	std::vector<MouseDelta> packets;
+	gatherMouseDeltas([&](MouseDelta &delta) {
+		packets.push_back(delta);
+	});
+	return packets;
+}
+
+void resetMouseDeltas() {
+	MouseDelta delta;
+	while (mouseMoved(&delta)) {}
+	mDeltaPending = false;
+	mLastButtons = {};
+}
+
+TEST(mouse_coalesces_movement) {
+	hostSetup();
+	mouseEnabled = true;
+	resetMouseDeltas();
+	auto mouse = getMouse();
+
+	// the first movement is sent straight away, as the interval since the last packet has passed
+	delay(mPacketInterval);
+	mouse->queueDelta(makeMouseDelta(1, 2, 0));
+	CHECK_EQ(sendMouseDeltas().size(), 1);
+
+	// further movement within the interval is held back and summed
+	for (auto i = 0; i < 10; i++) {
+		mouse->queueDelta(makeMouseDelta(3, -1, 1));
+	}
+	CHECK(sendMouseDeltas().empty());
+	delay(mPacketInterval);
+	auto packets = sendMouseDeltas();
+	CHECK_EQ(packets.size(), 1);
+	CHECK_EQ(packets[0].deltaX, 30);
+	CHECK_EQ(packets[0].deltaY, -10);
+	CHECK_EQ(packets[0].deltaZ, 10);
+	CHECK(sendMouseDeltas().empty());
+}
+
+// Movement before a button change goes in a packet of its own, ahead of the change
+TEST(mouse_button_change_sends_immediately) {
+	hostSetup();
+	mouseEnabled = true;
+	resetMouseDeltas();
+	auto mouse = getMouse();
+
+	mouse->queueDelta(makeMouseDelta(5, 0, 0));
+	mouse->queueDelta(makeMouseDelta(6, 0, 0, true));
+	mouse->queueDelta(makeMouseDelta(7, 0, 0, true));
+	auto packets = sendMouseDeltas();
+	CHECK_EQ(packets.size(), 2);
+	CHECK_EQ(packets[0].deltaX, 5);
+	CHECK(!packets[0].buttons.left);
+	CHECK_EQ(packets[1].deltaX, 6);
+	CHECK(packets[1].buttons.left);
+	// the delta after the button change waits for the packet interval
+	CHECK(sendMouseDeltas().empty());
+	delay(mPacketInterval);
+	packets = sendMouseDeltas();
+	CHECK_EQ(packets.size(), 1);
+	CHECK_EQ(packets[0].deltaX, 7);
+}
+
+// With no packet interval, every delta is sent on its own
+TEST(mouse_zero_interval_sends_every_delta) {
+	hostSetup();
+	mouseEnabled = true;
+	resetMouseDeltas();
+	auto mouse = getMouse();
+	setMousePacketInterval(0);
+
+	for (auto i = 1; i <= 3; i++) {
+		mouse->queueDelta(makeMouseDelta(i, 0, 0));
+	}
+	for (auto i = 1; i <= 3; i++) {
+		auto packets = sendMouseDeltas();
+		CHECK_EQ(packets.size(), 1);
+		CHECK_EQ(packets[0].deltaX, i);
+	}
+	CHECK(sendMouseDeltas().empty());
+	setMousePacketInterval(MOUSE_DEFAULT_PACKET_INTERVAL);
+}
+
+TEST(mouse_movement_saturates) {
+	hostSetup();
+	mouseEnabled = true;
+	resetMouseDeltas();
+	auto mouse = getMouse();
+
+	delay(mPacketInterval);
+	for (auto i = 0; i < 4; i++) {
+		mouse->queueDelta(makeMouseDelta(20000, -20000, 100));
+	}
+	auto packets = sendMouseDeltas();
+	CHECK_EQ(packets.size(), 1);
+	CHECK_EQ(packets[0].deltaX, 32767);
+	CHECK_EQ(packets[0].deltaY, -32768);
+	CHECK_EQ(packets[0].deltaZ, 127);
+
+	delay(mPacketInterval);
+	for (auto i = 0; i < 4; i++) {
+		mouse->queueDelta(makeMouseDelta(0, 0, -100));
+	}
+	packets = sendMouseDeltas();
+	CHECK_EQ(packets.size(), 1);
+	CHECK_EQ(packets[0].deltaZ, -128);
+}
+
+#endif // TEST_MOUSE_H
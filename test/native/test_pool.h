@@ -0,0 +1,156 @@
+#ifndef TEST_POOL_H
+#define TEST_POOL_H
+
+// Block pool
+// Small allocations come from size-classed slabs, and larger ones fall through to the heap
+//
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "host_vdp.h"
+#include "runner.h"
+#include "test_buffers.h"
+#include "test_slices.h"
+#include "test_vdu.h"
+
+// Totals over every size class
+BlockPool::ClassStats totalPoolStats(BlockPool &pool) {
+	BlockPool::ClassStats total = {};
+	for (size_t size = BLOCK_POOL_MIN_SIZE; size <= BLOCK_POOL_MAX_SIZE; size <<= 1) {
+		auto stats = pool.getClassStats(size);
+		total.slabs += stats.slabs;
+		total.inUse += stats.inUse;
+		total.requestedBytes += stats.requestedBytes;
+		total.allocations += stats.allocations;
+	}
+	return total;
+}
+
+TEST(pool_reuses_freed_items) {
+	BlockPool pool;
+	auto first = pool.allocate(100);
+	CHECK(first != nullptr);
+	pool.deallocate(first, 100);
+	// any size in the same class gets the item just freed
+	auto second = pool.allocate(120);
+	CHECK(second == first);
+	auto stats = pool.getClassStats(128);
+	CHECK_EQ(stats.slabs, 1);
+	CHECK_EQ(stats.inUse, 1);
+	CHECK_EQ(stats.requestedBytes, 120);
+	CHECK_EQ(stats.allocations, 2);
+
+	// filling the slab adds another, and the items are all distinct
+	std::vector<void *> items = { second };
+	for (auto i = 0; i < BLOCK_POOL_SLAB_SIZE / 128; i++) {
+		items.push_back(pool.allocate(128));
+	}
+	CHECK_EQ(pool.getClassStats(128).slabs, 2);
+	std::sort(items.begin(), items.end());
+	CHECK(std::adjacent_find(items.begin(), items.end()) == items.end());
+	for (auto item : items) {
+		pool.deallocate(item, item == second ? 120 : 128);
+	}
+	CHECK_EQ(pool.getClassStats(128).inUse, 0);
+	CHECK_EQ(pool.getClassStats(128).requestedBytes, 0);
+	CHECK_EQ(pool.getHeapAllocations(), 0);
+}
+
+TEST(pool_class_boundary) {
+	BlockPool pool;
+	auto pooled = pool.allocate(BLOCK_POOL_MAX_SIZE);
+	CHECK(pooled != nullptr);
+	CHECK_EQ(pool.getClassStats(BLOCK_POOL_MAX_SIZE).inUse, 1);
+	CHECK_EQ(pool.getHeapAllocations(), 0);
+
+	auto heap = pool.allocate(BLOCK_POOL_MAX_SIZE + 1);
+	CHECK(heap != nullptr);
+	CHECK_EQ(pool.getClassStats(BLOCK_POOL_MAX_SIZE).inUse, 1);
+	CHECK_EQ(pool.getHeapAllocations(), 1);
+	CHECK_EQ(pool.getHeapInUse(), 1);
+	CHECK_EQ(totalPoolStats(pool).allocations, 1);
+
+	pool.deallocate(pooled, BLOCK_POOL_MAX_SIZE);
+	pool.deallocate(heap, BLOCK_POOL_MAX_SIZE + 1);
+	CHECK_EQ(pool.getClassStats(BLOCK_POOL_MAX_SIZE).inUse, 0);
+	CHECK_EQ(pool.getHeapInUse(), 0);
+}
+
+// Large allocations go straight to the heap, and failures are counted whether they come from the heap or a new slab
+TEST(pool_heap_fallthrough) {
+	BlockPool pool;
+	auto allocations = hostPsramAllocations();
+	auto large = pool.allocate(100000);
+	CHECK(large != nullptr);
+	CHECK_EQ(hostPsramAllocations() - allocations, 1);
+	CHECK_EQ(totalPoolStats(pool).slabs, 0);
+	pool.deallocate(large, 100000);
+	CHECK_EQ(pool.getHeapInUse(), 0);
+
+	hostPsramLimit() = 1024;
+	CHECK(pool.allocate(2000) == nullptr);
+	CHECK(pool.allocate(16) == nullptr);
+	hostPsramLimit() = SIZE_MAX;
+	CHECK_EQ(pool.getFailures(), 2);
+	CHECK_EQ(pool.getHeapInUse(), 0);
+	CHECK_EQ(totalPoolStats(pool).inUse, 0);
+}
+
+// Splitting a 64KB buffer into 8 byte chunks takes thousands of pooled streams, all of which go back once it's cleared
+TEST(pool_stats_after_split_and_clear) {
+	hostSetup();
+	HostProcessor host;
+	host.run(makeBufferClear(0x700));
+	auto before = totalPoolStats(blockPool);
+	auto heapBefore = blockPool.getHeapInUse();
+
+	host.run(makeBufferWrite(0x700, makeCountingData(32768)));
+	host.run(makeBufferWrite(0x700, makeCountingData(32768)));
+	std::vector<uint8_t> split = { 23, 0, 0xA0 };
+	pushWord(split, 0x700);
+	split.push_back(BUFFERED_SPLIT);
+	pushWord(split, 8);
+	host.run(split);
+	CHECK_EQ(buffers.get(0x700)->size(), 8192);
+	auto during = totalPoolStats(blockPool);
+	CHECK(during.inUse - before.inUse >= 8192);
+	CHECK(during.allocations - before.allocations >= 8192);
+	CHECK(during.slabs * BLOCK_POOL_SLAB_SIZE >= during.requestedBytes);
+
+	host.run(makeBufferClear(0x700));
+	auto after = totalPoolStats(blockPool);
+	CHECK_EQ(after.inUse, before.inUse);
+	CHECK_EQ(after.requestedBytes, before.requestedBytes);
+	CHECK_EQ(after.slabs, during.slabs);
+	CHECK_EQ(blockPool.getHeapInUse(), heapBefore);
+}
+
+// Heap allocations made creating the streams for a 64KB split into 8 byte chunks, with and without the pool
+void benchmarkChunkStreams(const char * label, std::function<std::shared_ptr<BufferStream>()> create) {
+	std::vector<std::shared_ptr<BufferStream>> chunks;
+	chunks.reserve(8192);
+	auto makeChunks = [&]() {
+		for (auto i = 0; i < 8192; i++) {
+			chunks.push_back(create());
+		}
+		chunks.clear();
+	};
+	makeChunks();
+	auto allocations = hostPsramAllocations();
+	makeChunks();
+	printf("  %-40s %10u heap allocations\n", label, hostPsramAllocations() - allocations);
+	benchmark(label, 0, 8192, makeChunks);
+}
+
+BENCHMARK(pool_chunk_streams) {
+	benchmarkChunkStreams("8 byte chunk streams, pooled", []() {
+		return make_shared_pooled<BufferStream>(8);
+	});
+	benchmarkChunkStreams("8 byte chunk streams, heap", []() {
+		return make_shared_psram<BufferStream>(8);
+	});
+}
+
+#endif // TEST_POOL_H
@@ -0,0 +1,91 @@
+#ifndef TEST_RENDER_H
+#define TEST_RENDER_H
+
+// Render pipeline
+// By default the host has a single task, so the render task can't start, and plots must fall back to being executed directly
+// With threaded tasks turned on the render task really runs alongside the processor
+// The render task never ends, so a processor that has started one is deliberately leaked
+//
+
+#include "host_vdp.h"
+#include "runner.h"
+#include "test_vdu.h"
+
+void setRenderPipeline(HostProcessor &host, bool enabled) {
+	if (enabled) {
+		host.run({ 23, 0, 0xF8, TEST_FLAG_RENDER_PIPELINE, 0, 1, 0 });
+	} else {
+		host.run({ 23, 0, 0xF9, TEST_FLAG_RENDER_PIPELINE, 0 });
+	}
+}
+
+TEST(render_pipeline_falls_back_to_direct_plotting) {
+	hostSetup();
+	HostProcessor host;
+	setRenderPipeline(host, true);
+	host.run({ 12, 18, 0, 15, 25, 4, 0, 0, 0, 0, 25, 5, 0xFE, 0x04, 0, 0 });
+	setRenderPipeline(host, false);
+	CHECK(!host.vdu->hasPendingLookahead());
+	CHECK(canvas->getPixel(320, canvas->getHeight() - 1) != RGB888(0, 0, 0));
+}
+
+// Take a copy of the whole screen
+std::vector<RGB888> snapshotCanvas() {
+	std::vector<RGB888> pixels;
+	for (int y = 0; y < canvas->getHeight(); y++) {
+		for (int x = 0; x < canvas->getWidth(); x++) {
+			pixels.push_back(canvas->getPixel(x, y));
+		}
+	}
+	return pixels;
+}
+
+TEST(render_pipeline_threaded_matches_direct) {
+	hostSetup();
+	auto lines = makeLineStream(200);
+	HostProcessor direct;
+	direct.run({ 12 });
+	direct.run(lines);
+	auto expected = snapshotCanvas();
+
+	HostThreadedTasks threaded;
+	auto host = new HostProcessor();
+	host->run({ 12 });
+	setRenderPipeline(*host, true);
+	host->run(lines);
+	setRenderPipeline(*host, false);
+	CHECK(host->vdu->isRenderTaskRunning());
+	CHECK(snapshotCanvas() == expected);
+}
+
+BENCHMARK(render_pipeline_lines_fallback) {
+	hostSetup();
+	auto lines = makeLineStream(1000);
+	std::vector<uint8_t> data = { 23, 0, 0xF8, TEST_FLAG_RENDER_PIPELINE, 0, 1, 0 };
+	data.insert(data.end(), lines.begin(), lines.end());
+	data.insert(data.end(), { 23, 0, 0xF9, TEST_FLAG_RENDER_PIPELINE, 0 });
+	benchmarkStream("lines, render pipeline fallback without a render task", data);
+}
+
+BENCHMARK(render_pipeline_lines_threaded) {
+	hostSetup();
+	HostThreadedTasks threaded;
+	auto host = new HostProcessor();
+	host->run({ 12 });
+	setRenderPipeline(*host, true);
+	host->stream->reset();
+	auto data = makeLineStream(1000);
+	// a text command at the end waits for the render task to finish the queued plots
+	data.push_back(30);
+	auto startCount = host->vdu->getCommandCount();
+	host->run(data);
+	auto commands = host->vdu->getCommandCount() - startCount;
+
+	benchmark("lines, render pipeline on its own thread", data.size(), commands, [&]() {
+		host->stream->rewind();
+		host->vdu->processAllAvailable();
+	});
+	setRenderPipeline(*host, false);
+}
+
+#endif // TEST_RENDER_H
@@ -0,0 +1,81 @@
+#ifndef TEST_SEEK_H
+#define TEST_SEEK_H
+
+// Seeking within multi-block buffers
+//
+
+#include <vector>
+
+#include "host_vdp.h"
+#include "runner.h"
+
+// Blocks of varying sizes, including empty ones, with each byte holding its offset in the buffer modulo 251
+std::vector<std::shared_ptr<BufferStream>> makeSeekBlocks(uint32_t count) {
+	std::vector<std::shared_ptr<BufferStream>> blocks;
+	uint32_t offset = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		auto size = (i % 7 == 3) ? 0 : 1 + (i * 13) % 40;
+		auto block = make_shared_psram<BufferStream>(size);
+		for (uint32_t j = 0; j < size; j++) {
+			block->getBuffer()[j] = (offset + j) % 251;
+		}
+		offset += size;
+		blocks.push_back(block);
+	}
+	return blocks;
+}
+
+TEST(seek_resolves_offsets) {
+	BufferIndex index(makeSeekBlocks(200));
+	for (uint32_t position = 0; position < index.size(); position += 7) {
+		uint32_t blockOffset = position;
+		size_t blockIndex = 0;
+		CHECK(index.resolve(blockOffset, blockIndex));
+		CHECK(blockOffset < index[blockIndex]->size());
+		CHECK_EQ(index.blockStart(blockIndex) + blockOffset, position);
+		CHECK_EQ(index[blockIndex]->getBuffer()[blockOffset], position % 251);
+	}
+	uint32_t blockOffset = index.size();
+	size_t blockIndex = 0;
+	CHECK(!index.resolve(blockOffset, blockIndex));
+	CHECK_EQ(blockIndex, index.blockCount());
+}
+
+TEST(seek_stream_reads_from_offset) {
+	MultiBufferStream stream(makeSeekBlocks(200));
+	for (uint32_t position = 0; position < stream.size(); position += 97) {
+		stream.seekTo(position);
+		CHECK_EQ(stream.read(), position % 251);
+		CHECK_EQ(stream.read(), (position + 1) % 251);
+	}
+}
+
+BENCHMARK(seek_resolve) {
+	BufferIndex index(makeSeekBlocks(1000));
+	auto size = index.size();
+	uint32_t total = 0;
+	benchmark("resolve, 1000 blocks", 0, 1000, [&]() {
+		for (uint32_t i = 0; i < 1000; i++) {
+			uint32_t blockOffset = (i * 7919) % size;
+			size_t blockIndex = 0;
+			index.resolve(blockOffset, blockIndex);
+			total += blockIndex;
+		}
+	});
+	CHECK(total > 0);
+}
+
+BENCHMARK(seek_stream) {
+	MultiBufferStream stream(makeSeekBlocks(1000));
+	auto size = stream.size();
+	uint32_t total = 0;
+	benchmark("seekTo and read, 1000 blocks", 0, 1000, [&]() {
+		for (uint32_t i = 0; i < 1000; i++) {
+			stream.seekTo((i * 7919) % size);
+			total += stream.read();
+		}
+	});
+	CHECK(total > 0);
+}
+
+#endif // TEST_SEEK_H
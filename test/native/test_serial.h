@@ -0,0 +1,146 @@
+#ifndef TEST_SERIAL_H
+#define TEST_SERIAL_H
+
+// Waiting for, and receiving, VDP serial data
+//
+
+#include <chrono>
+#include <thread>
+
+#include "host_vdp.h"
+#include "runner.h"
+
+TEST(serial_wait_complete_command_never_blocks) {
+	hostSetup();
+	HostProcessor host;
+	auto waits = hostWaitCount();
+	host.run({ 17, 3, 18, 0, 1 });
+	CHECK_EQ(hostWaitCount() - waits, 0);
+}
+
+TEST(serial_wait_timeout_sleeps_per_tick) {
+	hostSetup();
+	HostProcessor host;
+	auto waits = hostWaitCount();
+	auto start = micros();
+	// a colour command missing its argument waits for the full timeout
+	host.run({ 17 });
+	auto elapsed = micros() - start;
+	CHECK(elapsed >= COMMS_TIMEOUT * 1000);
+	// each wait blocks for a tick, rather than spinning
+	CHECK(hostWaitCount() - waits <= pdMS_TO_TICKS(COMMS_TIMEOUT) + 1);
+}
+
+// The host can't start the drain task, so the VDP stream falls back to reading the serial port directly
+TEST(serial_ring_falls_back_to_serial_port) {
+	hostSetup();
+	const uint8_t data[] = { 17, 3, 18, 0, 1 };
+	VDPSerial.receive(data, sizeof data);
+	CHECK_EQ(VDPStream.available(), sizeof data);
+	CHECK(VDPStream.readableSpan().empty());
+
+	auto startCount = processor->getCommandCount();
+	auto start = micros();
+	processor->processAllAvailable();
+	CHECK_EQ(processor->getCommandCount() - startCount, 2);
+	CHECK_EQ(VDPStream.available(), 0);
+	CHECK(micros() - start < COMMS_TIMEOUT * 1000);
+}
+
+TEST(serial_ring_fallback_reads_bytes) {
+	hostSetup();
+	const uint8_t data[] = { 1, 2, 3, 4 };
+	VDPSerial.receive(data, sizeof data);
+	uint8_t buffer[8];
+	CHECK_EQ(VDPStream.readBytes(buffer, sizeof buffer), sizeof data);
+	CHECK(memcmp(buffer, data, sizeof data) == 0);
+}
+
+// A wait for data wakes as soon as another thread delivers some, rather than running to its timeout
+TEST(serial_wait_wakes_when_data_arrives) {
+	hostSetup();
+	HostThreadedTasks threaded;
+	const uint8_t data[] = { 1, 2, 3 };
+	std::thread producer([&]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		VDPSerial.receive(data, sizeof data);
+	});
+	auto start = std::chrono::steady_clock::now();
+	waitForVDPData(pdMS_TO_TICKS(5000));
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	producer.join();
+	CHECK(elapsed < std::chrono::milliseconds(2000));
+	CHECK_EQ(VDPStream.available(), sizeof data);
+	uint8_t buffer[sizeof data];
+	CHECK_EQ(VDPStream.readBytes(buffer, sizeof buffer), sizeof data);
+}
+
+// Commands whose bytes trickle in from a slow producer are completed as the bytes arrive
+TEST(serial_slow_producer) {
+	hostSetup();
+	HostThreadedTasks threaded;
+	const uint8_t data[] = { 17, 3, 18, 0, 1 };
+	std::thread producer([&]() {
+		for (auto value : data) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+			VDPSerial.receive(&value, 1);
+		}
+	});
+	auto startCount = processor->getCommandCount();
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (processor->getCommandCount() - startCount < 2 && std::chrono::steady_clock::now() < deadline) {
+		waitForVDPData(pdMS_TO_TICKS(100));
+		processor->processAllAvailable();
+	}
+	producer.join();
+	CHECK_EQ(processor->getCommandCount() - startCount, 2);
+	CHECK_EQ(VDPStream.available(), 0);
+}
+
+// Poll until a condition holds, giving up after a few seconds
+template<typename F> bool waitUntil(F condition) {
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (!condition()) {
+		if (std::chrono::steady_clock::now() > deadline) {
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return true;
+}
+
+// The drain task holds off the sender once the ring is nearly full, and lets it send again once enough is read
+// The ring and its drain task live for the rest of the run, on a port of their own
+TEST(serial_ring_drives_rts) {
+	static HardwareSerial port(1);
+	static SerialRingStream stream(port, UART_NUM_1);
+	HostThreadedTasks threaded;
+	CHECK(stream.begin(4096, 1024, 2048, 5, 1));
+	port.onReceive([]() { stream.dataReceived(); });
+	CHECK_EQ(hostUartRts()[UART_NUM_1], 1);
+
+	std::vector<uint8_t> data(3500);
+	for (size_t i = 0; i < data.size(); i++) {
+		data[i] = i;
+	}
+	port.receive(data.data(), data.size());
+	CHECK(waitUntil([]() { return stream.available() == 3500; }));
+	CHECK(waitUntil([]() { return hostUartRts()[UART_NUM_1] == 0; }));
+	CHECK_EQ(stream.getHeldOffCount(), 1);
+
+	// reading down to just under the resume space keeps the sender held off
+	std::vector<uint8_t> buffer(data.size());
+	CHECK_EQ(stream.readBytes(buffer.data(), 1400), 1400);
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	CHECK_EQ(hostUartRts()[UART_NUM_1], 0);
+
+	CHECK_EQ(stream.readBytes(buffer.data() + 1400, 100), 100);
+	CHECK(waitUntil([]() { return hostUartRts()[UART_NUM_1] == 1; }));
+	CHECK_EQ(stream.getHeldOffCount(), 1);
+	CHECK(stream.getHeldOffTime() >= 10000);
+
+	CHECK_EQ(stream.readBytes(buffer.data() + 1500, 2000), 2000);
+	CHECK(buffer == data);
+}
+
+#endif // TEST_SERIAL_H
@@ -0,0 +1,193 @@
+#ifndef TEST_SLICES_H
+#define TEST_SLICES_H
+
+// Buffer slices
+// Splits and copies share storage with their source, which must be copied on write,
+// and small slices of a larger block get storage of their own so the rest can be freed
+//
+
+#include <vector>
+
+#include "host_vdp.h"
+#include "runner.h"
+#include "test_adjust.h"
+#include "test_buffers.h"
+#include "test_vdu.h"
+
+// Split a buffer into chunks of the given length, one per buffer from targetStart onwards
+std::vector<uint8_t> makeBufferSplitFrom(uint16_t bufferId, uint16_t length, uint16_t targetStart) {
+	std::vector<uint8_t> command = { 23, 0, 0xA0 };
+	pushWord(command, bufferId);
+	command.push_back(BUFFERED_SPLIT_FROM);
+	pushWord(command, length);
+	pushWord(command, targetStart);
+	return command;
+}
+
+std::vector<uint8_t> makeBufferCopy(uint16_t bufferId, const std::vector<uint16_t> &sourceIds) {
+	std::vector<uint8_t> command = { 23, 0, 0xA0 };
+	pushWord(command, bufferId);
+	command.push_back(BUFFERED_COPY);
+	for (auto sourceId : sourceIds) {
+		pushWord(command, sourceId);
+	}
+	pushWord(command, 65535);
+	return command;
+}
+
+// Set one byte of a buffer
+std::vector<uint8_t> makeBufferSetByte(uint16_t bufferId, uint16_t offset, uint8_t value) {
+	return makeAdjustStrided(bufferId, ADJUST_SET, offset, 1, 1, 1, {}, { value });
+}
+
+// Make an RGBA2222 bitmap from a buffer
+std::vector<uint8_t> makeBitmapFromBuffer(uint16_t bufferId, uint16_t width, uint16_t height) {
+	std::vector<uint8_t> command = { 23, 27, 0x20 };
+	pushWord(command, bufferId);
+	command.insert(command.end(), { 23, 27, 0x21 });
+	pushWord(command, width);
+	pushWord(command, height);
+	command.push_back(1);
+	return command;
+}
+
+std::vector<uint8_t> makeCountingData(uint32_t length) {
+	std::vector<uint8_t> data(length);
+	for (uint32_t i = 0; i < length; i++) {
+		data[i] = i;
+	}
+	return data;
+}
+
+void clearBuffers(HostProcessor &host, uint16_t first, uint16_t count) {
+	for (uint16_t id = first; id < first + count; id++) {
+		host.run(makeBufferClear(id));
+	}
+}
+
+TEST(slices_split_then_adjust_one_chunk) {
+	hostSetup();
+	HostProcessor host;
+	clearBuffers(host, 0x500, 5);
+	auto data = makeCountingData(64);
+	host.run(makeBufferWrite(0x500, data));
+	host.run(makeBufferSplitFrom(0x500, 16, 0x501));
+	host.run(makeBufferSetByte(0x502, 4, 0xFF));
+
+	CHECK(readBuffer(0x500) == data);
+	for (uint16_t chunk = 0; chunk < 4; chunk++) {
+		std::vector<uint8_t> expected(data.begin() + chunk * 16, data.begin() + chunk * 16 + 16);
+		if (chunk == 1) {
+			expected[4] = 0xFF;
+		}
+		CHECK(readBuffer(0x501 + chunk) == expected);
+	}
+	// only the adjusted chunk was copied
+	CHECK_EQ(buffers.get(0x502)->front()->getStorageLength(), 16);
+	CHECK(buffers.get(0x501)->front()->isShared());
+	clearBuffers(host, 0x500, 5);
+}
+
+TEST(slices_copy_then_modify_either_side) {
+	hostSetup();
+	HostProcessor host;
+	clearBuffers(host, 0x510, 4);
+	auto data = makeCountingData(32);
+
+	// modify the copy
+	host.run(makeBufferWrite(0x510, data));
+	host.run(makeBufferCopy(0x511, { 0x510 }));
+	CHECK(buffers.get(0x511)->front()->isShared());
+	host.run(makeBufferSetByte(0x511, 0, 0xAA));
+	CHECK(readBuffer(0x510) == data);
+	CHECK_EQ(readBuffer(0x511)[0], 0xAA);
+	CHECK(std::equal(data.begin() + 1, data.end(), readBuffer(0x511).begin() + 1));
+
+	// modify the source
+	host.run(makeBufferWrite(0x512, data));
+	host.run(makeBufferCopy(0x513, { 0x512 }));
+	host.run(makeBufferSetByte(0x512, 31, 0x55));
+	CHECK(readBuffer(0x513) == data);
+	CHECK_EQ(readBuffer(0x512)[31], 0x55);
+
+	// neither side shares once one has been modified
+	CHECK(!buffers.get(0x512)->front()->isShared());
+	CHECK(!buffers.get(0x513)->front()->isShared());
+	clearBuffers(host, 0x510, 4);
+}
+
+// A small slice left as the only user of a larger block gets storage of its own when it is modified
+TEST(slices_unshared_small_slice_is_compacted) {
+	hostSetup();
+	HostProcessor host;
+	clearBuffers(host, 0x520, 5);
+	auto data = makeCountingData(256);
+	host.run(makeBufferWrite(0x520, data));
+	host.run(makeBufferSplitFrom(0x520, 64, 0x521));
+	clearBuffers(host, 0x520, 1);
+	clearBuffers(host, 0x522, 3);
+	auto &chunk = buffers.get(0x521)->front();
+	CHECK(!chunk->isShared());
+	CHECK_EQ(chunk->getStorageLength(), 256);
+
+	host.run(makeBufferSetByte(0x521, 0, 0x80));
+	CHECK_EQ(chunk->getStorageLength(), 64);
+	auto expected = std::vector<uint8_t>(data.begin(), data.begin() + 64);
+	expected[0] = 0x80;
+	CHECK(readBuffer(0x521) == expected);
+	clearBuffers(host, 0x520, 5);
+}
+
+// Pinning a chunk of a split gives it storage of its own, so neither the bitmap nor the other chunks see changes to each other
+TEST(slices_pin_after_split) {
+	hostSetup();
+	HostProcessor host;
+	clearBuffers(host, 0x530, 5);
+	auto data = makeCountingData(64);
+	host.run(makeBufferWrite(0x530, data));
+	host.run(makeBufferSplitFrom(0x530, 16, 0x531));
+	host.run(makeBitmapFromBuffer(0x532, 4, 4));
+
+	auto &chunk = buffers.get(0x532)->front();
+	auto bitmap = bitmaps[0x532];
+	CHECK(bitmap != nullptr);
+	CHECK(chunk->isPinned());
+	CHECK_EQ(chunk->getStorageLength(), 16);
+	CHECK(bitmap->data == chunk->getBuffer());
+	CHECK(memcmp(bitmap->data, data.data() + 16, 16) == 0);
+
+	// changing the source and a neighbouring chunk leaves the bitmap alone
+	host.run(makeBufferSetByte(0x530, 16, 0xEE));
+	host.run(makeBufferSetByte(0x531, 15, 0xEE));
+	CHECK_EQ(bitmap->data[0], 16);
+	CHECK_EQ(readBuffer(0x533)[0], 32);
+
+	// changing the pinned chunk changes the bitmap in place
+	host.run(makeBufferSetByte(0x532, 0, 0xCC));
+	CHECK(bitmap->data == chunk->getBuffer());
+	CHECK_EQ(bitmap->data[0], 0xCC);
+	CHECK_EQ(readBuffer(0x530)[16], 0xEE);
+	clearBuffers(host, 0x530, 5);
+	bitmaps.erase(0x532);
+}
+
+TEST(slices_bitmap_after_adjust_sees_adjusted_data) {
+	hostSetup();
+	HostProcessor host;
+	clearBuffers(host, 0x540, 2);
+	auto data = makeCountingData(16);
+	host.run(makeBufferWrite(0x540, data));
+	host.run(makeBufferCopy(0x541, { 0x540 }));
+	host.run(makeBufferSetByte(0x541, 5, 0x3F));
+	host.run(makeBitmapFromBuffer(0x541, 4, 4));
+
+	auto bitmap = bitmaps[0x541];
+	CHECK(bitmap != nullptr);
+	CHECK_EQ(bitmap->data[5], 0x3F);
+	CHECK_EQ(bitmap->data[4], 4);
+	CHECK(readBuffer(0x540) == data);
+	clearBuffers(host, 0x540, 2);
+	bitmaps.erase(0x541);
+}
+
+#endif // TEST_SLICES_H
@@ -0,0 +1,70 @@
+#ifndef TEST_TRACE_H
+#define TEST_TRACE_H
+
+// Trace capture and replay
+//
+
+#include <vector>
+
+#include "host_vdp.h"
+#include "runner.h"
+#include "test_vdu.h"
+
+// Build a command to write a trace of the given bytes to a buffer, one microsecond apart
+std::vector<uint8_t> makeTraceUpload(uint16_t bufferId, const std::vector<uint8_t> &bytes) {
+	std::vector<uint8_t> data = { 23, 0, 0xA0 };
+	pushWord(data, bufferId);
+	data.push_back(2);
+	data.insert(data.end(), { 23, 0, 0xA0 });
+	pushWord(data, bufferId);
+	data.push_back(0);
+	pushWord(data, bytes.size() * sizeof(TraceRecord));
+	for (uint32_t i = 0; i < bytes.size(); i++) {
+		TraceRecord record = { i, bytes[i] };
+		auto raw = (const uint8_t *)&record;
+		data.insert(data.end(), raw, raw + sizeof record);
+	}
+	return data;
+}
+
+std::vector<uint8_t> makeTraceReplay(uint16_t bufferId) {
+	std::vector<uint8_t> data = { 23, 0, 0xA2, TRACE_REPLAY };
+	pushWord(data, bufferId);
+	data.push_back(0);
+	return data;
+}
+
+TEST(trace_replay_draws) {
+	hostSetup();
+	HostProcessor host;
+	host.run(makeTraceUpload(0x300, { 12, 18, 0, 15, 25, 4, 0, 0, 0, 0, 25, 5, 0xFE, 0x04, 0, 0 }));
+	host.run({ 12 });
+	CHECK(canvas->getPixel(320, canvas->getHeight() - 1) == RGB888(0, 0, 0));
+	host.run(makeTraceReplay(0x300));
+	host.vdu->flushRenderQueue();
+	CHECK(canvas->getPixel(320, canvas->getHeight() - 1) != RGB888(0, 0, 0));
+}
+
+TEST(trace_replay_suppresses_output) {
+	hostSetup();
+	HostProcessor host;
+	// a general poll is answered with a packet, which should be discarded during replay
+	host.run(makeTraceUpload(0x301, { 23, 0, 0x80, 0x55 }));
+	host.run(makeTraceReplay(0x301));
+	CHECK(host.stream->output.empty());
+	// and output works again afterwards
+	host.run({ 23, 0, 0x80, 0x55 });
+	CHECK(!host.stream->output.empty());
+}
+
+TEST(trace_replay_resolves_lookahead) {
+	hostSetup();
+	HostProcessor host;
+	// a cursor left with text at the graphics cursor waits to see if it's a backspace
+	host.run(makeTraceUpload(0x302, { 5, 'A', 8 }));
+	host.run(makeTraceReplay(0x302));
+	CHECK(!host.vdu->hasPendingLookahead());
+	host.run({ 4 });
+}
+
+#endif // TEST_TRACE_H
@@ -0,0 +1,46 @@
+#ifndef TEST_TX_H
+#define TEST_TX_H
+
+// Transmit queue records
+//
+
+#include "host_vdp.h"
+#include "runner.h"
+
+TEST(tx_ring_stages_across_wrap) {
+	SPSCRing<uint8_t> ring;
+	CHECK(ring.begin(8));
+	// move the write position near the end of the storage
+	for (auto i = 0; i < 6; i++) {
+		ring.push(0);
+	}
+	ring.consume(6);
+
+	const uint8_t header[] = { 1, 2 };
+	const uint8_t data[] = { 3, 4, 5, 6 };
+	ring.stage(0, header, sizeof header);
+	ring.stage(sizeof header, data, sizeof data);
+	CHECK(ring.empty());
+	ring.produce(sizeof header + sizeof data);
+	CHECK_EQ(ring.size(), 6);
+	for (uint8_t expected = 1; expected <= 6; expected++) {
+		uint8_t value;
+		CHECK(ring.pop(value));
+		CHECK_EQ(value, expected);
+	}
+}
+
+BENCHMARK(tx_ring_stage_packets) {
+	SPSCRing<uint8_t> ring;
+	ring.begin(TX_QUEUE_SIZE);
+	uint8_t packet[64] = {};
+	benchmark("stage 64 byte records", sizeof packet * 100, 0, [&]() {
+		for (auto i = 0; i < 100; i++) {
+			ring.stage(0, packet, sizeof packet);
+			ring.produce(sizeof packet);
+			ring.consume(sizeof packet);
+		}
+	});
+}
+
+#endif // TEST_TX_H
@@ -0,0 +1,114 @@
+#ifndef TEST_VDU_H
+#define TEST_VDU_H
+
+// VDU stream throughput
+// Each benchmark feeds a representative VDU stream through a processor and reports bytes/sec and ns/command
+//
+
+#include <vector>
+
+#include "host_vdp.h"
+#include "runner.h"
+
+// Append a 16-bit value, as VDU commands expect
+inline void pushWord(std::vector<uint8_t> &data, uint16_t value) {
+	data.push_back(value & 0xFF);
+	data.push_back(value >> 8);
+}
+
+// A run of plot commands drawing a fan of lines
+std::vector<uint8_t> makeLineStream(uint32_t lines) {
+	std::vector<uint8_t> data;
+	for (uint32_t i = 0; i < lines; i++) {
+		data.insert(data.end(), { 25, 4 });
+		pushWord(data, 640);
+		pushWord(data, 512);
+		data.insert(data.end(), { 25, 5 });
+		pushWord(data, (i * 37) % 1280);
+		pushWord(data, (i * 53) % 1024);
+	}
+	return data;
+}
+
+// Text with colour changes, starting from the top of the screen
+// Lines should fit on screen, as scrolling would dominate the time taken
+std::vector<uint8_t> makeTextStream(uint32_t lines) {
+	std::vector<uint8_t> data = { 30 };
+	for (uint32_t i = 0; i < lines; i++) {
+		data.insert(data.end(), { 17, (uint8_t)(i & 15) });
+		for (auto c : "The quick brown fox jumps over the lazy dog") {
+			if (c) {
+				data.push_back(c);
+			}
+		}
+		data.insert(data.end(), { 13, 10 });
+	}
+	return data;
+}
+
+// Run a stream once to count its commands, then benchmark it
+// bytes is the number of VDU bytes the stream represents, if not just its own length
+void benchmarkStream(const char * label, const std::vector<uint8_t> &data, uint64_t bytes = 0) {
+	hostSetup();
+	HostProcessor host;
+	host.run({ 12 });
+	// only the benchmarked data should be replayed
+	host.stream->reset();
+	auto startCount = host.vdu->getCommandCount();
+	host.run(data);
+	auto commands = host.vdu->getCommandCount() - startCount;
+
+	benchmark(label, bytes ? bytes : data.size(), commands, [&]() {
+		host.stream->rewind();
+		host.vdu->processAllAvailable();
+	});
+}
+
+TEST(vdu_counts_commands) {
+	hostSetup();
+	HostProcessor host;
+	host.run({ 17, 3, 18, 0, 1, 30, 12 });
+	CHECK_EQ(host.vdu->getCommandCount(), 4);
+}
+
+TEST(vdu_plots_line) {
+	hostSetup();
+	HostProcessor host;
+	// clear the screen, then draw a horizontal line along the bottom in white
+	host.run({ 12, 18, 0, 15, 25, 4, 0, 0, 0, 0, 25, 5, 0xFE, 0x04, 0, 0 });
+	host.vdu->flushRenderQueue();
+	CHECK(canvas->getPixel(320, canvas->getHeight() - 1) != RGB888(0, 0, 0));
+	CHECK(canvas->getPixel(320, canvas->getHeight() - 2) == RGB888(0, 0, 0));
+}
+
+BENCHMARK(vdu_lines) {
+	benchmarkStream("lines", makeLineStream(1000));
+}
+
+BENCHMARK(vdu_text) {
+	benchmarkStream("text", makeTextStream(20));
+}
+
+// Repeatedly call a buffer of line drawing commands
+void benchmarkBufferedCall(const char * label) {
+	hostSetup();
+	HostProcessor host;
+	auto lines = makeLineStream(200);
+	std::vector<uint8_t> setup = { 23, 0, 0xA0, 0x00, 0x01, 2 };
+	setup.insert(setup.end(), { 23, 0, 0xA0, 0x00, 0x01, 0 });
+	pushWord(setup, lines.size());
+	setup.insert(setup.end(), lines.begin(), lines.end());
+	host.run(setup);
+
+	std::vector<uint8_t> call;
+	for (auto i = 0; i < 10; i++) {
+		call.insert(call.end(), { 23, 0, 0xA0, 0x00, 0x01, 1 });
+	}
+	benchmarkStream(label, call, call.size() + lines.size() * 10);
+}
+
+BENCHMARK(vdu_buffered_call) {
+	benchmarkBufferedCall("buffered call");
+}
+
+#endif // TEST_VDU_H
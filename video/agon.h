@@ -20,6 +20,7 @@
 #define MAX_BITMAPS				256		// Maximum number of bitmaps
 
 // #define VDP_USE_WDT						// Use the esp watchdog timer (experimental)
+// #define VDP_BENCHMARK					// Include the buffer benchmark command
 
 #define UART_BR					1152000	// Max baud rate; previous stable value was 384000
 #define UART_NA					-1
@@ -31,8 +32,29 @@
 #define COMMS_TIMEOUT			200		// Timeout for VDP commands (ms)
 #define FAST_COMMS_TIMEOUT		10		// Fast timeout for VDP commands (ms)
 
+#define TEXT_RUN_LENGTH			64		// Maximum number of characters gathered into a single text plot
+
 #define UART_RX_SIZE			256		// The RX buffer size
 #define UART_RX_THRESH			128		// Point at which RTS is toggled
+#define UART_RING_SIZE			8192	// Size of the receive ring the UART is drained into (rounded up to a power of 2)
+#define UART_RING_HOLD_OFF		512		// Free space in the ring below which RTS holds off the eZ80
+#define UART_RING_RESUME		1024	// Free space needed in the ring before RTS lets the eZ80 send again, and draining resumes after it fills
+#define UART_DRAIN_PRIORITY		5		// Priority of the UART drain task
+#define UART_DRAIN_CORE			1		// Core to run the UART drain task on
+
+#define TX_QUEUE_SIZE			1024	// Size of the queue for high priority data sent to MOS (keyboard and responses)
+#define TX_LOW_QUEUE_SIZE		512		// Size of the queue for low priority data sent to MOS (mouse), which must hold any one packet
+#define TX_PRIORITY				4		// Priority of the transmit task
+#define TX_CORE					1		// Core to run the transmit task on
+
+#define RENDER_QUEUE_SIZE		256		// Number of plot commands that can be queued for the render task
+#define RENDER_PRIORITY			2		// Priority of the render task
+#define RENDER_CORE				1		// Core to run the render task on
+
+#define BLOCK_POOL_MIN_SIZE		16		// Smallest block pool size class, in bytes
+#define BLOCK_POOL_CLASSES		6		// Number of power-of-two size classes in the block pool
+#define BLOCK_POOL_MAX_SIZE		(BLOCK_POOL_MIN_SIZE << (BLOCK_POOL_CLASSES - 1))	// Largest pooled allocation
+#define BLOCK_POOL_SLAB_SIZE	4096	// Size of each slab the block pool carves into items
 
 #define GPIO_ITRP				17		// VSync Interrupt Pin - for reference only
 
@@ -71,6 +93,8 @@
 #define VDP_SHIFT_ORIGIN		0x9F	// Move origin to new position from graphics coordinates, and viewports too
 #define VDP_BUFFERED			0xA0	// Buffered commands
 #define VDP_UPDATER				0xA1	// Update VDP
+#define VDP_TRACE				0xA2	// Serial trace capture and replay
+#define VDP_STATISTICS			0xA3	// Performance statistics
 #define VDP_LOGICALCOORDS		0xC0	// Switch BBC Micro style logical coords on and off
 #define VDP_LEGACYMODES			0xC1	// Switch VDP 1.03 compatible modes on and off
 #define VDP_SWITCHBUFFER		0xC3	// Double buffering control
@@ -95,6 +119,7 @@
 #define PACKET_RTC				0x07	// RTC
 #define PACKET_KEYSTATE			0x08	// Keyboard repeat rate and LED status
 #define PACKET_MOUSE			0x09	// Mouse data
+#define PACKET_STATISTICS		0x23	// Command statistics
 
 #define AUDIO_CHANNELS			3		// Default number of audio channels
 #define AUDIO_DEFAULT_SAMPLE_RATE	16384	// Default sample rate
@@ -183,6 +208,7 @@
 #define MOUSE_SET_SCALING		8		// Set mouse scaling
 #define MOUSE_SET_ACCERATION	9		// Set mouse acceleration (1-2000)
 #define MOUSE_SET_WHEELACC		10		// Set mouse wheel acceleration
+#define MOUSE_SET_PACKET_INTERVAL	11	// Set minimum interval between mouse packets
 
 #define MOUSE_DEFAULT_CURSOR		0		// Default mouse cursor
 #define MOUSE_DEFAULT_SAMPLERATE	60		// Default mouse sample rate
@@ -190,6 +216,7 @@
 #define MOUSE_DEFAULT_SCALING		1		// Default mouse scaling (1:1)
 #define MOUSE_DEFAULT_ACCELERATION	180		// Default mouse acceleration 
 #define MOUSE_DEFAULT_WHEELACC		60000	// Default mouse wheel acceleration
+#define MOUSE_DEFAULT_PACKET_INTERVAL	16	// Default minimum interval between mouse packets (ms, roughly one frame)
 
 // Font management commands
 #define FONT_SELECT						0		// Select a font (by buffer ID, 65535 for system font)
@@ -235,6 +262,25 @@
 #define CONTEXT_RESET_CHAR2BITMAP		0x40	// char-to-bitmap mappings
 #define CONTEXT_RESET_RESERVED			0x80	// reserved for future use
 
+// Trace commands
+#define TRACE_START						0		// Start recording a trace of received bytes
+#define TRACE_STOP						1		// Stop recording
+#define TRACE_SAVE						2		// Save the recorded trace to a buffer
+#define TRACE_DUMP						3		// Dump the recorded trace to the debug serial port
+#define TRACE_REPLAY					4		// Replay a trace from a buffer
+
+#define TRACE_REPLAY_PACED				0x01	// Replay a trace with its original timing
+
+// Statistics commands
+#define STATS_SERIAL					0		// Dump serial receive statistics to the debug serial port
+#define STATS_SERIAL_RESET				1		// Reset serial receive statistics
+#define STATS_COMMAND					2		// Send statistics for a VDU 23, 0 command to MOS
+#define STATS_COMMANDS_DUMP				3		// Dump VDU 23, 0 command statistics to the debug serial port
+#define STATS_COMMANDS_RESET			4		// Reset VDU 23, 0 command statistics
+#define STATS_MOUSE						5		// Dump mouse packet statistics to the debug serial port
+#define STATS_BLOCK_POOL				6		// Dump buffer block pool usage to the debug serial port
+#define STATS_BLOCK_POOL_RESET			7		// Reset buffer block pool allocation counts
+
 // Buffered commands
 #define BUFFERED_WRITE					0x00	// Write to a numbered buffer
 #define BUFFERED_CALL					0x01	// Call buffered commands
@@ -263,13 +309,22 @@
 #define BUFFERED_REVERSE				0x18	// Reverse the order of data in a buffer
 #define BUFFERED_COPY_REF				0x19	// Copy references to blocks from multiple buffers into one buffer
 #define BUFFERED_COPY_AND_CONSOLIDATE	0x1A	// Copy blocks from multiple buffers into one buffer and consolidate them
+#define BUFFERED_ADJUST_STRIDED			0x1B	// Adjust fixed-width elements spaced at a stride through a buffer
+#define BUFFERED_FILL					0x1C	// Fill a buffer region with a repeated byte pattern
+#define BUFFERED_BLIT					0x1D	// Copy a rectangle of pixels between buffers
+#define BUFFERED_ADJUST_MASKED			0x1E	// Strided adjust, changing only the bits set in a mask
 #define BUFFERED_AFFINE_TRANSFORM		0x20	// Create or combine affine transform matrix buffer
 #define BUFFERED_AFFINE_TRANSFORM_APPLY	0x21	// Apply an affine transform matrix to a buffer
 #define BUFFERED_COMPRESS				0x40	// Compress blocks from multiple buffers into one buffer
 #define BUFFERED_DECOMPRESS				0x41	// Decompress blocks from multiple buffers into one buffer
+#define BUFFERED_COMPRESS_TYPE			0x42	// Compress blocks from multiple buffers into one buffer, using a given compression type
+#define BUFFERED_DECOMPRESS_STREAM		0x43	// Decompress data sent with the command into a buffer, bitmap or sample
 #define BUFFERED_EXPAND_BITMAP			0x48	// Expand a bitmap buffer
 
 #define BUFFERED_DEBUG_INFO				0x80	// Get debug info about a buffer
+#ifdef VDP_BENCHMARK
+#define BUFFERED_BENCHMARK				0x81	// Time repeated calls of a buffer, reporting on debug serial
+#endif
 
 // Adjust operation codes
 #define ADJUST_NOT				0x00	// Adjust: NOT
@@ -313,6 +368,21 @@
 #define REVERSE_BLOCK			0x08	// reverse block order
 #define REVERSE_UNUSED_BITS		0xF0	// unused bits
 
+// Fill operation flags
+#define FILL_CREATE				0x01	// replace the buffer with a new one of the fill length, so no offset is given
+#define FILL_ADVANCED_OFFSETS	0x10	// advanced, 24-bit offsets and length
+#define FILL_BUFFER_PATTERN		0x20	// pattern is read from a buffer rather than given inline
+
+// Blit operation flags
+#define BLIT_TRANSPARENT		0x01	// skip source pixels matching a key value, which follows the other arguments
+#define BLIT_CREATE				0x02	// replace the target with a new buffer just holding the rectangle, so no offset or pitch is given
+#define BLIT_ADVANCED_OFFSETS	0x10	// advanced, 24-bit offsets and pitches
+
+// Decompress stream targets
+#define DECOMPRESS_STREAM_BUFFER	0	// store the decompressed data in the buffer
+#define DECOMPRESS_STREAM_BITMAP	1	// make a bitmap from the decompressed data
+#define DECOMPRESS_STREAM_SAMPLE	2	// make a sample from the decompressed data
+
 // Expand bitmap operation flags
 #define EXPAND_BITMAP_SIZE		0x07	// bottom bits indicate the number of bits per pixel in bitmap, 0=8bpp
 #define EXPAND_BITMAP_ALIGNED	0x08	// includes pixel width value to indicate where a byte alignment should be performed
@@ -356,6 +426,8 @@
 
 // Test flags
 #define TEST_FLAG_AFFINE_TRANSFORM	1	// Affine transform test flag
+#define TEST_FLAG_RENDER_PIPELINE	2	// Execute plot commands on a separate render task
+#define TEST_FLAG_COMPILED_BUFFERS	3	// Pre-decode the commands in called buffers
 
 #define LOGICAL_SCRW			1280	// As per the BBC Micro standard
 #define LOGICAL_SCRH			1024
@@ -342,19 +342,21 @@ void redefineCharacter(uint8_t c, uint8_t * data) {
 }
 
 std::shared_ptr<fabgl::FontInfo> createFontFromBuffer(uint16_t bufferId, uint8_t width, uint8_t height, uint8_t ascent, uint8_t flags) {
-	if (bufferId == 65535 || (buffers.find(bufferId) == buffers.end())) {
+	auto bufferBlocks = bufferId == 65535 ? nullptr : buffers.get(bufferId);
+	if (!bufferBlocks) {
 		debug_log("createFontFromBuffer: buffer %d not found\n\r", bufferId);
 		return nullptr;
 	}
-	if (buffers[bufferId].size() != 1) {
+	if (bufferBlocks->size() != 1) {
 		debug_log("createFontFromBuffer: buffer %d is not a singular buffer and cannot be used for a font source\n\r", bufferId);
 		return nullptr;
 	}
+	auto &buffer = bufferBlocks->front();
 
 	if (~flags & FONTINFOFLAGS_VARWIDTH) {
 		// Font is fixed width, so we can calculate the size that our font data should be
 		auto size = ((width + 7) >> 3) * height * 256;
-		if (buffers[bufferId][0]->size() != size) {
+		if (buffer->size() != size) {
 			debug_log("createFontFromBuffer: buffer %d is not the correct size for a fixed width font\n\r", bufferId);
 			return nullptr;
 		}
@@ -364,7 +366,12 @@ std::shared_ptr<fabgl::FontInfo> createFontFromBuffer(uint16_t bufferId, uint8_t
 		return nullptr;
 	}
 
-	auto data = buffers[bufferId][0]->getBuffer();
+	// the font uses the buffer's data in place, so it must not move
+	if (!buffer->pin()) {
+		debug_log("createFontFromBuffer: failed to pin buffer %d\n\r", bufferId);
+		return nullptr;
+	}
+	auto data = buffer->getBuffer();
 
 	auto font = make_shared_psram<fabgl::FontInfo>();
 	font->width = width;
@@ -408,15 +415,20 @@ void setFontInfo(uint16_t bufferId, uint8_t field, uint16_t value) {
 			font->flags = (uint8_t) value;
 		} break;
 		case FONT_INFO_CHARPTRS_BUFFER: {
-			if (buffers.find(value) == buffers.end()) {
+			auto bufferBlocks = buffers.get(value);
+			if (!bufferBlocks) {
 				debug_log("setFontInfo: buffer %d for character pointers not found\n\r", value);
 				return;
 			}
-			if (buffers[value].size() != 1) {
+			if (bufferBlocks->size() != 1) {
 				debug_log("setFontInfo: buffer %d is not a singular buffer and cannot be used for a font character pointer source\n\r", value);
 				return;
 			}
-			font->chptr = (const uint32_t*) (buffers[value][0]->getBuffer());
+			if (!bufferBlocks->front()->pin()) {
+				debug_log("setFontInfo: failed to pin buffer %d\n\r", value);
+				return;
+			}
+			font->chptr = (const uint32_t*) (bufferBlocks->front()->getBuffer());
 		} break;
 		case FONT_INFO_POINTSIZE: {
 			font->pointSize = (uint8_t) value;
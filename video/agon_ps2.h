@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <algorithm>
+#include <limits>
 
 #include <fabgl.h>
 
@@ -20,6 +21,14 @@ uint8_t			mResolution = MOUSE_DEFAULT_RESOLUTION;	// Mouse resolution
 uint8_t			mScaling = MOUSE_DEFAULT_SCALING;	// Mouse scaling
 uint16_t		mAcceleration = MOUSE_DEFAULT_ACCELERATION;	// Mouse acceleration
 uint32_t		mWheelAcc = MOUSE_DEFAULT_WHEELACC;	// Mouse wheel acceleration
+uint8_t			mPacketInterval = MOUSE_DEFAULT_PACKET_INTERVAL;	// Minimum interval between mouse packets (ms)
+
+MouseDelta		mPendingDelta;					// Mouse movement accumulated since the last packet
+bool			mDeltaPending = false;			// Is there accumulated movement to send?
+MouseButtons	mLastButtons = {};				// Button state from the most recent delta
+uint32_t		mLastPacketTime = 0;			// Time the last mouse packet was sent
+uint32_t		mDeltaCount = 0;				// Number of mouse deltas received, for statistics
+uint32_t		mPacketCount = 0;				// Number of mouse packets sent, for statistics
 
 // Forward declarations
 //
@@ -256,6 +265,7 @@ bool disableMouse() {
 	}
 	mouse->suspendPort();
 	mouseEnabled = false;
+	mDeltaPending = false;
 	return true;
 }
 
@@ -370,6 +380,11 @@ bool setMousePos(uint16_t x, uint16_t y) {
 	return true;
 }
 
+bool setMousePacketInterval(uint8_t interval) {
+	mPacketInterval = interval;
+	return true;
+}
+
 bool resetMouse() {
 	auto mouse = getMouse();
 	if (!mouse) {
@@ -382,6 +397,7 @@ bool resetMouse() {
 	setMouseScaling(0);
 	setMouseAcceleration(0);
 	setMouseWheelAcceleration(0);
+	setMousePacketInterval(MOUSE_DEFAULT_PACKET_INTERVAL);
 	return mouse->reset();
 }
 
@@ -401,4 +417,88 @@ bool mouseMoved(MouseDelta * delta) {
 	return false;
 }
 
+// Add to an accumulated movement, clamping at the limits of its type rather than wrapping
+//
+template<typename T>
+T addMouseMovement(T total, T movement) {
+	int32_t sum = (int32_t)total + movement;
+	sum = std::min<int32_t>(sum, std::numeric_limits<T>::max());
+	sum = std::max<int32_t>(sum, std::numeric_limits<T>::min());
+	return sum;
+}
+
+// Does a mouse delta change the button state from the last delta accumulated?
+//
+bool mouseButtonsChanged(const MouseDelta &delta) {
+	return delta.buttons.left != mLastButtons.left
+		|| delta.buttons.middle != mLastButtons.middle
+		|| delta.buttons.right != mLastButtons.right;
+}
+
+// Add a mouse delta to the movement waiting to be sent
+// Returns true if the button state has changed, in which case a packet should be sent immediately
+//
+bool accumulateMouseDelta(const MouseDelta &delta) {
+	mDeltaCount++;
+	if (mDeltaPending) {
+		mPendingDelta.deltaX = addMouseMovement(mPendingDelta.deltaX, delta.deltaX);
+		mPendingDelta.deltaY = addMouseMovement(mPendingDelta.deltaY, delta.deltaY);
+		mPendingDelta.deltaZ = addMouseMovement(mPendingDelta.deltaZ, delta.deltaZ);
+		mPendingDelta.buttons = delta.buttons;
+	} else {
+		mPendingDelta = delta;
+		mDeltaPending = true;
+	}
+	auto buttonsChanged = mouseButtonsChanged(delta);
+	mLastButtons = delta.buttons;
+	return buttonsChanged;
+}
+
+// Take the accumulated mouse movement, if it is due to be sent
+// Movement is sent at most once per mPacketInterval ms, unless immediate is set
+// Returns true if delta has been filled in and a packet should be sent
+//
+bool takeMouseDelta(MouseDelta * delta, bool immediate) {
+	if (!mDeltaPending) {
+		return false;
+	}
+	auto now = millis();
+	if (!immediate && (now - mLastPacketTime) < mPacketInterval) {
+		return false;
+	}
+	*delta = mPendingDelta;
+	mDeltaPending = false;
+	mLastPacketTime = now;
+	mPacketCount++;
+	return true;
+}
+
+// Gather the mouse deltas that have arrived, calling send with each packet that is due
+// Movement made before a button change is sent first, with the buttons as they were,
+// and then the change is sent straight away
+// With a packet interval of zero, each delta is sent in a packet of its own
+// Returns true if the mouse moved
+//
+template<typename F>
+bool gatherMouseDeltas(F send) {
+	MouseDelta delta;
+	bool moved = false;
+	bool buttonsChanged = false;
+	while (!buttonsChanged && mouseMoved(&delta)) {
+		moved = true;
+		MouseDelta pending;
+		if (mouseButtonsChanged(delta) && takeMouseDelta(&pending, true)) {
+			send(pending);
+		}
+		buttonsChanged = accumulateMouseDelta(delta);
+		if (mPacketInterval == 0) {
+			break;
+		}
+	}
+	if (takeMouseDelta(&delta, buttonsChanged)) {
+		send(delta);
+	}
+	return moved;
+}
+
 #endif // AGON_PS2_H
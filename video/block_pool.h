@@ -0,0 +1,291 @@
+#ifndef BLOCK_POOL_H
+#define BLOCK_POOL_H
+
+#include <memory>
+
+#include "agon.h"
+#include "types.h"
+
+extern void force_debug_log(const char *format, ...);
+
+// BlockPool is a size-classed slab allocator for small allocations
+// Requests up to BLOCK_POOL_MAX_SIZE bytes are rounded up to a power-of-two size class,
+// and served from slabs of BLOCK_POOL_SLAB_SIZE bytes carved into equal items with an intrusive free list
+// Larger requests fall through to the regular PSRAM-preferring heap
+// Slabs are kept once allocated, so splitting a buffer into many small chunks re-uses memory
+// rather than fragmenting the heap with thousands of tiny allocations
+// Callers must pass the same size to deallocate that they passed to allocate
+//
+class BlockPool {
+	public:
+		void * allocate(size_t size);
+		void deallocate(void * ptr, size_t size);
+
+		// Usage of the size class that serves requests of a given size
+		struct ClassStats {
+			uint32_t slabs;
+			uint32_t inUse;
+			uint32_t requestedBytes;
+			uint32_t allocations;
+		};
+		ClassStats getClassStats(size_t size);
+		uint32_t getHeapAllocations();
+		uint32_t getHeapInUse();
+		uint32_t getFailures();
+
+		void resetStats();
+		void dumpStats();
+
+	private:
+		static constexpr uint8_t classCount = BLOCK_POOL_CLASSES;
+
+		struct FreeItem {
+			FreeItem * next;
+		};
+		struct SizeClass {
+			FreeItem * freeList = nullptr;
+			uint32_t slabs = 0;
+			uint32_t inUse = 0;
+			uint32_t peakInUse = 0;
+			uint32_t requestedBytes = 0;	// bytes actually asked for by items in use
+			uint32_t allocations = 0;
+		};
+
+		static inline size_t classSize(uint8_t index) {
+			return BLOCK_POOL_MIN_SIZE << index;
+		}
+		static inline int8_t classIndex(size_t size) {
+			if (size > BLOCK_POOL_MAX_SIZE) {
+				return -1;
+			}
+			int8_t index = 0;
+			while (classSize(index) < size) {
+				index++;
+			}
+			return index;
+		}
+		bool addSlab(SizeClass &sizeClass, size_t itemSize);
+
+		SizeClass classes[classCount];
+		uint32_t heapAllocations = 0;
+		uint32_t heapInUse = 0;
+		uint32_t failures = 0;
+		portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+};
+
+void * BlockPool::allocate(size_t size) {
+	auto index = classIndex(size);
+	if (index < 0) {
+		auto ptr = PreferPSRAMAlloc(size);
+		portENTER_CRITICAL(&lock);
+		if (ptr) {
+			heapAllocations++;
+			heapInUse++;
+		} else {
+			failures++;
+		}
+		portEXIT_CRITICAL(&lock);
+		return ptr;
+	}
+
+	auto &sizeClass = classes[index];
+	portENTER_CRITICAL(&lock);
+	auto item = sizeClass.freeList;
+	if (item) {
+		sizeClass.freeList = item->next;
+		sizeClass.inUse++;
+		sizeClass.allocations++;
+		sizeClass.requestedBytes += size;
+		if (sizeClass.inUse > sizeClass.peakInUse) {
+			sizeClass.peakInUse = sizeClass.inUse;
+		}
+	}
+	portEXIT_CRITICAL(&lock);
+	if (item) {
+		return item;
+	}
+
+	// free list is empty, so add a new slab and try again
+	if (!addSlab(sizeClass, classSize(index))) {
+		portENTER_CRITICAL(&lock);
+		failures++;
+		portEXIT_CRITICAL(&lock);
+		return nullptr;
+	}
+	return allocate(size);
+}
+
+void BlockPool::deallocate(void * ptr, size_t size) {
+	if (!ptr) {
+		return;
+	}
+	auto index = classIndex(size);
+	if (index < 0) {
+		free(ptr);
+		portENTER_CRITICAL(&lock);
+		heapInUse--;
+		portEXIT_CRITICAL(&lock);
+		return;
+	}
+
+	auto &sizeClass = classes[index];
+	auto item = (FreeItem *)ptr;
+	portENTER_CRITICAL(&lock);
+	item->next = sizeClass.freeList;
+	sizeClass.freeList = item;
+	sizeClass.inUse--;
+	sizeClass.requestedBytes -= size;
+	portEXIT_CRITICAL(&lock);
+}
+
+// Allocate a new slab, and thread its items onto the free list
+// The slab memory is never returned to the heap
+//
+bool BlockPool::addSlab(SizeClass &sizeClass, size_t itemSize) {
+	auto slab = (uint8_t *)PreferPSRAMAlloc(BLOCK_POOL_SLAB_SIZE);
+	if (!slab) {
+		return false;
+	}
+	auto itemCount = BLOCK_POOL_SLAB_SIZE / itemSize;
+	for (size_t i = 0; i < itemCount - 1; i++) {
+		((FreeItem *)(slab + i * itemSize))->next = (FreeItem *)(slab + (i + 1) * itemSize);
+	}
+	auto last = (FreeItem *)(slab + (itemCount - 1) * itemSize);
+
+	portENTER_CRITICAL(&lock);
+	last->next = sizeClass.freeList;
+	sizeClass.freeList = (FreeItem *)slab;
+	sizeClass.slabs++;
+	portEXIT_CRITICAL(&lock);
+	return true;
+}
+
+// Returns all zeros for requests too large for the pool, which are served by the heap
+//
+BlockPool::ClassStats BlockPool::getClassStats(size_t size) {
+	ClassStats stats = {};
+	auto index = classIndex(size);
+	if (index < 0) {
+		return stats;
+	}
+	auto &sizeClass = classes[index];
+	portENTER_CRITICAL(&lock);
+	stats.slabs = sizeClass.slabs;
+	stats.inUse = sizeClass.inUse;
+	stats.requestedBytes = sizeClass.requestedBytes;
+	stats.allocations = sizeClass.allocations;
+	portEXIT_CRITICAL(&lock);
+	return stats;
+}
+
+uint32_t BlockPool::getHeapAllocations() {
+	portENTER_CRITICAL(&lock);
+	auto value = heapAllocations;
+	portEXIT_CRITICAL(&lock);
+	return value;
+}
+
+uint32_t BlockPool::getHeapInUse() {
+	portENTER_CRITICAL(&lock);
+	auto value = heapInUse;
+	portEXIT_CRITICAL(&lock);
+	return value;
+}
+
+uint32_t BlockPool::getFailures() {
+	portENTER_CRITICAL(&lock);
+	auto value = failures;
+	portEXIT_CRITICAL(&lock);
+	return value;
+}
+
+void BlockPool::resetStats() {
+	portENTER_CRITICAL(&lock);
+	for (auto &sizeClass : classes) {
+		sizeClass.peakInUse = sizeClass.inUse;
+		sizeClass.allocations = 0;
+	}
+	heapAllocations = 0;
+	failures = 0;
+	portEXIT_CRITICAL(&lock);
+}
+
+// Dump usage to the debug serial port
+// "waste" is memory reserved in slabs that is not holding requested data,
+// either because items are free, or because requests were rounded up to their size class
+//
+void BlockPool::dumpStats() {
+	uint32_t totalReserved = 0;
+	uint32_t totalRequested = 0;
+	for (uint8_t i = 0; i < classCount; i++) {
+		auto &sizeClass = classes[i];
+		if (sizeClass.slabs == 0) {
+			continue;
+		}
+		uint32_t reserved = sizeClass.slabs * BLOCK_POOL_SLAB_SIZE;
+		totalReserved += reserved;
+		totalRequested += sizeClass.requestedBytes;
+		force_debug_log("BlockPool: %4u byte class, %3u slabs, %6u in use (peak %6u), %8u allocations, %7u bytes wasted\n\r",
+			classSize(i), sizeClass.slabs, sizeClass.inUse, sizeClass.peakInUse, sizeClass.allocations,
+			reserved - sizeClass.requestedBytes);
+	}
+	force_debug_log("BlockPool: %u bytes in slabs holding %u requested bytes (%u%% used)\n\r",
+		totalReserved, totalRequested, totalReserved ? (uint32_t)((uint64_t)totalRequested * 100 / totalReserved) : 0);
+	force_debug_log("BlockPool: %u heap allocations, %u still in use, %u failures\n\r",
+		heapAllocations, heapInUse, failures);
+}
+
+BlockPool blockPool;
+
+// pool_allocator
+//
+// A C++ allocator that allocates from the block pool, falling back to PSRAM for larger allocations
+// Used with std::allocate_shared so that an object and its shared_ptr control block
+// come from a single pooled allocation
+
+template <typename T>
+class pool_allocator
+{
+public:
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef T value_type;
+
+	pool_allocator(){}
+	~pool_allocator(){}
+
+	template <class U> struct rebind { typedef pool_allocator<U> other; };
+	template <class U> pool_allocator(const pool_allocator<U>&){}
+
+	pointer allocate(size_type n, const void * = 0)
+	{
+		return static_cast<pointer>(blockPool.allocate(n * sizeof(T)));
+	}
+
+	void deallocate(pointer p, size_type n)
+	{
+		blockPool.deallocate(p, n * sizeof(T));
+	}
+};
+
+template <typename T, typename U>
+inline bool operator==(const pool_allocator<T>&, const pool_allocator<U>&) { return true; }
+template <typename T, typename U>
+inline bool operator!=(const pool_allocator<T>&, const pool_allocator<U>&) { return false; }
+
+// make_shared_pooled
+//
+// Same as std::make_shared except allocates from the block pool
+
+template<typename T, typename... Args>
+std::shared_ptr<T> make_shared_pooled(Args&&... args)
+{
+	pool_allocator<T> allocator;
+	return std::allocate_shared<T>(allocator, std::forward<Args>(args)...);
+}
+
+#endif // BLOCK_POOL_H
@@ -0,0 +1,80 @@
+#ifndef BUFFER_INDEX_H
+#define BUFFER_INDEX_H
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "buffer_stream.h"
+#include "types.h"
+
+// BufferIndex is a snapshot of the blocks in a buffer, along with the offset of each block within the whole buffer
+// This gives the total size in constant time, and finds the block holding any offset with a binary search
+// Snapshots are shared, so anything holding one sees the block list as it was when the snapshot was taken
+//
+class BufferIndex {
+	public:
+		BufferIndex(std::vector<std::shared_ptr<BufferStream>> blocks);
+
+		inline const std::vector<std::shared_ptr<BufferStream>> &getBlocks() const {
+			return blocks;
+		}
+		inline const std::shared_ptr<BufferStream> &operator[](size_t index) const {
+			return blocks[index];
+		}
+		inline size_t blockCount() const {
+			return blocks.size();
+		}
+		// Total size of all blocks
+		inline uint32_t size() const {
+			return offsets.back();
+		}
+		// Offset of a block from the start of the buffer
+		inline uint32_t blockStart(size_t index) const {
+			return offsets[index];
+		}
+
+		bool resolve(uint32_t &blockOffset, size_t &blockIndex) const;
+
+	private:
+		std::vector<std::shared_ptr<BufferStream>> blocks;
+		std::vector<uint32_t> offsets;		// one more entry than blocks, so the last is the total size
+};
+
+BufferIndex::BufferIndex(std::vector<std::shared_ptr<BufferStream>> blocks) : blocks(std::move(blocks)) {
+	offsets.reserve(this->blocks.size() + 1);
+	uint32_t offset = 0;
+	offsets.push_back(offset);
+	for (auto &block : this->blocks) {
+		offset += block->size();
+		offsets.push_back(offset);
+	}
+}
+
+// Resolve an offset, which may run past the end of the given block, to the block that contains it
+// blockOffset and blockIndex are updated to point into the containing block
+// Returns false if the offset is beyond the end of the buffer, leaving blockIndex as the block count
+//
+bool BufferIndex::resolve(uint32_t &blockOffset, size_t &blockIndex) const {
+	if (blockIndex >= blocks.size()) {
+		return false;
+	}
+	if (blockOffset < blocks[blockIndex]->size()) {
+		// common case - the offset is within the given block
+		return true;
+	}
+	uint64_t position = (uint64_t)offsets[blockIndex] + blockOffset;
+	if (position >= size()) {
+		blockOffset = position - size();
+		blockIndex = blocks.size();
+		return false;
+	}
+	// find the last block starting at or before our position, skipping any empty blocks
+	auto start = offsets.begin() + blockIndex + 1;
+	auto found = std::upper_bound(start, offsets.end(), (uint32_t)position) - 1;
+	blockIndex = found - offsets.begin();
+	blockOffset = position - *found;
+	return true;
+}
+
+#endif // BUFFER_INDEX_H
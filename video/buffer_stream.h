@@ -1,14 +1,63 @@
 #ifndef BUFFER_STREAM_H
 #define BUFFER_STREAM_H
 
+#include <atomic>
 #include <memory>
 #include <Stream.h>
 
+#include "block_pool.h"
 #include "types.h"
 
+// BufferStorage is a reference-counted block of buffer data, allocated from the block pool
+// The data immediately follows the header, so a block and its count are a single allocation
+//
+struct BufferStorage {
+	std::atomic<uint32_t> refs;
+	uint32_t length;
+
+	inline uint8_t * data() {
+		return (uint8_t *)(this + 1);
+	}
+
+	static BufferStorage * create(uint32_t length) {
+		auto storage = (BufferStorage *)blockPool.allocate(sizeof(BufferStorage) + length);
+		if (storage) {
+			new (&storage->refs) std::atomic<uint32_t>(1);
+			storage->length = length;
+		}
+		return storage;
+	}
+	inline void acquire() {
+		refs.fetch_add(1, std::memory_order_relaxed);
+	}
+	void release() {
+		if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			blockPool.deallocate(this, sizeof(BufferStorage) + length);
+		}
+	}
+};
+
+// BufferStream holds a block of buffer data
+// The stream itself should be created with make_shared_pooled so it comes from the block pool too
+//
+// A stream can also be a slice - a view onto part of another stream's storage, made without copying
+// Storage shared between streams is copied on write, so a slice behaves exactly like a copy
+// A slice using only a small part of storage it no longer shares is also copied on write,
+// so the rest of the storage can be freed
+// Streams whose data address is held elsewhere (such as by a bitmap) are pinned,
+// which gives them their own storage so their address never changes, and slicing them copies instead
+//
 class BufferStream : public Stream {
 	public:
 		BufferStream(uint32_t bufferLength);
+		BufferStream(const BufferStream &source, uint32_t offset, uint32_t length);
+		BufferStream(const BufferStream &) = delete;
+		BufferStream &operator=(const BufferStream &) = delete;
+		virtual ~BufferStream() {
+			if (storage) {
+				storage->release();
+			}
+		}
 		int available();
 		int read();
 		int peek();
@@ -30,11 +79,16 @@ class BufferStream : public Stream {
 			bufferPosition = position;
 		}
 
+		// Note that writes through getBuffer are only safe on newly created streams
+		// Existing streams should be modified via getWritableBuffer
 		inline uint8_t * getBuffer() {
-			return buffer.get();
+			return buffer;
+		}
+		inline uint8_t * getWritableBuffer() {
+			return makeWritable() ? buffer : nullptr;
 		}
 		inline const uint8_t * getBuffer() const {
-			return buffer.get();
+			return buffer;
 		}
 		inline uint32_t size() const {
 			return bufferLength;
@@ -46,14 +100,80 @@ class BufferStream : public Stream {
 		bool writeBuffer(uint8_t * data, uint32_t length, uint32_t offset);
 		void writeBufferByte(uint8_t data, uint32_t offset);
 		bool incrementBufferByte(uint32_t offset, int8_t by);
+
+		inline bool isShared() const {
+			return storage && storage->refs.load(std::memory_order_relaxed) > 1;
+		}
+		// Whether the stream uses at least half of its storage
+		inline bool isCompact() const {
+			return !storage || (uint64_t)bufferLength * 2 >= storage->length;
+		}
+		inline uint32_t getStorageLength() const {
+			return storage ? storage->length : 0;
+		}
+		bool makeWritable();
+		bool pin();
+		inline bool isPinned() const {
+			return pinned;
+		}
+		// Incremented whenever the stream's data may be modified
+		inline uint32_t getVersion() const {
+			return version;
+		}
 	protected:
-		std::unique_ptr<uint8_t[]> buffer;
+		BufferStorage * storage;
+		uint8_t * buffer;
 		uint32_t bufferLength;
 		uint32_t bufferPosition;
+		bool pinned = false;
+		uint32_t version = 0;
 };
 
 BufferStream::BufferStream(uint32_t bufferLength) : bufferLength(bufferLength), bufferPosition(0) {
-	buffer = make_unique_psram_array<uint8_t>(bufferLength);
+	storage = BufferStorage::create(bufferLength);
+	buffer = storage ? storage->data() : nullptr;
+}
+
+// Create a slice of another stream, sharing its storage
+// The caller must ensure the range is within the source
+//
+BufferStream::BufferStream(const BufferStream &source, uint32_t offset, uint32_t length) :
+	storage(source.storage), buffer(source.buffer + offset), bufferLength(length), bufferPosition(0) {
+	if (storage) {
+		storage->acquire();
+	}
+}
+
+// Ensure this stream has storage of its own, copying its data if the storage is shared,
+// or if it is a small slice of a larger block
+// This is called before every modification, so it also updates the stream's version
+// Returns false if a copy was needed but could not be allocated
+//
+bool BufferStream::makeWritable() {
+	version++;
+	if (!isShared() && (isCompact() || pinned)) {
+		return true;
+	}
+	auto newStorage = BufferStorage::create(bufferLength);
+	if (!newStorage) {
+		debug_log("BufferStream::makeWritable: failed to copy %d bytes\n\r", bufferLength);
+		return false;
+	}
+	memcpy(newStorage->data(), buffer, bufferLength);
+	storage->release();
+	storage = newStorage;
+	buffer = newStorage->data();
+	return true;
+}
+
+// Pin the stream's data at its current address
+//
+bool BufferStream::pin() {
+	if (!makeWritable()) {
+		return false;
+	}
+	pinned = true;
+	return true;
 }
 
 int BufferStream::available() {
@@ -90,7 +210,10 @@ bool BufferStream::writeBuffer(uint8_t * data, uint32_t length, uint32_t offset
 	// TODO consider return type - we could support writing to buffer limit,
 	// and returning how many bytes were written
 	if (length + offset <= bufferLength) {
-		memcpy(buffer.get() + offset, data, length);
+		if (!makeWritable()) {
+			return false;
+		}
+		memcpy(buffer + offset, data, length);
 		return true;
 	} else {
 		debug_log("BufferStream::writeBuffer: buffer overflow\n\r");
@@ -99,7 +222,7 @@ bool BufferStream::writeBuffer(uint8_t * data, uint32_t length, uint32_t offset
 }
 
 void BufferStream::writeBufferByte(uint8_t data, uint32_t offset = 0) {
-	if (offset < bufferLength) {
+	if (offset < bufferLength && makeWritable()) {
 		buffer[offset] = data;
 	}
 }
@@ -108,7 +231,7 @@ void BufferStream::writeBufferByte(uint8_t data, uint32_t offset = 0) {
 // accepts an offset and a value to increment by
 // returns true if value overflowed
 bool BufferStream::incrementBufferByte(uint32_t offset = 0, int8_t by = 1) {
-	if (offset < bufferLength) {
+	if (offset < bufferLength && makeWritable()) {
 		auto oldValue = buffer[offset];
 		buffer[offset] += by;
 
@@ -140,7 +263,7 @@ class WritableBufferStream : public BufferStream {
 };
 
 size_t WritableBufferStream::write(uint8_t b) {
-	if (bufferWritePosition < bufferLength) {
+	if (bufferWritePosition < bufferLength && makeWritable()) {
 		buffer[bufferWritePosition++] = b;
 		return 1;
 	}
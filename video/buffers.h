@@ -3,12 +3,168 @@
 
 #include <memory>
 #include <vector>
-#include <unordered_map>
 
+#include "buffer_index.h"
 #include "buffer_stream.h"
+#include "compiled_buffer.h"
 #include "span.h"
+#include "types.h"
 
-std::unordered_map<uint16_t, std::vector<std::shared_ptr<BufferStream>>> buffers;
+// BufferTable holds the blocks for every buffer, indexed directly by buffer ID
+// IDs are split into a high byte selecting a page, and a low byte selecting a slot within that page
+// Pages are allocated on demand (preferentially in PSRAM) and freed again once they hold no buffers,
+// so lookups are two array indexes with no hashing, and an empty table costs only the page pointers
+// Each buffer also caches a BufferIndex of its blocks, built on first use, and optionally a compiled
+// version of its commands.  Both are discarded whenever the block list may have been modified,
+// which is any access via create or getMutable
+//
+class BufferTable {
+	public:
+		using Blocks = std::vector<std::shared_ptr<BufferStream>>;
+
+		// Get the blocks for a buffer, or nullptr if the buffer doesn't exist
+		inline const Blocks * get(uint16_t id) {
+			auto slot = getSlot(id);
+			return slot ? &slot->blocks : nullptr;
+		}
+
+		// Get the blocks for a buffer for modification, or nullptr if the buffer doesn't exist
+		Blocks * getMutable(uint16_t id) {
+			auto slot = getSlot(id);
+			if (!slot) {
+				return nullptr;
+			}
+			slot->index = nullptr;
+			slot->compiled = nullptr;
+			return &slot->blocks;
+		}
+
+		// Get the index for a buffer, or nullptr if the buffer doesn't exist
+		std::shared_ptr<const BufferIndex> getIndex(uint16_t id) {
+			auto slot = getSlot(id);
+			if (!slot) {
+				return nullptr;
+			}
+			if (!slot->index) {
+				slot->index = make_shared_psram<BufferIndex>(slot->blocks);
+			}
+			return slot->index;
+		}
+
+		// Get the compiled commands for a buffer, or nullptr if it has not been compiled,
+		// or its data has changed since
+		std::shared_ptr<const CompiledBuffer> getCompiled(uint16_t id) {
+			auto slot = getSlot(id);
+			if (!slot || !slot->compiled) {
+				return nullptr;
+			}
+			if (!slot->compiled->isCurrent(slot->blocks)) {
+				slot->compiled = nullptr;
+			}
+			return slot->compiled;
+		}
+		void setCompiled(uint16_t id, std::shared_ptr<const CompiledBuffer> compiled) {
+			auto slot = getSlot(id);
+			if (slot) {
+				slot->compiled = std::move(compiled);
+			}
+		}
+
+		// Get the blocks for a buffer for modification, creating an empty buffer if it doesn't exist
+		// Returns nullptr if there is not enough memory to create the buffer
+		Blocks * create(uint16_t id) {
+			auto &page = pages[id >> 8];
+			if (!page) {
+				page = make_unique_psram<Page>();
+				if (!page) {
+					return nullptr;
+				}
+			}
+			auto &slot = page->slots[id & 0xFF];
+			if (!slot.used) {
+				slot.used = true;
+				page->count++;
+				count++;
+			}
+			slot.index = nullptr;
+			slot.compiled = nullptr;
+			return &slot.blocks;
+		}
+
+		void erase(uint16_t id) {
+			auto &page = pages[id >> 8];
+			if (!page) {
+				return;
+			}
+			auto &slot = page->slots[id & 0xFF];
+			if (!slot.used) {
+				return;
+			}
+			slot.blocks.clear();
+			slot.blocks.shrink_to_fit();
+			slot.index = nullptr;
+			slot.compiled = nullptr;
+			slot.used = false;
+			count--;
+			if (--page->count == 0) {
+				page = nullptr;
+			}
+		}
+
+		void clear() {
+			for (auto &page : pages) {
+				page = nullptr;
+			}
+			count = 0;
+		}
+
+		inline uint32_t size() const {
+			return count;
+		}
+
+		// Call fn(id, blocks) for every buffer, in ID order
+		template<typename F>
+		void forEach(F fn) {
+			for (uint32_t pageIndex = 0; pageIndex < 256; pageIndex++) {
+				auto &page = pages[pageIndex];
+				if (!page) {
+					continue;
+				}
+				for (uint32_t slotIndex = 0; slotIndex < 256; slotIndex++) {
+					auto &slot = page->slots[slotIndex];
+					if (slot.used) {
+						fn((uint16_t)((pageIndex << 8) | slotIndex), (const Blocks &)slot.blocks);
+					}
+				}
+			}
+		}
+
+	private:
+		struct BufferSlot {
+			Blocks blocks;
+			std::shared_ptr<const BufferIndex> index;
+			std::shared_ptr<const CompiledBuffer> compiled;
+			bool used = false;
+		};
+		struct Page {
+			BufferSlot slots[256];
+			uint32_t count = 0;
+		};
+
+		inline BufferSlot * getSlot(uint16_t id) {
+			auto &page = pages[id >> 8];
+			if (!page) {
+				return nullptr;
+			}
+			auto &slot = page->slots[id & 0xFF];
+			return slot.used ? &slot : nullptr;
+		}
+
+		std::unique_ptr<Page> pages[256];
+		uint32_t count = 0;
+};
+
+BufferTable buffers;
 
 // Utility functions for buffer management:
 
@@ -85,7 +241,7 @@ std::shared_ptr<BufferStream> consolidateBuffers(const std::vector<std::shared_p
 	for (auto &block : streams) {
 		length += block->size();
 	}
-	auto bufferStream = make_shared_psram<BufferStream>(length);
+	auto bufferStream = make_shared_pooled<BufferStream>(length);
 	if (!bufferStream || !bufferStream->getBuffer()) {
 		// buffer couldn't be created
 		return nullptr;
@@ -99,30 +255,38 @@ std::shared_ptr<BufferStream> consolidateBuffers(const std::vector<std::shared_p
 	return bufferStream;
 }
 
+// make a block holding part of another block
+// this is a slice sharing the source's storage, unless the source is pinned in which case the data is copied
+std::shared_ptr<BufferStream> sliceBuffer(const std::shared_ptr<BufferStream> &source, uint32_t offset, uint32_t length) {
+	if (!source->isPinned()) {
+		return make_shared_pooled<BufferStream>(*source, offset, length);
+	}
+	auto bufferStream = make_shared_pooled<BufferStream>(length);
+	if (!bufferStream || !bufferStream->getBuffer()) {
+		return nullptr;
+	}
+	memcpy(bufferStream->getBuffer(), source->getBuffer() + offset, length);
+	return bufferStream;
+}
+
 // split a buffer into multiple blocks/chunks
+// chunks are slices of the source buffer, so no data is copied
 std::vector<std::shared_ptr<BufferStream>> splitBuffer(std::shared_ptr<BufferStream> buffer, uint16_t length) {
 	std::vector<std::shared_ptr<BufferStream>> chunks;
 	auto totalLength = buffer->size();
-	auto remaining = totalLength;
-	auto sourceData = buffer->getBuffer();
-
-	// chop up source data by length, storing into new buffers
-	// looping the buffer list until we have no data left
-	while (remaining > 0) {
-		auto bufferLength = length;
-		if (remaining < bufferLength) {
-			bufferLength = remaining;
-		}
-		auto chunk = make_shared_psram<BufferStream>(bufferLength);
-		if (!chunk || !chunk->getBuffer()) {
+	uint32_t offset = 0;
+
+	// chop up source data by length
+	while (offset < totalLength) {
+		uint32_t bufferLength = std::min<uint32_t>(length, totalLength - offset);
+		auto chunk = sliceBuffer(buffer, offset, bufferLength);
+		if (!chunk) {
 			// buffer couldn't be created, so return an empty vector
 			chunks.clear();
 			break;
 		}
-		memcpy(chunk->getBuffer(), sourceData, bufferLength);
 		chunks.push_back(std::move(chunk));
-		sourceData += bufferLength;
-		remaining -= bufferLength;
+		offset += bufferLength;
 	}
 	return chunks;
 }
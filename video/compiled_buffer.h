@@ -0,0 +1,51 @@
+#ifndef COMPILED_BUFFER_H
+#define COMPILED_BUFFER_H
+
+#include <memory>
+#include <vector>
+
+#include "buffer_index.h"
+#include "buffer_stream.h"
+#include "types.h"
+
+// A single command pre-decoded from a buffer
+//
+struct CompiledCommand {
+	enum Type : uint8_t {
+		Bytes,		// any other fixed-length command, executed by interpreting its bytes
+		Text,		// a run of printable characters
+		Plot,		// VDU 25, with the mode in code and pre-decoded coordinates
+	};
+	uint8_t type;
+	uint8_t code;
+	uint16_t length;		// number of bytes the command occupies in the buffer
+	int16_t x;
+	int16_t y;
+};
+
+// CompiledBuffer is the result of pre-decoding the commands in a buffer
+// Only a prefix of fixed-length commands is compiled - it stops at the first command
+// whose length depends on its arguments, or which may change the flow of execution,
+// and the remainder of the buffer is interpreted as normal
+// The version of each source block is recorded, so modifying a block's data makes the compiled copy stale
+//
+struct CompiledBuffer {
+	std::vector<CompiledCommand, psram_allocator<CompiledCommand>> commands;
+	std::shared_ptr<const BufferIndex> data;		// a single block holding the buffer's bytes
+	uint32_t length = 0;							// number of bytes covered by the compiled commands
+	std::vector<uint32_t> versions;
+
+	bool isCurrent(const std::vector<std::shared_ptr<BufferStream>> &blocks) const {
+		if (blocks.size() != versions.size()) {
+			return false;
+		}
+		for (size_t i = 0; i < blocks.size(); i++) {
+			if (blocks[i]->getVersion() != versions[i]) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+#endif // COMPILED_BUFFER_H
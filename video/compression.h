@@ -21,13 +21,23 @@ extern void debug_log(const char * format, ...);		// Debug log function
 // 11iiiiiiii   String of 16 bytes starting at window index iiiiiiii
 //
 // Note: Worst case, the output can be 25% LARGER than the input!
+//
+// A second, LZ4-style format is also supported, with COMPRESSION_TYPE_LZ in the header.
+// This is byte-aligned, with a window of 64KB and matches of any length from 4 bytes,
+// so compresses bitmaps far better, and decodes much faster. See agon_lz_compress for details.
 
 #define COMPRESSION_WINDOW_SIZE 256     // power of 2
 #define COMPRESSION_STRING_SIZE 16      // power of 2
 #define COMPRESSION_TYPE_TURBO  'T'     // TurboVega-style compression
+#define COMPRESSION_TYPE_LZ     'L'     // LZ4-style compression
 #define TEMP_BUFFER_SIZE        256
 
-#define COMPRESSION_OUTPUT_CHUNK_SIZE	1024 // used to extend temporary buffer
+#define COMPRESSION_OUTPUT_CHUNK_SIZE	4096 // size of each block of compressed output
+#define COMPRESSION_HASH_SIZE   256     // buckets in the window match index, power of 2
+#define COMPRESSION_MIN_MATCH   4       // bytes hashed to find candidate window matches
+#define LZ_HASH_BITS            12      // size of the LZ match finder hash table, as a power of 2
+#define LZ_MAX_OFFSET           65535   // furthest back an LZ match can refer to
+#define LZ_MIN_MATCH            4       // shortest LZ match
 
 #pragma pack(push, 1)
 typedef struct {
@@ -39,7 +49,6 @@ typedef struct {
 
 
 typedef void (*WriteCompressedByte)(void*, uint8_t);
-typedef bool (*WriteDecompressedByte)(void*, uint8_t);
 
 typedef struct {
     void*               context;
@@ -56,18 +65,19 @@ typedef struct {
     uint8_t             temp_buffer[TEMP_BUFFER_SIZE];
     uint8_t             out_byte;
     uint8_t             out_bits;
+    // Index of window positions by the hash of the 4 bytes starting there
+    // Entries are window positions plus 1, so that 0 marks the end of a chain
+    // Chains are kept in ascending position order, matching the order of a linear scan
+    uint8_t             hash_head[COMPRESSION_HASH_SIZE];
+    uint8_t             hash_next[COMPRESSION_WINDOW_SIZE];
+    uint8_t             hash_prev[COMPRESSION_WINDOW_SIZE];
 } CompressionData;
 
 typedef struct {
-    void*               context;
-    WriteDecompressedByte write_fcn;
-    uint32_t            window_size;
     uint32_t            window_write_index;
-    uint32_t            input_count;
     uint32_t            output_count;
     uint32_t            orig_size;
     uint8_t             window_data[COMPRESSION_WINDOW_SIZE];
-    uint8_t             temp_buffer[TEMP_BUFFER_SIZE];
     uint16_t            code;
     uint8_t             code_bits;
 } DecompressionData;
@@ -94,39 +104,67 @@ void agon_write_compressed_byte(CompressionData* cd, uint8_t comp_byte) {
     }
 }
 
-// Write compressed output to a temporary buffer
+// Hash the first 4 bytes of a string, to index window positions that may match it
 //
-static void local_write_compressed_byte(void* p_cd, uint8_t comp_byte) {
-	CompressionData* cd = (CompressionData*) p_cd;
-    uint8_t** pp_temp = (uint8_t**) cd->context;
-	uint8_t* p_temp = *pp_temp;
-	p_temp[cd->output_count++] = comp_byte;
-	if (!(cd->output_count & (COMPRESSION_OUTPUT_CHUNK_SIZE-1))) {
-		// extend the temporary buffer to make room for more output
-		auto new_size = cd->output_count + COMPRESSION_OUTPUT_CHUNK_SIZE;
-		uint8_t* p_temp2 = (uint8_t*) ps_malloc(new_size);
-		if (p_temp2) {
-			memcpy(p_temp2, p_temp, cd->output_count);
-			*pp_temp = p_temp2; // use new buffer pointer now
-		} else {
-			debug_log("bufferCompress: cannot allocate temporary buffer of %d bytes\n\r", new_size);
-			*pp_temp = NULL; // indicate failure
-		}
-		heap_caps_free(p_temp);
-	}
+static inline uint8_t agon_window_hash_of(const uint8_t* p) {
+    uint32_t key = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    return (uint8_t) ((key * 2654435761u) >> 24);
 }
 
-// Write decompressed output to a temporary buffer
+static inline uint8_t agon_window_hash(CompressionData* cd, uint32_t position) {
+    return agon_window_hash_of(cd->window_data + position);
+}
+
+// Add a window position to the index, keeping its chain in ascending order
 //
-static bool local_write_decompressed_byte(void* p_dd, uint8_t orig_data) {
-	DecompressionData* dd = (DecompressionData*) p_dd;
-    uint8_t** pp_temp = (uint8_t**) dd->context;
-	uint8_t* p_temp = *pp_temp;
-    if (dd->output_count >= dd->orig_size) {
-        return false;
+static void agon_hash_insert(CompressionData* cd, uint32_t position) {
+    uint8_t* link = &cd->hash_head[agon_window_hash(cd, position)];
+    uint8_t prev = 0;
+    while (*link && *link <= position) {
+        prev = *link;
+        link = &cd->hash_next[*link - 1];
+    }
+    cd->hash_next[position] = *link;
+    cd->hash_prev[position] = prev;
+    if (*link) {
+        cd->hash_prev[*link - 1] = position + 1;
+    }
+    *link = position + 1;
+}
+
+// Remove a window position from the index, before the window data it was hashed from changes
+//
+static void agon_hash_remove(CompressionData* cd, uint32_t position) {
+    uint8_t next = cd->hash_next[position];
+    uint8_t prev = cd->hash_prev[position];
+    if (prev) {
+        cd->hash_next[prev - 1] = next;
+    } else {
+        cd->hash_head[agon_window_hash(cd, position)] = next;
+    }
+    if (next) {
+        cd->hash_prev[next - 1] = prev;
+    }
+}
+
+// Add a byte to the window, updating the index for the positions whose first 4 bytes include it
+// Only positions whose 4 bytes are all in the window without wrapping are indexed,
+// as the search only considers strings lying entirely within the current window data
+//
+static void agon_add_to_window(CompressionData* cd, uint8_t orig_byte) {
+    uint32_t wi = cd->window_write_index;
+    uint32_t first = wi >= COMPRESSION_MIN_MATCH - 1 ? wi - (COMPRESSION_MIN_MATCH - 1) : 0;
+    for (uint32_t p = first; p <= wi && p + COMPRESSION_MIN_MATCH <= cd->window_size; p++) {
+        agon_hash_remove(cd, p);
+    }
+    cd->window_data[cd->window_write_index++] = orig_byte;
+    cd->window_write_index &= (COMPRESSION_WINDOW_SIZE - 1);
+    if (cd->window_size < COMPRESSION_WINDOW_SIZE) {
+        (cd->window_size)++;
+    }
+    for (uint32_t p = first; p <= wi && p + COMPRESSION_MIN_MATCH <= cd->window_size; p++) {
+        agon_hash_insert(cd, p);
     }
-	p_temp[dd->output_count++] = orig_data;
-    return true;
 }
 
 void agon_compress_byte(CompressionData* cd, uint8_t orig_byte) {
@@ -140,80 +178,60 @@ void agon_compress_byte(CompressionData* cd, uint8_t orig_byte) {
     }
 
     if (cd->string_size >= 16) {
-        if (cd->window_size >= 16) {
-            // Determine whether the full string of 16 is in the window
-            for (uint32_t start = 0; start <= cd->window_size - 16; start++) {
-                uint32_t wi = start;
-                uint32_t si = cd->string_read_index;
-                uint8_t match = 1;
-                for (uint8_t i = 0; i < 16; i++) {
-                    if (cd->window_data[wi++] != cd->string_data[si++]) {
-                        match = 0;
-                        break;
-                    }
-                    wi &= (COMPRESSION_WINDOW_SIZE - 1);
-                    si &= (COMPRESSION_STRING_SIZE - 1);
-                }
-                if (match) {
-                    agon_write_compressed_bit(cd, 1); // Output first '1' of '11iiiiiiii'.
-                    agon_write_compressed_bit(cd, 1); // Output second '1' of '11iiiiiiii'.
-                    agon_write_compressed_byte(cd, (uint8_t) (start)); // Output window index
-                    cd->string_size = 0;
-                    return;
-                }
-            }
+        uint8_t string[COMPRESSION_STRING_SIZE];
+        for (uint8_t i = 0; i < COMPRESSION_STRING_SIZE; i++) {
+            string[i] = cd->string_data[(cd->string_read_index + i) & (COMPRESSION_STRING_SIZE - 1)];
         }
 
-        if (cd->window_size >= 8) {
-            // Determine whether the partial string of 8 is in the window
-            for (uint32_t start = 0; start <= cd->window_size - 8; start++) {
-                uint32_t wi = start;
-                uint32_t si = cd->string_read_index;
-                uint8_t match = 1;
-                for (uint8_t i = 0; i < 8; i++) {
-                    if (cd->window_data[wi++] != cd->string_data[si++]) {
-                        match = 0;
-                        break;
-                    }
-                    wi &= (COMPRESSION_WINDOW_SIZE - 1);
-                    si &= (COMPRESSION_STRING_SIZE - 1);
-                }
-                if (match) {
-                    agon_write_compressed_bit(cd, 1); // Output '1' of '10iiiiiiii'.
-                    agon_write_compressed_bit(cd, 0); // Output '0' of '10iiiiiiii'.
-                    agon_write_compressed_byte(cd, (uint8_t) (start)); // Output window index
-                    cd->string_size -= 8;
-                    cd->string_read_index = (cd->string_read_index + 8) & (COMPRESSION_STRING_SIZE - 1);
-                    return;
-                }
+        // Every 16 or 8 byte match also starts with a 4 byte match, so the candidates for all
+        // lengths are the window positions whose first 4 bytes hash the same as the string's.
+        // Walking them in ascending order finds the same lowest-index matches as scanning the whole window.
+        int32_t match8 = -1;
+        int32_t match4 = -1;
+        uint8_t candidate = cd->window_size >= COMPRESSION_MIN_MATCH ? cd->hash_head[agon_window_hash_of(string)] : 0;
+        while (candidate) {
+            uint32_t start = candidate - 1;
+            candidate = cd->hash_next[start];
+            const uint8_t* window = cd->window_data + start;
+            if (memcmp(window, string, 4) != 0) {
+                continue;
             }
-        }
-            
-        if (cd->window_size >= 4) {
-            // Determine whether the partial string of 4 is in the window
-            for (uint32_t start = 0; start <= cd->window_size - 4; start++) {
-                uint32_t wi = start;
-                uint32_t si = cd->string_read_index;
-                uint8_t match = 1;
-                for (uint8_t i = 0; i < 4; i++) {
-                    if (cd->window_data[wi++] != cd->string_data[si++]) {
-                        match = 0;
-                        break;
-                    }
-                    wi &= (COMPRESSION_WINDOW_SIZE - 1);
-                    si &= (COMPRESSION_STRING_SIZE - 1);
-                }
-                if (match) {
-                    agon_write_compressed_bit(cd, 0); // Output '0' of '01iiiiiiii'.
-                    agon_write_compressed_bit(cd, 1); // Output '1' of '01iiiiiiii'.
-                    agon_write_compressed_byte(cd, (uint8_t) (start)); // Output window index
-                    cd->string_size -= 4;
-                    cd->string_read_index = (cd->string_read_index + 4) & (COMPRESSION_STRING_SIZE - 1);
-                    return;
-                }
+            if (match4 < 0) {
+                match4 = start;
+            }
+            if (start + 8 > cd->window_size || memcmp(window + 4, string + 4, 4) != 0) {
+                continue;
+            }
+            if (match8 < 0) {
+                match8 = start;
+            }
+            if (start + 16 <= cd->window_size && memcmp(window + 8, string + 8, 8) == 0) {
+                agon_write_compressed_bit(cd, 1); // Output first '1' of '11iiiiiiii'.
+                agon_write_compressed_bit(cd, 1); // Output second '1' of '11iiiiiiii'.
+                agon_write_compressed_byte(cd, (uint8_t) (start)); // Output window index
+                cd->string_size = 0;
+                return;
             }
         }
 
+        if (match8 >= 0) {
+            agon_write_compressed_bit(cd, 1); // Output '1' of '10iiiiiiii'.
+            agon_write_compressed_bit(cd, 0); // Output '0' of '10iiiiiiii'.
+            agon_write_compressed_byte(cd, (uint8_t) (match8)); // Output window index
+            cd->string_size -= 8;
+            cd->string_read_index = (cd->string_read_index + 8) & (COMPRESSION_STRING_SIZE - 1);
+            return;
+        }
+
+        if (match4 >= 0) {
+            agon_write_compressed_bit(cd, 0); // Output '0' of '01iiiiiiii'.
+            agon_write_compressed_bit(cd, 1); // Output '1' of '01iiiiiiii'.
+            agon_write_compressed_byte(cd, (uint8_t) (match4)); // Output window index
+            cd->string_size -= 4;
+            cd->string_read_index = (cd->string_read_index + 4) & (COMPRESSION_STRING_SIZE - 1);
+            return;
+        }
+
         // Need to make room in the string for the next original byte
         uint8_t old_byte = cd->string_data[cd->string_read_index++];
         agon_write_compressed_bit(cd, 0); // Output '0' of '00xxxxxxxx'.
@@ -223,11 +241,7 @@ void agon_compress_byte(CompressionData* cd, uint8_t orig_byte) {
         cd->string_read_index &= (COMPRESSION_STRING_SIZE - 1);
 
         // Add the old original byte to the window
-        cd->window_data[cd->window_write_index++] = old_byte;
-        cd->window_write_index &= (COMPRESSION_WINDOW_SIZE - 1);
-        if (cd->window_size < COMPRESSION_WINDOW_SIZE) {
-            (cd->window_size)++;
-        }
+        agon_add_to_window(cd, old_byte);
     }
 }
 
@@ -244,65 +258,389 @@ void agon_finish_compression(CompressionData* cd) {
     }
 }
 
-void agon_init_decompression(DecompressionData* dd, void* context, WriteDecompressedByte write_fcn, uint32_t orig_size) {
+void agon_init_decompression(DecompressionData* dd, uint32_t orig_size) {
     memset(dd, 0, sizeof(DecompressionData));
-    dd->context = context;
-    dd->write_fcn = write_fcn;
     dd->orig_size = orig_size;
 }
 
-void agon_decompress_byte(DecompressionData* dd, uint8_t comp_byte) {
-    for (uint8_t bit = 0; bit < 8; bit++) {
-        dd->code = (dd->code << 1) | ((comp_byte & 0x80) ? 1 : 0);
-        comp_byte <<= 1;
-        if (++(dd->code_bits) >= 10) {
-            // Interpret the incoming code
-            uint16_t command = (dd->code >> 8);
-            uint8_t value = (uint8_t)dd->code;
-            dd->code = 0;
-            dd->code_bits = 0;
-            uint8_t size;
-
-            switch (command)
-            {
-            case 0: // value is copy of original byte
-                // Add the new decompressed byte to the window
-                dd->window_data[dd->window_write_index++] = value;
-                dd->window_write_index &= (COMPRESSION_WINDOW_SIZE - 1);
-                if (dd->window_size < COMPRESSION_WINDOW_SIZE) {
-                    (dd->window_size)++;
+// Decompress a block of compressed data straight into an output buffer of dd->orig_size bytes
+// Codes are extracted from a bit accumulator refilled several bytes at a time,
+// and window strings are copied out in at most two runs rather than byte by byte
+// Any partial code left at the end of the block is kept in dd, so blocks can be passed in turn
+// Returns false once the output is full
+//
+bool agon_decompress_block(DecompressionData* dd, const uint8_t* comp_data, uint32_t comp_size, uint8_t* output) {
+    uint32_t bits = dd->code;
+    uint32_t bit_count = dd->code_bits;
+    uint32_t out = dd->output_count;
+    const uint32_t orig_size = dd->orig_size;
+    const uint8_t* end = comp_data + comp_size;
+
+    while (out < orig_size) {
+        if (bit_count < 10) {
+            if (end - comp_data >= 3) {
+                // codes are 10 bits and input comes in whole bytes, so bit_count is even, and at most 8 here
+                // which leaves room in the accumulator for three more bytes
+                bits = (bits << 24) | ((uint32_t)comp_data[0] << 16) | ((uint32_t)comp_data[1] << 8) | comp_data[2];
+                comp_data += 3;
+                bit_count += 24;
+            } else {
+                while (bit_count < 10 && comp_data < end) {
+                    bits = (bits << 8) | *comp_data++;
+                    bit_count += 8;
                 }
-                (*(dd->write_fcn))(dd, value);
-                continue;
+                if (bit_count < 10) {
+                    break;
+                }
+            }
+        }
+        bit_count -= 10;
+        uint32_t command = (bits >> (bit_count + 8)) & 0x03;
+        uint8_t value = (uint8_t)(bits >> bit_count);
 
-            case 1: // value is index to string of 4 bytes
-                size = 4;
-                break;
+        if (command == 0) {
+            // value is copy of original byte, which is added to the window
+            dd->window_data[dd->window_write_index++] = value;
+            dd->window_write_index &= (COMPRESSION_WINDOW_SIZE - 1);
+            output[out++] = value;
+            continue;
+        }
+
+        // value is index to string of 4, 8 or 16 bytes, which may wrap around the end of the window
+        uint32_t size = 2 << command;
+        if (size > orig_size - out) {
+            debug_log("Decompression overflow\n\r");
+            size = orig_size - out;
+        }
+        uint32_t first = COMPRESSION_WINDOW_SIZE - value;
+        if (first >= size) {
+            memcpy(output + out, dd->window_data + value, size);
+        } else {
+            memcpy(output + out, dd->window_data + value, first);
+            memcpy(output + out + first, dd->window_data, size - first);
+        }
+        out += size;
+    }
+
+    // keep only the bits of any partial code
+    dd->code = bits & ((1 << bit_count) - 1);
+    dd->code_bits = bit_count;
+    dd->output_count = out;
+    return out < orig_size;
+}
+
+// LZ4-style compression
+//
+// The compressed data is a series of sequences, each made up of:
+//   token          high nibble is the literal count, low nibble is the match length less 4
+//   [literal ext]  if the literal count nibble is 15, bytes to add to it, continuing while a byte is 255
+//   literals       bytes copied straight to the output
+//   offset         16-bit little-endian distance back from the output position to copy the match from
+//   [match ext]    if the match length nibble is 15, bytes to add to it, continuing while a byte is 255
+// The offset and match are left off the last sequence, when its literals run to the end of the data.
+// Matches may overlap the bytes they produce, so a short offset repeats a pattern.
+
+typedef void (*WriteCompressedBlock)(void*, const uint8_t*, uint32_t);
+
+typedef struct {
+    void*               context;
+    WriteCompressedBlock write_fcn;
+    uint32_t*           hash_table;     // 1 << LZ_HASH_BITS entries of input positions plus 1, cleared
+    uint32_t            input_count;
+    uint32_t            output_count;
+} LzCompressionData;
+
+typedef enum : uint8_t {
+    LZ_TOKEN,
+    LZ_LITERAL_LENGTH,
+    LZ_LITERALS,
+    LZ_OFFSET_LOW,
+    LZ_OFFSET_HIGH,
+    LZ_MATCH_LENGTH,
+    LZ_MATCH,
+    LZ_DONE,
+} LzDecompressionState;
+
+typedef struct {
+    uint32_t            input_count;
+    uint32_t            output_count;
+    uint32_t            orig_size;
+    uint32_t            length;         // literals or match bytes still to copy
+    uint32_t            offset;
+    uint8_t             token;
+    LzDecompressionState state;
+} LzDecompressionData;
+
+static inline uint32_t agon_lz_hash(const uint8_t* p) {
+    uint32_t key = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    return (key * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static void agon_lz_write_length(LzCompressionData* lc, uint32_t length) {
+    uint8_t ext[16];
+    uint32_t count = 0;
+    while (length >= 255) {
+        ext[count++] = 255;
+        length -= 255;
+        if (count == sizeof(ext)) {
+            (*lc->write_fcn)(lc->context, ext, count);
+            lc->output_count += count;
+            count = 0;
+        }
+    }
+    ext[count++] = (uint8_t) length;
+    (*lc->write_fcn)(lc->context, ext, count);
+    lc->output_count += count;
+}
+
+// Write one sequence, of literals followed by an optional match
+//
+static void agon_lz_write_sequence(LzCompressionData* lc, const uint8_t* literals, uint32_t literal_count, uint32_t offset, uint32_t match_length) {
+    uint8_t token = (literal_count < 15 ? literal_count : 15) << 4;
+    if (match_length) {
+        match_length -= LZ_MIN_MATCH;
+        token |= match_length < 15 ? match_length : 15;
+    }
+    (*lc->write_fcn)(lc->context, &token, 1);
+    lc->output_count++;
+    if (literal_count >= 15) {
+        agon_lz_write_length(lc, literal_count - 15);
+    }
+    if (literal_count) {
+        (*lc->write_fcn)(lc->context, literals, literal_count);
+        lc->output_count += literal_count;
+    }
+    if (offset) {
+        uint8_t offset_bytes[2] = { (uint8_t) offset, (uint8_t) (offset >> 8) };
+        (*lc->write_fcn)(lc->context, offset_bytes, 2);
+        lc->output_count += 2;
+        if (match_length >= 15) {
+            agon_lz_write_length(lc, match_length - 15);
+        }
+    }
+}
+
+// Compress a whole buffer of data in one go
+// Matches are found greedily, through a hash table of the last position each 4-byte string was seen
+//
+void agon_lz_compress(LzCompressionData* lc, const uint8_t* data, uint32_t size) {
+    uint32_t* table = lc->hash_table;
+    uint32_t pos = 0;
+    uint32_t anchor = 0;
+    lc->input_count += size;
+
+    while (pos + LZ_MIN_MATCH <= size) {
+        uint32_t hash = agon_lz_hash(data + pos);
+        uint32_t candidate = table[hash];
+        table[hash] = pos + 1;
+        if (candidate == 0 || pos - (candidate - 1) > LZ_MAX_OFFSET ||
+            memcmp(data + candidate - 1, data + pos, LZ_MIN_MATCH) != 0) {
+            pos++;
+            continue;
+        }
+        uint32_t match = candidate - 1;
+        uint32_t length = LZ_MIN_MATCH;
+        while (pos + length < size && data[match + length] == data[pos + length]) {
+            length++;
+        }
+        // take in any matching bytes just before, that would otherwise be literals
+        while (pos > anchor && match > 0 && data[pos - 1] == data[match - 1]) {
+            pos--, match--, length++;
+        }
+        agon_lz_write_sequence(lc, data + anchor, pos - anchor, pos - match, length);
+        pos += length;
+        anchor = pos;
+        // index a position inside the match, so nearby repeats are found
+        if (pos >= 2 && pos + 2 <= size) {
+            table[agon_lz_hash(data + pos - 2)] = pos - 1;
+        }
+    }
+    if (anchor < size) {
+        agon_lz_write_sequence(lc, data + anchor, size - anchor, 0, 0);
+    }
+}
+
+void agon_init_lz_decompression(LzDecompressionData* ld, uint32_t orig_size) {
+    memset(ld, 0, sizeof(LzDecompressionData));
+    ld->orig_size = orig_size;
+    ld->state = orig_size ? LZ_TOKEN : LZ_DONE;
+}
+
+// Decompress a block of LZ compressed data straight into an output buffer of ld->orig_size bytes
+// The decoder state is kept in ld, so a sequence may be split across blocks passed in turn
+// Returns false once decompression has finished, either with the output full, or on invalid data
+//
+bool agon_lz_decompress_block(LzDecompressionData* ld, const uint8_t* comp_data, uint32_t comp_size, uint8_t* output) {
+    const uint8_t* end = comp_data + comp_size;
+    uint32_t out = ld->output_count;
+    const uint32_t orig_size = ld->orig_size;
+    ld->input_count += comp_size;
+
+    while (ld->state != LZ_DONE) {
+        if (ld->state != LZ_MATCH && ld->state != LZ_LITERALS && comp_data == end) {
+            break;
+        }
+        switch (ld->state) {
+            case LZ_TOKEN: {
+                uint8_t token = *comp_data++;
+                uint32_t literal_count = token >> 4;
+                uint32_t offset;
+                // fast path for a short sequence lying entirely within this block, with room in the output
+                if (literal_count < 15 && (token & 0x0F) < 15 && (uint32_t)(end - comp_data) >= literal_count + 2 &&
+                    orig_size - out >= literal_count + 14 + LZ_MIN_MATCH &&
+                    (offset = comp_data[literal_count] | ((uint32_t)comp_data[literal_count + 1] << 8)) != 0 &&
+                    offset <= out + literal_count) {
+                    uint32_t match_length = (token & 0x0F) + LZ_MIN_MATCH;
+                    memcpy(output + out, comp_data, literal_count);
+                    out += literal_count;
+                    comp_data += literal_count + 2;
+                    uint8_t* dest = output + out;
+                    const uint8_t* source = dest - offset;
+                    if (offset >= match_length) {
+                        memcpy(dest, source, match_length);
+                    } else {
+                        for (uint32_t i = 0; i < match_length; i++) {
+                            dest[i] = source[i];
+                        }
+                    }
+                    out += match_length;
+                    if (out == orig_size) {
+                        ld->state = LZ_DONE;
+                    }
+                    break;
+                }
+                ld->token = token;
+                ld->length = literal_count;
+                ld->state = literal_count == 15 ? LZ_LITERAL_LENGTH : LZ_LITERALS;
+            }   break;
+
+            case LZ_LITERAL_LENGTH: {
+                uint8_t value = *comp_data++;
+                ld->length += value;
+                if (value != 255) {
+                    ld->state = LZ_LITERALS;
+                }
+            }   break;
+
+            case LZ_LITERALS: {
+                uint32_t count = ld->length;
+                if (count > (uint32_t)(end - comp_data)) {
+                    count = end - comp_data;
+                }
+                if (count > orig_size - out) {
+                    debug_log("Decompression overflow\n\r");
+                    ld->state = LZ_DONE;
+                    count = orig_size - out;
+                }
+                memcpy(output + out, comp_data, count);
+                out += count;
+                comp_data += count;
+                ld->length -= count;
+                if (ld->state == LZ_DONE) {
+                    break;
+                }
+                if (ld->length == 0) {
+                    ld->state = out == orig_size ? LZ_DONE : LZ_OFFSET_LOW;
+                } else if (comp_data == end) {
+                    goto finished;
+                }
+            }   break;
 
-            case 2: // value is index to string of 8 bytes
-                size = 8;
+            case LZ_OFFSET_LOW:
+                ld->offset = *comp_data++;
+                ld->state = LZ_OFFSET_HIGH;
                 break;
 
-            case 3: // value is index to string of 16 bytes
-                size = 16;
+            case LZ_OFFSET_HIGH:
+                ld->offset |= (uint32_t)(*comp_data++) << 8;
+                ld->length = (ld->token & 0x0F) + LZ_MIN_MATCH;
+                ld->state = (ld->token & 0x0F) == 15 ? LZ_MATCH_LENGTH : LZ_MATCH;
                 break;
-            }
 
-            // Extract a byte string from the window
-            uint8_t string_data[COMPRESSION_STRING_SIZE];
-            uint32_t wi = value;
-            for (uint8_t si = 0; si < size; si++) {
-                uint8_t out_byte = dd->window_data[wi++];
-                wi &= (COMPRESSION_WINDOW_SIZE - 1);
-                string_data[si] = out_byte;
-                if (!(*(dd->write_fcn))(dd, out_byte)) {
-                    // decompression has overflowed the output buffer
+            case LZ_MATCH_LENGTH: {
+                uint8_t value = *comp_data++;
+                ld->length += value;
+                if (value != 255) {
+                    ld->state = LZ_MATCH;
+                }
+            }   break;
+
+            case LZ_MATCH: {
+                if (ld->offset == 0 || ld->offset > out) {
+                    debug_log("Decompression offset %u invalid at %u\n\r", ld->offset, out);
+                    ld->state = LZ_DONE;
+                    break;
+                }
+                uint32_t count = ld->length;
+                if (count > orig_size - out) {
                     debug_log("Decompression overflow\n\r");
-                    return;
-                };
-            }
+                    count = orig_size - out;
+                }
+                uint8_t* dest = output + out;
+                const uint8_t* source = dest - ld->offset;
+                if (ld->offset >= count) {
+                    memcpy(dest, source, count);
+                } else {
+                    // the match overlaps its own output, repeating a pattern of offset bytes
+                    // so lay down one copy of it, then copy the output so far onto itself in doubling runs
+                    memcpy(dest, source, ld->offset);
+                    uint32_t copied = ld->offset;
+                    while (copied < count) {
+                        uint32_t run = copied < count - copied ? copied : count - copied;
+                        memcpy(dest + copied, dest, run);
+                        copied += run;
+                    }
+                }
+                out += count;
+                ld->state = out == orig_size ? LZ_DONE : LZ_TOKEN;
+            }   break;
+
+            default:
+                break;
         }
     }
+
+finished:
+    ld->output_count = out;
+    return ld->state != LZ_DONE;
+}
+
+// Decompression of any supported type, chosen by the type in the compression header
+
+typedef struct {
+    uint8_t             type;
+    DecompressionData   dd;
+    LzDecompressionData ld;
+} AnyDecompressionData;
+
+// Check a compression header, and prepare to decompress the data following it
+// Returns false if the header is invalid, or the compression type isn't supported
+//
+bool agon_init_any_decompression(AnyDecompressionData* ad, const CompressionFileHeader* hdr) {
+    if (hdr->marker[0] != 'C' ||
+        hdr->marker[1] != 'm' ||
+        hdr->marker[2] != 'p' ||
+        (hdr->type != COMPRESSION_TYPE_TURBO && hdr->type != COMPRESSION_TYPE_LZ)) {
+        return false;
+    }
+    ad->type = hdr->type;
+    agon_init_decompression(&ad->dd, hdr->orig_size);
+    agon_init_lz_decompression(&ad->ld, hdr->orig_size);
+    return true;
+}
+
+// Decompress a block of compressed data into an output buffer of the header's orig_size bytes
+// Returns false once the output is full, or decompression has otherwise finished
+//
+bool agon_decompress_any_block(AnyDecompressionData* ad, const uint8_t* comp_data, uint32_t comp_size, uint8_t* output) {
+    if (ad->type == COMPRESSION_TYPE_LZ) {
+        return agon_lz_decompress_block(&ad->ld, comp_data, comp_size, output);
+    }
+    return agon_decompress_block(&ad->dd, comp_data, comp_size, output);
+}
+
+uint32_t agon_decompressed_count(const AnyDecompressionData* ad) {
+    return ad->type == COMPRESSION_TYPE_LZ ? ad->ld.output_count : ad->dd.output_count;
 }
 
 #endif // COMPRESSION_H
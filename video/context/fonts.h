@@ -159,8 +159,14 @@ void Context::changeFont(uint16_t newFontId, uint8_t flags) {
 		return;
 	}
 
+	auto fontBlocks = isSystemFont ? nullptr : buffers.get(newFontId);
+	if (!isSystemFont && (!fontBlocks || fontBlocks->empty())) {
+		debug_log("changeFont: buffer %d for font not found\n\r", newFontId);
+		return;
+	}
+
 	auto newFont = isSystemFont ? nullptr : fonts[newFontId];
-	auto fontData = isSystemFont ? nullptr : buffers[newFontId][0];
+	auto fontData = isSystemFont ? nullptr : fontBlocks->front();
 	changeFont(newFont, fontData, flags);
 }
 
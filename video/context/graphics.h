@@ -756,7 +756,7 @@ void Context::plotPending(int16_t peeked) {
 
 // Plot a string
 //
-void Context::plotString(const std::string& s) {
+void Context::plotString(const char * s, size_t length) {
 	if (!ttxtMode && !plottingText) {
 		if (textCursorActive()) {
 			setClippingRect(textViewport);
@@ -773,14 +773,16 @@ void Context::plotString(const std::string& s) {
 
 	auto font = getFont();
 	// iterate over the string and plot each character
-	for (const char c : s) {
+	for (auto end = s + length; s != end; s++) {
+		const char c = *s;
 		if (cursorBehaviour.scrollProtect) {
 			cursorAutoNewline();
 		}
 		if (ttxtMode) {
 			ttxt_instance.draw_char(activeCursor->X, activeCursor->Y, c);
 		} else {
-			auto bitmap = getBitmapFromChar(c);
+			// only look up bitmaps for characters that have been mapped
+			std::shared_ptr<Bitmap> bitmap = charToBitmap[(uint8_t)c] != 65535 ? getBitmapFromChar(c) : nullptr;
 			if (bitmap) {
 				canvas->drawBitmap(activeCursor->X, activeCursor->Y + font->height - bitmap->height, bitmap.get());
 			} else {
@@ -817,9 +819,9 @@ void Context::drawBitmap(uint16_t x, uint16_t y, bool compensateHeight, bool for
 		}
 		auto yPos = (compensateHeight && logicalCoords) ? (y + 1 - bitmap->height) : y;
 		if (bitmapTransform != 65535) {
-			auto transformBufferIter = buffers.find(bitmapTransform);
-			if (transformBufferIter != buffers.end()) {
-				auto &transformBuffer = transformBufferIter->second;
+			auto transformBufferBlocks = buffers.getMutable(bitmapTransform);
+			if (transformBufferBlocks) {
+				auto &transformBuffer = *transformBufferBlocks;
 				int const matrixSize = sizeof(float) * 9;
 				if (transformBuffer.size() == 1) {
 					// make sure we have an inverse matrix cached
@@ -830,7 +832,7 @@ void Context::drawBitmap(uint16_t x, uint16_t y, bool compensateHeight, bool for
 					// create an inverse matrix, and push that to the buffer
 					auto transform = (float *)transformBuffer[0]->getBuffer();
 					auto matrix = dspm::Mat(transform, 3, 3).inverse();
-					auto bufferStream = make_shared_psram<BufferStream>(matrixSize);
+					auto bufferStream = make_shared_pooled<BufferStream>(matrixSize);
 					bufferStream->writeBuffer((uint8_t *)matrix.data, matrixSize);
 					transformBuffer.push_back(bufferStream);
 				}
@@ -5,11 +5,17 @@
 #include <vector>
 #include <Stream.h>
 
+#include "buffer_index.h"
 #include "buffer_stream.h"
+#include "span_reader.h"
 #include "types.h"
 
-class MultiBufferStream : public Stream {
+// MultiBufferStream reads through all the blocks of a buffer in sequence
+// Block offsets come from a BufferIndex, so seeking is a binary search and size is constant time
+//
+class MultiBufferStream : public Stream, public SpanReader {
 	public:
+		MultiBufferStream(std::shared_ptr<const BufferIndex> index);
 		MultiBufferStream(std::vector<std::shared_ptr<BufferStream>> buffers);
 		int available();
 		int read();
@@ -19,21 +25,27 @@ class MultiBufferStream : public Stream {
 			return readBytes((char *)outBuffer, length);
 		}
 		size_t write(uint8_t b);
+		tcb::span<const uint8_t> readableSpan() override;
+		void commit(size_t count) override;
 		void rewind(size_t bufferIndex = 0);
 		void seekTo(uint32_t position, size_t bufferIndex = 0);
 		uint32_t size();
-		const std::vector<std::shared_ptr<BufferStream>> &tellBuffer(uint32_t &blockOffset, size_t &blockIndex);
+		const BufferIndex &tellBuffer(uint32_t &blockOffset, size_t &blockIndex);
 	private:
-		std::vector<std::shared_ptr<BufferStream>> buffers;
+		std::shared_ptr<const BufferIndex> index;
+		const std::vector<std::shared_ptr<BufferStream>> &buffers;
 		BufferStream * getBuffer();
 		size_t currentBufferIndex = 0;
 };
 
-MultiBufferStream::MultiBufferStream(std::vector<std::shared_ptr<BufferStream>> buffers) : buffers(std::move(buffers)) {
+MultiBufferStream::MultiBufferStream(std::shared_ptr<const BufferIndex> index) : index(std::move(index)), buffers(this->index->getBlocks()) {
 	// rewind to the start of the first buffer
 	rewind();
 }
 
+MultiBufferStream::MultiBufferStream(std::vector<std::shared_ptr<BufferStream>> buffers) :
+	MultiBufferStream(make_shared_psram<BufferIndex>(std::move(buffers))) {}
+
 int MultiBufferStream::available() {
 	auto buffer = getBuffer();
 	if (buffer) {
@@ -69,6 +81,25 @@ size_t MultiBufferStream::write(uint8_t b) {
 	return 0;
 }
 
+// Get the unread remainder of the current block
+// Data that spans a block boundary must be read via the normal stream interface
+//
+tcb::span<const uint8_t> MultiBufferStream::readableSpan() {
+	auto buffer = getBuffer();
+	if (!buffer) {
+		return {};
+	}
+	auto position = buffer->tell();
+	return { buffer->getBuffer() + position, buffer->size() - position };
+}
+
+void MultiBufferStream::commit(size_t count) {
+	auto buffer = getBuffer();
+	if (buffer) {
+		buffer->seekTo(buffer->tell() + count);
+	}
+}
+
 void MultiBufferStream::rewind(size_t bufferIndex) {
 	currentBufferIndex = bufferIndex;
 	if (currentBufferIndex < buffers.size()) {
@@ -78,39 +109,25 @@ void MultiBufferStream::rewind(size_t bufferIndex) {
 
 void MultiBufferStream::seekTo(uint32_t position, size_t bufferIndex) {
 	// find the buffer that contains the position we want
-	// keeping track of an offset into the whole buffer
-	auto offset = position;
-	for (auto i = bufferIndex; i < buffers.size(); i++) {
-		auto &stream = buffers[i];
-		auto bufferSize = stream->size();
-		if (offset < bufferSize) {
-			// this is the buffer we want
-			currentBufferIndex = i;
-			stream->seekTo(offset);
-			return;
-		}
-		// reduce the offset by the size of this buffer, as position wasn't there
-		offset -= bufferSize;
+	if (index->resolve(position, bufferIndex)) {
+		currentBufferIndex = bufferIndex;
+		buffers[bufferIndex]->seekTo(position);
+		return;
 	}
-
-	// if we get here, we've gone past the end of the buffers
+	// we've gone past the end of the buffers
 	// so just seek past the end of the last buffer
 	currentBufferIndex = buffers.size();
 }
 
 uint32_t MultiBufferStream::size() {
-	uint32_t totalSize = 0;
-	for (auto &buffer : buffers) {
-		totalSize += buffer->size();
-	}
-	return totalSize;
+	return index->size();
 }
 
-const std::vector<std::shared_ptr<BufferStream>> &MultiBufferStream::tellBuffer(uint32_t &blockOffset, size_t &blockIndex) {
+const BufferIndex &MultiBufferStream::tellBuffer(uint32_t &blockOffset, size_t &blockIndex) {
 	auto buffer = getBuffer();
 	blockOffset = buffer ? buffer->tell() : 0;
 	blockIndex = currentBufferIndex;
-	return buffers;
+	return *index;
 }
 
 inline BufferStream * MultiBufferStream::getBuffer() {
@@ -0,0 +1,332 @@
+#ifndef SERIAL_RING_STREAM_H
+#define SERIAL_RING_STREAM_H
+
+#include <memory>
+#include <HardwareSerial.h>
+#include <Stream.h>
+#include <driver/uart.h>
+
+#include "span.h"
+#include "span_reader.h"
+#include "spsc_ring.h"
+#include "types.h"
+
+// SerialRingStream reads from a hardware serial port via a large receive ring
+// A dedicated drain task moves data from the UART driver into the ring as soon as it arrives,
+// and drives RTS from how full the ring is, so the sender is held off before the ring overflows
+// rather than whenever the small UART buffer fills
+// Readers can use the normal Stream interface, or use readableSpan/commit to access ring data in place
+// Writes are passed straight through to the serial port
+// If the ring can't be started, reads also go straight to the serial port, and readableSpan is always empty
+//
+class SerialRingStream : public Stream, public SpanReader {
+	public:
+		SerialRingStream(HardwareSerial &serial, uart_port_t uart) : serial(serial), uart(uart) {}
+		bool begin(uint32_t size, uint32_t holdOffSpace, uint32_t resumeSpace, UBaseType_t priority, BaseType_t core);
+
+		int available() {
+			if (!drainTaskHandle) {
+				return serial.available();
+			}
+			return ring.size();
+		}
+		int read() {
+			if (!drainTaskHandle) {
+				return serial.read();
+			}
+			if (ring.empty()) {
+				return -1;
+			}
+			auto value = ring.front();
+			ring.consume(1);
+			return value;
+		}
+		int peek() {
+			if (!drainTaskHandle) {
+				return serial.peek();
+			}
+			if (ring.empty()) {
+				return -1;
+			}
+			return ring.front();
+		}
+		virtual size_t readBytes(char * outBuffer, size_t length);
+		virtual size_t readBytes(uint8_t * outBuffer, size_t length) {
+			return readBytes((char *)outBuffer, length);
+		}
+		size_t write(uint8_t b) {
+			return serial.write(b);
+		}
+		size_t write(const uint8_t * buffer, size_t size) {
+			return serial.write(buffer, size);
+		}
+
+		// Zero-copy access to received data
+		// readableSpan returns the contiguous data available, and commit marks bytes as used
+		tcb::span<const uint8_t> readableSpan() override {
+			auto span = ring.readableSpan();
+			return { span.data(), span.size() };
+		}
+		void commit(size_t count) override {
+			ring.consume(count);
+		}
+
+		void waitForData(TickType_t timeout);
+		void dataReceived();
+
+		// Statistics
+		// The held off figures count how often, and for how long, RTS held off the sender
+		// The ring full figures count how often, and for how long, draining was paused because the ring was full
+		// These are updated by the drain task on the other core, so are only accessed under statsLock
+		inline uint32_t getCapacity() const {
+			return ring.getCapacity();
+		}
+		uint32_t getHighWater() {
+			portENTER_CRITICAL(&statsLock);
+			auto value = highWater;
+			portEXIT_CRITICAL(&statsLock);
+			return value;
+		}
+		uint64_t getRingFullTime() {
+			portENTER_CRITICAL(&statsLock);
+			auto value = ringFullTime;
+			portEXIT_CRITICAL(&statsLock);
+			return value;
+		}
+		uint32_t getRingFullCount() {
+			portENTER_CRITICAL(&statsLock);
+			auto value = ringFullCount;
+			portEXIT_CRITICAL(&statsLock);
+			return value;
+		}
+		uint64_t getHeldOffTime() {
+			portENTER_CRITICAL(&statsLock);
+			auto value = heldOffTime;
+			portEXIT_CRITICAL(&statsLock);
+			return value;
+		}
+		uint32_t getHeldOffCount() {
+			portENTER_CRITICAL(&statsLock);
+			auto value = heldOffCount;
+			portEXIT_CRITICAL(&statsLock);
+			return value;
+		}
+		uint64_t getBytesReceived() {
+			portENTER_CRITICAL(&statsLock);
+			auto value = bytesReceived;
+			portEXIT_CRITICAL(&statsLock);
+			return value;
+		}
+		void resetStats() {
+			portENTER_CRITICAL(&statsLock);
+			highWater = ring.size();
+			ringFullTime = 0;
+			ringFullCount = 0;
+			heldOffTime = 0;
+			heldOffCount = 0;
+			bytesReceived = 0;
+			portEXIT_CRITICAL(&statsLock);
+		}
+
+	private:
+		static void drainTask(void * parameter);
+		void drain();
+		void updateFlowControl();
+		size_t readAvailable(uint8_t * outBuffer, size_t length);
+
+		HardwareSerial &serial;
+		uart_port_t uart;
+		SPSCRing<uint8_t> ring;
+		uint32_t holdOffSpace = 0;
+		uint32_t resumeSpace = 0;
+		bool heldOff = false;
+		uint32_t heldOffStart = 0;
+		TaskHandle_t drainTaskHandle = nullptr;
+		volatile TaskHandle_t waitingTask = nullptr;
+
+		portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+		uint32_t highWater = 0;
+		uint64_t ringFullTime = 0;
+		uint32_t ringFullCount = 0;
+		uint64_t heldOffTime = 0;
+		uint32_t heldOffCount = 0;
+		uint64_t bytesReceived = 0;
+};
+
+// Allocate the ring and start the drain task
+// RTS holds off the sender once less than holdOffSpace is free in the ring,
+// and lets it send again once resumeSpace is free, which is also when draining resumes after the ring filled up
+// The UART's own hardware flow control should be disabled once this succeeds, as the drain task then drives RTS
+// Returns false if the ring could not be started, in which case reads go directly to the serial port
+//
+bool SerialRingStream::begin(uint32_t size, uint32_t holdOffSpace, uint32_t resumeSpace, UBaseType_t priority, BaseType_t core) {
+	if (!ring.begin(size)) {
+		debug_log("SerialRingStream: failed to allocate %d byte ring\n\r", size);
+		return false;
+	}
+	this->resumeSpace = std::min(resumeSpace, ring.getCapacity());
+	this->holdOffSpace = std::min(holdOffSpace, this->resumeSpace);
+	heldOff = false;
+	uart_set_rts(uart, 1);
+	auto result = xTaskCreatePinnedToCore(
+		drainTask,
+		"serialDrain",
+		2048,
+		this,
+		priority,
+		&drainTaskHandle,
+		core
+	);
+	if (result != pdPASS) {
+		drainTaskHandle = nullptr;
+		return false;
+	}
+	return true;
+}
+
+// Read bytes into a buffer, waiting up to our timeout for data to arrive
+// Returns as soon as some data has been read, so may return fewer bytes than requested
+//
+size_t SerialRingStream::readBytes(char * outBuffer, size_t length) {
+	size_t read = 0;
+	auto start = xTaskGetTickCount();
+	const auto timeCheck = pdMS_TO_TICKS(_timeout);
+
+	while (read < length) {
+		auto count = readAvailable((uint8_t *)outBuffer + read, length - read);
+		if (count == 0) {
+			auto elapsed = xTaskGetTickCount() - start;
+			if (read > 0 || elapsed >= timeCheck) {
+				break;
+			}
+			waitForData(timeCheck - elapsed);
+			continue;
+		}
+		read += count;
+	}
+	return read;
+}
+
+// Copy out data that has already been received, without waiting
+//
+size_t SerialRingStream::readAvailable(uint8_t * outBuffer, size_t length) {
+	if (!drainTaskHandle) {
+		auto available = serial.available();
+		if (available <= 0) {
+			return 0;
+		}
+		return serial.read(outBuffer, std::min<size_t>(available, length));
+	}
+	auto span = ring.readableSpan();
+	auto count = std::min<size_t>(span.size(), length);
+	memcpy(outBuffer, span.data(), count);
+	ring.consume(count);
+	return count;
+}
+
+// Block the calling task until data is in the ring, or the timeout expires
+// Only one task should wait at a time
+//
+void SerialRingStream::waitForData(TickType_t timeout) {
+	waitingTask = xTaskGetCurrentTaskHandle();
+	// check again after registering, so a notification can't be missed
+	if (available() == 0) {
+		ulTaskNotifyTake(pdTRUE, timeout);
+	}
+	waitingTask = nullptr;
+}
+
+// Called from the UART event task whenever data is received
+// This wakes the drain task, or if reading directly from the serial port, any task waiting for data
+//
+void SerialRingStream::dataReceived() {
+	auto task = drainTaskHandle ? drainTaskHandle : waitingTask;
+	if (task) {
+		xTaskNotifyGive(task);
+	}
+}
+
+void SerialRingStream::drainTask(void * parameter) {
+	((SerialRingStream *)parameter)->drain();
+}
+
+// Hold off the sender when the ring is nearly full, and let it send again once enough has been read
+// Only called by the drain task
+//
+void SerialRingStream::updateFlowControl() {
+	auto space = ring.space();
+	if (!heldOff && space < holdOffSpace) {
+		heldOff = true;
+		heldOffStart = micros();
+		uart_set_rts(uart, 0);
+		portENTER_CRITICAL(&statsLock);
+		heldOffCount++;
+		portEXIT_CRITICAL(&statsLock);
+	} else if (heldOff && space >= resumeSpace) {
+		heldOff = false;
+		uart_set_rts(uart, 1);
+		uint32_t elapsed = micros() - heldOffStart;
+		portENTER_CRITICAL(&statsLock);
+		heldOffTime += elapsed;
+		portEXIT_CRITICAL(&statsLock);
+	}
+}
+
+void SerialRingStream::drain() {
+	bool ringFull = false;
+	uint32_t ringFullStart = 0;
+
+	while (true) {
+		updateFlowControl();
+		auto available = serial.available();
+		if (available <= 0) {
+			// wait for the UART to tell us data has arrived
+			// with a short timeout just in case a notification is missed
+			ulTaskNotifyTake(pdTRUE, 1);
+			continue;
+		}
+
+		auto span = ring.writableSpan();
+		if (span.empty() || (ringFull && ring.space() < resumeSpace)) {
+			// ring is full, which RTS should have prevented, so stop draining the UART
+			// until the ring has room again, leaving anything more in the UART buffer
+			if (!ringFull) {
+				ringFull = true;
+				ringFullStart = micros();
+				portENTER_CRITICAL(&statsLock);
+				ringFullCount++;
+				portEXIT_CRITICAL(&statsLock);
+			}
+			vTaskDelay(1);
+			continue;
+		}
+		if (ringFull) {
+			ringFull = false;
+			uint32_t elapsed = micros() - ringFullStart;
+			portENTER_CRITICAL(&statsLock);
+			ringFullTime += elapsed;
+			portEXIT_CRITICAL(&statsLock);
+		}
+
+		auto count = serial.read(span.data(), std::min<size_t>(span.size(), available));
+		if (count == 0) {
+			continue;
+		}
+		ring.produce(count);
+		updateFlowControl();
+		auto level = ring.size();
+		portENTER_CRITICAL(&statsLock);
+		bytesReceived += count;
+		if (level > highWater) {
+			highWater = level;
+		}
+		portEXIT_CRITICAL(&statsLock);
+
+		auto task = waitingTask;
+		if (task) {
+			xTaskNotifyGive(task);
+		}
+	}
+}
+
+#endif // SERIAL_RING_STREAM_H
@@ -0,0 +1,19 @@
+#ifndef SPAN_READER_H
+#define SPAN_READER_H
+
+#include <stdint.h>
+
+#include "span.h"
+
+// Interface for input streams that can expose data they have already received
+// readableSpan returns the contiguous bytes that can be read without waiting,
+// and commit marks bytes from the start of that span as read
+// The span is only valid until the next read or commit on the stream
+//
+class SpanReader {
+	public:
+		virtual tcb::span<const uint8_t> readableSpan() = 0;
+		virtual void commit(size_t count) = 0;
+};
+
+#endif // SPAN_READER_H
@@ -0,0 +1,117 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "span.h"
+#include "types.h"
+
+// Lock-free single-producer, single-consumer ring buffer
+// One task (or core) may write, and a different one may read, without any locking
+// Capacity is rounded up to a power of two, and storage is allocated preferentially from PSRAM
+//
+// The producer can either push items one at a time, or get a contiguous writable span,
+// fill it, and then produce the items.  The consumer has the equivalent readable span and consume calls,
+// which allows data to be used in place without copying
+//
+template<typename T>
+class SPSCRing {
+	public:
+		bool begin(uint32_t requestedCapacity) {
+			uint32_t size = 1;
+			while (size < requestedCapacity) {
+				size <<= 1;
+			}
+			storage = make_unique_psram_array<T>(size);
+			if (!storage) {
+				capacity = 0;
+				return false;
+			}
+			capacity = size;
+			mask = size - 1;
+			head.store(0, std::memory_order_relaxed);
+			tail.store(0, std::memory_order_relaxed);
+			return true;
+		}
+
+		inline uint32_t getCapacity() const {
+			return capacity;
+		}
+		// Number of items currently held
+		inline uint32_t size() const {
+			return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+		}
+		inline bool empty() const {
+			return size() == 0;
+		}
+		inline uint32_t space() const {
+			return capacity - size();
+		}
+
+		// Producer interface
+		tcb::span<T> writableSpan() {
+			auto writeIndex = head.load(std::memory_order_relaxed);
+			auto free = capacity - (writeIndex - tail.load(std::memory_order_acquire));
+			auto offset = writeIndex & mask;
+			auto contiguous = capacity - offset;
+			return { storage.get() + offset, free < contiguous ? free : contiguous };
+		}
+		// Copy items into the ring, offset from the current write position, without publishing them
+		// The caller must have checked there is space, and then calls produce with the total count
+		// so that a multi-part record becomes visible to the consumer all at once
+		// Items are copied in at most two runs, either side of the end of the storage
+		void stage(uint32_t offset, const T * items, uint32_t count) {
+			auto start = (head.load(std::memory_order_relaxed) + offset) & mask;
+			auto first = std::min(count, capacity - start);
+			std::copy(items, items + first, storage.get() + start);
+			std::copy(items + first, items + count, storage.get());
+		}
+		inline void produce(uint32_t count) {
+			head.store(head.load(std::memory_order_relaxed) + count, std::memory_order_release);
+		}
+		bool push(const T &item) {
+			auto writeIndex = head.load(std::memory_order_relaxed);
+			if (writeIndex - tail.load(std::memory_order_acquire) >= capacity) {
+				return false;
+			}
+			storage[writeIndex & mask] = item;
+			head.store(writeIndex + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Consumer interface
+		tcb::span<T> readableSpan() {
+			auto readIndex = tail.load(std::memory_order_relaxed);
+			auto available = head.load(std::memory_order_acquire) - readIndex;
+			auto offset = readIndex & mask;
+			auto contiguous = capacity - offset;
+			return { storage.get() + offset, available < contiguous ? available : contiguous };
+		}
+		inline void consume(uint32_t count) {
+			tail.store(tail.load(std::memory_order_relaxed) + count, std::memory_order_release);
+		}
+		// Peek at the next item, which must exist
+		inline T &front() {
+			return storage[tail.load(std::memory_order_relaxed) & mask];
+		}
+		bool pop(T &item) {
+			auto readIndex = tail.load(std::memory_order_relaxed);
+			if (head.load(std::memory_order_acquire) == readIndex) {
+				return false;
+			}
+			item = storage[readIndex & mask];
+			tail.store(readIndex + 1, std::memory_order_release);
+			return true;
+		}
+
+	private:
+		std::unique_ptr<T[]> storage;
+		uint32_t capacity = 0;
+		uint32_t mask = 0;
+		std::atomic<uint32_t> head { 0 };		// total items produced, only written by the producer
+		std::atomic<uint32_t> tail { 0 };		// total items consumed, only written by the consumer
+};
+
+#endif // SPSC_RING_H
@@ -0,0 +1,222 @@
+#ifndef TRACE_STREAM_H
+#define TRACE_STREAM_H
+
+#include <memory>
+#include <Stream.h>
+
+#include "buffer_stream.h"
+#include "span_reader.h"
+#include "types.h"
+
+// A single traced byte, as stored in a saved trace buffer
+// time is in microseconds since the trace was started
+//
+struct TraceRecord {
+	uint32_t time;
+	uint8_t value;
+} __attribute__((packed));
+
+// TraceStream wraps another stream, recording every byte read from it
+// into a ring of timestamped records.  When the ring fills the oldest
+// records are overwritten, so the trace always holds the most recent bytes
+// If the source supports span reads they are passed through, with committed bytes being recorded
+//
+class TraceStream : public Stream, public SpanReader {
+	public:
+		TraceStream(std::shared_ptr<Stream> source, SpanReader * sourceSpans) : source(std::move(source)), sourceSpans(sourceSpans) {}
+		int available() {
+			return source->available();
+		}
+		int read() {
+			auto value = source->read();
+			if (recording && value != -1) {
+				record(value);
+			}
+			return value;
+		}
+		int peek() {
+			return source->peek();
+		}
+		virtual size_t readBytes(char * outBuffer, size_t length) {
+			auto read = source->readBytes(outBuffer, length);
+			if (recording) {
+				for (size_t i = 0; i < read; i++) {
+					record(outBuffer[i]);
+				}
+			}
+			return read;
+		}
+		virtual size_t readBytes(uint8_t * outBuffer, size_t length) {
+			return readBytes((char *)outBuffer, length);
+		}
+		size_t write(uint8_t b) {
+			return source->write(b);
+		}
+		tcb::span<const uint8_t> readableSpan() override {
+			if (!sourceSpans) {
+				return {};
+			}
+			return sourceSpans->readableSpan();
+		}
+		void commit(size_t count) override {
+			if (recording) {
+				auto span = sourceSpans->readableSpan();
+				for (size_t i = 0; i < count; i++) {
+					record(span[i]);
+				}
+			}
+			sourceSpans->commit(count);
+		}
+
+		bool start(uint32_t size);
+		void stop() {
+			recording = false;
+		}
+		inline bool isRecording() const {
+			return recording;
+		}
+		inline uint32_t count() const {
+			return recordCount;
+		}
+		inline uint32_t dropped() const {
+			return droppedCount;
+		}
+		// Get a record, with index 0 being the oldest record held
+		inline const TraceRecord &getRecord(uint32_t index) const {
+			auto position = recordCount < capacity ? index : writeIndex + index;
+			if (position >= capacity) {
+				position -= capacity;
+			}
+			return records[position];
+		}
+
+	private:
+		void record(uint8_t value) {
+			auto &entry = records[writeIndex];
+			entry.time = micros() - startTime;
+			entry.value = value;
+			if (++writeIndex == capacity) {
+				writeIndex = 0;
+			}
+			if (recordCount < capacity) {
+				recordCount++;
+			} else {
+				droppedCount++;
+			}
+		}
+
+		std::shared_ptr<Stream> source;
+		SpanReader * sourceSpans;
+		std::unique_ptr<TraceRecord[]> records;
+		uint32_t capacity = 0;
+		uint32_t writeIndex = 0;
+		uint32_t recordCount = 0;
+		uint32_t droppedCount = 0;
+		uint32_t startTime = 0;
+		bool recording = false;
+};
+
+// Start a new trace, discarding any previously recorded data
+// Returns false if the trace storage could not be allocated
+//
+bool TraceStream::start(uint32_t size) {
+	recording = false;
+	if (size != capacity) {
+		records = nullptr;
+		capacity = 0;
+		records = make_unique_psram_array<TraceRecord>(size);
+		if (!records) {
+			return false;
+		}
+		capacity = size;
+	}
+	writeIndex = 0;
+	recordCount = 0;
+	droppedCount = 0;
+	startTime = micros();
+	recording = size > 0;
+	return recording;
+}
+
+// ReplayStream plays back a saved trace buffer
+// When paced, bytes only become available once their original arrival time has passed
+// relative to the start of the replay, otherwise the trace is delivered as fast as possible
+// Writes are discarded, so replaying never sends responses back to MOS
+//
+class ReplayStream : public Stream {
+	public:
+		ReplayStream(std::shared_ptr<BufferStream> trace, bool paced) :
+			trace(std::move(trace)), paced(paced) {
+				records = (const TraceRecord *)this->trace->getBuffer();
+				recordCount = this->trace->size() / sizeof(TraceRecord);
+				if (recordCount > 0) {
+					baseTime = records[0].time;
+				}
+				startTime = micros();
+			}
+		int available() {
+			if (index >= recordCount) {
+				return 0;
+			}
+			if (paced) {
+				return isDue() ? 1 : 0;
+			}
+			return recordCount - index;
+		}
+		int read() {
+			if (index >= recordCount || (paced && !isDue())) {
+				return -1;
+			}
+			return records[index++].value;
+		}
+		int peek() {
+			if (index >= recordCount || (paced && !isDue())) {
+				return -1;
+			}
+			return records[index].value;
+		}
+		virtual size_t readBytes(char * outBuffer, size_t length) {
+			size_t read = 0;
+			while (read < length && available()) {
+				outBuffer[read++] = records[index++].value;
+			}
+			return read;
+		}
+		virtual size_t readBytes(uint8_t * outBuffer, size_t length) {
+			return readBytes((char *)outBuffer, length);
+		}
+		size_t write(uint8_t b) {
+			return 0;
+		}
+
+		inline bool finished() const {
+			return index >= recordCount;
+		}
+		inline uint32_t size() const {
+			return recordCount;
+		}
+		// Microseconds until the next byte is due, when paced
+		uint32_t timeUntilDue() {
+			if (!paced || index >= recordCount) {
+				return 0;
+			}
+			auto due = records[index].time - baseTime;
+			auto now = micros() - startTime;
+			return due > now ? due - now : 0;
+		}
+
+	private:
+		inline bool isDue() {
+			return (uint32_t)(micros() - startTime) >= records[index].time - baseTime;
+		}
+
+		std::shared_ptr<BufferStream> trace;
+		const TraceRecord * records = nullptr;
+		uint32_t recordCount = 0;
+		uint32_t index = 0;
+		uint32_t baseTime = 0;
+		uint32_t startTime = 0;
+		bool paced;
+};
+
+#endif // TRACE_STREAM_H
@@ -132,13 +132,16 @@ struct psram_deleter
 //
 // Like std::make_unique, but returns PSRAM instead of base RAM.  We cheat a little here by not providing
 // a deleter, because we know that PSRAM can be freed with the regular free() call and does not require
-// special handling.
+// special handling.  Returns nullptr if the allocation fails.
 
 template<typename T, typename... Args>
 std::unique_ptr<T> make_unique_psram(Args&&... args)
 {
 	psram_allocator<T> allocator;
 	T* ptr = allocator.allocate(1);
+	if (!ptr) {
+		return nullptr;
+	}
 	allocator.construct(ptr, std::forward<Args>(args)...);
 	return std::unique_ptr<T>(ptr);
 }
@@ -13,32 +13,146 @@
 #include <HardwareSerial.h>
 
 #include "agon.h"								// Configuration file
+#include "serial_ring_stream.h"
+#include "spsc_ring.h"
 
 #define VDPSerial Serial2
 
+SerialRingStream	VDPStream(VDPSerial, UART_NUM_2);		// VDP serial input, via a large receive ring
+
+// Priority of data sent back to MOS
+// Queued high priority data is always sent before any low priority data
+//
+enum class TxPriority : uint8_t {
+	High = 0,			// Keyboard and command responses
+	Low = 1,			// Mouse updates
+};
+
+// Transmit queues for data sent to MOS, which are drained by the transmit task
+// Each queue holds records of a 16-bit length followed by that many bytes
+// Producers may be on any task, so they take txQueueLock while queuing, but the transmit task never needs to
+//
+SPSCRing<uint8_t>	txQueues[2];
+portMUX_TYPE		txQueueLock = portMUX_INITIALIZER_UNLOCKED;
+TaskHandle_t		txTaskHandle = nullptr;
+
+void txTask(void * parameter);
+
+// Called from the UART event task whenever data is received
+//
+void vdpDataReceived() {
+	VDPStream.dataReceived();
+}
+
 void setupVDPProtocol() {
 	VDPSerial.end();
 	VDPSerial.setRxBufferSize(UART_RX_SIZE);					// Can't be called when running
 	VDPSerial.begin(UART_BR, SERIAL_8N1, UART_RX, UART_TX);
-	VDPSerial.setHwFlowCtrlMode(HW_FLOWCTRL_RTS, 64);			// Can be called whenever
 	VDPSerial.setPins(UART_NA, UART_NA, UART_CTS, UART_RTS);	// Must be called after begin
 	VDPSerial.setTimeout(COMMS_TIMEOUT);
+	VDPStream.setTimeout(COMMS_TIMEOUT);
+	if (VDPStream.begin(UART_RING_SIZE, UART_RING_HOLD_OFF, UART_RING_RESUME, UART_DRAIN_PRIORITY, UART_DRAIN_CORE)) {
+		VDPSerial.setHwFlowCtrlMode(HW_FLOWCTRL_DISABLE, 0);	// The drain task drives RTS from the ring
+	} else {
+		debug_log("setupVDPProtocol: failed to start serial receive ring, reading serial port directly\n\r");
+		VDPSerial.setHwFlowCtrlMode(HW_FLOWCTRL_RTS, 64);		// Can be called whenever
+	}
+	VDPSerial.onReceive(vdpDataReceived);
+
+	if (!txQueues[(int)TxPriority::High].begin(TX_QUEUE_SIZE) || !txQueues[(int)TxPriority::Low].begin(TX_LOW_QUEUE_SIZE)) {
+		debug_log("setupVDPProtocol: failed to allocate transmit queues\n\r");
+		return;
+	}
+	if (xTaskCreatePinnedToCore(txTask, "vdpTx", 2048, nullptr, TX_PRIORITY, &txTaskHandle, TX_CORE) != pdPASS) {
+		debug_log("setupVDPProtocol: failed to start transmit task\n\r");
+		txTaskHandle = nullptr;
+	}
+}
+
+// Block the calling task until VDP serial data is available, or the timeout expires
+// Only one task should wait at a time
+//
+void waitForVDPData(TickType_t timeout) {
+	VDPStream.waitForData(timeout);
+}
+
+// Queue data to be sent to MOS, preceded by an optional header
+// The header and data are queued as one record, so will never be split up by other data
+// Waits for space if the queue is full, or writes directly if the transmit task isn't running
+// Records too large to ever fit in the queue are dropped
+//
+void queueVDPData(const uint8_t * header, uint16_t headerLength, const uint8_t * data, uint16_t length, TxPriority priority) {
+	if (!txTaskHandle) {
+		if (headerLength) {
+			VDPSerial.write(header, headerLength);
+		}
+		VDPSerial.write(data, length);
+		return;
+	}
+	auto &queue = txQueues[(int)priority];
+	uint32_t recordLength = headerLength + length;
+	uint8_t lengthBytes[] = { (uint8_t) (recordLength & 0xFF), (uint8_t) (recordLength >> 8) };
+	uint32_t total = sizeof lengthBytes + recordLength;
+	if (total > queue.getCapacity()) {
+		debug_log("queueVDPData: %d byte record is too large for the transmit queue\n\r", recordLength);
+		return;
+	}
+
+	while (true) {
+		portENTER_CRITICAL(&txQueueLock);
+		auto queued = queue.space() >= total;
+		if (queued) {
+			queue.stage(0, lengthBytes, sizeof lengthBytes);
+			queue.stage(sizeof lengthBytes, header, headerLength);
+			queue.stage(sizeof lengthBytes + headerLength, data, length);
+			queue.produce(total);
+		}
+		portEXIT_CRITICAL(&txQueueLock);
+		if (queued) {
+			break;
+		}
+		vTaskDelay(1);
+	}
+	xTaskNotifyGive(txTaskHandle);
+}
+
+// Send records from the transmit queues to MOS, high priority first
+// Records are always sent whole, so a low priority packet is never interrupted
+//
+void txTask(void * parameter) {
+	auto &highQueue = txQueues[(int)TxPriority::High];
+	auto &lowQueue = txQueues[(int)TxPriority::Low];
+	while (true) {
+		auto &queue = highQueue.empty() ? lowQueue : highQueue;
+		if (queue.empty()) {
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+			continue;
+		}
+		uint16_t remaining = queue.front();
+		queue.consume(1);
+		remaining |= queue.front() << 8;
+		queue.consume(1);
+		while (remaining > 0) {
+			auto span = queue.readableSpan();
+			auto count = std::min<uint32_t>(span.size(), remaining);
+			VDPSerial.write(span.data(), count);
+			queue.consume(count);
+			remaining -= count;
+		}
+	}
 }
 
 // TODO remove the following - it's only here for cursor.h to send escape key when doing paged mode handling
 
 inline void writeByte(uint8_t b) {
-	VDPSerial.write(b);
+	queueVDPData(nullptr, 0, &b, 1, TxPriority::High);
 }
 
 // Send a packet of data to the MOS
 //
-void send_packet(uint8_t code, uint16_t len, uint8_t data[]) {
-	writeByte(code + 0x80);
-	writeByte(len);
-	for (int i = 0; i < len; i++) {
-		writeByte(data[i]);
-	}
+void send_packet(uint8_t code, uint16_t len, uint8_t data[], TxPriority priority = TxPriority::High) {
+	uint8_t header[] = { (uint8_t) (code + 0x80), (uint8_t) len };
+	queueVDPData(header, sizeof header, data, len, priority);
 }
 
 #endif // AGON_VDP_PROTOCOL_H
@@ -5,15 +5,33 @@
 
 #include "agon.h"
 #include "vdu_audio.h"
+#include "vdu_compiled.h"
+#include "vdu_render.h"
 #include "vdu_sys.h"
 
 extern bool consoleMode;
 extern bool printerOn;
 extern HardwareSerial DBGSerial;
 
+// Housekeeping needed before any command starts
+// c is the command's leading byte
+//
+inline void VDUStreamProcessor::beginCommand(uint8_t c) {
+	commandCount++;
+
+	if (hasPendingLookahead()) {
+		resolveLookahead(c);
+	}
+	if (c != 0x19) {
+		flushRenderQueue();
+	}
+}
+
 // Handle VDU commands
 //
 void VDUStreamProcessor::vdu(uint8_t c, bool usePeek) {
+	beginCommand(c);
+
 	// We want to send raw chars back to the debugger
 	// this allows binary (faster) data transfer in ZDI mode
 	// to inspect memory and register values
@@ -87,10 +105,9 @@ void VDUStreamProcessor::vdu(uint8_t c, bool usePeek) {
 			playNote(0, 100, 750, 125);
 			break;
 		case 0x08:	// Cursor Left
-			if (!context->textCursorActive() && usePeek && peekByte_t(FAST_COMMS_TIMEOUT) == 0x20) {
-				// left followed by a space is almost certainly a backspace
-				// but MOS doesn't send backspaces to delete characters on line edits
-				context->plotBackspace();
+			if (!context->textCursorActive() && usePeek) {
+				// this may be a backspace, depending on the next byte
+				deferLookahead(PendingLookahead::Backspace);
 			} else {
 				context->cursorLeft();
 			}
@@ -190,18 +207,38 @@ void VDUStreamProcessor::vdu_print(char c, bool usePeek) {
 		DBGSerial.write(c);
 	}
 
-	std::string s;
-	s += c;
-	// gather our string for printing
+	// gather our string for printing into a fixed scratch buffer
+	char s[TEXT_RUN_LENGTH];
+	size_t length = 0;
+	s[length++] = c;
 	if (usePeek) {
-		auto limit = 15;
-		while (--limit) {
+		while (length < TEXT_RUN_LENGTH) {
+			// take a run of plain printable characters directly from the input if we can
+			auto span = inputSpans ? inputSpans->readableSpan() : tcb::span<const uint8_t>();
+			size_t count = 0;
+			while (count < span.size() && length < TEXT_RUN_LENGTH) {
+				auto next = span[count];
+				if (next < 0x20 || next == 0x7F) {
+					break;
+				}
+				s[length++] = next;
+				count++;
+			}
+			if (count > 0) {
+				if (printerOn) {
+					DBGSerial.write(span.data(), count);
+				}
+				inputSpans->commit(count);
+				inputBytesRead += count;
+				continue;
+			}
+
 			if (!byteAvailable()) {
 				break;
 			}
 			auto next = inputStream->peek();
 			if (next == 27) {
-				inputStream->read();
+				readByte();
 				if (consoleMode) {
 					DBGSerial.write(next);
 				}
@@ -209,10 +246,10 @@ void VDUStreamProcessor::vdu_print(char c, bool usePeek) {
 				if (next == -1) {
 					break;
 				}
-				s += (char)next;
+				s[length++] = next;
 			} else if ((next >= 0x20 && next <= 0x7E) || (next >= 0x80 && next <= 0xFF)) {
-				s += (char)next;
-				inputStream->read();
+				s[length++] = next;
+				readByte();
 			} else {
 				break;
 			}
@@ -221,7 +258,7 @@ void VDUStreamProcessor::vdu_print(char c, bool usePeek) {
 			}
 		}
 	}
-	context->plotString(s);
+	context->plotString(s, length);
 }
 
 // VDU 17 Handle COLOUR
@@ -316,15 +353,40 @@ void VDUStreamProcessor::vdu_graphicsViewport() {
 // VDU 25 Handle PLOT
 //
 void IRAM_ATTR VDUStreamProcessor::vdu_plot() {
-	auto command = readByte_t(); if (command == -1) return;
-	auto x = readWord_t(); if (x == -1) return;
-	auto y = readWord_t(); if (y == -1) return;
+	int16_t command;
+	int32_t x, y;
+	auto data = peekInput(5);
+	if (data) {
+		// whole command has arrived, so decode it in place
+		command = data[0];
+		x = data[1] | (data[2] << 8);
+		y = data[3] | (data[4] << 8);
+		inputSpans->commit(5);
+		inputBytesRead += 5;
+	} else {
+		command = readByte_t(); if (command == -1) return;
+		x = readWord_t(); if (x == -1) return;
+		y = readWord_t(); if (y == -1) return;
+	}
+
+	executePlot(command, x, y);
+}
 
+// Execute a decoded plot command
+//
+void IRAM_ATTR VDUStreamProcessor::executePlot(uint8_t command, int16_t x, int16_t y) {
 	if (ttxtMode) return;
 
-	if (context->plot((int16_t) x, (int16_t) y, command)) {
+	if (useRenderPipeline()) {
+		queuePlot(x, y, command);
+		// we won't know whether this leaves a path pending until it's rendered
+		deferLookahead(PendingLookahead::QueuedPlot);
+		return;
+	}
+
+	if (context->plot(x, y, command)) {
 		// we have a pending plot command
-		context->plotPending(peekByte_t(FAST_COMMS_TIMEOUT));
+		deferLookahead(PendingLookahead::PlotPath);
 	}
 }
 
@@ -257,14 +257,15 @@ uint8_t VDUStreamProcessor::loadSample(uint16_t bufferId, uint32_t length) {
 // Create a sample from a buffer
 //
 uint8_t VDUStreamProcessor::createSampleFromBuffer(uint16_t bufferId, uint8_t format, uint16_t sampleRate) {
-	if (buffers.find(bufferId) == buffers.end()) {
+	auto bufferBlocks = buffers.get(bufferId);
+	if (!bufferBlocks) {
 		debug_log("vdu_sys_audio: buffer %d not found\n\r", bufferId);
 		return 0;
 	}
 	clearSample(bufferId);
 	auto sample = (format & AUDIO_FORMAT_WITH_RATE) ?
-		std::make_shared<AudioSample>(buffers[bufferId], format & AUDIO_FORMAT_DATA_MASK, sampleRate)
-		: std::make_shared<AudioSample>(buffers[bufferId], format & AUDIO_FORMAT_DATA_MASK);
+		std::make_shared<AudioSample>(*bufferBlocks, format & AUDIO_FORMAT_DATA_MASK, sampleRate)
+		: std::make_shared<AudioSample>(*bufferBlocks, format & AUDIO_FORMAT_DATA_MASK);
 	if (sample) {
 		if (format & AUDIO_FORMAT_TUNEABLE) {
 			sample->baseFrequency = AUDIO_DEFAULT_FREQUENCY;
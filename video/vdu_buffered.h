@@ -191,6 +191,18 @@ void IRAM_ATTR VDUStreamProcessor::vdu_sys_buffered() {
 			}
 			bufferCopyAndConsolidate(bufferId, sourceBufferIds);
 		}	break;
+		case BUFFERED_ADJUST_STRIDED: {
+			bufferAdjustStrided(bufferId, false);
+		}	break;
+		case BUFFERED_FILL: {
+			bufferFill(bufferId);
+		}	break;
+		case BUFFERED_BLIT: {
+			bufferBlit(bufferId);
+		}	break;
+		case BUFFERED_ADJUST_MASKED: {
+			bufferAdjustStrided(bufferId, true);
+		}	break;
 		case BUFFERED_AFFINE_TRANSFORM: {
 			if (isTestFlagSet(TEST_FLAG_AFFINE_TRANSFORM)) {
 				bufferAffineTransform(bufferId);
@@ -199,13 +211,21 @@ void IRAM_ATTR VDUStreamProcessor::vdu_sys_buffered() {
 		case BUFFERED_COMPRESS: {
 			auto sourceBufferId = readWord_t();
 			if (sourceBufferId == -1) return;
-			bufferCompress(bufferId, sourceBufferId);
+			bufferCompress(bufferId, sourceBufferId, COMPRESSION_TYPE_TURBO);
+		}	break;
+		case BUFFERED_COMPRESS_TYPE: {
+			auto sourceBufferId = readWord_t(); if (sourceBufferId == -1) return;
+			auto type = readByte_t(); if (type == -1) return;
+			bufferCompress(bufferId, sourceBufferId, type);
 		}	break;
 		case BUFFERED_DECOMPRESS: {
 			auto sourceBufferId = readWord_t();
 			if (sourceBufferId == -1) return;
 			bufferDecompress(bufferId, sourceBufferId);
 		}	break;
+		case BUFFERED_DECOMPRESS_STREAM: {
+			bufferDecompressStream(bufferId);
+		}	break;
 		case BUFFERED_EXPAND_BITMAP: {
 			auto options = readByte_t(); if (options == -1) return;
 			auto sourceBufferId = readWord_t();
@@ -214,12 +234,13 @@ void IRAM_ATTR VDUStreamProcessor::vdu_sys_buffered() {
 		}	break;
 		case BUFFERED_DEBUG_INFO: {
 			// force_debug_log("vdu_sys_buffered: debug info stack highwater %d\n\r",uxTaskGetStackHighWaterMark(nullptr));
-			debug_log("vdu_sys_buffered: buffer %d, %d streams stored\n\r", bufferId, buffers[bufferId].size());
-			if (buffers[bufferId].empty()) {
+			auto bufferBlocks = buffers.get(bufferId);
+			debug_log("vdu_sys_buffered: buffer %d, %d streams stored\n\r", bufferId, bufferBlocks ? bufferBlocks->size() : 0);
+			if (!bufferBlocks || bufferBlocks->empty()) {
 				return;
 			}
 			// output contents of buffer stream 0
-			auto buffer = buffers[bufferId][0];
+			auto buffer = bufferBlocks->front();
 			auto bufferLength = buffer->size();
 			for (auto i = 0; i < bufferLength; i++) {
 				auto data = buffer->getBuffer()[i];
@@ -227,6 +248,12 @@ void IRAM_ATTR VDUStreamProcessor::vdu_sys_buffered() {
 			}
 			debug_log("\n\r");
 		}	break;
+#ifdef VDP_BENCHMARK
+		case BUFFERED_BENCHMARK: {
+			auto iterations = readWord_t(); if (iterations == -1) return;
+			bufferBenchmark(bufferId, iterations);
+		}	break;
+#endif
 		default: {
 			debug_log("vdu_sys_buffered: unknown command %d, buffer %d\n\r", command, bufferId);
 		}	break;
@@ -238,7 +265,7 @@ void IRAM_ATTR VDUStreamProcessor::vdu_sys_buffered() {
 // allowing a single bufferId to store multiple streams of data
 //
 uint32_t VDUStreamProcessor::bufferWrite(uint16_t bufferId, uint32_t length) {
-	auto bufferStream = make_shared_psram<BufferStream>(length);
+	auto bufferStream = make_shared_pooled<BufferStream>(length);
 
 	debug_log("bufferWrite: storing stream into buffer %d, length %d\n\r", bufferId, length);
 
@@ -255,8 +282,13 @@ uint32_t VDUStreamProcessor::bufferWrite(uint16_t bufferId, uint32_t length) {
 		return remaining;
 	}
 
-	buffers[bufferId].push_back(std::move(bufferStream));
-	debug_log("bufferWrite: stored stream in buffer %d, length %d, %d streams stored\n\r", bufferId, length, buffers[bufferId].size());
+	auto buffer = buffers.create(bufferId);
+	if (!buffer) {
+		debug_log("bufferWrite: failed to create buffer %d\n\r", bufferId);
+		return remaining;
+	}
+	buffer->push_back(std::move(bufferStream));
+	debug_log("bufferWrite: stored stream in buffer %d, length %d, %d streams stored\n\r", bufferId, length, buffer->size());
 	return remaining;
 }
 
@@ -289,24 +321,36 @@ void VDUStreamProcessor::bufferCall(uint16_t callBufferId, AdvancedOffset offset
 			return;
 		}
 	}
-	auto bufferIter = buffers.find(bufferId);
-	if (bufferIter == buffers.end()) {
+	auto bufferIndex = buffers.getIndex(bufferId);
+	if (!bufferIndex) {
 		debug_log("bufferCall: buffer %d not found\n\r", bufferId);
 		return;
 	}
-	auto &streams = bufferIter->second;
-	std::shared_ptr<Stream> callInputStream = make_shared_psram<MultiBufferStream>(streams);
+	std::shared_ptr<const CompiledBuffer> compiled;
+	auto multiBufferStream = make_shared_psram<MultiBufferStream>(std::move(bufferIndex));
 	if (offset.blockOffset != 0 || offset.blockIndex != 0) {
-		auto multiBufferStream = (MultiBufferStream *)callInputStream.get();
 		multiBufferStream->seekTo(offset.blockOffset, offset.blockIndex);
+	} else if (isTestFlagSet(TEST_FLAG_COMPILED_BUFFERS)) {
+		compiled = buffers.getCompiled(bufferId);
+		if (!compiled) {
+			compiled = compileBuffer(bufferId);
+		}
 	}
+	SpanReader * callInputSpans = multiBufferStream.get();
+	std::shared_ptr<Stream> callInputStream = std::move(multiBufferStream);
 	// use the current VDUStreamProcessor, swapping out the stream
 	std::swap(id, callBufferId);
 	std::swap(inputStream, callInputStream);
-	processAllAvailable();
+	std::swap(inputSpans, callInputSpans);
+	if (compiled) {
+		runCompiledBuffer(*compiled);
+	} else {
+		processAllAvailable();
+	}
 	// restore the original buffer id and stream
 	id = callBufferId;
 	inputStream = std::move(callInputStream);
+	inputSpans = callInputSpans;
 	if (id != 65535) {
 		// return to the appropriate offset
 		auto multiBufferStream = (MultiBufferStream *)inputStream.get();
@@ -338,12 +382,11 @@ void VDUStreamProcessor::bufferClear(uint16_t bufferId) {
 		resetSamples();
 		return;
 	}
-	auto bufferIter = buffers.find(bufferId);
-	if (bufferIter == buffers.end()) {
+	if (!buffers.get(bufferId)) {
 		debug_log("bufferClear: buffer %d not found\n\r", bufferId);
 		return;
 	}
-	buffers.erase(bufferIter);
+	buffers.erase(bufferId);
 	bufferRemoveUsers(bufferId);
 	debug_log("bufferClear: cleared buffer %d\n\r", bufferId);
 }
@@ -356,16 +399,21 @@ std::shared_ptr<WritableBufferStream> VDUStreamProcessor::bufferCreate(uint16_t
 		debug_log("bufferCreate: bufferId %d is reserved\n\r", bufferId);
 		return nullptr;
 	}
-	if (buffers.find(bufferId) != buffers.end()) {
+	if (buffers.get(bufferId)) {
 		debug_log("bufferCreate: buffer %d already exists\n\r", bufferId);
 		return nullptr;
 	}
-	auto buffer = make_shared_psram<WritableBufferStream>(size);
+	auto buffer = make_shared_pooled<WritableBufferStream>(size);
 	if (!buffer) {
 		debug_log("bufferCreate: failed to create buffer %d\n\r", bufferId);
 		return nullptr;
 	}
-	buffers[bufferId].push_back(buffer);
+	auto bufferBlocks = buffers.create(bufferId);
+	if (!bufferBlocks) {
+		debug_log("bufferCreate: failed to create buffer %d\n\r", bufferId);
+		return nullptr;
+	}
+	bufferBlocks->push_back(buffer);
 	debug_log("bufferCreate: created buffer %d, size %d\n\r", bufferId, size);
 	return buffer;
 }
@@ -386,12 +434,12 @@ void VDUStreamProcessor::setOutputStream(uint16_t bufferId) {
 		outputStream = originalOutputStream;
 		return;
 	}
-	auto bufferIter = buffers.find(bufferId);
-	if (bufferIter == buffers.end() || bufferIter->second.empty()) {
+	auto bufferBlocks = buffers.get(bufferId);
+	if (!bufferBlocks || bufferBlocks->empty()) {
 		debug_log("setOutputStream: buffer %d not found\n\r", bufferId);
 		return;
 	}
-	auto &output = bufferIter->second.front();
+	auto &output = bufferBlocks->front();
 	if (output->isWritable()) {
 		outputStream = output;
 	} else {
@@ -442,23 +490,31 @@ std::vector<uint16_t> VDUStreamProcessor::getBufferIdsFromStream() {
 }
 
 // Get the longest contiguous span at the given buffer offset. Updates the offset to the correct block index.
-tcb::span<uint8_t> VDUStreamProcessor::getBufferSpan(const std::vector<std::shared_ptr<BufferStream>> &buffer, AdvancedOffset &offset) {
-	while (offset.blockIndex < buffer.size()) {
-		// check for available bytes in the current block
-		auto &block = buffer[offset.blockIndex];
-		if (offset.blockOffset < block->size()) {
-			return { block->getBuffer() + offset.blockOffset, block->size() - offset.blockOffset };
-		}
-		// if offset exceeds the block size, loop to find the correct block
-		offset.blockOffset -= block->size();
-		offset.blockIndex++;
-	}
-	// offset not found in buffer
-	return {};
+tcb::span<uint8_t> VDUStreamProcessor::getBufferSpan(const BufferIndex &buffer, AdvancedOffset &offset) {
+	if (!buffer.resolve(offset.blockOffset, offset.blockIndex)) {
+		// offset not found in buffer
+		return {};
+	}
+	auto &block = buffer[offset.blockIndex];
+	return { block->getBuffer() + offset.blockOffset, block->size() - offset.blockOffset };
+}
+
+// As getBufferSpan, but for modifying the buffer
+// If the block's storage is shared with other blocks it is copied first
+tcb::span<uint8_t> VDUStreamProcessor::getWritableBufferSpan(const BufferIndex &buffer, AdvancedOffset &offset) {
+	auto bufferSpan = getBufferSpan(buffer, offset);
+	if (bufferSpan.empty()) {
+		return {};
+	}
+	auto data = buffer[offset.blockIndex]->getWritableBuffer();
+	if (!data) {
+		return {};
+	}
+	return { data + offset.blockOffset, bufferSpan.size() };
 }
 
 // Utility call to read a byte from a buffer at the given offset
-int16_t VDUStreamProcessor::getBufferByte(const std::vector<std::shared_ptr<BufferStream>> &buffer, AdvancedOffset &offset, bool iterate) {
+int16_t VDUStreamProcessor::getBufferByte(const BufferIndex &buffer, AdvancedOffset &offset, bool iterate) {
 	auto bufferSpan = getBufferSpan(buffer, offset);
 	if (bufferSpan.empty()) {
 		// offset not found in buffer
@@ -472,8 +528,8 @@ int16_t VDUStreamProcessor::getBufferByte(const std::vector<std::shared_ptr<Buff
 }
 
 // Utility call to set a byte in a buffer at the given offset
-bool VDUStreamProcessor::setBufferByte(uint8_t value, const std::vector<std::shared_ptr<BufferStream>> &buffer, AdvancedOffset &offset, bool iterate) {
-	auto bufferSpan = getBufferSpan(buffer, offset);
+bool VDUStreamProcessor::setBufferByte(uint8_t value, const BufferIndex &buffer, AdvancedOffset &offset, bool iterate) {
+	auto bufferSpan = getWritableBufferSpan(buffer, offset);
 	if (bufferSpan.empty()) {
 		// offset not found in buffer
 		return false;
@@ -770,6 +826,31 @@ struct AdjustMulti {
 	}
 };
 
+// Adjusts count elements of width bytes, starting stride bytes apart
+// Each element takes its operand bytes from operand, which advances by operandStride per element
+// so an operandStride of zero applies the same operand pattern to every element
+// Carry runs through the bytes of an element, least significant first, and is cleared between elements
+template<uint8_t Operator>
+struct AdjustStrided {
+	static void adjust(uint8_t * target, size_t stride, size_t width, const uint8_t * operand, size_t operandStride, size_t count) {
+		if (width == 1) {
+			for (size_t i = 0; i < count; i++) {
+				bool carry = false;
+				*target = AdjustSingle<Operator>::adjust(*target, *operand, carry);
+				target += stride, operand += operandStride;
+			}
+			return;
+		}
+		for (size_t i = 0; i < count; i++) {
+			bool carry = false;
+			for (size_t j = 0; j < width; j++) {
+				target[j] = AdjustSingle<Operator>::adjust(target[j], operand[j], carry);
+			}
+			target += stride, operand += operandStride;
+		}
+	}
+};
+
 // Automatically generates a function table for all operators. Would be easier with C++14
 template <template<uint8_t, typename...> typename T>
 class AdjustFuncTable {
@@ -827,7 +908,8 @@ void VDUStreamProcessor::bufferAdjust(uint16_t adjustBufferId) {
 	const bool hasOperand = op > ADJUST_NEG;
 
 	auto offset = getOffsetFromStream(useAdvancedOffsets);
-	const std::vector<std::shared_ptr<BufferStream>> * operandBuffer = nullptr;
+	std::shared_ptr<const BufferIndex> operandBufferIndex;
+	const BufferIndex * operandBuffer = nullptr;
 	auto operandBufferId = 0;
 	AdvancedOffset operandOffset = {};
 	auto count = 1;
@@ -842,12 +924,12 @@ void VDUStreamProcessor::bufferAdjust(uint16_t adjustBufferId) {
 			debug_log("bufferAdjust: no operand buffer ID\n\r");
 			return;
 		}
-		auto operandBufferIter = buffers.find(operandBufferId);
-		if (operandBufferIter == buffers.end()) {
+		operandBufferIndex = buffers.getIndex(operandBufferId);
+		if (!operandBufferIndex) {
 			debug_log("bufferAdjust: buffer %d not found\n\r", operandBufferId);
 			return;
 		}
-		operandBuffer = &operandBufferIter->second;
+		operandBuffer = operandBufferIndex.get();
 	}
 
 	auto bufferId = resolveBufferId(adjustBufferId, id);
@@ -855,12 +937,12 @@ void VDUStreamProcessor::bufferAdjust(uint16_t adjustBufferId) {
 		debug_log("bufferAdjust: no target buffer ID\n\r");
 		return;
 	}
-	auto bufferIter = buffers.find(bufferId);
-	if (bufferIter == buffers.end()) {
+	auto bufferIndex = buffers.getIndex(bufferId);
+	if (!bufferIndex) {
 		debug_log("bufferAdjust: buffer %d not found\n\r", bufferId);
 		return;
 	}
-	auto &buffer = bufferIter->second;
+	auto &buffer = *bufferIndex;
 
 	if (command == -1 || count == -1 || offset.blockOffset == -1 || operandOffset.blockOffset == -1) {
 		debug_log("bufferAdjust: invalid command, count, offset or operand value\n\r");
@@ -897,7 +979,7 @@ void VDUStreamProcessor::bufferAdjust(uint16_t adjustBufferId) {
 	}
 	if (!useMultiTarget) {
 		// we have a singular target value
-		targetSpan = getBufferSpan(buffer, offset);
+		targetSpan = getWritableBufferSpan(buffer, offset);
 		if (targetSpan.empty()) {
 			debug_log("bufferAdjust: invalid target offset\n\r");
 			return;
@@ -953,7 +1035,7 @@ void VDUStreamProcessor::bufferAdjust(uint16_t adjustBufferId) {
 			auto func = adjustMultiSingleFuncs[op];
 			auto operandWord = (uint8_t)operandValue * (uint32_t)0x01010101;
 			while (count > 0) {
-				targetSpan = getBufferSpan(buffer, offset);
+				targetSpan = getWritableBufferSpan(buffer, offset);
 				auto iterCount = std::min<size_t>(targetSpan.size(), count);
 				if (iterCount == 0) {
 					debug_log("bufferAdjust: target buffer overflow\n\r");
@@ -966,7 +1048,7 @@ void VDUStreamProcessor::bufferAdjust(uint16_t adjustBufferId) {
 		} else if (operandBuffer) {
 			auto func = adjustMultiFuncs[op];
 			while (count > 0) {
-				targetSpan = getBufferSpan(buffer, offset);
+				targetSpan = getWritableBufferSpan(buffer, offset);
 				auto operandSpan = getBufferSpan(*operandBuffer, operandOffset);
 				auto iterCount = std::min<size_t>(std::min(targetSpan.size(), operandSpan.size()), count);
 				if (iterCount == 0) {
@@ -988,7 +1070,7 @@ void VDUStreamProcessor::bufferAdjust(uint16_t adjustBufferId) {
 		} else {
 			auto func = adjustSingleFuncs[op];
 			while (count > 0) {
-				targetSpan = getBufferSpan(buffer, offset);
+				targetSpan = getWritableBufferSpan(buffer, offset);
 				auto iterCount = std::min<size_t>(targetSpan.size(), count);
 				if (iterCount == 0) {
 					debug_log("bufferAdjust: target buffer overflow\n\r");
@@ -1017,6 +1099,569 @@ void VDUStreamProcessor::bufferAdjust(uint16_t adjustBufferId) {
 	}
 }
 
+// Restore the bits of an adjusted element that are clear in mask from its original value
+//
+static inline void mergeMasked(uint8_t * adjusted, const uint8_t * original, const uint8_t * mask, size_t width) {
+	for (size_t i = 0; i < width; i++) {
+		adjusted[i] = original[i] ^ ((original[i] ^ adjusted[i]) & mask[i]);
+	}
+}
+
+// VDU 23, 0, &A0, bufferId; &1B, operation, offset; count; width, stride; [operand]: Strided adjust
+// VDU 23, 0, &A0, bufferId; &1E, operation, offset; count; width, stride, <mask>, [operand]: Masked strided adjust
+// Adjusts count elements of width bytes, the first at offset and each following one stride bytes further on
+// such as the alpha channel of every pixel in an RGBA8888 bitmap (width 1, stride 4)
+// The masked form gives width mask bytes, and only the bits set in the mask are changed in each element
+// Operation uses the same operators as bufferAdjust, with these flags:
+// - ADJUST_ADVANCED_OFFSETS: offset, count and stride are all 24-bit values
+// - ADJUST_BUFFER_VALUE: operand is read from operandBufferId; operandOffset; rather than given inline
+// - ADJUST_MULTI_OPERAND: each element has its own operand of width bytes, otherwise one operand is used for all
+// ADJUST_MULTI_TARGET is implied, and ignored
+// For add with carry, carry propagates through each element's bytes (little-endian), and is not stored
+//
+void VDUStreamProcessor::bufferAdjustStrided(uint16_t adjustBufferId, bool masked) {
+	static constexpr AdjustFuncTable<AdjustStrided> adjustStridedFuncs;
+
+	const auto command = readByte_t(); if (command == -1) return;
+	const bool useAdvancedOffsets = command & ADJUST_ADVANCED_OFFSETS;
+	const bool useBufferValue = command & ADJUST_BUFFER_VALUE;
+	const bool useMultiOperand = command & ADJUST_MULTI_OPERAND;
+	const uint8_t op = command & ADJUST_OP_MASK;
+	const bool hasOperand = op > ADJUST_NEG;
+
+	auto offset = getOffsetFromStream(useAdvancedOffsets); if (offset.blockOffset == -1) return;
+	int32_t count = useAdvancedOffsets ? read24_t() : readWord_t(); if (count == -1) return;
+	auto width = readByte_t(); if (width == -1) return;
+	int32_t stride = useAdvancedOffsets ? read24_t() : readWord_t(); if (stride == -1) return;
+
+	uint8_t mask[255];
+	if (masked && readIntoBuffer(mask, width) != 0) {
+		debug_log("bufferAdjustStrided: mask timeout\n\r");
+		return;
+	}
+
+	// operand arguments must always be consumed, so the stream stays in step when the command is rejected
+	auto skipOperand = [&]() {
+		if (!hasOperand) {
+			return;
+		}
+		if (useBufferValue) {
+			readWord_t();
+			getOffsetFromStream(useAdvancedOffsets);
+		} else {
+			discardBytes(useMultiOperand ? (uint32_t)width * count : width);
+		}
+	};
+
+	if (width == 0 || stride < width) {
+		debug_log("bufferAdjustStrided: invalid width %d or stride %d\n\r", width, stride);
+		skipOperand();
+		return;
+	}
+	if (count == 0) {
+		skipOperand();
+		return;
+	}
+
+	auto bufferId = resolveBufferId(adjustBufferId, id);
+	if (bufferId == -1) {
+		debug_log("bufferAdjustStrided: no target buffer ID\n\r");
+		skipOperand();
+		return;
+	}
+	auto bufferIndex = buffers.getIndex(bufferId);
+	if (!bufferIndex) {
+		debug_log("bufferAdjustStrided: buffer %d not found\n\r", bufferId);
+		skipOperand();
+		return;
+	}
+	auto &buffer = *bufferIndex;
+
+	// all the elements must fit in the target, which also bounds the operand size
+	uint32_t position = offset.blockIndex < buffer.blockCount()
+		? buffer.blockStart(offset.blockIndex) + offset.blockOffset : buffer.size();
+	uint32_t available = position < buffer.size() ? buffer.size() - position : 0;
+	uint32_t maxCount = available >= (uint32_t)width ? (available - width) / stride + 1 : 0;
+	if ((uint32_t)count > maxCount) {
+		debug_log("bufferAdjustStrided: %d elements overflow buffer %d, which has room for %d\n\r", count, bufferId, maxCount);
+		skipOperand();
+		return;
+	}
+
+	// gather the operand bytes into one contiguous run
+	// this is width bytes, or width bytes per element when using multiple operands
+	size_t operandSize = hasOperand ? (useMultiOperand ? width * count : width) : 1;
+	auto operand = make_unique_psram_array<uint8_t>(operandSize);
+	if (!operand) {
+		debug_log("bufferAdjustStrided: failed to allocate %d operand bytes\n\r", operandSize);
+		skipOperand();
+		return;
+	}
+	operand[0] = 0;
+	if (hasOperand) {
+		if (useBufferValue) {
+			auto operandBufferId = resolveBufferId(readWord_t(), id);
+			auto operandOffset = getOffsetFromStream(useAdvancedOffsets);
+			if (operandBufferId == -1 || operandOffset.blockOffset == -1) {
+				debug_log("bufferAdjustStrided: no operand buffer ID\n\r");
+				return;
+			}
+			auto operandBuffer = buffers.getIndex(operandBufferId);
+			if (!operandBuffer) {
+				debug_log("bufferAdjustStrided: buffer %d not found\n\r", operandBufferId);
+				return;
+			}
+			size_t copied = 0;
+			while (copied < operandSize) {
+				auto operandSpan = getBufferSpan(*operandBuffer, operandOffset);
+				auto iterCount = std::min<size_t>(operandSpan.size(), operandSize - copied);
+				if (iterCount == 0) {
+					debug_log("bufferAdjustStrided: operand buffer overflow\n\r");
+					return;
+				}
+				memcpy(operand.get() + copied, operandSpan.data(), iterCount);
+				operandOffset.blockOffset += iterCount;
+				copied += iterCount;
+			}
+		} else if (readIntoBuffer(operand.get(), operandSize) != 0) {
+			debug_log("bufferAdjustStrided: operand timeout\n\r");
+			return;
+		}
+	}
+
+	debug_log("bufferAdjustStrided: command %d, offset %d:%d, count %d, width %d, stride %d\n\r",
+		command, (int)offset.blockIndex, offset.blockOffset, count, width, stride);
+
+	auto func = adjustStridedFuncs[op];
+	const uint8_t * operandData = operand.get();
+	const size_t operandStride = useMultiOperand ? width : 0;
+	while (count > 0) {
+		auto targetSpan = getWritableBufferSpan(buffer, offset);
+		if (targetSpan.empty()) {
+			debug_log("bufferAdjustStrided: target buffer overflow\n\r");
+			return;
+		}
+		// adjust all the elements that lie entirely within this block in one pass
+		size_t iterCount = targetSpan.size() >= (size_t)width ? (targetSpan.size() - width) / stride + 1 : 0;
+		iterCount = std::min<size_t>(iterCount, count);
+		if (iterCount > 0) {
+			if (masked) {
+				// save a run of elements, adjust them all in place, then restore their unmasked bits
+				uint8_t saved[256];
+				const size_t runLength = sizeof(saved) / width;
+				for (size_t done = 0; done < iterCount; done += runLength) {
+					auto run = std::min(runLength, iterCount - done);
+					auto target = targetSpan.data() + done * stride;
+					if (width == 1) {
+						for (size_t i = 0; i < run; i++) {
+							saved[i] = target[i * stride];
+						}
+						func(target, stride, width, operandData + done * operandStride, operandStride, run);
+						for (size_t i = 0; i < run; i++) {
+							mergeMasked(target + i * stride, saved + i, mask, 1);
+						}
+						continue;
+					}
+					for (size_t i = 0; i < run; i++) {
+						memcpy(saved + i * width, target + i * stride, width);
+					}
+					func(target, stride, width, operandData + done * operandStride, operandStride, run);
+					for (size_t i = 0; i < run; i++) {
+						mergeMasked(target + i * stride, saved + i * width, mask, width);
+					}
+				}
+			} else {
+				func(targetSpan.data(), stride, width, operandData, operandStride, iterCount);
+			}
+			offset.blockOffset += iterCount * stride;
+			operandData += iterCount * operandStride;
+			count -= iterCount;
+			continue;
+		}
+		// this element straddles a block boundary, so adjust a copy of it
+		uint8_t element[255];
+		uint8_t original[255];
+		auto elementOffset = offset;
+		for (auto i = 0; i < width; i++) {
+			auto value = getBufferByte(buffer, elementOffset, true);
+			if (value == -1) {
+				debug_log("bufferAdjustStrided: target buffer overflow\n\r");
+				return;
+			}
+			element[i] = original[i] = value;
+		}
+		func(element, width, width, operandData, operandStride, 1);
+		if (masked) {
+			mergeMasked(element, original, mask, width);
+		}
+		elementOffset = offset;
+		for (auto i = 0; i < width; i++) {
+			setBufferByte(element[i], buffer, elementOffset, true);
+		}
+		offset.blockOffset += stride;
+		operandData += operandStride;
+		count--;
+	}
+}
+
+// Fill length bytes at target with a repeating pattern, starting phase bytes into the pattern
+// Patterns of 1, 2 or 4 bytes are stored a word at a time once the target is aligned,
+// and longer patterns are laid down once then copied over themselves in doubling runs
+//
+static void fillPattern(uint8_t * target, size_t length, const uint8_t * pattern, size_t patternLength, size_t phase) {
+	if (patternLength == 1) {
+		memset(target, pattern[0], length);
+		return;
+	}
+	if (sizeof(uint32_t) % patternLength == 0) {
+		while (length > 0 && (reinterpret_cast<uintptr_t>(target) & 3)) {
+			*target++ = pattern[phase];
+			phase = (phase + 1) % patternLength;
+			length--;
+		}
+		// as the pattern length divides the word size, every aligned word holds the same bytes
+		uint8_t wordBytes[sizeof(uint32_t)];
+		for (size_t i = 0; i < sizeof(uint32_t); i++) {
+			wordBytes[i] = pattern[(phase + i) % patternLength];
+		}
+		auto word = read32_unaligned(wordBytes);
+		while (length >= sizeof(uint32_t)) {
+			write32_aligned(target, word);
+			target += sizeof(uint32_t), length -= sizeof(uint32_t);
+		}
+		for (size_t i = 0; i < length; i++) {
+			target[i] = wordBytes[i];
+		}
+		return;
+	}
+	size_t filled = std::min(length, patternLength);
+	for (size_t i = 0; i < filled; i++) {
+		target[i] = pattern[(phase + i) % patternLength];
+	}
+	while (filled < length) {
+		auto copyLength = std::min(filled, length - filled);
+		memcpy(target + filled, target, copyLength);
+		filled += copyLength;
+	}
+}
+
+// VDU 23, 0, &A0, bufferId; &1C, options, [offset;] length; patternLength, <pattern>: Fill buffer
+// Fills length bytes of a buffer from offset onwards with a repeating pattern of patternLength bytes
+// such as a single byte to clear a buffer, or an RGBA colour to clear a bitmap
+// Options:
+// - FILL_CREATE: the buffer is cleared, and replaced with a new one of length bytes, so no offset is given
+// - FILL_ADVANCED_OFFSETS: offset and length are 24-bit values
+// - FILL_BUFFER_PATTERN: the pattern bytes are replaced with patternBufferId; patternOffset;
+//
+void VDUStreamProcessor::bufferFill(uint16_t fillBufferId) {
+	auto options = readByte_t(); if (options == -1) return;
+	const bool create = options & FILL_CREATE;
+	const bool useAdvancedOffsets = options & FILL_ADVANCED_OFFSETS;
+
+	AdvancedOffset offset = {};
+	if (!create) {
+		offset = getOffsetFromStream(useAdvancedOffsets); if (offset.blockOffset == -1) return;
+	}
+	int32_t length = useAdvancedOffsets ? read24_t() : readWord_t(); if (length == -1) return;
+	auto patternLength = readByte_t(); if (patternLength == -1) return;
+	if (patternLength == 0) {
+		debug_log("bufferFill: empty pattern\n\r");
+		return;
+	}
+
+	uint8_t pattern[255];
+	if (options & FILL_BUFFER_PATTERN) {
+		auto patternBufferId = resolveBufferId(readWord_t(), id);
+		auto patternOffset = getOffsetFromStream(useAdvancedOffsets);
+		if (patternBufferId == -1 || patternOffset.blockOffset == -1) {
+			debug_log("bufferFill: no pattern buffer ID\n\r");
+			return;
+		}
+		auto patternBuffer = buffers.getIndex(patternBufferId);
+		if (!patternBuffer) {
+			debug_log("bufferFill: buffer %d not found\n\r", patternBufferId);
+			return;
+		}
+		for (auto i = 0; i < patternLength; i++) {
+			auto value = getBufferByte(*patternBuffer, patternOffset, true);
+			if (value == -1) {
+				debug_log("bufferFill: pattern buffer overflow\n\r");
+				return;
+			}
+			pattern[i] = value;
+		}
+	} else if (readIntoBuffer(pattern, patternLength) != 0) {
+		debug_log("bufferFill: pattern timeout\n\r");
+		return;
+	}
+
+	auto bufferId = resolveBufferId(fillBufferId, id);
+	if (bufferId == -1) {
+		debug_log("bufferFill: no target buffer ID\n\r");
+		return;
+	}
+	if (create) {
+		if (bufferId == 65535) {
+			debug_log("bufferFill: bufferId %d is reserved\n\r", bufferId);
+			return;
+		}
+		bufferClear(bufferId);
+		auto buffer = bufferCreate(bufferId, length);
+		if (!buffer || !buffer->getBuffer()) {
+			return;
+		}
+		fillPattern(buffer->getBuffer(), length, pattern, patternLength, 0);
+		debug_log("bufferFill: created buffer %d, filled %d bytes with a %d byte pattern\n\r", bufferId, length, patternLength);
+		return;
+	}
+
+	auto bufferIndex = buffers.getIndex(bufferId);
+	if (!bufferIndex) {
+		debug_log("bufferFill: buffer %d not found\n\r", bufferId);
+		return;
+	}
+	size_t filled = 0;
+	while (filled < (size_t)length) {
+		auto targetSpan = getWritableBufferSpan(*bufferIndex, offset);
+		if (targetSpan.empty()) {
+			debug_log("bufferFill: target buffer overflow, %d of %d bytes filled\n\r", filled, length);
+			return;
+		}
+		auto iterCount = std::min<size_t>(targetSpan.size(), length - filled);
+		fillPattern(targetSpan.data(), iterCount, pattern, patternLength, filled % patternLength);
+		offset.blockOffset += iterCount;
+		filled += iterCount;
+	}
+	debug_log("bufferFill: buffer %d, filled %d bytes with a %d byte pattern\n\r", bufferId, length, patternLength);
+}
+
+// Copy pixels from source to target, skipping any that match the key
+// 1 byte pixels are checked four at a time, so runs without the key are copied a word at a time
+//
+static void copyKeyedPixels(uint8_t * target, const uint8_t * source, uint32_t pixels, uint8_t bytesPerPixel, const uint8_t * key) {
+	switch (bytesPerPixel) {
+		case 1: {
+			auto keyValue = key[0];
+			const uint32_t keyWord = keyValue * 0x01010101u;
+			uint32_t i = 0;
+			for (; i + 4 <= pixels; i += 4) {
+				auto value = read32_unaligned(source + i);
+				// a byte of difference is zero where the pixel matches the key
+				auto difference = value ^ keyWord;
+				if (((difference - 0x01010101u) & ~difference & 0x80808080u) == 0) {
+					write32_unaligned(target + i, value);
+				} else if (difference != 0) {
+					for (auto j = i; j < i + 4; j++) {
+						if (source[j] != keyValue) {
+							target[j] = source[j];
+						}
+					}
+				}
+			}
+			for (; i < pixels; i++) {
+				if (source[i] != keyValue) {
+					target[i] = source[i];
+				}
+			}
+		}	break;
+		case 2: {
+			auto keyValue = read16_unaligned(key);
+			for (uint32_t i = 0; i < pixels; i++, source += 2, target += 2) {
+				auto value = read16_unaligned(source);
+				if (value != keyValue) {
+					write16_unaligned(target, value);
+				}
+			}
+		}	break;
+		case 4: {
+			auto keyValue = read32_unaligned(key);
+			for (uint32_t i = 0; i < pixels; i++, source += 4, target += 4) {
+				auto value = read32_unaligned(source);
+				if (value != keyValue) {
+					write32_unaligned(target, value);
+				}
+			}
+		}	break;
+		default: {
+			for (uint32_t i = 0; i < pixels; i++, source += bytesPerPixel, target += bytesPerPixel) {
+				if (memcmp(source, key, bytesPerPixel) != 0) {
+					memcpy(target, source, bytesPerPixel);
+				}
+			}
+		}	break;
+	}
+}
+
+// Copy one row of a blit, which may cross blocks in either buffer
+// When key is given, pixels matching it are skipped
+// Returns false if either buffer is too short
+//
+bool VDUStreamProcessor::blitRow(const BufferIndex &source, AdvancedOffset sourceOffset, const BufferIndex &target, AdvancedOffset targetOffset, uint32_t length, uint8_t bytesPerPixel, const uint8_t * key) {
+	while (length > 0) {
+		auto targetSpan = getWritableBufferSpan(target, targetOffset);
+		auto sourceSpan = getBufferSpan(source, sourceOffset);
+		auto iterCount = std::min<size_t>(std::min(sourceSpan.size(), targetSpan.size()), length);
+		if (iterCount == 0) {
+			return false;
+		}
+		if (!key) {
+			memmove(targetSpan.data(), sourceSpan.data(), iterCount);
+		} else {
+			auto pixels = iterCount / bytesPerPixel;
+			if (pixels == 0) {
+				// this pixel straddles a block boundary, so compare a copy of it
+				uint8_t pixel[255];
+				auto pixelOffset = sourceOffset;
+				for (auto i = 0; i < bytesPerPixel; i++) {
+					auto value = getBufferByte(source, pixelOffset, true);
+					if (value == -1) {
+						return false;
+					}
+					pixel[i] = value;
+				}
+				if (memcmp(pixel, key, bytesPerPixel) != 0) {
+					pixelOffset = targetOffset;
+					for (auto i = 0; i < bytesPerPixel; i++) {
+						if (!setBufferByte(pixel[i], target, pixelOffset, true)) {
+							return false;
+						}
+					}
+				}
+				iterCount = bytesPerPixel;
+			} else {
+				copyKeyedPixels(targetSpan.data(), sourceSpan.data(), pixels, bytesPerPixel, key);
+				iterCount = pixels * bytesPerPixel;
+			}
+		}
+		sourceOffset.blockOffset += iterCount;
+		targetOffset.blockOffset += iterCount;
+		length -= iterCount;
+	}
+	return true;
+}
+
+// VDU 23, 0, &A0, bufferId; &1D, options, sourceBufferId; sourceOffset; sourcePitch; [offset; pitch;] width; height; bytesPerPixel, [key]: Blit
+// Copies a rectangle of width x height pixels, each of bytesPerPixel bytes, from a source buffer into this buffer
+// Pitches are the number of bytes from the start of one row to the start of the next
+// such as 1024 when taking a 16x16 tile from a 256x256 RGBA2222 sprite sheet
+// Options:
+// - BLIT_TRANSPARENT: source pixels matching the bytesPerPixel byte key are not copied
+// - BLIT_CREATE: this buffer is replaced with a new one just holding the rectangle, so no offset or pitch is given
+// - BLIT_ADVANCED_OFFSETS: offsets and pitches are 24-bit values
+//
+void VDUStreamProcessor::bufferBlit(uint16_t blitBufferId) {
+	auto options = readByte_t(); if (options == -1) return;
+	const bool create = options & BLIT_CREATE;
+	const bool useAdvancedOffsets = options & BLIT_ADVANCED_OFFSETS;
+
+	auto sourceBufferId = resolveBufferId(readWord_t(), id);
+	auto sourceOffset = getOffsetFromStream(useAdvancedOffsets); if (sourceOffset.blockOffset == -1) return;
+	int32_t sourcePitch = useAdvancedOffsets ? read24_t() : readWord_t(); if (sourcePitch == -1) return;
+	AdvancedOffset offset = {};
+	int32_t pitch = 0;
+	if (!create) {
+		offset = getOffsetFromStream(useAdvancedOffsets); if (offset.blockOffset == -1) return;
+		pitch = useAdvancedOffsets ? read24_t() : readWord_t(); if (pitch == -1) return;
+	}
+	auto width = readWord_t(); if (width == -1) return;
+	auto height = readWord_t(); if (height == -1) return;
+	auto bytesPerPixel = readByte_t(); if (bytesPerPixel == -1) return;
+	uint8_t key[255];
+	const bool useKey = options & BLIT_TRANSPARENT;
+	if (useKey && readIntoBuffer(key, bytesPerPixel) != 0) {
+		debug_log("bufferBlit: key timeout\n\r");
+		return;
+	}
+
+	uint32_t rowLength = width * bytesPerPixel;
+	if (create) {
+		pitch = rowLength;
+	}
+	if (bytesPerPixel == 0 || (uint32_t)sourcePitch < rowLength || (uint32_t)pitch < rowLength) {
+		debug_log("bufferBlit: invalid pixel size %d or pitch %d:%d for width %d\n\r", bytesPerPixel, sourcePitch, pitch, width);
+		return;
+	}
+	if (sourceBufferId == -1) {
+		debug_log("bufferBlit: no source buffer ID\n\r");
+		return;
+	}
+	auto source = buffers.getIndex(sourceBufferId);
+	if (!source) {
+		debug_log("bufferBlit: buffer %d not found\n\r", sourceBufferId);
+		return;
+	}
+	auto bufferId = resolveBufferId(blitBufferId, id);
+	if (bufferId == -1) {
+		debug_log("bufferBlit: no target buffer ID\n\r");
+		return;
+	}
+	if (create) {
+		if (bufferId == 65535) {
+			debug_log("bufferBlit: bufferId %d is reserved\n\r", bufferId);
+			return;
+		}
+		// our source index keeps its blocks alive, even if we are replacing the source buffer
+		bufferClear(bufferId);
+		auto buffer = bufferCreate(bufferId, rowLength * height);
+		if (!buffer || !buffer->getBuffer()) {
+			return;
+		}
+		if (useKey) {
+			memset(buffer->getBuffer(), 0, rowLength * height);
+		}
+	}
+	auto target = buffers.getIndex(bufferId);
+	if (!target) {
+		debug_log("bufferBlit: buffer %d not found\n\r", bufferId);
+		return;
+	}
+
+	// work from absolute positions, so rows can be stepped through with a simple add
+	if (!source->resolve(sourceOffset.blockOffset, sourceOffset.blockIndex) || !target->resolve(offset.blockOffset, offset.blockIndex)) {
+		debug_log("bufferBlit: offset outside of buffer\n\r");
+		return;
+	}
+	uint32_t sourceStart = source->blockStart(sourceOffset.blockIndex) + sourceOffset.blockOffset;
+	uint32_t targetStart = target->blockStart(offset.blockIndex) + offset.blockOffset;
+
+	debug_log("bufferBlit: %d x %d x %d from buffer %d at %d pitch %d, to buffer %d at %d pitch %d\n\r",
+		width, height, bytesPerPixel, sourceBufferId, sourceStart, sourcePitch, bufferId, targetStart, pitch);
+
+	// copy rows bottom-up if moving data later within the same buffer, so rows aren't overwritten before they're read
+	const bool sameBuffer = !create && sourceBufferId == bufferId;
+	const bool reverse = sameBuffer && targetStart > sourceStart;
+	std::unique_ptr<BufferIndex> staging;
+	for (auto i = 0; i < height; i++) {
+		auto row = reverse ? height - 1 - i : i;
+		AdvancedOffset rowSource;
+		AdvancedOffset rowTarget;
+		rowSource.blockOffset = sourceStart + (uint32_t)row * sourcePitch;
+		rowTarget.blockOffset = targetStart + (uint32_t)row * pitch;
+		auto rowBuffer = source.get();
+		// a row that overlaps itself is copied out first, as the copy runs forwards a block at a time
+		if (sameBuffer && std::max(rowSource.blockOffset, rowTarget.blockOffset) - std::min(rowSource.blockOffset, rowTarget.blockOffset) < rowLength) {
+			if (!staging) {
+				auto block = make_shared_pooled<BufferStream>(rowLength);
+				if (!block->getBuffer()) {
+					debug_log("bufferBlit: failed to allocate %d byte staging row\n\r", rowLength);
+					return;
+				}
+				staging.reset(new BufferIndex({ block }));
+			}
+			if (!blitRow(*source, rowSource, *staging, AdvancedOffset(), rowLength, bytesPerPixel, nullptr)) {
+				debug_log("bufferBlit: buffer overflow at row %d\n\r", row);
+				return;
+			}
+			rowBuffer = staging.get();
+			rowSource.blockOffset = 0;
+		}
+		if (!blitRow(*rowBuffer, rowSource, *target, rowTarget, rowLength, bytesPerPixel, useKey ? key : nullptr)) {
+			debug_log("bufferBlit: buffer overflow at row %d\n\r", row);
+			return;
+		}
+	}
+}
+
 // returns true or false depending on whether conditions are met
 // Will read the following arguments from the stream
 // operation, checkBufferId; offset; [operand]
@@ -1035,7 +1680,8 @@ bool VDUStreamProcessor::bufferConditional() {
 	bool hasOperand = op > COND_NOT_EXISTS;
 
 	auto offset = getOffsetFromStream(useAdvancedOffsets);
-	const std::vector<std::shared_ptr<BufferStream>> * operandBuffer = nullptr;
+	std::shared_ptr<const BufferIndex> operandBufferIndex;
+	const BufferIndex * operandBuffer = nullptr;
 	auto operandBufferId = 0;
 	AdvancedOffset operandOffset = {};
 
@@ -1046,12 +1692,12 @@ bool VDUStreamProcessor::bufferConditional() {
 			debug_log("bufferConditional: no operand buffer ID\n\r");
 			return false;
 		}
-		auto operandBufferIter = buffers.find(operandBufferId);
-		if (operandBufferIter == buffers.end()) {
+		operandBufferIndex = buffers.getIndex(operandBufferId);
+		if (!operandBufferIndex) {
 			debug_log("bufferConditional: buffer %d not found\n\r", operandBufferId);
 			return false;
 		}
-		operandBuffer = &operandBufferIter->second;
+		operandBuffer = operandBufferIndex.get();
 	}
 
 	if (command == -1 || checkBufferId == -1 || offset.blockOffset == -1 || operandOffset.blockOffset == -1) {
@@ -1059,12 +1705,12 @@ bool VDUStreamProcessor::bufferConditional() {
 		return false;
 	}
 
-	auto checkBufferIter = buffers.find(checkBufferId);
-	if (checkBufferIter == buffers.end()) {
+	auto checkBufferIndex = buffers.getIndex(checkBufferId);
+	if (!checkBufferIndex) {
 		debug_log("bufferConditional: buffer %d not found\n\r", checkBufferId);
 		return false;
 	}
-	auto &checkBuffer = checkBufferIter->second;
+	auto &checkBuffer = *checkBufferIndex;
 	auto sourceValue = getBufferByte(checkBuffer, offset);
 	int16_t operandValue = 0;
 	if (hasOperand) {
@@ -1136,18 +1782,18 @@ void VDUStreamProcessor::bufferJump(uint16_t bufferId, AdvancedOffset offset) {
 		instream->seekTo(offset.blockOffset, offset.blockIndex);
 		return;
 	}
-	auto bufferIter = buffers.find(bufferId);
-	if (bufferIter == buffers.end()) {
+	auto bufferIndex = buffers.getIndex(bufferId);
+	if (!bufferIndex) {
 		debug_log("bufferJump: buffer %d not found\n\r", bufferId);
 		return;
 	}
 	// replace our input stream with a new one
-	auto &streams = bufferIter->second;
-	auto multiBufferStream = make_shared_psram<MultiBufferStream>(streams);
+	auto multiBufferStream = make_shared_psram<MultiBufferStream>(std::move(bufferIndex));
 	if (offset.blockOffset != 0 || offset.blockIndex != 0) {
 		multiBufferStream->seekTo(offset.blockOffset, offset.blockIndex);
 	}
 	id = bufferId;
+	inputSpans = multiBufferStream.get();
 	inputStream = std::move(multiBufferStream);
 }
 
@@ -1168,19 +1814,19 @@ void VDUStreamProcessor::bufferCopy(uint16_t bufferId, tcb::span<const uint16_t>
 	std::vector<std::shared_ptr<BufferStream>, psram_allocator<std::shared_ptr<BufferStream>>> streams;
 	// loop thru buffer IDs
 	for (const auto sourceId : sourceBufferIds) {
-		auto sourceBufferIter = buffers.find(sourceId);
-		if (sourceBufferIter != buffers.end()) {
+		auto sourceBufferBlocks = buffers.get(sourceId);
+		if (sourceBufferBlocks) {
 			// buffer ID exists
 			// loop thru blocks stored against this ID
-			for (const auto &block : sourceBufferIter->second) {
+			for (const auto &block : *sourceBufferBlocks) {
 				// push a copy of the block into our vector
-				auto bufferStream = make_shared_psram<BufferStream>(block->size());
-				if (!bufferStream || !bufferStream->getBuffer()) {
+				// this is a slice of the whole block, so the data is only copied if either is modified
+				auto bufferStream = sliceBuffer(block, 0, block->size());
+				if (!bufferStream) {
 					debug_log("bufferCopy: failed to create buffer\n\r");
 					return;
 				}
 				debug_log("bufferCopy: copying stream %d bytes\n\r", block->size());
-				bufferStream->writeBuffer(block->getBuffer(), block->size());
 				streams.push_back(std::move(bufferStream));
 			}
 		} else {
@@ -1188,9 +1834,14 @@ void VDUStreamProcessor::bufferCopy(uint16_t bufferId, tcb::span<const uint16_t>
 		}
 	}
 	// replace buffer with new one
+	auto buffer = buffers.create(bufferId);
+	if (!buffer) {
+		debug_log("bufferCopy: failed to create buffer %d\n\r", bufferId);
+		return;
+	}
 	bufferRemoveUsers(bufferId);
-	buffers[bufferId].assign(std::make_move_iterator(streams.begin()), std::make_move_iterator(streams.end()));
-	debug_log("bufferCopy: copied %d streams into buffer %d (%d)\n\r", streams.size(), bufferId, buffers[bufferId].size());
+	buffer->assign(std::make_move_iterator(streams.begin()), std::make_move_iterator(streams.end()));
+	debug_log("bufferCopy: copied %d streams into buffer %d (%d)\n\r", streams.size(), bufferId, buffer->size());
 }
 
 // VDU 23, 0, &A0, bufferId; &0E : Consolidate blocks within buffer
@@ -1201,12 +1852,12 @@ void VDUStreamProcessor::bufferConsolidate(uint16_t bufferId) {
 	// Create a new stream big enough to contain all streams in the given buffer
 	// Copy all streams into the new stream
 	// Replace the given buffer with the new stream
-	auto bufferIter = buffers.find(bufferId);
-	if (bufferIter == buffers.end()) {
+	auto bufferBlocks = buffers.getMutable(bufferId);
+	if (!bufferBlocks) {
 		debug_log("bufferConsolidate: buffer %d not found\n\r", bufferId);
 		return;
 	}
-	auto &buffer = bufferIter->second;
+	auto &buffer = *bufferBlocks;
 	if (buffer.size() == 1) {
 		// only one stream, so nothing to consolidate
 		return;
@@ -1236,13 +1887,13 @@ void VDUStreamProcessor::clearTargets(tcb::span<const uint16_t> targets) {
 // Will overwrite any existing buffers
 //
 void VDUStreamProcessor::bufferSplitInto(uint16_t bufferId, uint16_t length, tcb::span<uint16_t> newBufferIds, bool iterate) {
-	auto bufferIter = buffers.find(bufferId);
-	if (bufferIter == buffers.end()) {
+	auto bufferBlocks = buffers.get(bufferId);
+	if (!bufferBlocks) {
 		debug_log("bufferSplitInto: buffer %d not found\n\r", bufferId);
 		return;
 	}
 	// get a consolidated version of the buffer
-	auto bufferStream = consolidateBuffers(bufferIter->second);
+	auto bufferStream = consolidateBuffers(*bufferBlocks);
 	if (!bufferStream) {
 		debug_log("bufferSplitInto: failed to create buffer\n\r");
 		return;
@@ -1263,7 +1914,12 @@ void VDUStreamProcessor::bufferSplitInto(uint16_t bufferId, uint16_t length, tcb
 		if (iterate) {
 			bufferClear(targetId);
 		}
-		buffers[targetId].push_back(std::move(chunk));
+		auto target = buffers.create(targetId);
+		if (!target) {
+			debug_log("bufferSplitInto: failed to create buffer %d\n\r", targetId);
+			return;
+		}
+		target->push_back(std::move(chunk));
 		iterate = updateTarget(newBufferIds, targetIter, iterate);
 	}
 	debug_log("bufferSplitInto: split buffer %d into %d blocks of length %d\n\r", bufferId, chunks.size(), length);
@@ -1276,13 +1932,13 @@ void VDUStreamProcessor::bufferSplitInto(uint16_t bufferId, uint16_t length, tcb
 // Will overwrite any existing buffers
 //
 void VDUStreamProcessor::bufferSplitByInto(uint16_t bufferId, uint16_t width, uint16_t chunkCount, tcb::span<uint16_t> newBufferIds, bool iterate) {
-	auto bufferIter = buffers.find(bufferId);
-	if (bufferIter == buffers.end()) {
+	auto bufferBlocks = buffers.get(bufferId);
+	if (!bufferBlocks) {
 		debug_log("bufferSplitByInto: buffer %d not found\n\r", bufferId);
 		return;
 	}
 	// get a consolidated version of the buffer
-	auto bufferStream = consolidateBuffers(bufferIter->second);
+	auto bufferStream = consolidateBuffers(*bufferBlocks);
 	if (!bufferStream) {
 		debug_log("bufferSplitByInto: failed to create buffer\n\r");
 		return;
@@ -1323,7 +1979,12 @@ void VDUStreamProcessor::bufferSplitByInto(uint16_t bufferId, uint16_t width, ui
 			debug_log("bufferSplitByInto: failed to create buffer\n\r");
 			return;
 		}
-		buffers[targetId].push_back(std::move(chunk));
+		auto target = buffers.create(targetId);
+		if (!target) {
+			debug_log("bufferSplitByInto: failed to create buffer %d\n\r", targetId);
+			return;
+		}
+		target->push_back(std::move(chunk));
 		iterate = updateTarget(newBufferIds, targetIter, iterate);
 	}
 
@@ -1334,15 +1995,14 @@ void VDUStreamProcessor::bufferSplitByInto(uint16_t bufferId, uint16_t width, ui
 // VDU 23, 0, &A0, bufferId; &16, targetBufferId; : Spread blocks from target buffer onwards
 //
 void VDUStreamProcessor::bufferSpreadInto(uint16_t bufferId, tcb::span<uint16_t> newBufferIds, bool iterate) {
-	auto bufferIter = buffers.find(bufferId);
-	if (bufferIter == buffers.end()) {
+	auto bufferBlocks = buffers.getMutable(bufferId);
+	if (!bufferBlocks) {
 		debug_log("bufferSpreadInto: buffer %d not found\n\r", bufferId);
 		return;
 	}
-	auto &buffer = bufferIter->second;
 	// swap the source buffer contents into a local vector so it can be iterated safely even if it's a target
 	std::vector<std::shared_ptr<BufferStream>> localBuffer;
-	localBuffer.swap(buffer);
+	localBuffer.swap(*bufferBlocks);
 	if (!iterate) {
 		clearTargets(newBufferIds);
 	}
@@ -1353,12 +2013,19 @@ void VDUStreamProcessor::bufferSpreadInto(uint16_t bufferId, tcb::span<uint16_t>
 		if (iterate) {
 			bufferClear(targetId);
 		}
-		buffers[targetId].push_back(block);
+		auto target = buffers.create(targetId);
+		if (!target) {
+			debug_log("bufferSpreadInto: failed to create buffer %d\n\r", targetId);
+			break;
+		}
+		target->push_back(block);
 		iterate = updateTarget(newBufferIds, targetIter, iterate);
 	}
 	// if the source buffer is still empty, move the original contents back
-	if (buffer.empty()) {
-		buffer = std::move(localBuffer);
+	// it is looked up again, as clearing targets may have removed it from the table
+	auto buffer = buffers.create(bufferId);
+	if (buffer && buffer->empty()) {
+		*buffer = std::move(localBuffer);
 	}
 }
 
@@ -1367,10 +2034,10 @@ void VDUStreamProcessor::bufferSpreadInto(uint16_t bufferId, tcb::span<uint16_t>
 // may be useful for mirroring bitmaps if they have been split by row
 //
 void VDUStreamProcessor::bufferReverseBlocks(uint16_t bufferId) {
-	auto bufferIter = buffers.find(bufferId);
-	if (bufferIter != buffers.end()) {
+	auto bufferBlocks = buffers.getMutable(bufferId);
+	if (bufferBlocks) {
 		// reverse the order of the streams
-		auto &buffer = bufferIter->second;
+		auto &buffer = *bufferBlocks;
 		std::reverse(buffer.begin(), buffer.end());
 		debug_log("bufferReverseBlocks: reversed blocks in buffer %d\n\r", bufferId);
 	}
@@ -1381,12 +2048,12 @@ void VDUStreamProcessor::bufferReverseBlocks(uint16_t bufferId) {
 // may be useful for mirroring bitmaps
 //
 void VDUStreamProcessor::bufferReverse(uint16_t bufferId, uint8_t options) {
-	auto bufferIter = buffers.find(bufferId);
-	if (bufferIter == buffers.end()) {
+	auto bufferBlocks = buffers.getMutable(bufferId);
+	if (!bufferBlocks) {
 		debug_log("bufferReverse: buffer %d not found\n\r", bufferId);
 		return;
 	}
-	auto &buffer = bufferIter->second;
+	auto &buffer = *bufferBlocks;
 	bool use16Bit = options & REVERSE_16BIT;
 	bool use32Bit = options & REVERSE_32BIT;
 	bool useSize  = (options & REVERSE_SIZE) == REVERSE_SIZE;
@@ -1438,10 +2105,17 @@ void VDUStreamProcessor::bufferReverse(uint16_t bufferId, uint8_t options) {
 	for (const auto &block : buffer) {
 		if (chunkSize == 0) {
 			// no chunking, so simpler reverse
-			reverseValues(block->getBuffer(), block->size(), valueSize);
+			auto data = block->getWritableBuffer();
+			if (!data) {
+				return;
+			}
+			reverseValues(data, block->size(), valueSize);
 		} else {
 			// reverse in chunks
-			auto data = block->getBuffer();
+			auto data = block->getWritableBuffer();
+			if (!data) {
+				return;
+			}
 			auto chunkCount = block->size() / chunkSize;
 			for (auto i = 0; i < chunkCount; i++) {
 				reverseValues(data + (i * chunkSize), chunkSize, valueSize);
@@ -1471,7 +2145,12 @@ void VDUStreamProcessor::bufferCopyRef(uint16_t bufferId, tcb::span<const uint16
 		return;
 	}
 	bufferClear(bufferId);
-	auto &buffer = buffers[bufferId];
+	auto bufferBlocks = buffers.create(bufferId);
+	if (!bufferBlocks) {
+		debug_log("bufferCopyRef: failed to create buffer %d\n\r", bufferId);
+		return;
+	}
+	auto &buffer = *bufferBlocks;
 
 	// loop thru buffer IDs
 	for (const auto sourceId : sourceBufferIds) {
@@ -1479,17 +2158,17 @@ void VDUStreamProcessor::bufferCopyRef(uint16_t bufferId, tcb::span<const uint16
 			debug_log("bufferCopyRef: skipping buffer %d as it's the target\n\r", sourceId);
 			continue;
 		}
-		auto sourceBufferIter = buffers.find(sourceId);
-		if (sourceBufferIter != buffers.end()) {
+		auto sourceBufferBlocks = buffers.get(sourceId);
+		if (sourceBufferBlocks) {
 			// buffer ID exists
-			auto &sourceBuffer = sourceBufferIter->second;
+			auto &sourceBuffer = *sourceBufferBlocks;
 			// push pointers to the blocks into our target buffer
 			buffer.insert(buffer.end(), sourceBuffer.begin(), sourceBuffer.end());
 		} else {
 			debug_log("bufferCopyRef: buffer %d not found\n\r", sourceId);
 		}
 	}
-	debug_log("bufferCopyRef: copied %d block references into buffer %d\n\r", buffers[bufferId].size(), bufferId);
+	debug_log("bufferCopyRef: copied %d block references into buffer %d\n\r", buffer.size(), bufferId);
 }
 
 // VDU 23, 0, &A0, bufferId; &1A, sourceBufferId; sourceBufferId; ...; 65535; : Copy blocks from buffers and consolidate
@@ -1511,9 +2190,9 @@ void VDUStreamProcessor::bufferCopyAndConsolidate(uint16_t bufferId, tcb::span<c
 		if (sourceId == bufferId) {
 			continue;
 		}
-		auto sourceBufferIter = buffers.find(sourceId);
-		if (sourceBufferIter != buffers.end()) {
-			auto &sourceBuffer = sourceBufferIter->second;
+		auto sourceBufferBlocks = buffers.get(sourceId);
+		if (sourceBufferBlocks) {
+			auto &sourceBuffer = *sourceBufferBlocks;
 			for (const auto &block : sourceBuffer) {
 				length += block->size();
 			}
@@ -1521,11 +2200,16 @@ void VDUStreamProcessor::bufferCopyAndConsolidate(uint16_t bufferId, tcb::span<c
 	}
 
 	// Ensure the buffer has 1 block of the correct size
-	auto &buffer = buffers[bufferId];
+	auto bufferBlocks = buffers.create(bufferId);
+	if (!bufferBlocks) {
+		debug_log("bufferCopyAndConsolidate: failed to create buffer %d\n\r", bufferId);
+		return;
+	}
+	auto &buffer = *bufferBlocks;
 	if (buffer.size() != 1 || buffer.front()->size() != length) {
 		bufferRemoveUsers(bufferId);
 		buffer.clear();
-		auto bufferStream = make_shared_psram<BufferStream>(length);
+		auto bufferStream = make_shared_pooled<BufferStream>(length);
 		if (!bufferStream || !bufferStream->getBuffer()) {
 			// buffer couldn't be created
 			debug_log("bufferCopyAndConsolidate: failed to create buffer %d\n\r", bufferId);
@@ -1534,7 +2218,11 @@ void VDUStreamProcessor::bufferCopyAndConsolidate(uint16_t bufferId, tcb::span<c
 		buffer.push_back(std::move(bufferStream));
 	}
 
-	auto destination = buffer.front()->getBuffer();
+	auto destination = buffer.front()->getWritableBuffer();
+	if (!destination) {
+		debug_log("bufferCopyAndConsolidate: failed to create buffer %d\n\r", bufferId);
+		return;
+	}
 
 	// loop thru buffer IDs
 	for (const auto sourceId : sourceBufferIds) {
@@ -1542,10 +2230,10 @@ void VDUStreamProcessor::bufferCopyAndConsolidate(uint16_t bufferId, tcb::span<c
 			debug_log("bufferCopyAndConsolidate: skipping buffer %d as it's the target\n\r", sourceId);
 			continue;
 		}
-		auto sourceBufferIter = buffers.find(sourceId);
-		if (sourceBufferIter != buffers.end()) {
+		auto sourceBufferBlocks = buffers.get(sourceId);
+		if (sourceBufferBlocks) {
 			// buffer ID exists
-			auto &sourceBuffer = sourceBufferIter->second;
+			auto &sourceBuffer = *sourceBufferBlocks;
 			// loop thru blocks stored against this ID
 			for (const auto &block : sourceBuffer) {
 				// copy the block into our target buffer
@@ -1580,13 +2268,12 @@ void VDUStreamProcessor::bufferAffineTransform(uint16_t bufferId) {
 	// get a MultiBufferStream object for a buffer
 	// NB this will rewind all the streams in the buffer
 	auto getMultiBufferStream = [this](uint16_t bufferId) -> std::unique_ptr<MultiBufferStream> {
-		auto bufferIter = buffers.find(bufferId);
-		if (bufferIter == buffers.end()) {
+		auto bufferIndex = buffers.getIndex(bufferId);
+		if (!bufferIndex) {
 			debug_log("bufferAffineTransform: buffer %d not found\n\r", bufferId);
 			return nullptr;
 		}
-		auto buffer = bufferIter->second;
-		return std::unique_ptr<MultiBufferStream>(new MultiBufferStream(buffer));
+		return std::unique_ptr<MultiBufferStream>(new MultiBufferStream(std::move(bufferIndex)));
 	};
 
 	auto getFormatInfo = [this, useAdvancedOffsets, useBufferValue](bool &isFixed, bool &is16Bit, int8_t &shift, int16_t &sourceBufferId, AdvancedOffset &offset) -> bool {
@@ -1852,7 +2539,7 @@ void VDUStreamProcessor::bufferAffineTransform(uint16_t bufferId) {
 			return;
 	}
 
-	auto bufferStream = make_shared_psram<BufferStream>(matrixSize);
+	auto bufferStream = make_shared_pooled<BufferStream>(matrixSize);
 	if (!bufferStream || !bufferStream->getBuffer()) {
 		// buffer couldn't be created
 		debug_log("bufferAffineTransform: failed to create buffer %d\n\r", bufferId);
@@ -1873,7 +2560,12 @@ void VDUStreamProcessor::bufferAffineTransform(uint16_t bufferId) {
 
 	bufferStream->writeBuffer((uint8_t *)transform, matrixSize);
 	bufferClear(bufferId);
-	buffers[bufferId].push_back(std::move(bufferStream));
+	auto buffer = buffers.create(bufferId);
+	if (!buffer) {
+		debug_log("bufferAffineTransform: failed to create buffer %d\n\r", bufferId);
+		return;
+	}
+	buffer->push_back(std::move(bufferStream));
 	debug_log("bufferAffineTransform: created new matrix buffer %d\n\r", bufferId);
 
 	debug_log(" %f %f %f\n\r", transform[0], transform[1], transform[2]);
@@ -1882,100 +2574,189 @@ void VDUStreamProcessor::bufferAffineTransform(uint16_t bufferId) {
 }
 
 
+// Output sink for compression, collecting the compressed data in blocks of COMPRESSION_OUTPUT_CHUNK_SIZE bytes
+// which then become the blocks of the compressed buffer, so the output is never re-copied as it grows
+//
+struct CompressionSink {
+	std::vector<std::shared_ptr<BufferStream>> blocks;
+	uint8_t * data = nullptr;
+	uint32_t used = 0;
+	bool failed = false;
+
+	bool addBlock() {
+		auto block = make_shared_pooled<BufferStream>(COMPRESSION_OUTPUT_CHUNK_SIZE);
+		if (!block || !block->getBuffer()) {
+			debug_log("bufferCompress: cannot allocate output block of %d bytes\n\r", COMPRESSION_OUTPUT_CHUNK_SIZE);
+			failed = true;
+			data = nullptr;
+			return false;
+		}
+		data = block->getBuffer();
+		used = 0;
+		blocks.push_back(std::move(block));
+		return true;
+	}
+
+	void write(const uint8_t * source, uint32_t length) {
+		while (length > 0 && data) {
+			auto count = std::min<uint32_t>(length, COMPRESSION_OUTPUT_CHUNK_SIZE - used);
+			memcpy(data + used, source, count);
+			used += count;
+			source += count;
+			length -= count;
+			if (used == COMPRESSION_OUTPUT_CHUNK_SIZE) {
+				addBlock();
+			}
+		}
+	}
+
+	// Trim the last block down to the data written to it
+	bool finish() {
+		if (failed) {
+			return false;
+		}
+		if (used == 0) {
+			// the last block filled up exactly, leaving an unused one
+			blocks.pop_back();
+			return true;
+		}
+		auto block = make_shared_pooled<BufferStream>(used);
+		if (!block || !block->getBuffer()) {
+			failed = true;
+			return false;
+		}
+		memcpy(block->getBuffer(), data, used);
+		blocks.back() = std::move(block);
+		return true;
+	}
+};
+
+static void sink_write_compressed_byte(void* p_cd, uint8_t comp_byte) {
+	CompressionData* cd = (CompressionData*) p_cd;
+	CompressionSink* sink = (CompressionSink*) cd->context;
+	if (!sink->data) {
+		return;
+	}
+	sink->data[sink->used++] = comp_byte;
+	cd->output_count++;
+	if (sink->used == COMPRESSION_OUTPUT_CHUNK_SIZE) {
+		sink->addBlock();
+	}
+}
+
+static void sink_write_compressed_block(void* p_sink, const uint8_t* comp_data, uint32_t comp_size) {
+	((CompressionSink*) p_sink)->write(comp_data, comp_size);
+}
+
 // VDU 23, 0, &A0, bufferId; &40, sourceBufferId; : Compress blocks from a buffer
+// VDU 23, 0, &A0, bufferId; &42, sourceBufferId; type : Compress blocks from a buffer using a given type
 // Compress (blocks from) a buffer into a new buffer.
 // Replaces the target buffer with the new one.
+// The new buffer will usually be made up of several blocks
 //
-void VDUStreamProcessor::bufferCompress(uint16_t bufferId, uint16_t sourceBufferId) {
-	debug_log("Compressing into buffer %u\n\r", bufferId);
+void VDUStreamProcessor::bufferCompress(uint16_t bufferId, uint16_t sourceBufferId, uint8_t type) {
+	debug_log("Compressing into buffer %u, type %c\n\r", bufferId, type);
 
-	auto sourceBufferIter = buffers.find(sourceBufferId);
-	if (sourceBufferIter == buffers.end()) {
+	auto sourceBufferBlocks = buffers.get(sourceBufferId);
+	if (!sourceBufferBlocks) {
 		debug_log("bufferCompress: buffer %d not found\n\r", sourceBufferId);
 		return;
 	}
+	if (type != COMPRESSION_TYPE_TURBO && type != COMPRESSION_TYPE_LZ) {
+		debug_log("bufferCompress: unknown compression type %d\n\r", type);
+		return;
+	}
 
-	// create a temporary output buffer, which may be expanded during compression
-	uint8_t* p_temp = (uint8_t*) ps_malloc(COMPRESSION_OUTPUT_CHUNK_SIZE);
-	if (p_temp) {
-		// prepare for doing compression
-		CompressionData cd;
-		agon_init_compression(&cd, &p_temp, &local_write_compressed_byte);
-
-		// Output the compression header
-		CompressionFileHeader hdr;
-		hdr.marker[0] = 'C';
-		hdr.marker[1] = 'm';
-		hdr.marker[2] = 'p';
-		hdr.type = COMPRESSION_TYPE_TURBO;
-		hdr.orig_size = 0;
+	CompressionSink sink;
+	if (!sink.addBlock()) {
+		return;
+	}
 
-		auto p_hdr_bytes = hdr.marker;
-		for (int i = 0; i < sizeof(hdr); i++) {
-			local_write_compressed_byte(&cd, *p_hdr_bytes++);
+	// Output the compression header, with the size filled in once known
+	CompressionFileHeader hdr;
+	hdr.marker[0] = 'C';
+	hdr.marker[1] = 'm';
+	hdr.marker[2] = 'p';
+	hdr.type = type;
+	hdr.orig_size = 0;
+	sink.write((const uint8_t *) &hdr, sizeof(hdr));
+
+	uint32_t input_count = 0;
+	uint32_t output_count = sizeof(hdr);
+	auto &sourceBuffer = *sourceBufferBlocks;
+	if (type == COMPRESSION_TYPE_LZ) {
+		// matches can reach back across blocks, so this works on a single block
+		auto source = consolidateBuffers(sourceBuffer);
+		auto hashTable = make_unique_psram_array<uint32_t>(1 << LZ_HASH_BITS);
+		if (!source || !hashTable) {
+			debug_log("bufferCompress: cannot allocate compression data\n\r");
+			return;
 		}
-
+		memset(hashTable.get(), 0, sizeof(uint32_t) << LZ_HASH_BITS);
+		LzCompressionData lc = { &sink, &sink_write_compressed_block, hashTable.get(), 0, 0 };
+		agon_lz_compress(&lc, source->getBuffer(), source->size());
+		input_count = lc.input_count;
+		output_count += lc.output_count;
+	} else {
+		auto cd = make_unique_psram<CompressionData>();
+		if (!cd) {
+			debug_log("bufferCompress: cannot allocate compression data\n\r");
+			return;
+		}
+		agon_init_compression(cd.get(), &sink, &sink_write_compressed_byte);
 		// loop thru blocks stored against the source buffer ID
-		uint32_t orig_size = 0;
-		auto &sourceBuffer = sourceBufferIter->second;
 		for (const auto &block : sourceBuffer) {
-			// compress the block into our temporary buffer
 			auto bufferLength = block->size();
 			auto p_data = block->getBuffer();
-			orig_size += bufferLength;
 			debug_log(" from buffer %u [%08X] %u bytes\n\r", sourceBufferId, p_data, bufferLength);
-			debug_log(" %02hX %02hX %02hX %02hX\n\r",
-						p_data[0], p_data[1], p_data[2], p_data[3]);
-			cd.input_count += bufferLength;
+			cd->input_count += bufferLength;
 			while (bufferLength--) {
-				agon_compress_byte(&cd, *p_data++);
+				agon_compress_byte(cd.get(), *p_data++);
 			}
 		}
-		agon_finish_compression(&cd);
-
-		// make a single buffer with all of the temporary output data
-		auto bufferStream = make_shared_psram<BufferStream>(cd.output_count);
-		if (!bufferStream || !bufferStream->getBuffer()) {
-			// buffer couldn't be created
-			debug_log("bufferCompress: failed to create buffer %d\n\r", bufferId);
-			return;
-		}
-
-		auto p_hdr = (CompressionFileHeader*) p_temp;
-		p_hdr->orig_size = orig_size;
+		agon_finish_compression(cd.get());
+		input_count = cd->input_count;
+		output_count += cd->output_count;
+	}
 
-		auto destination = bufferStream->getBuffer();
-		debug_log(" %02hX %02hX %02hX %02hX %02hX %02hX %02hX %02hX %02hX %02hX %02hX %02hX\n\r",
-					p_temp[0], p_temp[1], p_temp[2], p_temp[3],
-					p_temp[4], p_temp[5], p_temp[6], p_temp[7],
-					p_temp[8], p_temp[9], p_temp[10], p_temp[11]);
-		memcpy(destination, p_temp, cd.output_count);
-		heap_caps_free(p_temp);
-		bufferClear(bufferId);
-		buffers[bufferId].push_back(bufferStream);
+	if (!sink.finish()) {
+		debug_log("bufferCompress: failed to create buffer %d\n\r", bufferId);
+		return;
+	}
+	auto p_hdr = (CompressionFileHeader*) sink.blocks.front()->getBuffer();
+	p_hdr->orig_size = input_count;
 
-		uint32_t pct = (cd.output_count * 100) / cd.input_count;
-		debug_log("Compressed %u input bytes to %u output bytes (%u%%) at %08X\n\r",
-				cd.input_count, cd.output_count, pct, destination);
-	} else {
-		debug_log("bufferCompress: cannot allocate temporary buffer of %d bytes\n\r", COMPRESSION_OUTPUT_CHUNK_SIZE);
+	bufferClear(bufferId);
+	auto bufferBlocks = buffers.create(bufferId);
+	if (!bufferBlocks) {
+		debug_log("bufferCompress: failed to create buffer %d\n\r", bufferId);
+		return;
+	}
+	auto &buffer = *bufferBlocks;
+	for (auto &block : sink.blocks) {
+		buffer.push_back(std::move(block));
 	}
+
+	uint32_t pct = input_count ? (output_count * 100) / input_count : 0;
+	debug_log("Compressed %u input bytes to %u output bytes (%u%%) in %u blocks\n\r",
+			input_count, output_count, pct, buffer.size());
 }
 
 // VDU 23, 0, &A0, bufferId; &41, sourceBufferId; : Decompress blocks from a buffer
 // Decompress (blocks from) a buffer into a new buffer.
 // Replaces the target buffer with the new one.
+// The compression type is taken from the header, so this handles any supported type
 //
 void VDUStreamProcessor::bufferDecompress(uint16_t bufferId, uint16_t sourceBufferId) {
 	#ifdef DEBUG
 	auto start = millis();
 	#endif
-	auto sourceBufferIter = buffers.find(sourceBufferId);
-	if (sourceBufferIter == buffers.end()) {
+	auto sourceBufferBlocks = buffers.get(sourceBufferId);
+	if (!sourceBufferBlocks) {
 		debug_log("bufferDeompress: buffer %d not found\n\r", sourceBufferId);
 		return;
 	}
-	auto &sourceBuffer = sourceBufferIter->second;
+	auto &sourceBuffer = *sourceBufferBlocks;
 
 	// Validate the compression header
 	if (sourceBuffer.size() >= 1 && sourceBuffer[0]->size() < sizeof(CompressionFileHeader)) {
@@ -1984,33 +2765,33 @@ void VDUStreamProcessor::bufferDecompress(uint16_t bufferId, uint16_t sourceBuff
 	}
 	
 	auto p_hdr = (const CompressionFileHeader*) sourceBuffer[0]->getBuffer();
-	if (p_hdr->marker[0] != 'C' ||
-		p_hdr->marker[1] != 'm' ||
-		p_hdr->marker[2] != 'p' ||
-		p_hdr->type != COMPRESSION_TYPE_TURBO) {
+	auto ad = make_unique_psram<AnyDecompressionData>();
+	if (!ad) {
+		debug_log("bufferDecompress: cannot allocate decompression data\n\r");
+		return;
+	}
+	if (!agon_init_any_decompression(ad.get(), p_hdr)) {
 		debug_log("bufferDecompress: header is invalid\n\r");
 		return;
 	}
 	auto orig_size = p_hdr->orig_size;
 
-	debug_log("Decompressing into buffer %u\n\r", bufferId);
+	debug_log("Decompressing into buffer %u, type %c\n\r", bufferId, p_hdr->type);
 
 	// create output buffer
-	auto bufferStream = make_shared_psram<BufferStream>(orig_size);
+	auto bufferStream = make_shared_pooled<BufferStream>(orig_size);
 	if (!bufferStream || !bufferStream->getBuffer()) {
 		// buffer couldn't be created
 		debug_log("bufferDecompress: failed to create buffer %d\n\r", bufferId);
 		return;
 	}
 
-	// prepare for doing compression
+	// prepare for doing decompression, straight into the output buffer
 	auto buffer = bufferStream->getBuffer();
-	DecompressionData dd;
-	agon_init_decompression(&dd, &buffer, &local_write_decompressed_byte, orig_size);
 
 	// loop thru blocks stored against the source buffer ID
 	uint32_t skip_hdr = sizeof(CompressionFileHeader);
-	dd.input_count = skip_hdr;
+	uint32_t input_count = skip_hdr;
 	for (const auto &block : sourceBuffer) {
 		// decompress the block into our temporary buffer
 		auto bufferLength = block->size() - skip_hdr;
@@ -2022,42 +2803,214 @@ void VDUStreamProcessor::bufferDecompress(uint16_t bufferId, uint16_t sourceBuff
 					p_data[8], p_data[9], p_data[10], p_data[11]);
 		p_data += skip_hdr;
 		skip_hdr = 0;
-		dd.input_count += bufferLength;
-		while (bufferLength--) {
-			agon_decompress_byte(&dd, *p_data++);
+		input_count += bufferLength;
+		if (!agon_decompress_any_block(ad.get(), p_data, bufferLength, buffer)) {
+			break;
 		}
 	}
+	auto output_count = agon_decompressed_count(ad.get());
 
 	debug_log(" %02hX %02hX %02hX %02hX\n\r",
 				buffer[0], buffer[1], buffer[2], buffer[3]);
 	bufferClear(bufferId);
-	buffers[bufferId].push_back(bufferStream);
+	auto bufferBlocks = buffers.create(bufferId);
+	if (!bufferBlocks) {
+		debug_log("bufferDecompress: failed to create buffer %d\n\r", bufferId);
+		return;
+	}
+	bufferBlocks->push_back(bufferStream);
 
-	uint32_t pct = (dd.output_count * 100) / dd.input_count;
+	uint32_t pct = (output_count * 100) / input_count;
 	debug_log("Decompressed %u input bytes to %u output bytes (%u%%) at %08X\n\r",
-				dd.input_count, dd.output_count, pct, buffer);
+				input_count, output_count, pct, buffer);
 
-	if (dd.output_count != orig_size) {
+	if (output_count != orig_size) {
 		debug_log("Decompressed buffer size %u does not equal original size %u\r\n",
-					dd.output_count, orig_size);
+					output_count, orig_size);
 	}
 	#ifdef DEBUG
 	debug_log("Decompress took %u ms\n\r", millis() - start);
 	#endif
 }
 
+// VDU 23, 0, &A0, bufferId; &43, target, [<target arguments>], length; lengthHighByte, <compressed data>: Decompress from stream
+// Decompresses data sent with the command, including its compression header, straight into a new buffer
+// which then becomes a bitmap or sample in place, so the compressed data is never stored
+// and peak memory is only the decompressed size plus the decoder's state
+// Target is one of:
+// - DECOMPRESS_STREAM_BUFFER: just store the data in the buffer
+// - DECOMPRESS_STREAM_BITMAP: format, width; height; make a bitmap from it, as VDU 23, 27, &21
+// - DECOMPRESS_STREAM_SAMPLE: format, [sampleRate;] make a sample from it, as VDU 23, 0, &85, 5
+// Replaces the target buffer with the new one.
+//
+void VDUStreamProcessor::bufferDecompressStream(uint16_t bufferId) {
+	auto target = readByte_t(); if (target == -1) return;
+	int16_t format = 0;
+	int32_t width = 0;
+	int32_t height = 0;
+	int32_t sampleRate = AUDIO_DEFAULT_SAMPLE_RATE;
+	switch (target) {
+		case DECOMPRESS_STREAM_BUFFER:
+			break;
+		case DECOMPRESS_STREAM_BITMAP: {
+			format = readByte_t(); if (format == -1) return;
+			width = readWord_t(); if (width == -1) return;
+			height = readWord_t(); if (height == -1) return;
+		}	break;
+		case DECOMPRESS_STREAM_SAMPLE: {
+			format = readByte_t(); if (format == -1) return;
+			if (format & AUDIO_FORMAT_WITH_RATE) {
+				sampleRate = readWord_t(); if (sampleRate == -1) return;
+			}
+		}	break;
+		default:
+			// without knowing its arguments, the rest of the command can't be skipped
+			debug_log("bufferDecompressStream: unknown target %d\n\r", target);
+			return;
+	}
+	int32_t length = read24_t(); if (length == -1) return;
+
+	CompressionFileHeader hdr;
+	if ((uint32_t)length < sizeof(hdr)) {
+		debug_log("bufferDecompressStream: data too small for header\n\r");
+		discardBytes(length);
+		return;
+	}
+	if (readIntoBuffer((uint8_t *) &hdr, sizeof(hdr)) != 0) {
+		debug_log("bufferDecompressStream: timed out reading header\n\r");
+		return;
+	}
+	uint32_t remaining = length - sizeof(hdr);
+
+	auto ad = make_unique_psram<AnyDecompressionData>();
+	if (!ad || !agon_init_any_decompression(ad.get(), &hdr) || bufferId == 65535) {
+		debug_log("bufferDecompressStream: header is invalid, or cannot decompress into buffer %d\n\r", bufferId);
+		discardBytes(remaining);
+		return;
+	}
+	bufferClear(bufferId);
+	auto bufferStream = make_shared_pooled<BufferStream>(hdr.orig_size);
+	if (!bufferStream || !bufferStream->getBuffer()) {
+		debug_log("bufferDecompressStream: failed to create buffer %d\n\r", bufferId);
+		discardBytes(remaining);
+		return;
+	}
+	auto output = bufferStream->getBuffer();
+
+	// decode data as it arrives, straight from the input when it's already been received
+	uint8_t chunk[256];
+	bool more = true;
+	while (remaining > 0) {
+		if (inputSpans) {
+			auto span = inputSpans->readableSpan();
+			auto count = std::min<uint32_t>(span.size(), remaining);
+			if (count > 0) {
+				if (more) {
+					more = agon_decompress_any_block(ad.get(), span.data(), count, output);
+				}
+				inputSpans->commit(count);
+				inputBytesRead += count;
+				remaining -= count;
+				continue;
+			}
+		}
+		auto count = std::min<uint32_t>(sizeof(chunk), remaining);
+		if (readIntoBuffer(chunk, count) != 0) {
+			debug_log("bufferDecompressStream: timed out with %d bytes remaining\n\r", remaining);
+			return;
+		}
+		if (more) {
+			more = agon_decompress_any_block(ad.get(), chunk, count, output);
+		}
+		remaining -= count;
+	}
+
+	auto outputCount = agon_decompressed_count(ad.get());
+	if (outputCount != hdr.orig_size) {
+		debug_log("bufferDecompressStream: decompressed size %u does not equal original size %u\n\r", outputCount, hdr.orig_size);
+		return;
+	}
+	auto bufferBlocks = buffers.create(bufferId);
+	if (!bufferBlocks) {
+		debug_log("bufferDecompressStream: failed to create buffer %d\n\r", bufferId);
+		return;
+	}
+	bufferBlocks->push_back(std::move(bufferStream));
+	debug_log("bufferDecompressStream: decompressed %u bytes into buffer %d\n\r", outputCount, bufferId);
+
+	switch (target) {
+		case DECOMPRESS_STREAM_BITMAP:
+			createBitmapFromBuffer(bufferId, format, width, height);
+			break;
+		case DECOMPRESS_STREAM_SAMPLE:
+			createSampleFromBuffer(bufferId, format, sampleRate);
+			break;
+	}
+}
+
+// Expand source bytes through a table of size output bytes per possible source byte value
+// Whole table entries are stored at once, using aligned stores when the destination allows
+//
+template<uint8_t Size, bool Aligned>
+static void expandBitmapEntries(uint8_t * destination, const uint8_t * source, uint32_t count, const uint8_t * table) {
+	for (uint32_t i = 0; i < count; i++, destination += Size) {
+		auto entry = table + source[i] * Size;
+		if (Size == 8) {
+			if (Aligned) {
+				write32_aligned(destination, read32_aligned(entry));
+				write32_aligned(destination + 4, read32_aligned(entry + 4));
+			} else {
+				write32_unaligned(destination, read32_aligned(entry));
+				write32_unaligned(destination + 4, read32_aligned(entry + 4));
+			}
+		} else if (Size == 4) {
+			if (Aligned) {
+				write32_aligned(destination, read32_aligned(entry));
+			} else {
+				write32_unaligned(destination, read32_aligned(entry));
+			}
+		} else if (Size == 2) {
+			if (Aligned) {
+				write16_aligned(destination, read16_aligned(entry));
+			} else {
+				write16_unaligned(destination, read16_aligned(entry));
+			}
+		} else {
+			*destination = *entry;
+		}
+	}
+}
+
+static void expandBitmapBytes(uint8_t * destination, const uint8_t * source, uint32_t count, const uint8_t * table, uint8_t size) {
+	bool aligned = (reinterpret_cast<uintptr_t>(destination) & (std::min<uint8_t>(size, sizeof(uint32_t)) - 1)) == 0;
+	switch (size) {
+		case 8:
+			aligned ? expandBitmapEntries<8, true>(destination, source, count, table) : expandBitmapEntries<8, false>(destination, source, count, table);
+			break;
+		case 4:
+			aligned ? expandBitmapEntries<4, true>(destination, source, count, table) : expandBitmapEntries<4, false>(destination, source, count, table);
+			break;
+		case 2:
+			aligned ? expandBitmapEntries<2, true>(destination, source, count, table) : expandBitmapEntries<2, false>(destination, source, count, table);
+			break;
+		default:
+			expandBitmapEntries<1, true>(destination, source, count, table);
+			break;
+	}
+}
+
 // VDU 23, 0, &A0, bufferId; &48, options, sourceBufferId; [width;] [mapBufferId;] [mapValues...] : Expand a bitmap buffer
 // Expands a bitmap buffer into a new buffer with 8-bit values
 // options dictates how the expansion is done
 // width will be provided to give a pixel width at which a byte-align is done
 //
 void VDUStreamProcessor::bufferExpandBitmap(uint16_t bufferId, uint8_t options, uint16_t sourceBufferId) {
-	auto sourceBufferIter = buffers.find(sourceBufferId);
-	if (sourceBufferIter == buffers.end()) {
+	auto sourceBufferBlocks = buffers.get(sourceBufferId);
+	if (!sourceBufferBlocks) {
 		debug_log("bufferExpandBitmap: source buffer %d not found\n\r", sourceBufferId);
 		return;
 	}
-	auto &sourceBuffer = sourceBufferIter->second;
+	auto &sourceBuffer = *sourceBufferBlocks;
 
 	// pixelSize is our number of bits in a pixel
 	auto pixelSize = options & EXPAND_BITMAP_SIZE;
@@ -2088,12 +3041,12 @@ void VDUStreamProcessor::bufferExpandBitmap(uint16_t bufferId, uint8_t options,
 			debug_log("bufferExpandBitmap: failed to read map buffer ID\n\r");
 			return;
 		}
-		auto bufferIter = buffers.find(mapId);
-		if (bufferIter == buffers.end()) {
+		auto bufferBlocks = buffers.get(mapId);
+		if (!bufferBlocks) {
 			debug_log("bufferExpandBitmap: map buffer %d not found\n\r", mapId);
 			return;
 		}
-		auto &buffer = bufferIter->second;
+		auto &buffer = *bufferBlocks;
 		if (buffer.size() != 1) {
 			debug_log("bufferExpandBitmap: map buffer %d does not contain a single block\n\r", mapId);
 			return;
@@ -2122,33 +3075,43 @@ void VDUStreamProcessor::bufferExpandBitmap(uint16_t bufferId, uint8_t options,
 		debug_log("\n\r");
 	}
 
-	// work out source size
-	uint32_t sourceSize = 0;
-	for (const auto &block : sourceBuffer) {
-		sourceSize += block->size();
+	// rows may cross blocks, so work from a single block
+	auto source = consolidateBuffers(sourceBuffer);
+	if (!source) {
+		debug_log("bufferExpandBitmap: failed to consolidate source buffer %d\n\r", sourceBufferId);
+		if (!useBuffer) {
+			free(mapValues);
+		}
+		return;
 	}
-
-	// if we are aligning we need to work out our byte width, based off the pixel width
-	uint32_t byteWidth = 0;	
-	if (aligned) {
-		byteWidth = ((pixelSize * width) + (8 - pixelSize)) / 8;
+	uint32_t sourceSize = source->size();
+	if (aligned && width <= 0) {
+		debug_log("bufferExpandBitmap: invalid width %d\n\r", width);
+		if (!useBuffer) {
+			free(mapValues);
+		}
+		return;
 	}
 
-	// work out our output size
-	uint32_t outputSize = 0;
-	if (aligned) {
-		outputSize = (sourceSize / byteWidth) * width;
-	} else {
-		outputSize = (sourceSize * 8) / pixelSize;
-	}
+	// each row starts on a byte boundary when aligned, otherwise the whole source is a single row
+	uint32_t byteWidth = aligned ? ((pixelSize * width) + 7) / 8 : sourceSize;
+	uint32_t rowPixels = aligned ? width : (sourceSize * 8) / pixelSize;
+	uint32_t rows = byteWidth ? sourceSize / byteWidth : 0;
+	uint32_t outputSize = rows * rowPixels;
 
 	debug_log("bufferExpandBitmap: source size %d, output size %d, pixel size %d, width %d, byte width %d\n\r",
 		sourceSize, outputSize, pixelSize, width, byteWidth);
 
 	// create output buffer
-	auto bufferStream = make_shared_psram<BufferStream>(outputSize);
+	auto bufferStream = make_shared_pooled<BufferStream>(outputSize);
+	// table of the pixel values each source byte expands to, for pixel sizes that divide into a byte
+	std::unique_ptr<uint32_t[]> lookup;
+	const uint8_t pixelsPerByte = (8 % pixelSize == 0) ? 8 / pixelSize : 0;
+	if (pixelsPerByte > 1) {
+		lookup = make_unique_psram_array<uint32_t>(256 * pixelsPerByte / sizeof(uint32_t));
+	}
 
-	if (!bufferStream || !bufferStream->getBuffer()) {
+	if (!bufferStream || !bufferStream->getBuffer() || (pixelsPerByte > 1 && !lookup)) {
 		// buffer couldn't be created
 		debug_log("bufferExpandBitmap: failed to create buffer %d\n\r", bufferId);
 		if (!useBuffer) {
@@ -2158,52 +3121,101 @@ void VDUStreamProcessor::bufferExpandBitmap(uint16_t bufferId, uint8_t options,
 	}
 
 	auto destination = bufferStream->getBuffer();
-
-	// iterate through source buffer
-	auto p_data = destination;
-	uint8_t bit = 0;
-	uint8_t pixel = 0;
-	uint16_t pixelCount = 0;
-	for (const auto &block : sourceBuffer) {
-		auto bufferLength = block->size();
-		auto p_source = block->getBuffer();
-
-		// go through one byte at a time,
-		// and expand the pixels into the destination buffer
-		// aligning when our pixel count reaches our pixel width if required
-
-		while (bufferLength--) {
-			auto value = *p_source++;
-			for (uint8_t i = 0; i < 8; i++) {
-				debug_log("pixel bit is %d ", ((value >> 7 - i) & 1));
-				pixel = (pixel << 1) | ((value >> (7 - i)) & 1);
-				bit++;
-				if (bit == pixelSize) {
-					bit = 0;
-					*p_data++ = mapValues[pixel];
-					debug_log(" %02hX %02hX (%02hX) %d\n\r", pixel, mapValues[pixel], value, i);
-					pixel = 0;
-					if (aligned) {
-						if (++pixelCount == width) {
-							// byte align
-							debug_log("aligned... skipping to next byte at byte bit %d\n\r", i);
-							pixelCount = 0;
-							// jump to next byte
-							break;
-						}
-					}
+	auto p_source = source->getBuffer();
+
+	if (pixelsPerByte) {
+		// expand whole source bytes at a time through the lookup table
+		// 8-bit pixels map directly through the map values
+		auto table = pixelsPerByte > 1 ? (const uint8_t *)lookup.get() : mapValues;
+		if (pixelsPerByte > 1) {
+			auto entries = (uint8_t *)lookup.get();
+			uint8_t mask = (1 << pixelSize) - 1;
+			for (uint32_t value = 0; value < 256; value++) {
+				for (uint8_t i = 0; i < pixelsPerByte; i++) {
+					*entries++ = mapValues[(value >> (8 - pixelSize * (i + 1))) & mask];
 				}
 			}
 		}
+		uint32_t wholeBytes = rowPixels / pixelsPerByte;
+		uint32_t tailPixels = rowPixels % pixelsPerByte;
+		for (uint32_t row = 0; row < rows; row++) {
+			expandBitmapBytes(destination, p_source, wholeBytes, table, pixelsPerByte);
+			destination += wholeBytes * pixelsPerByte;
+			if (tailPixels) {
+				// partial byte at the end of an aligned row
+				memcpy(destination, table + p_source[wholeBytes] * pixelsPerByte, tailPixels);
+				destination += tailPixels;
+			}
+			p_source += byteWidth;
+		}
+	} else {
+		// pixels straddle bytes, so gather them a bit at a time
+		for (uint32_t row = 0; row < rows; row++) {
+			uint32_t bitOffset = 0;
+			for (uint32_t i = 0; i < rowPixels; i++) {
+				uint8_t pixel = 0;
+				for (uint8_t b = 0; b < pixelSize; b++, bitOffset++) {
+					pixel = (pixel << 1) | ((p_source[bitOffset >> 3] >> (7 - (bitOffset & 7))) & 1);
+				}
+				*destination++ = mapValues[pixel];
+			}
+			p_source += byteWidth;
+		}
 	}
 
-	// save our bufferStream to the buffer
-	bufferClear(bufferId);
-	buffers[bufferId].push_back(std::move(bufferStream));
 	if (!useBuffer) {
 		free(mapValues);
 	}
+
+	// save our bufferStream to the buffer
+	bufferClear(bufferId);
+	auto bufferBlocks = buffers.create(bufferId);
+	if (!bufferBlocks) {
+		debug_log("bufferExpandBitmap: failed to create buffer %d\n\r", bufferId);
+		return;
+	}
+	bufferBlocks->push_back(std::move(bufferStream));
 	debug_log("bufferExpandBitmap: expanded %d bytes into buffer %d\n\r", outputSize, bufferId);
 }
 
+#ifdef VDP_BENCHMARK
+// VDU 23, 0, &A0, bufferId; &81, iterations; : Benchmark a buffer
+// Calls the given buffer repeatedly, timing how long it takes to process
+// and reports throughput on the debug serial port
+// The buffer should contain a representative VDU stream, such as a set of plot commands
+//
+void VDUStreamProcessor::bufferBenchmark(uint16_t bufferId, uint16_t iterations) {
+	auto bufferBlocks = buffers.get(bufferId);
+	if (!bufferBlocks) {
+		debug_log("bufferBenchmark: buffer %d not found\n\r", bufferId);
+		return;
+	}
+	uint64_t bufferSize = 0;
+	for (const auto &block : *bufferBlocks) {
+		bufferSize += block->size();
+	}
+	if (iterations == 0 || bufferSize == 0) {
+		debug_log("bufferBenchmark: nothing to do for buffer %d\n\r", bufferId);
+		return;
+	}
+
+	auto startCount = commandCount;
+	auto start = micros();
+	for (auto i = 0; i < iterations; i++) {
+		bufferCall(bufferId, {});
+	}
+	uint64_t elapsed = micros() - start;
+	uint64_t commands = commandCount - startCount;
+	uint64_t bytes = bufferSize * iterations;
+	if (elapsed == 0) {
+		elapsed = 1;
+	}
+
+	force_debug_log("bufferBenchmark: buffer %u, %u iterations, %llu bytes, %llu commands in %llu us\n\r",
+		bufferId, iterations, bytes, commands, elapsed);
+	force_debug_log("bufferBenchmark: %llu bytes/sec, %llu ns/command\n\r",
+		(bytes * 1000000) / elapsed, commands ? (elapsed * 1000) / commands : 0);
+}
+#endif // VDP_BENCHMARK
+
 #endif // VDU_BUFFERED_H
@@ -0,0 +1,204 @@
+#ifndef VDU_COMPILED_H
+#define VDU_COMPILED_H
+
+#include <memory>
+
+#include "agon.h"
+#include "buffers.h"
+#include "compiled_buffer.h"
+#include "multi_buffer_stream.h"
+#include "vdu_stream_processor.h"
+
+extern bool consoleMode;
+extern bool printerOn;
+
+// Compiled buffers
+// When TEST_FLAG_COMPILED_BUFFERS is set, a buffer that is called is compiled on its first call
+// into an array of pre-decoded commands, which later calls then execute directly
+// Text runs and plot commands are executed without re-reading their bytes,
+// and other fixed-length commands are interpreted from a single contiguous copy of the buffer
+//
+
+// Number of argument bytes following each VDU control code
+// -1 marks codes that can't be compiled, as their length isn't fixed or they change how following bytes are handled
+//
+static const int8_t vduArgumentLengths[32] = {
+	0,	1,	0,	0,	0,	0,	0,	0,		// 0-7
+	0,	0,	0,	0,	0,	0,	0,	0,		// 8-15
+	0,	1,	2,	5,	0,	-1,	1,	-1,		// 16-23 (21 disables commands, 23 is handled separately)
+	8,	5,	0,	1,	4,	4,	0,	2,		// 24-31
+};
+
+// Work out the total length of the command at the start of data
+// Returns -1 if the command can't be compiled, or isn't complete
+//
+int32_t VDUStreamProcessor::compiledCommandLength(const uint8_t * data, uint32_t available) {
+	auto c = data[0];
+	int32_t length = 1;
+	if (c >= 0x20) {
+		length = 1;
+	} else if (c != 0x17) {
+		if (vduArgumentLengths[c] < 0) {
+			return -1;
+		}
+		length = 1 + vduArgumentLengths[c];
+	} else {
+		// VDU 23, mode
+		if (available < 2) {
+			return -1;
+		}
+		auto mode = data[1];
+		if (mode >= 32) {
+			length = 10;						// VDU 23, c, n1, n2, n3, n4, n5, n6, n7, n8
+		} else {
+			switch (mode) {
+				case 0x00: {					// VDU 23, 0, command, <args>
+					if (available < 3) {
+						return -1;
+					}
+					auto index = sysCommandIndex[data[2]];
+					if (index == 255) {
+						length = 3;
+						break;
+					}
+					auto argLength = sysCommands[index].argLength;
+					if (argLength < 0) {
+						// this includes all buffered commands, which can jump or call
+						return -1;
+					}
+					length = 3 + argLength;
+				}	break;
+				case 0x01:	length = 3;		break;	// VDU 23, 1, n
+				case 0x06:	length = 10;	break;	// VDU 23, 6, n1, n2, n3, n4, n5, n6, n7, n8
+				case 0x07:	length = 5;		break;	// VDU 23, 7, extent, direction, movement
+				case 0x10:	length = 4;		break;	// VDU 23, 16, setting, mask
+				case 0x17:	length = 3;		break;	// VDU 23, 23, n
+				case 0x1B:								// VDU 23, 27 (sprites)
+				case 0x1C:								// VDU 23, 28 (hexload)
+					return -1;
+				default:	length = 2;		break;	// unknown commands ignore any further bytes
+			}
+		}
+	}
+	if ((uint32_t)length > available) {
+		return -1;
+	}
+	return length;
+}
+
+// Compile a buffer, and store the result against it
+// Returns nullptr if the buffer doesn't exist or couldn't be compiled
+//
+std::shared_ptr<const CompiledBuffer> VDUStreamProcessor::compileBuffer(uint16_t bufferId) {
+	auto bufferBlocks = buffers.get(bufferId);
+	if (!bufferBlocks || bufferBlocks->empty()) {
+		return nullptr;
+	}
+	auto bufferStream = consolidateBuffers(*bufferBlocks);
+	if (!bufferStream) {
+		debug_log("compileBuffer: failed to consolidate buffer %d\n\r", bufferId);
+		return nullptr;
+	}
+	auto program = make_shared_psram<CompiledBuffer>();
+	if (!program) {
+		return nullptr;
+	}
+	for (auto &block : *bufferBlocks) {
+		program->versions.push_back(block->getVersion());
+	}
+	program->data = make_shared_psram<BufferIndex>(std::vector<std::shared_ptr<BufferStream>> { bufferStream });
+
+	auto data = bufferStream->getBuffer();
+	auto size = bufferStream->size();
+	uint32_t offset = 0;
+	while (offset < size) {
+		auto c = data[offset];
+		CompiledCommand command = { CompiledCommand::Bytes, c, 1, 0, 0 };
+		if (c >= 0x20 && c != 0x7F) {
+			// gather a run of printable characters
+			command.type = CompiledCommand::Text;
+			while (command.length < TEXT_RUN_LENGTH && offset + command.length < size) {
+				auto next = data[offset + command.length];
+				if (next < 0x20 || next == 0x7F) {
+					break;
+				}
+				command.length++;
+			}
+		} else {
+			auto length = compiledCommandLength(data + offset, size - offset);
+			if (length < 0) {
+				break;
+			}
+			command.length = length;
+			if (c == 0x19) {
+				command.type = CompiledCommand::Plot;
+				command.code = data[offset + 1];
+				command.x = data[offset + 2] | (data[offset + 3] << 8);
+				command.y = data[offset + 4] | (data[offset + 5] << 8);
+			}
+		}
+		program->commands.push_back(command);
+		offset += command.length;
+	}
+	program->length = offset;
+
+	debug_log("compileBuffer: buffer %d, compiled %d commands covering %d of %d bytes\n\r",
+		bufferId, program->commands.size(), offset, size);
+	buffers.setCompiled(bufferId, program);
+	return program;
+}
+
+// Run a compiled buffer
+// The buffer's own stream must already be our input stream, and is used for the uncompiled remainder
+//
+void VDUStreamProcessor::runCompiledBuffer(const CompiledBuffer &program) {
+	auto programStream = make_shared_psram<MultiBufferStream>(program.data);
+	if (!programStream) {
+		processAllAvailable();
+		return;
+	}
+	auto data = program.data->getBlocks().front()->getBuffer();
+	std::shared_ptr<Stream> bufferStream = programStream;
+	SpanReader * bufferSpans = programStream.get();
+	std::swap(inputStream, bufferStream);
+	std::swap(inputSpans, bufferSpans);
+
+	uint32_t offset = 0;
+	for (const auto &command : program.commands) {
+		if (command.type != CompiledCommand::Bytes && commandsEnabled && !printerOn && !consoleMode) {
+			// skip over the command's bytes first, as a plot may look ahead to the next command
+			programStream->seekTo(offset + command.length);
+			if (command.type == CompiledCommand::Text) {
+				beginCommand(data[offset]);
+				context->plotString((const char *)data + offset, command.length);
+			} else {
+				beginCommand(0x19);
+				executePlot(command.code, command.x, command.y);
+			}
+			offset += command.length;
+			continue;
+		}
+		// interpret this command from our copy of the buffer
+		programStream->seekTo(offset);
+		vdu(readByte());
+		uint32_t blockOffset;
+		size_t blockIndex;
+		programStream->tellBuffer(blockOffset, blockIndex);
+		auto position = blockIndex > 0 ? program.data->size() : blockOffset;
+		if (position != offset + command.length) {
+			// the command consumed more or less than expected, such as text gathered while printing
+			// so interpret the rest of the buffer from wherever it left off
+			offset = position;
+			break;
+		}
+		offset += command.length;
+	}
+
+	// continue with the rest of the buffer
+	inputStream = std::move(bufferStream);
+	inputSpans = bufferSpans;
+	((MultiBufferStream *)inputStream.get())->seekTo(offset);
+	processAllAvailable();
+}
+
+#endif // VDU_COMPILED_H
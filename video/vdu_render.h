@@ -0,0 +1,99 @@
+#ifndef VDU_RENDER_H
+#define VDU_RENDER_H
+
+#include "agon.h"
+#include "test_flags.h"
+#include "vdu_stream_processor.h"
+
+// Render pipeline
+// When TEST_FLAG_RENDER_PIPELINE is set, VDU 25 plot commands are decoded by the processor
+// and queued for a render task running on the other core, which executes them against our context
+// Any other command waits for the queue to drain first, so they see the results of all earlier plots
+//
+
+// Check whether plots should be queued for the render task, starting it if needed
+//
+bool VDUStreamProcessor::useRenderPipeline() {
+	if (!isTestFlagSet(TEST_FLAG_RENDER_PIPELINE)) {
+		return false;
+	}
+	if (renderTaskHandle) {
+		return true;
+	}
+	if (renderPipelineFailed) {
+		return false;
+	}
+	renderPipelineFailed = !startRenderPipeline();
+	return !renderPipelineFailed;
+}
+
+bool VDUStreamProcessor::startRenderPipeline() {
+	if (!renderQueue.begin(RENDER_QUEUE_SIZE)) {
+		debug_log("startRenderPipeline: failed to allocate render queue\n\r");
+		return false;
+	}
+	auto result = xTaskCreatePinnedToCore(
+		renderTask,
+		"render",
+		4096,
+		this,
+		RENDER_PRIORITY,
+		&renderTaskHandle,
+		RENDER_CORE
+	);
+	if (result != pdPASS) {
+		debug_log("startRenderPipeline: failed to create render task\n\r");
+		renderTaskHandle = nullptr;
+		return false;
+	}
+	debug_log("startRenderPipeline: render task started on core %d\n\r", RENDER_CORE);
+	return true;
+}
+
+// Queue a plot command, waiting for space if the queue is full
+//
+void VDUStreamProcessor::queuePlot(int16_t x, int16_t y, uint8_t command) {
+	PlotRecord record = { x, y, command };
+	while (!renderQueue.push(record)) {
+		waitForRender();
+	}
+	xTaskNotifyGive(renderTaskHandle);
+}
+
+// Block until the render task has completed a command, or the next tick
+//
+void VDUStreamProcessor::waitForRender() {
+	renderWaitingTask = xTaskGetCurrentTaskHandle();
+	// check again after registering, so a notification can't be missed
+	if (!renderQueue.empty()) {
+		ulTaskNotifyTake(pdTRUE, 1);
+	}
+	renderWaitingTask = nullptr;
+}
+
+void VDUStreamProcessor::renderTask(void * parameter) {
+	((VDUStreamProcessor *)parameter)->renderLoop();
+}
+
+// Execute queued plot commands
+// Commands are only removed from the queue once they have been completed,
+// so an empty queue means the render task is idle
+//
+void VDUStreamProcessor::renderLoop() {
+	while (true) {
+		if (renderQueue.empty()) {
+			ulTaskNotifyTake(pdTRUE, 1);
+			continue;
+		}
+		auto &record = renderQueue.front();
+		renderPathPending = context->plot(record.x, record.y, record.command);
+		renderQueue.consume(1);
+
+		auto task = renderWaitingTask;
+		if (task) {
+			xTaskNotifyGive(task);
+		}
+	}
+}
+
+#endif // VDU_RENDER_H
@@ -261,18 +261,19 @@ void VDUStreamProcessor::createBitmapFromBuffer(uint16_t bufferId, uint8_t forma
 	// TODO unmap bitmap from characters for all contexts
 	context->unmapBitmapFromChars(bufferId);
 	// do we have a buffer with this ID?
-	if (buffers.find(bufferId) == buffers.end()) {
+	auto bufferBlocks = buffers.get(bufferId);
+	if (!bufferBlocks) {
 		debug_log("vdu_sys_sprites: buffer %d not found\n\r", bufferId);
 		return;
 	}
 	// is this a singular buffer we can use for a bitmap source?
-	if (buffers[bufferId].size() != 1) {
+	if (bufferBlocks->size() != 1) {
 		debug_log("vdu_sys_sprites: buffer %d is not a singular buffer and cannot be used for a bitmap source\n\r", bufferId);
 		return;
 	}
 
 	// create bitmap from buffer
-	auto stream = buffers[bufferId][0];
+	auto stream = bufferBlocks->front();
 	// map our pixel format, default to RGBA8888
 	PixelFormat pixelFormat = PixelFormat::RGBA8888;
 	auto bytesPerPixel = 4.;
@@ -306,6 +307,11 @@ void VDUStreamProcessor::createBitmapFromBuffer(uint16_t bufferId, uint8_t forma
 		debug_log("vdu_sys_sprites: buffer %d - stream length %d does not match expected length %d\n\r", bufferId, streamLength, expectedLength);
 		return;
 	}
+	// the bitmap uses the buffer's data in place, so it must not move
+	if (!stream->pin()) {
+		debug_log("vdu_sys_sprites: buffer %d - failed to pin buffer data\n\r", bufferId);
+		return;
+	}
 	auto data = stream->getBuffer();
 	if (bytesPerPixel < 1) {
 		// get our current foreground graphics colour
@@ -10,9 +10,15 @@
 
 #include "agon.h"
 #include "context.h"
+#include "buffer_index.h"
 #include "buffer_stream.h"
+#include "compiled_buffer.h"
 #include "span.h"
+#include "span_reader.h"
+#include "spsc_ring.h"
+#include "trace_stream.h"
 #include "types.h"
+#include "vdp_protocol.h"
 
 std::unordered_map<uint8_t, std::shared_ptr<std::vector<std::shared_ptr<Context>>>> contextStacks;
 
@@ -23,15 +29,63 @@ class VDUStreamProcessor {
 			size_t blockIndex = 0;
 		};
 
+		// Commands that need to see the next byte before they can complete
+		enum class PendingLookahead : uint8_t {
+			None,
+			Backspace,				// cursor left, which becomes a backspace if followed by a space
+			PlotPath,				// path plot, committed unless followed by another plot
+			QueuedPlot,				// plot queued for the render task, which may leave a path pending
+		};
+
+		// A plot command queued for the render task
+		struct PlotRecord {
+			int16_t x;
+			int16_t y;
+			uint8_t command;
+		};
+
+		// Entry in the VDU 23, 0 command dispatch table
+		struct SysCommand {
+			uint8_t command;
+			int8_t argLength;		// Fixed number of argument bytes, or -1 if variable
+			void (VDUStreamProcessor::*handler)();
+		};
+		// Statistics gathered for each VDU 23, 0 command
+		struct SysCommandStats {
+			uint32_t count;
+			uint32_t maxTime;		// Longest single execution, in microseconds
+			uint64_t totalTime;		// Total execution time in microseconds, including any nested commands
+			uint64_t bytes;			// Total argument bytes consumed
+		};
+		static const SysCommand sysCommands[];
+		static const size_t sysCommandCount;
+		static SysCommandStats sysCommandStats[];
+		static uint8_t sysCommandIndex[256];		// Table index for each command byte, or 255 if unknown
+		static void initSysCommands();
+
 		std::shared_ptr<Stream> inputStream;
+		SpanReader * inputSpans = nullptr;	// inputStream's span interface, if it has one
 		std::shared_ptr<Stream> outputStream;
 		std::shared_ptr<Stream> originalOutputStream;
+		std::shared_ptr<TraceStream> traceStream;
 
 		// Graphics context storage and management
 		std::shared_ptr<Context> context;					// Current active context
 		std::shared_ptr<std::vector<std::shared_ptr<Context>>> contextStack;	// Current active context stack
 
 		bool commandsEnabled = true;
+		bool outputSuppressed = false;	// Discard all output, such as while replaying a trace
+		PendingLookahead pendingLookahead = PendingLookahead::None;
+		TickType_t pendingLookaheadTime = 0;
+		uint32_t commandCount = 0;		// Number of VDU commands processed, used for benchmarking
+		uint32_t inputBytesRead = 0;	// Number of bytes read from input, used for statistics
+
+		// Render pipeline, where plot commands are executed by a task on the other core
+		SPSCRing<PlotRecord> renderQueue;
+		TaskHandle_t renderTaskHandle = nullptr;
+		volatile TaskHandle_t renderWaitingTask = nullptr;
+		volatile bool renderPathPending = false;	// The last queued plot left a path pending
+		bool renderPipelineFailed = false;
 
 		int16_t readByte_t(uint16_t timeout);
 		int32_t readWord_t(uint16_t timeout);
@@ -40,6 +94,16 @@ class VDUStreamProcessor {
 		uint32_t readIntoBuffer(uint8_t * buffer, uint32_t length, uint16_t timeout);
 		uint32_t discardBytes(uint32_t length, uint16_t timeout);
 		int16_t peekByte_t(uint16_t timeout);
+		const uint8_t * peekInput(size_t length);
+		void deferLookahead(PendingLookahead type);
+		void resolveLookahead(int16_t next);
+		void beginCommand(uint8_t c);
+
+		bool useRenderPipeline();
+		bool startRenderPipeline();
+		void queuePlot(int16_t x, int16_t y, uint8_t command);
+		static void renderTask(void * parameter);
+		void renderLoop();
 
 		void vdu_print(char c, bool usePeek);
 		void vdu_colour();
@@ -48,6 +112,7 @@ class VDUStreamProcessor {
 		void vdu_mode();
 		void vdu_graphicsViewport();
 		void vdu_plot();
+		void executePlot(uint8_t command, int16_t x, int16_t y);
 		void vdu_resetViewports();
 		void vdu_textViewport();
 		void vdu_origin();
@@ -55,6 +120,34 @@ class VDUStreamProcessor {
 
 		void vdu_sys();
 		void vdu_sys_video();
+		void vdu_sys_video_cursorVStart();
+		void vdu_sys_video_cursorVEnd();
+		void vdu_sys_video_scrchar();
+		void vdu_sys_video_scrpixel();
+		void vdu_sys_video_cursorHStart();
+		void vdu_sys_video_cursorHEnd();
+		void vdu_sys_video_cursorMove();
+		void vdu_sys_video_udg();
+		void vdu_sys_video_udgReset();
+		void vdu_sys_video_mapCharToBitmap();
+		void vdu_sys_video_scrcharGraphics();
+		void vdu_sys_video_readColour();
+		void vdu_sys_video_affineTransform();
+		void vdu_sys_video_controlKeys();
+		void vdu_sys_video_bufferPrint();
+		void vdu_sys_video_textViewport();
+		void vdu_sys_video_graphicsViewport();
+		void vdu_sys_video_graphicsOrigin();
+		void vdu_sys_video_shiftOrigin();
+		void vdu_sys_video_logicalCoords();
+		void vdu_sys_video_legacyModes();
+		void vdu_sys_video_switchBuffer();
+		void vdu_sys_video_flushDrawingQueue();
+		void vdu_sys_video_patternLength();
+		void vdu_sys_video_testFlagSet();
+		void vdu_sys_video_testFlagClear();
+		void vdu_sys_video_consoleMode();
+		void vdu_sys_video_terminalMode();
 		void sendGeneralPoll();
 		void vdu_sys_video_kblayout();
 		void sendCursorPosition();
@@ -70,6 +163,9 @@ class VDUStreamProcessor {
 		void vdu_sys_scroll();
 		void vdu_sys_cursorBehaviour();
 		void vdu_sys_udg(char c);
+		void vdu_sys_statistics();
+		void sendCommandStatistics(uint8_t command);
+		void dumpCommandStatistics();
 
 		void vdu_sys_audio();
 		void sendAudioStatus(uint8_t channel, uint8_t status);
@@ -112,10 +208,15 @@ class VDUStreamProcessor {
 		void setOutputStream(uint16_t bufferId);
 		AdvancedOffset getOffsetFromStream(bool isAdvanced);
 		std::vector<uint16_t> getBufferIdsFromStream();
-		static tcb::span<uint8_t> getBufferSpan(const std::vector<std::shared_ptr<BufferStream>> &buffer, AdvancedOffset &offset);
-		static int16_t getBufferByte(const std::vector<std::shared_ptr<BufferStream>> &buffer, AdvancedOffset &offset, bool iterate = false);
-		static bool setBufferByte(uint8_t value, const std::vector<std::shared_ptr<BufferStream>> &buffer, AdvancedOffset &offset, bool iterate = false);
+		static tcb::span<uint8_t> getBufferSpan(const BufferIndex &buffer, AdvancedOffset &offset);
+		static tcb::span<uint8_t> getWritableBufferSpan(const BufferIndex &buffer, AdvancedOffset &offset);
+		static int16_t getBufferByte(const BufferIndex &buffer, AdvancedOffset &offset, bool iterate = false);
+		static bool setBufferByte(uint8_t value, const BufferIndex &buffer, AdvancedOffset &offset, bool iterate = false);
 		void bufferAdjust(uint16_t bufferId);
+		void bufferAdjustStrided(uint16_t bufferId, bool masked);
+		void bufferFill(uint16_t bufferId);
+		void bufferBlit(uint16_t bufferId);
+		bool blitRow(const BufferIndex &source, AdvancedOffset sourceOffset, const BufferIndex &target, AdvancedOffset targetOffset, uint32_t length, uint8_t bytesPerPixel, const uint8_t * key);
 		bool bufferConditional();
 		void bufferJump(uint16_t bufferId, AdvancedOffset offset);
 		void bufferCopy(uint16_t bufferId, tcb::span<const uint16_t> sourceBufferIds);
@@ -129,9 +230,23 @@ class VDUStreamProcessor {
 		void bufferCopyRef(uint16_t bufferId, tcb::span<const uint16_t> sourceBufferIds);
 		void bufferCopyAndConsolidate(uint16_t bufferId, tcb::span<const uint16_t> sourceBufferIds);
 		void bufferAffineTransform(uint16_t bufferId);
-		void bufferCompress(uint16_t bufferId, uint16_t sourceBufferId);
+		void bufferCompress(uint16_t bufferId, uint16_t sourceBufferId, uint8_t type);
 		void bufferDecompress(uint16_t bufferId, uint16_t sourceBufferId);
+		void bufferDecompressStream(uint16_t bufferId);
 		void bufferExpandBitmap(uint16_t bufferId, uint8_t options, uint16_t sourceBufferId);
+#ifdef VDP_BENCHMARK
+		void bufferBenchmark(uint16_t bufferId, uint16_t iterations);
+#endif
+
+		void vdu_sys_trace();
+		void traceStart(uint32_t size);
+		void traceSave(uint16_t bufferId);
+		void traceDump();
+		void traceReplay(uint16_t bufferId, uint8_t flags);
+
+		std::shared_ptr<const CompiledBuffer> compileBuffer(uint16_t bufferId);
+		int32_t compiledCommandLength(const uint8_t * data, uint32_t available);
+		void runCompiledBuffer(const CompiledBuffer &program);
 
 		void vdu_sys_updater();
 		void unlock();
@@ -147,38 +262,79 @@ class VDUStreamProcessor {
 				context = make_shared_psram<Context>(*_context);
 				contextStack = make_shared_psram<std::vector<std::shared_ptr<Context>>>();
 				contextStack->push_back(context);
+				initSysCommands();
 			}
-		VDUStreamProcessor(Stream *input) :
-			inputStream(std::shared_ptr<Stream>(input)), outputStream(inputStream), originalOutputStream(inputStream) {
+		VDUStreamProcessor(Stream *input, SpanReader *spans = nullptr) :
+			inputStream(std::shared_ptr<Stream>(input)), inputSpans(spans), outputStream(inputStream), originalOutputStream(inputStream) {
 				context = make_shared_psram<Context>();
 				contextStack = make_shared_psram<std::vector<std::shared_ptr<Context>>>();
 				contextStack->push_back(context);
+				initSysCommands();
 			}
 
 		inline bool byteAvailable() {
 			return inputStream->available() > 0;
 		}
 		inline uint8_t readByte() {
+			inputBytesRead++;
 			return inputStream->read();
 		}
+		// Wait for more input to arrive without spinning
+		// Serial data arriving wakes us immediately, otherwise the input is re-checked every tick
+		// which covers streams that don't come from the serial port
+		inline void waitForInput() {
+			waitForVDPData(1);
+		}
+		// Data for the serial port goes via the transmit queue, so it never blocks us
+		inline bool isSerialOutput() {
+			return outputStream.get() == static_cast<Stream *>(&VDPStream);
+		}
 		inline void writeByte(uint8_t b) {
-			if (outputStream) {
+			if (outputSuppressed) {
+				return;
+			}
+			if (isSerialOutput()) {
+				queueVDPData(nullptr, 0, &b, 1, TxPriority::High);
+			} else if (outputStream) {
 				outputStream->write(b);
 			}
 		}
-		void send_packet(uint8_t code, uint16_t len, uint8_t data[]);
+		void send_packet(uint8_t code, uint16_t len, uint8_t data[], TxPriority priority);
 
 		void sendMouseData(MouseDelta * delta);
 
 		void processAllAvailable();
 		void processNext();
+		inline uint32_t getCommandCount() {
+			return commandCount;
+		}
+		inline bool hasPendingLookahead() {
+			return pendingLookahead != PendingLookahead::None;
+		}
+		bool checkPendingLookahead();
+		inline bool isRenderTaskRunning() {
+			return renderTaskHandle != nullptr;
+		}
+		// Wait for all queued plot commands to be executed
+		// Must be called before anything else uses the context
+		inline void flushRenderQueue() {
+			while (!renderQueue.empty()) {
+				waitForRender();
+			}
+		}
+		void waitForRender();
 		void doCursorFlash() {
+			// the render task may still be drawing queued plots, so the flash waits until it is idle
+			if (!renderQueue.empty()) {
+				return;
+			}
 			context->doCursorFlash();
 		}
 		void hideCursor() {
 			context->hideCursor();
 		}
 		void showCursor() {
+			flushRenderQueue();
 			context->showCursor();
 		}
 
@@ -195,13 +351,37 @@ class VDUStreamProcessor {
 		}
 };
 
+// Get direct access to the next length bytes of input, if they have already been received
+// and are contiguous, allowing fixed-size arguments to be decoded without per-byte reads
+// Returns nullptr if the bytes must be read via the normal (timed) stream path instead
+// Callers must decode the data before committing it, as committed data may be overwritten
+//
+inline const uint8_t * VDUStreamProcessor::peekInput(size_t length) {
+	if (inputSpans) {
+		auto span = inputSpans->readableSpan();
+		if (span.size() >= length) {
+			return span.data();
+		}
+	}
+	return nullptr;
+}
+
 // Read an unsigned byte from the serial port, with a timeout
 // Returns:
 // - Byte value (0 to 255) if value read, otherwise -1
 //
 int16_t inline VDUStreamProcessor::readByte_t(uint16_t timeout = COMMS_TIMEOUT) {
+	auto data = peekInput(1);
+	if (data) {
+		auto value = data[0];
+		inputSpans->commit(1);
+		inputBytesRead++;
+		return value;
+	}
+
 	auto read = inputStream->read();
 	if (read != -1) {
+		inputBytesRead++;
 		return read;
 	}
 
@@ -209,8 +389,10 @@ int16_t inline VDUStreamProcessor::readByte_t(uint16_t timeout = COMMS_TIMEOUT)
 	const auto timeCheck = pdMS_TO_TICKS(timeout);
 
 	do {
+		waitForInput();
 		read = inputStream->read();
 		if (read != -1) {
+			inputBytesRead++;
 			return read;
 		}
 	} while (xTaskGetTickCountFromISR() - start < timeCheck);
@@ -223,6 +405,14 @@ int16_t inline VDUStreamProcessor::readByte_t(uint16_t timeout = COMMS_TIMEOUT)
 // - Word value (0 to 65535) if 2 bytes read, otherwise -1
 //
 int32_t VDUStreamProcessor::readWord_t(uint16_t timeout = COMMS_TIMEOUT) {
+	auto data = peekInput(2);
+	if (data) {
+		int32_t value = data[0] | (data[1] << 8);
+		inputSpans->commit(2);
+		inputBytesRead += 2;
+		return value;
+	}
+
 	auto l = readByte_t(timeout);
 	if (l != -1) {
 		auto h = readByte_t(timeout);
@@ -238,6 +428,14 @@ int32_t VDUStreamProcessor::readWord_t(uint16_t timeout = COMMS_TIMEOUT) {
 // - Value (0 to 16777215) if 3 bytes read, otherwise -1
 //
 int32_t VDUStreamProcessor::read24_t(uint16_t timeout = COMMS_TIMEOUT) {
+	auto data = peekInput(3);
+	if (data) {
+		int32_t value = data[0] | (data[1] << 8) | (data[2] << 16);
+		inputSpans->commit(3);
+		inputBytesRead += 3;
+		return value;
+	}
+
 	auto l = readByte_t(timeout);
 	if (l != -1) {
 		auto m = readByte_t(timeout);
@@ -254,7 +452,9 @@ int32_t VDUStreamProcessor::read24_t(uint16_t timeout = COMMS_TIMEOUT) {
 // Read an unsigned byte from the serial port (blocking)
 //
 uint8_t VDUStreamProcessor::readByte_b() {
-	while (inputStream->available() == 0);
+	while (inputStream->available() == 0) {
+		waitForInput();
+	}
 	return readByte();
 }
 
@@ -271,6 +471,19 @@ uint32_t VDUStreamProcessor::readIntoBuffer(uint8_t * buffer, uint32_t length, u
 	}
 
 	while (remaining > 0) {
+		if (inputSpans) {
+			// copy whatever has already been received directly
+			auto span = inputSpans->readableSpan();
+			auto count = std::min<uint32_t>(span.size(), remaining);
+			if (count > 0) {
+				memcpy(buffer, span.data(), count);
+				inputSpans->commit(count);
+				inputBytesRead += count;
+				buffer += count;
+				remaining -= count;
+				continue;
+			}
+		}
 		auto read = inputStream->readBytes(buffer, remaining);
 		if (read == 0) {
 			// timed out - perform a single retry
@@ -282,6 +495,7 @@ uint32_t VDUStreamProcessor::readIntoBuffer(uint8_t * buffer, uint32_t length, u
 		}
 		buffer += read;
 		remaining -= read;
+		inputBytesRead += read;
 	}
 	return remaining;
 }
@@ -315,17 +529,91 @@ int16_t VDUStreamProcessor::peekByte_t(uint16_t timeout = COMMS_TIMEOUT) {
 	auto start = xTaskGetTickCountFromISR();
 	const auto timeCheck = pdMS_TO_TICKS(timeout);
 
-	while (xTaskGetTickCountFromISR() - start < timeCheck) {
-		if (inputStream->available() > 0) {
-			return inputStream->peek();
+	while (inputStream->available() == 0) {
+		if (xTaskGetTickCountFromISR() - start >= timeCheck) {
+			return -1;
 		}
+		waitForInput();
 	}
-	return -1;
+	return inputStream->peek();
+}
+
+// Defer a command that needs to see the next byte in the stream
+// If the next byte is already available it is resolved immediately,
+// otherwise resolution happens when the next byte arrives, or on an idle timeout
+//
+void VDUStreamProcessor::deferLookahead(PendingLookahead type) {
+	pendingLookahead = type;
+	if (byteAvailable()) {
+		resolveLookahead(inputStream->peek());
+		return;
+	}
+	if (id != 65535) {
+		// we're in a buffer, so no more bytes will arrive
+		resolveLookahead(-1);
+		return;
+	}
+	pendingLookaheadTime = xTaskGetTickCountFromISR();
+}
+
+// Complete a pending command, given the next byte in the stream (or -1 if none arrived)
+//
+void VDUStreamProcessor::resolveLookahead(int16_t next) {
+	auto pending = pendingLookahead;
+	pendingLookahead = PendingLookahead::None;
+	switch (pending) {
+		case PendingLookahead::Backspace:
+			// left followed by a space is almost certainly a backspace
+			// but MOS doesn't send backspaces to delete characters on line edits
+			if (next == 0x20) {
+				context->plotBackspace();
+			} else {
+				context->cursorLeft();
+			}
+			break;
+		case PendingLookahead::PlotPath:
+			context->plotPending(next);
+			break;
+		case PendingLookahead::QueuedPlot:
+			// another plot can just be queued, otherwise we need the render task to catch up
+			if (next != 25) {
+				flushRenderQueue();
+				if (renderPathPending) {
+					renderPathPending = false;
+					context->plotPending(next);
+				}
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+// Resolve a pending command if no further byte has arrived within our fast timeout
+// Returns true if a pending command was resolved
+//
+bool VDUStreamProcessor::checkPendingLookahead() {
+	if (!hasPendingLookahead() || byteAvailable()) {
+		return false;
+	}
+	if (xTaskGetTickCountFromISR() - pendingLookaheadTime < pdMS_TO_TICKS(FAST_COMMS_TIMEOUT)) {
+		return false;
+	}
+	resolveLookahead(-1);
+	return true;
 }
 
 // Send a packet of data to the MOS
 //
-void VDUStreamProcessor::send_packet(uint8_t code, uint16_t len, uint8_t data[]) {
+void VDUStreamProcessor::send_packet(uint8_t code, uint16_t len, uint8_t data[], TxPriority priority = TxPriority::High) {
+	if (outputSuppressed) {
+		return;
+	}
+	if (isSerialOutput()) {
+		uint8_t header[] = { (uint8_t) (code + 0x80), (uint8_t) len };
+		queueVDPData(header, sizeof header, data, len, priority);
+		return;
+	}
 	writeByte(code + 0x80);
 	writeByte(len);
 	for (int i = 0; i < len; i++) {
@@ -353,6 +641,10 @@ void VDUStreamProcessor::sendMouseData(MouseDelta * delta = nullptr) {
 		buttons = mStatus.buttons.left << 0 | mStatus.buttons.right << 1 | mStatus.buttons.middle << 2;
 		wheelDelta = mStatus.wheelDelta;
 	}
+	if (delta) {
+		// deltas may have been coalesced, so use the total wheel movement rather than the last
+		wheelDelta = delta->deltaZ;
+	}
 	debug_log("sendMouseData: %d %d %d %d %d %d %d %d %d %d\n\r", mouseX, mouseY, buttons, wheelDelta, deltaX, deltaY);
 	uint8_t packet[] = {
 		(uint8_t) (mouseX & 0xFF),
@@ -366,7 +658,7 @@ void VDUStreamProcessor::sendMouseData(MouseDelta * delta = nullptr) {
 		(uint8_t) (deltaY & 0xFF),
 		(uint8_t) ((deltaY >> 8) & 0xFF),
 	};
-	send_packet(PACKET_MOUSE, sizeof packet, packet);
+	send_packet(PACKET_MOUSE, sizeof packet, packet, TxPriority::Low);
 }
 // Process all available commands from the stream
 //
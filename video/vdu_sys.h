@@ -16,6 +16,7 @@
 #include "vdu_context.h"
 #include "vdu_fonts.h"
 #include "vdu_sprites.h"
+#include "vdu_trace.h"
 #include "updater.h"
 #include "vdu_stream_processor.h"
 
@@ -56,6 +57,8 @@ void VDUStreamProcessor::wait_eZ80() {
 			if (c == 23) {
 				vdu_sys();
 			}
+		} else {
+			waitForInput();
 		}
 	}
 	debug_log("wait_eZ80: End\n\r");
@@ -127,221 +130,338 @@ void VDUStreamProcessor::vdu_sys() {
 
 // VDU 23,0: VDP control
 // These can send responses back; the response contains a packet # that matches the VDU command mode byte
+// Commands are dispatched via the sysCommands table, gathering statistics as they go
 //
 void VDUStreamProcessor::vdu_sys_video() {
-	auto mode = readByte_t();
+	auto mode = readByte_t(); if (mode == -1) return;
+	auto index = sysCommandIndex[mode];
+	if (index == 255) {
+		return;
+	}
 
-	switch (mode) {
-		case VDP_CURSOR_VSTART: {		// VDU 23, 0, &0A, offset
-			auto offset = readByte_t();	// Set the vertical start of the cursor
-			if (offset >= 0) {
-				context->setCursorVStart(offset & 0x1F);
-				context->setCursorAppearance((offset & 0x60) >> 5);
-			}
-		}	break;
-		case VDP_CURSOR_VEND: {			// VDU 23, 0, &0B, offset
-			auto offset = readByte_t();	// Set the vertical end of the cursor
-			if (offset >= 0) {
-				context->setCursorVEnd(offset);
-			}
-		}	break;
-		case VDP_GP: {					// VDU 23, 0, &80
-			sendGeneralPoll();			// Send a general poll packet
-		}	break;
-		case VDP_KEYCODE: {				// VDU 23, 0, &81, layout
-			vdu_sys_video_kblayout();
-		}	break;
-		case VDP_CURSOR: {				// VDU 23, 0, &82
-			sendCursorPosition();		// Send cursor position
-		}	break;
-		case VDP_SCRCHAR: {				// VDU 23, 0, &83, x; y;
-			auto x = readWord_t();		// Get character at screen position x, y
-			if (x == -1) return;
-			auto y = readWord_t();
-			if (y == -1) return;
-			auto c = context->getScreenChar(x, y);
-			sendScreenChar(c);
-		}	break;
-		case VDP_SCRPIXEL: {			// VDU 23, 0, &84, x; y;
-			auto x = readWord_t();		// Get pixel value at screen position x, y
-			if (x == -1) return;
-			auto y = readWord_t();
-			if (y == -1) return;
-			sendScreenPixel((short)x, (short)y);
-		}	break;
-		case VDP_AUDIO: {				// VDU 23, 0, &85, channel, command, <args>
-			vdu_sys_audio();
-		}	break;
-		case VDP_MODE: {				// VDU 23, 0, &86
-			sendModeInformation();		// Send mode information (screen dimensions, etc)
-		}	break;
-		case VDP_RTC: {					// VDU 23, 0, &87, mode
-			vdu_sys_video_time();		// Send time information
-		}	break;
-		case VDP_KEYSTATE: {			// VDU 23, 0, &88, repeatRate; repeatDelay; status
-			vdu_sys_keystate();
-		}	break;
-		case VDP_MOUSE: {				// VDU 23, 0, &89, command, <args>
-			vdu_sys_mouse();
-		}	break;
-		case VDP_CURSOR_HSTART: {		// VDU 23, 0, &8A, offset
-			auto offset = readByte_t();	// Set the horizontal start of the cursor
-			if (offset >= 0)
-				context->setCursorHStart(offset);
-		}	break;
-		case VDP_CURSOR_HEND: {			// VDU 23, 0, &8B, offset
-			auto offset = readByte_t();	// Set the vertical end of the cursor
-			if (offset >= 0)
-				context->setCursorHEnd(offset);
-		}	break;
-		case VDP_CURSOR_MOVE: {			// VDU 23, 0, &8C, x, y
-			auto x = readByte_t();		// Relative move of current active cursor by x, y pixels
-			if (x == -1) return;
-			auto y = readByte_t();
-			if (y == -1) return;
-			context->cursorRelativeMove((int8_t) x, (int8_t) y);
-		}	break;
-		case VDP_UDG: {					// VDU 23, 0, &90, c, <args>
-			auto c = readByte_t();		// Redefine a display character (system font only)
-			if (c >= 0) {
-				waitPlotCompletion();
-				vdu_sys_udg(c);
-			}
-		}	break;
-		case VDP_UDG_RESET: {			// VDU 23, 0, &91
-			waitPlotCompletion();
-			// TODO should this reset to system font?
-			copy_font();				// Reset UDGs (system font only)
-		}	break;
-		case VDP_MAP_CHAR_TO_BITMAP: {	// VDU 23, 0, &92, c, bitmapId;
-			auto c = readByte_t();		// Map a character to a bitmap
-			auto bitmapId = readWord_t();
-			if (c >= 0 && bitmapId >= 0) {
-				context->mapCharToBitmap(c, bitmapId);
-			}
-		}	break;
-		case VDP_SCRCHAR_GRAPHICS: {	// VDU 23, 0, &93, x; y;
-			auto x = readWord_t();		// Get character at graphics position x, y
-			if (x == -1) return;
-			auto y = readWord_t();
-			if (y == -1) return;
-			char c = context->getScreenCharAt(x, y);
-			sendScreenChar(c);
-		}	break;
-		case VDP_READ_COLOUR: {			// VDU 23, 0, &94, index
-			auto index = readByte_t();	// Read colour from palette
-			if (index >= 0) {
-				sendColour(index);
-			}
-		}	break;
-		case VDP_FONT: {				// VDU 23, 0, &95, command, [bufferId;] [<args>]
-			vdu_sys_font();				// Font management
-		}	break;
-		case VDP_AFFINE_TRANSFORM: {	// VDU 23, 0, &96, flags, bufferId;
-			if (!isTestFlagSet(TEST_FLAG_AFFINE_TRANSFORM)) {
-				return;
-			}
-			auto flags = readByte_t();	// Set affine transform flags
-			if (flags == -1) return;
-			auto bufferId = readWord_t();
-			if (bufferId >= 0) {
-				debug_log("vdu_sys_video: affine transform, flags %d, buffer %d\n\r", flags, bufferId);
-				context->setAffineTransform(flags, bufferId);
-			}
-		}	break;
-		case VDP_CONTROLKEYS: {			// VDU 23, 0, &98, n
-			auto b = readByte_t();		// Set control keys,  0 = off, 1 = on (default)
-			if (b >= 0) {
-				controlKeys = (bool) b;
-			}
-		}	break;
-		case VDP_BUFFER_PRINT: {		// VDU 23, 0, &9B
-			auto bufferId = readWord_t();
-			if (bufferId == -1) return;
-			printBuffer(bufferId);
-		}	break;
-		case VDP_TEXT_VIEWPORT: {		// VDU 23, 0, &9C
-			// Set text viewport using graphics coordinates
-			if (ttxtMode) {
-				// We could consider supporting this by dividing points by font size
-				debug_log("vdp_textViewport: Not supported in teletext mode\n\r");
-				return;
-			}
-			if (context->setTextViewport()) {
-				debug_log("vdp_textViewport: OK\n\r");
-			} else {
-				debug_log("vdp_textViewport: Invalid Viewport\n\r");
-			}
-			sendModeInformation();
-		}	break;
-		case VDP_GRAPHICS_VIEWPORT: {	// VDU 23, 0, &9D
-			// Set graphics viewport using latest graphics coordinates
-			if (context->setGraphicsViewport()) {
-				debug_log("vdp_graphicsViewport: OK\n\r");
-			} else {
-				debug_log("vdp_graphicsViewport: Invalid Viewport\n\r");
-			}
-		}	break;
-		case VDP_GRAPHICS_ORIGIN: {		// VDU 23, 0, &9E
-			// Set graphics origin using latest graphics coordintes
-			context->setOrigin();
-		}	break;
-		case VDP_SHIFT_ORIGIN: {		// VDU 23, 0, &9F
-			// Shift graphics origin and viewports using latest graphics coordintes
-			context->shiftOrigin();
-		}	break;
-		case VDP_BUFFERED: {			// VDU 23, 0, &A0, bufferId; command, <args>
-			vdu_sys_buffered();
-		}	break;
-		case VDP_UPDATER: {				// VDU 23, 0, &A1, command, <args>
-			vdu_sys_updater();
-		}	break;
-		case VDP_LOGICALCOORDS: {		// VDU 23, 0, &C0, n
-			auto b = readByte_t();		// Set logical coord mode
-			if (b >= 0) {
-				context->setLogicalCoords((bool) b);	// (0 = off, 1 = on)
-			}
-		}	break;
-		case VDP_LEGACYMODES: {			// VDU 23, 0, &C1, n
-			auto b = readByte_t();		// Switch legacy modes on or off
-			if (b >= 0) {
-				setLegacyModes((bool) b);
-			}
-		}	break;
-		case VDP_SWITCHBUFFER: {		// VDU 23, 0, &C3
-			switchBuffer();
-		}	break;
-		case VDP_CONTEXT: {				// VDU 23, 0, &C8, command, [<args>]
-			vdu_sys_context();			// Context management
-		}	break;
-		case VDP_FLUSH_DRAWING_QUEUE: {	// VDU 23, 0, &CA
-			waitPlotCompletion();
-		}	break;
-		case VDP_PATTERN_LENGTH: {		// VDU 23, 0, &F2, n
-			auto b = readByte_t();		// Set pattern length
-			if (b >= 0) {
-				context->setDottedLinePatternLength(b);
-			}
-		}	break;
-		case VDP_TESTFLAG_SET: {		// VDU 23, 0, &F8, flag; value;
-			auto flag = readWord_t();	// Set a test flag
-			auto value = readWord_t();
-			setTestFlag(flag, value);
-		}	break;
-		case VDP_TESTFLAG_CLEAR: {		// VDU 23, 0, &F9, flag
-			auto flag = readWord_t();	// Clear a test flag
-			clearTestFlag(flag);
-		}	break;
-		case VDP_CONSOLEMODE: {			// VDU 23, 0, &FE, n
-			auto b = readByte_t();
-			setConsoleMode((bool) b);
-		}	break;
-		case VDP_TERMINALMODE: {		// VDU 23, 0, &FF
-			startTerminal();		 	// Switch to, or resume, terminal mode
-		}	break;
+	auto &entry = sysCommands[index];
+	auto bytesRead = inputBytesRead;
+	auto start = micros();
+	(this->*entry.handler)();
+	uint32_t elapsed = micros() - start;
+
+	auto &stats = sysCommandStats[index];
+	stats.count++;
+	stats.totalTime += elapsed;
+	if (elapsed > stats.maxTime) {
+		stats.maxTime = elapsed;
+	}
+	stats.bytes += inputBytesRead - bytesRead;
+}
+
+// VDU 23, 0 command dispatch table, in command order
+//
+const VDUStreamProcessor::SysCommand VDUStreamProcessor::sysCommands[] = {
+	{ VDP_CURSOR_VSTART,		1,	&VDUStreamProcessor::vdu_sys_video_cursorVStart },		// VDU 23, 0, &0A, offset
+	{ VDP_CURSOR_VEND,			1,	&VDUStreamProcessor::vdu_sys_video_cursorVEnd },		// VDU 23, 0, &0B, offset
+	{ VDP_GP,					1,	&VDUStreamProcessor::sendGeneralPoll },					// VDU 23, 0, &80, echo
+	{ VDP_KEYCODE,				1,	&VDUStreamProcessor::vdu_sys_video_kblayout },			// VDU 23, 0, &81, layout
+	{ VDP_CURSOR,				0,	&VDUStreamProcessor::sendCursorPosition },				// VDU 23, 0, &82
+	{ VDP_SCRCHAR,				4,	&VDUStreamProcessor::vdu_sys_video_scrchar },			// VDU 23, 0, &83, x; y;
+	{ VDP_SCRPIXEL,				4,	&VDUStreamProcessor::vdu_sys_video_scrpixel },			// VDU 23, 0, &84, x; y;
+	{ VDP_AUDIO,				-1,	&VDUStreamProcessor::vdu_sys_audio },					// VDU 23, 0, &85, channel, command, <args>
+	{ VDP_MODE,					0,	&VDUStreamProcessor::sendModeInformation },				// VDU 23, 0, &86
+	{ VDP_RTC,					-1,	&VDUStreamProcessor::vdu_sys_video_time },				// VDU 23, 0, &87, mode, [<args>]
+	{ VDP_KEYSTATE,				5,	&VDUStreamProcessor::vdu_sys_keystate },				// VDU 23, 0, &88, repeatRate; repeatDelay; status
+	{ VDP_MOUSE,				-1,	&VDUStreamProcessor::vdu_sys_mouse },					// VDU 23, 0, &89, command, <args>
+	{ VDP_CURSOR_HSTART,		1,	&VDUStreamProcessor::vdu_sys_video_cursorHStart },		// VDU 23, 0, &8A, offset
+	{ VDP_CURSOR_HEND,			1,	&VDUStreamProcessor::vdu_sys_video_cursorHEnd },		// VDU 23, 0, &8B, offset
+	{ VDP_CURSOR_MOVE,			2,	&VDUStreamProcessor::vdu_sys_video_cursorMove },		// VDU 23, 0, &8C, x, y
+	{ VDP_UDG,					9,	&VDUStreamProcessor::vdu_sys_video_udg },				// VDU 23, 0, &90, c, n1, n2, n3, n4, n5, n6, n7, n8
+	{ VDP_UDG_RESET,			0,	&VDUStreamProcessor::vdu_sys_video_udgReset },			// VDU 23, 0, &91
+	{ VDP_MAP_CHAR_TO_BITMAP,	3,	&VDUStreamProcessor::vdu_sys_video_mapCharToBitmap },	// VDU 23, 0, &92, c, bitmapId;
+	{ VDP_SCRCHAR_GRAPHICS,		4,	&VDUStreamProcessor::vdu_sys_video_scrcharGraphics },	// VDU 23, 0, &93, x; y;
+	{ VDP_READ_COLOUR,			1,	&VDUStreamProcessor::vdu_sys_video_readColour },		// VDU 23, 0, &94, index
+	{ VDP_FONT,					-1,	&VDUStreamProcessor::vdu_sys_font },					// VDU 23, 0, &95, command, [bufferId;] [<args>]
+	{ VDP_AFFINE_TRANSFORM,		-1,	&VDUStreamProcessor::vdu_sys_video_affineTransform },	// VDU 23, 0, &96, flags, bufferId; (only when test flag set)
+	{ VDP_CONTROLKEYS,			1,	&VDUStreamProcessor::vdu_sys_video_controlKeys },		// VDU 23, 0, &98, n
+	{ VDP_BUFFER_PRINT,			2,	&VDUStreamProcessor::vdu_sys_video_bufferPrint },		// VDU 23, 0, &9B, bufferId;
+	{ VDP_TEXT_VIEWPORT,		0,	&VDUStreamProcessor::vdu_sys_video_textViewport },		// VDU 23, 0, &9C
+	{ VDP_GRAPHICS_VIEWPORT,	0,	&VDUStreamProcessor::vdu_sys_video_graphicsViewport },	// VDU 23, 0, &9D
+	{ VDP_GRAPHICS_ORIGIN,		0,	&VDUStreamProcessor::vdu_sys_video_graphicsOrigin },	// VDU 23, 0, &9E
+	{ VDP_SHIFT_ORIGIN,			0,	&VDUStreamProcessor::vdu_sys_video_shiftOrigin },		// VDU 23, 0, &9F
+	{ VDP_BUFFERED,				-1,	&VDUStreamProcessor::vdu_sys_buffered },				// VDU 23, 0, &A0, bufferId; command, <args>
+	{ VDP_UPDATER,				-1,	&VDUStreamProcessor::vdu_sys_updater },					// VDU 23, 0, &A1, command, <args>
+	{ VDP_TRACE,				-1,	&VDUStreamProcessor::vdu_sys_trace },					// VDU 23, 0, &A2, command, <args>
+	{ VDP_STATISTICS,			-1,	&VDUStreamProcessor::vdu_sys_statistics },				// VDU 23, 0, &A3, command, <args>
+	{ VDP_LOGICALCOORDS,		1,	&VDUStreamProcessor::vdu_sys_video_logicalCoords },		// VDU 23, 0, &C0, n
+	{ VDP_LEGACYMODES,			1,	&VDUStreamProcessor::vdu_sys_video_legacyModes },		// VDU 23, 0, &C1, n
+	{ VDP_SWITCHBUFFER,			0,	&VDUStreamProcessor::vdu_sys_video_switchBuffer },		// VDU 23, 0, &C3
+	{ VDP_CONTEXT,				-1,	&VDUStreamProcessor::vdu_sys_context },					// VDU 23, 0, &C8, command, [<args>]
+	{ VDP_FLUSH_DRAWING_QUEUE,	0,	&VDUStreamProcessor::vdu_sys_video_flushDrawingQueue },	// VDU 23, 0, &CA
+	{ VDP_PATTERN_LENGTH,		1,	&VDUStreamProcessor::vdu_sys_video_patternLength },		// VDU 23, 0, &F2, n
+	{ VDP_TESTFLAG_SET,			4,	&VDUStreamProcessor::vdu_sys_video_testFlagSet },		// VDU 23, 0, &F8, flag; value;
+	{ VDP_TESTFLAG_CLEAR,		2,	&VDUStreamProcessor::vdu_sys_video_testFlagClear },		// VDU 23, 0, &F9, flag;
+	{ VDP_CONSOLEMODE,			1,	&VDUStreamProcessor::vdu_sys_video_consoleMode },		// VDU 23, 0, &FE, n
+	{ VDP_TERMINALMODE,			0,	&VDUStreamProcessor::vdu_sys_video_terminalMode },		// VDU 23, 0, &FF
+};
+const size_t VDUStreamProcessor::sysCommandCount = sizeof(VDUStreamProcessor::sysCommands) / sizeof(VDUStreamProcessor::sysCommands[0]);
+VDUStreamProcessor::SysCommandStats VDUStreamProcessor::sysCommandStats[sizeof(VDUStreamProcessor::sysCommands) / sizeof(VDUStreamProcessor::sysCommands[0])] = {};
+uint8_t VDUStreamProcessor::sysCommandIndex[256];
+
+// Build the command byte to table index lookup for the VDU 23, 0 dispatch table
+// The table never changes, so this only does anything the first time it is called
+//
+void VDUStreamProcessor::initSysCommands() {
+	static bool initialised = false;
+	if (initialised) {
+		return;
+	}
+	initialised = true;
+	memset(sysCommandIndex, 255, sizeof(sysCommandIndex));
+	for (size_t i = 0; i < sysCommandCount; i++) {
+		sysCommandIndex[sysCommands[i].command] = i;
+	}
+}
+
+// VDU 23, 0, &0A, offset: Set the vertical start of the cursor
+//
+void VDUStreamProcessor::vdu_sys_video_cursorVStart() {
+	auto offset = readByte_t();
+	if (offset >= 0) {
+		context->setCursorVStart(offset & 0x1F);
+		context->setCursorAppearance((offset & 0x60) >> 5);
+	}
+}
+
+// VDU 23, 0, &0B, offset: Set the vertical end of the cursor
+//
+void VDUStreamProcessor::vdu_sys_video_cursorVEnd() {
+	auto offset = readByte_t();
+	if (offset >= 0) {
+		context->setCursorVEnd(offset);
+	}
+}
+
+// VDU 23, 0, &83, x; y;: Get character at screen position x, y
+//
+void VDUStreamProcessor::vdu_sys_video_scrchar() {
+	auto x = readWord_t(); if (x == -1) return;
+	auto y = readWord_t(); if (y == -1) return;
+	auto c = context->getScreenChar(x, y);
+	sendScreenChar(c);
+}
+
+// VDU 23, 0, &84, x; y;: Get pixel value at screen position x, y
+//
+void VDUStreamProcessor::vdu_sys_video_scrpixel() {
+	auto x = readWord_t(); if (x == -1) return;
+	auto y = readWord_t(); if (y == -1) return;
+	sendScreenPixel((short)x, (short)y);
+}
+
+// VDU 23, 0, &8A, offset: Set the horizontal start of the cursor
+//
+void VDUStreamProcessor::vdu_sys_video_cursorHStart() {
+	auto offset = readByte_t();
+	if (offset >= 0) {
+		context->setCursorHStart(offset);
+	}
+}
+
+// VDU 23, 0, &8B, offset: Set the horizontal end of the cursor
+//
+void VDUStreamProcessor::vdu_sys_video_cursorHEnd() {
+	auto offset = readByte_t();
+	if (offset >= 0) {
+		context->setCursorHEnd(offset);
+	}
+}
+
+// VDU 23, 0, &8C, x, y: Relative move of current active cursor by x, y pixels
+//
+void VDUStreamProcessor::vdu_sys_video_cursorMove() {
+	auto x = readByte_t(); if (x == -1) return;
+	auto y = readByte_t(); if (y == -1) return;
+	context->cursorRelativeMove((int8_t) x, (int8_t) y);
+}
+
+// VDU 23, 0, &90, c, <args>: Redefine a display character (system font only)
+//
+void VDUStreamProcessor::vdu_sys_video_udg() {
+	auto c = readByte_t();
+	if (c >= 0) {
+		waitPlotCompletion();
+		vdu_sys_udg(c);
+	}
+}
+
+// VDU 23, 0, &91: Reset UDGs (system font only)
+//
+void VDUStreamProcessor::vdu_sys_video_udgReset() {
+	waitPlotCompletion();
+	// TODO should this reset to system font?
+	copy_font();
+}
+
+// VDU 23, 0, &92, c, bitmapId;: Map a character to a bitmap
+//
+void VDUStreamProcessor::vdu_sys_video_mapCharToBitmap() {
+	auto c = readByte_t();
+	auto bitmapId = readWord_t();
+	if (c >= 0 && bitmapId >= 0) {
+		context->mapCharToBitmap(c, bitmapId);
 	}
 }
 
+// VDU 23, 0, &93, x; y;: Get character at graphics position x, y
+//
+void VDUStreamProcessor::vdu_sys_video_scrcharGraphics() {
+	auto x = readWord_t(); if (x == -1) return;
+	auto y = readWord_t(); if (y == -1) return;
+	char c = context->getScreenCharAt(x, y);
+	sendScreenChar(c);
+}
+
+// VDU 23, 0, &94, index: Read colour from palette
+//
+void VDUStreamProcessor::vdu_sys_video_readColour() {
+	auto index = readByte_t();
+	if (index >= 0) {
+		sendColour(index);
+	}
+}
+
+// VDU 23, 0, &96, flags, bufferId;: Set affine transform
+//
+void VDUStreamProcessor::vdu_sys_video_affineTransform() {
+	if (!isTestFlagSet(TEST_FLAG_AFFINE_TRANSFORM)) {
+		return;
+	}
+	auto flags = readByte_t(); if (flags == -1) return;
+	auto bufferId = readWord_t();
+	if (bufferId >= 0) {
+		debug_log("vdu_sys_video: affine transform, flags %d, buffer %d\n\r", flags, bufferId);
+		context->setAffineTransform(flags, bufferId);
+	}
+}
+
+// VDU 23, 0, &98, n: Set control keys, 0 = off, 1 = on (default)
+//
+void VDUStreamProcessor::vdu_sys_video_controlKeys() {
+	auto b = readByte_t();
+	if (b >= 0) {
+		controlKeys = (bool) b;
+	}
+}
+
+// VDU 23, 0, &9B, bufferId;: Print a buffer literally
+//
+void VDUStreamProcessor::vdu_sys_video_bufferPrint() {
+	auto bufferId = readWord_t(); if (bufferId == -1) return;
+	printBuffer(bufferId);
+}
+
+// VDU 23, 0, &9C: Set text viewport using graphics coordinates
+//
+void VDUStreamProcessor::vdu_sys_video_textViewport() {
+	if (ttxtMode) {
+		// We could consider supporting this by dividing points by font size
+		debug_log("vdp_textViewport: Not supported in teletext mode\n\r");
+		return;
+	}
+	if (context->setTextViewport()) {
+		debug_log("vdp_textViewport: OK\n\r");
+	} else {
+		debug_log("vdp_textViewport: Invalid Viewport\n\r");
+	}
+	sendModeInformation();
+}
+
+// VDU 23, 0, &9D: Set graphics viewport using latest graphics coordinates
+//
+void VDUStreamProcessor::vdu_sys_video_graphicsViewport() {
+	if (context->setGraphicsViewport()) {
+		debug_log("vdp_graphicsViewport: OK\n\r");
+	} else {
+		debug_log("vdp_graphicsViewport: Invalid Viewport\n\r");
+	}
+}
+
+// VDU 23, 0, &9E: Set graphics origin using latest graphics coordinates
+//
+void VDUStreamProcessor::vdu_sys_video_graphicsOrigin() {
+	context->setOrigin();
+}
+
+// VDU 23, 0, &9F: Shift graphics origin and viewports using latest graphics coordinates
+//
+void VDUStreamProcessor::vdu_sys_video_shiftOrigin() {
+	context->shiftOrigin();
+}
+
+// VDU 23, 0, &C0, n: Set logical coord mode (0 = off, 1 = on)
+//
+void VDUStreamProcessor::vdu_sys_video_logicalCoords() {
+	auto b = readByte_t();
+	if (b >= 0) {
+		context->setLogicalCoords((bool) b);
+	}
+}
+
+// VDU 23, 0, &C1, n: Switch legacy modes on or off
+//
+void VDUStreamProcessor::vdu_sys_video_legacyModes() {
+	auto b = readByte_t();
+	if (b >= 0) {
+		setLegacyModes((bool) b);
+	}
+}
+
+// VDU 23, 0, &C3: Swap the screen buffers
+//
+void VDUStreamProcessor::vdu_sys_video_switchBuffer() {
+	switchBuffer();
+}
+
+// VDU 23, 0, &CA: Flush the drawing queue
+//
+void VDUStreamProcessor::vdu_sys_video_flushDrawingQueue() {
+	waitPlotCompletion();
+}
+
+// VDU 23, 0, &F2, n: Set pattern length
+//
+void VDUStreamProcessor::vdu_sys_video_patternLength() {
+	auto b = readByte_t();
+	if (b >= 0) {
+		context->setDottedLinePatternLength(b);
+	}
+}
+
+// VDU 23, 0, &F8, flag; value;: Set a test flag
+//
+void VDUStreamProcessor::vdu_sys_video_testFlagSet() {
+	auto flag = readWord_t();
+	auto value = readWord_t();
+	setTestFlag(flag, value);
+}
+
+// VDU 23, 0, &F9, flag;: Clear a test flag
+//
+void VDUStreamProcessor::vdu_sys_video_testFlagClear() {
+	auto flag = readWord_t();
+	clearTestFlag(flag);
+}
+
+// VDU 23, 0, &FE, n: Switch console mode on and off
+//
+void VDUStreamProcessor::vdu_sys_video_consoleMode() {
+	auto b = readByte_t();
+	setConsoleMode((bool) b);
+}
+
+// VDU 23, 0, &FF: Switch to, or resume, terminal mode
+//
+void VDUStreamProcessor::vdu_sys_video_terminalMode() {
+	startTerminal();
+}
+
 // VDU 23, 0, &80, <echo>: Send a general poll/echo byte back to MOS
 //
 void VDUStreamProcessor::sendGeneralPoll() {
@@ -429,16 +549,15 @@ void VDUStreamProcessor::sendColour(uint8_t colour) {
 }
 
 void VDUStreamProcessor::printBuffer(uint16_t bufferId) {
-	auto bufferIter = buffers.find(bufferId);
-	if (bufferIter == buffers.end()) {
+	auto bufferBlocks = buffers.get(bufferId);
+	if (!bufferBlocks) {
 		debug_log("vdp_bufferPrint: buffer %d not found\n\r", bufferId);
 		return;
 	}
 
-	auto buffer = bufferIter->second;
-	for (const auto &block : bufferIter->second) {
-		// grab strings from the buffer
-		context->plotString(std::string((const char*)block->getBuffer(), block->size()));
+	for (const auto &block : *bufferBlocks) {
+		// plot strings directly from the buffer
+		context->plotString((const char *)block->getBuffer(), block->size());
 	}
 }
 
@@ -656,6 +775,15 @@ void VDUStreamProcessor::vdu_sys_mouse() {
 				return;
 			}
 		}	break;
+
+		case MOUSE_SET_PACKET_INTERVAL: {
+			auto interval = readByte_t();	if (interval == -1) return;
+			if (setMousePacketInterval(interval)) {
+				// success so send new data packet (triggering VDP flag)
+				sendMouseData();
+				debug_log("vdu_sys_mouse: set packet interval %d\n\r", interval);
+			}
+		}	break;
 	}
 }
 
@@ -696,4 +824,93 @@ void VDUStreamProcessor::vdu_sys_udg(char c) {
 	}
 }
 
+// VDU 23, 0, &A3, command, [<args>]: Performance statistics
+//
+void VDUStreamProcessor::vdu_sys_statistics() {
+	auto command = readByte_t(); if (command == -1) return;
+
+	switch (command) {
+		case STATS_SERIAL: {			// VDU 23, 0, &A3, 0
+			force_debug_log("Serial: ring size %u, high water %u, %llu bytes received\n\r",
+				VDPStream.getCapacity(), VDPStream.getHighWater(), VDPStream.getBytesReceived());
+			force_debug_log("Serial: ring full %u times, for %llu us in total\n\r",
+				VDPStream.getRingFullCount(), VDPStream.getRingFullTime());
+			force_debug_log("Serial: held off %u times, for %llu us in total\n\r",
+				VDPStream.getHeldOffCount(), VDPStream.getHeldOffTime());
+		}	break;
+		case STATS_SERIAL_RESET: {		// VDU 23, 0, &A3, 1
+			VDPStream.resetStats();
+		}	break;
+		case STATS_COMMAND: {			// VDU 23, 0, &A3, 2, command
+			auto sysCommand = readByte_t(); if (sysCommand == -1) return;
+			sendCommandStatistics(sysCommand);
+		}	break;
+		case STATS_COMMANDS_DUMP: {		// VDU 23, 0, &A3, 3
+			dumpCommandStatistics();
+		}	break;
+		case STATS_COMMANDS_RESET: {	// VDU 23, 0, &A3, 4
+			memset(sysCommandStats, 0, sizeof(SysCommandStats) * sysCommandCount);
+		}	break;
+		case STATS_MOUSE: {				// VDU 23, 0, &A3, 5
+			force_debug_log("Mouse: %u deltas received, %u packets sent, packet interval %u ms\n\r",
+				mDeltaCount, mPacketCount, mPacketInterval);
+		}	break;
+		case STATS_BLOCK_POOL: {		// VDU 23, 0, &A3, 6
+			blockPool.dumpStats();
+		}	break;
+		case STATS_BLOCK_POOL_RESET: {	// VDU 23, 0, &A3, 7
+			blockPool.resetStats();
+		}	break;
+		default: {
+			debug_log("vdu_sys_statistics: unknown command %d\n\r", command);
+		}	break;
+	}
+}
+
+// Send statistics for a VDU 23, 0 command back to MOS
+// Times are in microseconds, with totals truncated to 32 bits
+// Unknown commands report all zeros
+//
+void VDUStreamProcessor::sendCommandStatistics(uint8_t command) {
+	SysCommandStats stats = {};
+	auto index = sysCommandIndex[command];
+	if (index != 255) {
+		stats = sysCommandStats[index];
+	}
+	uint32_t totalTime = stats.totalTime;
+	uint32_t bytes = stats.bytes;
+	uint8_t packet[] = {
+		command,
+		(uint8_t) (stats.count & 0xFF),			// Invocation count
+		(uint8_t) ((stats.count >> 8) & 0xFF),
+		(uint8_t) ((stats.count >> 16) & 0xFF),
+		(uint8_t) ((stats.count >> 24) & 0xFF),
+		(uint8_t) (totalTime & 0xFF),			// Total execution time
+		(uint8_t) ((totalTime >> 8) & 0xFF),
+		(uint8_t) ((totalTime >> 16) & 0xFF),
+		(uint8_t) ((totalTime >> 24) & 0xFF),
+		(uint8_t) (stats.maxTime & 0xFF),		// Maximum execution time
+		(uint8_t) ((stats.maxTime >> 8) & 0xFF),
+		(uint8_t) ((stats.maxTime >> 16) & 0xFF),
+		(uint8_t) ((stats.maxTime >> 24) & 0xFF),
+		(uint8_t) (bytes & 0xFF),				// Argument bytes consumed
+		(uint8_t) ((bytes >> 8) & 0xFF),
+		(uint8_t) ((bytes >> 16) & 0xFF),
+		(uint8_t) ((bytes >> 24) & 0xFF),
+	};
+	send_packet(PACKET_STATISTICS, sizeof packet, packet);
+}
+
+// Dump statistics for all VDU 23, 0 commands that have been used to the debug serial port
+//
+void VDUStreamProcessor::dumpCommandStatistics() {
+	for (size_t i = 0; i < sysCommandCount; i++) {
+		auto &stats = sysCommandStats[i];
+		if (stats.count) {
+			force_debug_log("Command %02X: %8u calls, total %10llu us, avg %8llu us, max %8u us, %10llu bytes\n\r",
+				sysCommands[i].command, stats.count, stats.totalTime, stats.totalTime / stats.count, stats.maxTime, stats.bytes);
+		}
+	}
+}
+
 #endif // VDU_SYS_H
@@ -0,0 +1,200 @@
+#ifndef VDU_TRACE_H
+#define VDU_TRACE_H
+
+#include <memory>
+
+#include "agon.h"
+#include "buffers.h"
+#include "trace_stream.h"
+#include "types.h"
+#include "vdu_stream_processor.h"
+
+extern void force_debug_log(const char *format, ...);
+
+// VDU 23, 0, &A2, command, [<args>]: Serial trace capture and replay
+//
+void VDUStreamProcessor::vdu_sys_trace() {
+	auto command = readByte_t(); if (command == -1) return;
+
+	switch (command) {
+		case TRACE_START: {		// VDU 23, 0, &A2, 0, size; sizeHighByte
+			auto size = read24_t(); if (size == -1) return;
+			traceStart(size);
+		}	break;
+		case TRACE_STOP: {		// VDU 23, 0, &A2, 1
+			if (traceStream) {
+				traceStream->stop();
+				debug_log("vdu_sys_trace: stopped, %d bytes recorded\n\r", traceStream->count());
+			}
+		}	break;
+		case TRACE_SAVE: {		// VDU 23, 0, &A2, 2, bufferId;
+			auto bufferId = readWord_t(); if (bufferId == -1) return;
+			traceSave(bufferId);
+		}	break;
+		case TRACE_DUMP: {		// VDU 23, 0, &A2, 3
+			traceDump();
+		}	break;
+		case TRACE_REPLAY: {	// VDU 23, 0, &A2, 4, bufferId; flags
+			auto bufferId = readWord_t(); if (bufferId == -1) return;
+			auto flags = readByte_t(); if (flags == -1) return;
+			traceReplay(bufferId, flags);
+		}	break;
+		default: {
+			debug_log("vdu_sys_trace: unknown command %d\n\r", command);
+		}	break;
+	}
+}
+
+// Start recording a trace of the bytes received from MOS
+// size is the number of bytes to keep - older bytes are discarded once this fills
+// The trace stream is installed on first use, and stays in place afterwards
+//
+void VDUStreamProcessor::traceStart(uint32_t size) {
+	if (!traceStream) {
+		if (id != 65535) {
+			debug_log("traceStart: tracing can only be started from the serial stream\n\r");
+			return;
+		}
+		traceStream = make_shared_psram<TraceStream>(inputStream, inputSpans);
+		if (!traceStream) {
+			debug_log("traceStart: failed to create trace stream\n\r");
+			return;
+		}
+		inputStream = traceStream;
+		inputSpans = traceStream.get();
+	}
+	if (!traceStream->start(size)) {
+		debug_log("traceStart: failed to allocate trace of %d bytes\n\r", size);
+		return;
+	}
+	debug_log("traceStart: tracing up to %d bytes\n\r", size);
+}
+
+// Save the current trace into a buffer, replacing its contents
+// Each record is 5 bytes: a 32-bit timestamp in microseconds, followed by the byte value
+//
+void VDUStreamProcessor::traceSave(uint16_t bufferId) {
+	if (!traceStream || traceStream->count() == 0) {
+		debug_log("traceSave: no trace recorded\n\r");
+		return;
+	}
+	if (bufferId == 65535) {
+		debug_log("traceSave: bufferId %d is reserved\n\r", bufferId);
+		return;
+	}
+	auto count = traceStream->count();
+	auto bufferStream = make_shared_pooled<BufferStream>(count * sizeof(TraceRecord));
+	if (!bufferStream || !bufferStream->getBuffer()) {
+		debug_log("traceSave: failed to create buffer %d\n\r", bufferId);
+		return;
+	}
+	auto records = (TraceRecord *)bufferStream->getBuffer();
+	for (uint32_t i = 0; i < count; i++) {
+		records[i] = traceStream->getRecord(i);
+	}
+	bufferClear(bufferId);
+	auto buffer = buffers.create(bufferId);
+	if (!buffer) {
+		debug_log("traceSave: failed to create buffer %d\n\r", bufferId);
+		return;
+	}
+	buffer->push_back(std::move(bufferStream));
+	debug_log("traceSave: saved %d bytes of trace to buffer %d\n\r", count, bufferId);
+}
+
+// Dump the current trace to the debug serial port
+//
+void VDUStreamProcessor::traceDump() {
+	if (!traceStream) {
+		force_debug_log("traceDump: no trace recorded\n\r");
+		return;
+	}
+	auto count = traceStream->count();
+	force_debug_log("traceDump: %u bytes recorded, %u dropped\n\r", count, traceStream->dropped());
+	for (uint32_t i = 0; i < count; i++) {
+		auto &record = traceStream->getRecord(i);
+		force_debug_log("%10u %02X\n\r", record.time, record.value);
+	}
+}
+
+// Replay a trace saved in a buffer through the VDU command processor
+// reporting per-command timings on the debug serial port
+// Timings are grouped by the leading byte of each command
+//
+void VDUStreamProcessor::traceReplay(uint16_t bufferId, uint8_t flags) {
+	auto bufferBlocks = buffers.get(bufferId);
+	if (!bufferBlocks || bufferBlocks->empty()) {
+		debug_log("traceReplay: buffer %d not found\n\r", bufferId);
+		return;
+	}
+	auto trace = consolidateBuffers(*bufferBlocks);
+	if (!trace) {
+		debug_log("traceReplay: failed to consolidate buffer %d\n\r", bufferId);
+		return;
+	}
+	struct CommandTiming {
+		uint32_t count;
+		uint32_t maxTime;
+		uint64_t totalTime;
+	};
+	auto timings = make_unique_psram_array<CommandTiming>(256);
+	if (!timings) {
+		debug_log("traceReplay: failed to allocate timing data\n\r");
+		return;
+	}
+	memset(timings.get(), 0, sizeof(CommandTiming) * 256);
+
+	auto replay = make_shared_psram<ReplayStream>(trace, flags & TRACE_REPLAY_PACED);
+	std::shared_ptr<Stream> replayStream = replay;
+	// swap in the replay stream, and discard any output generated during the replay
+	// the output stream is kept, so that commands which check where output goes behave as normal
+	std::swap(inputStream, replayStream);
+	auto savedInputSpans = inputSpans;
+	inputSpans = nullptr;
+	auto savedOutputStream = outputStream;
+	auto savedOutputSuppressed = outputSuppressed;
+	outputSuppressed = true;
+
+	auto start = micros();
+	while (!replay->finished()) {
+		if (!byteAvailable()) {
+			// only happens when paced, so wait for the next byte to be due
+			if (replay->timeUntilDue() > 1000) {
+				vTaskDelay(1);
+			}
+			continue;
+		}
+		auto c = readByte();
+		auto commandStart = micros();
+		vdu(c);
+		uint32_t elapsed = micros() - commandStart;
+		auto &timing = timings[c];
+		timing.count++;
+		timing.totalTime += elapsed;
+		if (elapsed > timing.maxTime) {
+			timing.maxTime = elapsed;
+		}
+	}
+	// a command at the end of the trace may be waiting to see the next byte, which the replay will never supply
+	if (hasPendingLookahead()) {
+		resolveLookahead(-1);
+	}
+	uint32_t elapsed = micros() - start;
+
+	// restore our original streams
+	inputStream = std::move(replayStream);
+	inputSpans = savedInputSpans;
+	outputStream = savedOutputStream;
+	outputSuppressed = savedOutputSuppressed;
+
+	force_debug_log("traceReplay: replayed %u bytes from buffer %u in %u us\n\r", replay->size(), bufferId, elapsed);
+	for (auto i = 0; i < 256; i++) {
+		auto &timing = timings[i];
+		if (timing.count) {
+			force_debug_log("traceReplay: %02X %8u commands, total %10llu us, avg %8llu us, max %8u us\n\r",
+				i, timing.count, timing.totalTime, timing.totalTime / timing.count, timing.maxTime);
+		}
+	}
+}
+
+#endif // VDU_TRACE_H
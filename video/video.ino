@@ -87,7 +87,7 @@ void setup() {
 	changeMode(0);
 	copy_font();
 	setupVDPProtocol();
-	processor = new VDUStreamProcessor(&VDPSerial);
+	processor = new VDUStreamProcessor(&VDPStream, &VDPStream);
 	initAudio();
 	boot_screen();
 	processor->wait_eZ80();
@@ -129,9 +129,14 @@ void processLoop(void * parameter) {
 		if (processor->byteAvailable()) {
 			processor->hideCursor();
 			processor->processNext();
-			if (!processor->byteAvailable()) {
+			if (!processor->byteAvailable() && !processor->hasPendingLookahead()) {
 				processor->showCursor();
 			}
+		} else if (processor->checkPendingLookahead()) {
+			processor->showCursor();
+		} else {
+			// nothing to do, so sleep until serial data arrives or the next tick
+			processor->waitForInput();
 		}
 	}
 }
@@ -185,15 +190,19 @@ void do_keyboard_terminal() {
 
 // Handle the mouse
 //
+// Movement is coalesced, so at most one packet is sent per mouse packet interval
+// but button changes are sent straight away
+//
 void do_mouse() {
-	// get mouse delta, if the mouse is active
-	MouseDelta delta;
-	if (mouseMoved(&delta)) {
+	// gather all mouse deltas that have arrived, if the mouse is active
+	auto moved = gatherMouseDeltas([](MouseDelta &delta) {
+		processor->sendMouseData(&delta);
+	});
+	if (moved) {
 		auto mouse = getMouse();
 		auto mStatus = mouse->status();
 		// update mouse cursor position if it's active
 		setMouseCursorPos(mStatus.X, mStatus.Y);
-		processor->sendMouseData(&delta);
 	}
 }
 